@@ -0,0 +1,347 @@
+// Headless throughput benchmark for EscapeSequenceParser and TerminalModel.
+//
+//   1t-bench [--iterations N] [--size ROWSxCOLS] [--mb N] [--frame-bytes N] [--chunk N]
+//            [recording...]
+//
+// Replays a set of synthetic VT streams, plus any recorded streams given on
+// the command line (captured with `1t --record` or asciinema as .cast files,
+// or raw with `script -q`), through the parser in PTY-sized chunks and
+// reports MB/s, ns/byte and heap allocations per MB. --chunk sets the chunk
+// size, to measure the larger reads PtyWorker grows to under load.
+
+#include "escapeparser.h"
+#include "recording.h"
+#include "terminalmodel.h"
+#include "debug.h"
+
+#include <QByteArray>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <span>
+#include <string>
+#include <vector>
+
+bool g_debugMode = false;
+
+namespace {
+std::atomic<std::uint64_t> g_allocations{0};
+
+// PtyWorker's smallest read; it grows up to 256 KiB while output keeps coming.
+constexpr std::size_t kDefaultChunkSize = 4096;
+
+struct Stream {
+    std::string name;
+    QByteArray data;
+};
+
+// Small deterministic generator so every run replays identical bytes.
+class Lcg {
+   public:
+    std::uint32_t next() noexcept {
+        m_state = m_state * 1664525u + 1013904223u;
+        return m_state >> 8;
+    }
+    int range(int lo, int hi) noexcept { return lo + int(next() % std::uint32_t(hi - lo + 1)); }
+
+   private:
+    std::uint32_t m_state{0x1234567u};
+};
+
+void appendWords(QByteArray& out, Lcg& rng, int width) {
+    static const char* const kWords[] = {"the",     "quick", "terminal", "buffer", "render",  "glyph",
+                                         "scroll",  "cell",  "parser",   "escape", "pointer", "std::vector",
+                                         "-Wall",   "int",   "return",   "const",  "0x7f3a",  "build/obj"};
+    int col = 0;
+    while (col < width) {
+        const char* w = kWords[rng.next() % (sizeof(kWords) / sizeof(kWords[0]))];
+        const int len = int(std::strlen(w));
+        if (col + len + 1 > width)
+            break;
+        out.append(w, len);
+        out.append(' ');
+        col += len + 1;
+    }
+}
+
+QByteArray plainText(std::size_t bytes) {
+    Lcg rng;
+    QByteArray out;
+    out.reserve(qsizetype(bytes + 256));
+    while (std::size_t(out.size()) < bytes) {
+        appendWords(out, rng, rng.range(0, 120));
+        out.append("\r\n");
+    }
+    return out;
+}
+
+QByteArray compilerOutput(std::size_t bytes) {
+    Lcg rng;
+    QByteArray out;
+    out.reserve(qsizetype(bytes + 512));
+    while (std::size_t(out.size()) < bytes) {
+        out.append("\x1b[1m");
+        out.append(QByteArray("src/module") + QByteArray::number(rng.range(0, 99)) + ".cpp:" +
+                   QByteArray::number(rng.range(1, 4000)) + ":" + QByteArray::number(rng.range(1, 80)) + ": ");
+        out.append(rng.next() & 1 ? "\x1b[0m\x1b[1;31merror: \x1b[0m\x1b[1m" : "\x1b[0m\x1b[1;35mwarning: \x1b[0m\x1b[1m");
+        appendWords(out, rng, rng.range(20, 70));
+        out.append("\x1b[0m\r\n    ");
+        out.append("\x1b[38;5;");
+        out.append(QByteArray::number(rng.range(16, 255)));
+        out.append("m");
+        appendWords(out, rng, rng.range(10, 40));
+        out.append("\x1b[38:2::");
+        out.append(QByteArray::number(rng.range(0, 255)) + ":" + QByteArray::number(rng.range(0, 255)) + ":" +
+                   QByteArray::number(rng.range(0, 255)));
+        out.append("m");
+        appendWords(out, rng, rng.range(5, 30));
+        out.append("\x1b[0m\r\n      \x1b[1;32m^~~~~\x1b[0m\r\n");
+    }
+    return out;
+}
+
+QByteArray fullScreenRedraws(std::size_t bytes, int rows, int cols) {
+    Lcg rng;
+    QByteArray out;
+    out.reserve(qsizetype(bytes + std::size_t(rows * cols * 2)));
+    out.append("\x1b[?1049h");
+    while (std::size_t(out.size()) < bytes) {
+        if (rng.next() % 8 == 0)
+            out.append("\x1b[H\x1b[2J");
+        for (int r = 1; r <= rows; ++r) {
+            out.append("\x1b[" + QByteArray::number(r) + ";1H");
+            out.append("\x1b[" + QByteArray::number(rng.range(30, 37)) + ";" + QByteArray::number(rng.range(40, 47)) +
+                       "m");
+            appendWords(out, rng, rng.range(cols / 4, cols - 1));
+            out.append("\x1b[0m\x1b[K");
+        }
+        out.append("\x1b[" + QByteArray::number(rows) + ";1H\x1b[7m-- INSERT --\x1b[27m");
+    }
+    out.append("\x1b[?1049l");
+    return out;
+}
+
+QByteArray scrollRegionChurn(std::size_t bytes, int rows) {
+    Lcg rng;
+    QByteArray out;
+    out.reserve(qsizetype(bytes + 512));
+    const int bottom = std::max(rows - 2, 3);
+    while (std::size_t(out.size()) < bytes) {
+        out.append("\x1b[2;" + QByteArray::number(bottom) + "r");
+        out.append("\x1b[" + QByteArray::number(bottom) + ";1H");
+        for (int i = 0; i < 16; ++i) {
+            appendWords(out, rng, rng.range(10, 70));
+            out.append("\r\n");
+        }
+        out.append("\x1b[" + QByteArray::number(rng.range(2, bottom)) + ";1H");
+        out.append("\x1b[" + QByteArray::number(rng.range(1, 5)) + "L");
+        out.append("\x1b[" + QByteArray::number(rng.range(1, 5)) + "M");
+        out.append("\x1b[2S\x1b[1T\x1bM\x1b[r");
+    }
+    return out;
+}
+
+QByteArray unicodeText(std::size_t bytes) {
+    static const char* const kWords[] = {"naïve", "café", "Grüße", "日本語", "テキスト", "한국어",
+                                         "🙂",     "→",    "∑",     "ελληνικά", "русский", "ascii"};
+    Lcg rng;
+    QByteArray out;
+    out.reserve(qsizetype(bytes + 256));
+    while (std::size_t(out.size()) < bytes) {
+        const int words = rng.range(0, 12);
+        for (int i = 0; i < words; ++i) {
+            out.append(kWords[rng.next() % (sizeof(kWords) / sizeof(kWords[0]))]);
+            out.append(' ');
+        }
+        out.append("\r\n");
+    }
+    return out;
+}
+
+// The output of a recording, without its timing.
+QByteArray castOutput(Recording& rec) {
+    QByteArray out;
+    Recording::Event e;
+    while (rec.next(e)) {
+        if (e.type == 'o')
+            out.append(e.data);
+    }
+    return out;
+}
+
+struct Result {
+    double seconds{0};
+    std::uint64_t allocations{0};
+};
+
+Result runOnce(const QByteArray& data, int rows, int cols, std::size_t chunkSize, std::size_t frameBytes) {
+    TerminalModel model(rows, cols);
+    EscapeSequenceParser parser(&model);
+    ScreenSnapshot snap;
+
+    const std::uint64_t allocsBefore = g_allocations.load(std::memory_order_relaxed);
+    const auto start = std::chrono::steady_clock::now();
+
+    std::size_t sinceFrame = 0;
+    const std::span<const std::byte> bytes = std::as_bytes(std::span(data.constData(), std::size_t(data.size())));
+    for (std::size_t off = 0; off < bytes.size(); off += chunkSize) {
+        const std::size_t n = std::min(chunkSize, bytes.size() - off);
+        QMutexLocker lock(&model.mutex());
+        parser.feed(bytes.subspan(off, n));
+        sinceFrame += n;
+        if (frameBytes && sinceFrame >= frameBytes) {
+            model.snapshot(-1, snap);
+            sinceFrame = 0;
+        }
+    }
+
+    const auto end = std::chrono::steady_clock::now();
+    return {std::chrono::duration<double>(end - start).count(),
+            g_allocations.load(std::memory_order_relaxed) - allocsBefore};
+}
+
+void usage() {
+    std::fprintf(stderr,
+                 "usage: 1t-bench [--iterations N] [--size ROWSxCOLS] [--mb N] [--frame-bytes N] [--chunk N] "
+                 "[recording...]\n");
+}
+}  // namespace
+
+#ifdef __GLIBC__
+// Count at the malloc level: Qt's containers allocate with malloc directly,
+// and operator new ends up here too.
+extern "C" {
+void* __libc_malloc(std::size_t);
+void* __libc_calloc(std::size_t, std::size_t);
+void* __libc_realloc(void*, std::size_t);
+
+void* malloc(std::size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void* calloc(std::size_t n, std::size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(n, size);
+}
+
+void* realloc(void* p, std::size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(p, size);
+}
+}
+#else
+void* operator new(std::size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+#endif
+
+int main(int argc, char* argv[]) {
+    int iterations = 5;
+    int rows = 50;
+    int cols = 200;
+    std::size_t megabytes = 16;
+    std::size_t frameBytes = 0;
+    std::size_t chunkSize = kDefaultChunkSize;
+    std::vector<std::string> recordings;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (arg == "--iterations" && hasValue) {
+            iterations = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (arg == "--size" && hasValue) {
+            if (std::sscanf(argv[++i], "%dx%d", &rows, &cols) != 2 || rows < 1 || cols < 1) {
+                usage();
+                return 2;
+            }
+        }
+        else if (arg == "--mb" && hasValue) {
+            megabytes = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (arg == "--frame-bytes" && hasValue) {
+            frameBytes = std::size_t(std::max(0, std::atoi(argv[++i])));
+        }
+        else if (arg == "--chunk" && hasValue) {
+            chunkSize = std::size_t(std::max(1, std::atoi(argv[++i])));
+        }
+        else if (arg == "-h" || arg == "--help") {
+            usage();
+            return 0;
+        }
+        else if (arg.starts_with("-")) {
+            usage();
+            return 2;
+        }
+        else {
+            recordings.push_back(arg);
+        }
+    }
+
+    const std::size_t bytes = megabytes * 1000 * 1000;
+    std::vector<Stream> streams = {
+        {"plain-text", plainText(bytes)},
+        {"sgr-compiler", compilerOutput(bytes)},
+        {"full-screen", fullScreenRedraws(bytes, rows, cols)},
+        {"scroll-region", scrollRegionChurn(bytes, rows)},
+        {"utf8-text", unicodeText(bytes)},
+    };
+    for (const std::string& path : recordings) {
+        const QString name = QString::fromStdString(path);
+        if (name.endsWith(QStringLiteral(".cast"))) {
+            std::unique_ptr<Recording> rec = Recording::open(name);
+            if (!rec)
+                return 1;
+            streams.push_back({QFileInfo(name).fileName().toStdString(), castOutput(*rec)});
+            continue;
+        }
+        QFile f(name);
+        if (!f.open(QIODevice::ReadOnly)) {
+            std::fprintf(stderr, "1t-bench: cannot open %s\n", path.c_str());
+            return 1;
+        }
+        streams.push_back({QFileInfo(f).fileName().toStdString(), f.readAll()});
+    }
+
+    std::printf("%dx%d grid, %zu-byte chunks, %d iterations, best run reported\n\n", rows, cols, chunkSize,
+                iterations);
+    std::printf("%-20s %10s %10s %10s %12s\n", "stream", "MB", "MB/s", "ns/byte", "allocs/MB");
+    for (const Stream& s : streams) {
+        if (s.data.isEmpty())
+            continue;
+
+        Result best;
+        best.seconds = -1;
+        for (int it = 0; it < iterations; ++it) {
+            const Result r = runOnce(s.data, rows, cols, chunkSize, frameBytes);
+            if (best.seconds < 0 || r.seconds < best.seconds)
+                best = r;
+        }
+
+        const double mb = double(s.data.size()) / 1e6;
+        std::printf("%-20s %10.2f %10.1f %10.3f %12.1f\n", s.name.c_str(), mb, mb / best.seconds,
+                    best.seconds * 1e9 / double(s.data.size()), double(best.allocations) / mb);
+    }
+    return 0;
+}
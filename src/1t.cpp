@@ -1,138 +1,275 @@
 #include "1t.h"
+#include "childreaper.h"
+#include "metrics.h"
+#include "metricsserver.h"
+#include "ptyscheduler.h"
+#include "scrollback.h"
 #include "terminalwidget.h"
-#include "escapeparser.h"
 #include "debug.h"
 
 #include <QApplication>
+#include <QCommandLineParser>
 #include <QIcon>
-#include <QSocketNotifier>
-#include <QVBoxLayout>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QKeySequence>
 #include <QResizeEvent>
+#include <QShortcut>
+#include <QSplitter>
+#include <QTabBar>
+#include <QTabWidget>
 
-#include <cerrno>
-#include <cstring>
-#include <fcntl.h>
-#include <memory>
-#include <pty.h>
-#include <sys/ioctl.h>
-#include <sys/wait.h>
-#include <unistd.h>
+#include <algorithm>
+#include <string_view>
 
 bool g_debugMode = false;
 
-OneTerm::OneTerm(QWidget* parent)
+namespace {
+// Whether main() should start a shell before Qt is up: not when the command
+// line asks for help or a replay. If it has a bad option instead, the parser
+// exits and the shell goes with its PTY.
+bool startsShell(int argc, char* argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg(argv[i]);
+        if (arg == "--")
+            break;
+        if (arg == "-h" || arg == "-?" || arg.starts_with("--help") || arg == "--replay" ||
+            arg.starts_with("--replay="))
+            return false;
+    }
+    return true;
+}
+}  // namespace
+
+OneTerm::OneTerm(const SessionConfig& config, QWidget* parent)
     : QWidget(parent),
-      m_terminalWidget(new TerminalWidget(this)),
-      m_parser(new EscapeSequenceParser(m_terminalWidget, this)) {
+      m_config(config),
+      m_layout(new QVBoxLayout(this)),
+      m_tabs(new QTabWidget(this)),
+      m_scheduler(new PtyScheduler),
+      m_reaper(new ChildReaper(this)) {
     setWindowTitle(QStringLiteral("1t"));
 
-    auto* layout = new QVBoxLayout(this);
-    layout->setContentsMargins(0, 0, 0, 10);
-    layout->addWidget(m_terminalWidget);
-}
+    m_layout->setContentsMargins(0, 0, 0, 10);
+    m_layout->addWidget(m_tabs);
 
-OneTerm::~OneTerm() {
-    if (m_notifier) {
-        m_notifier->setEnabled(false);
-    }
+    m_tabs->setDocumentMode(true);
+    m_tabs->setTabsClosable(true);
+    m_tabs->setTabBarAutoHide(true);
+    m_tabs->tabBar()->setFocusPolicy(Qt::NoFocus);
+    connect(m_tabs, &QTabWidget::tabCloseRequested, this, [this](int index) {
+        QWidget* page = m_tabs->widget(index);
+        for (Session* s : page->findChildren<Session*>())
+            closeSession(s);
+    });
+    connect(m_tabs, &QTabWidget::currentChanged, this, [this] {
+        if (Session* s = currentSession()) {
+            s->setFocus();
+            updateTitle(s, s->title());
+        }
+    });
 
-    if (m_masterFD >= 0) {
-#ifdef ENABLE_DEBUG
-        DBG() << "Closing master FD:" << m_masterFD;
-#endif
-        ::close(m_masterFD);
-    }
+    auto shortcut = [this](QKeyCombination keys, auto fn) {
+        connect(new QShortcut(QKeySequence(keys), this), &QShortcut::activated, this, fn);
+    };
+    shortcut(Qt::CTRL | Qt::SHIFT | Qt::Key_T, [this] { newTab(); });
+    shortcut(Qt::CTRL | Qt::SHIFT | Qt::Key_E, [this] { splitCurrent(Qt::Horizontal); });
+    shortcut(Qt::CTRL | Qt::SHIFT | Qt::Key_O, [this] { splitCurrent(Qt::Vertical); });
+    shortcut(Qt::CTRL | Qt::SHIFT | Qt::Key_W, [this] {
+        if (Session* s = currentSession())
+            closeSession(s);
+    });
+    shortcut(Qt::CTRL | Qt::SHIFT | Qt::Key_F, [this] {
+        if (Session* s = currentSession())
+            s->showFindBar();
+    });
+    shortcut(Qt::CTRL | Qt::SHIFT | Qt::Key_Up, [this] {
+        if (Session* s = currentSession())
+            s->terminal()->scrollToPrompt(true);
+    });
+    shortcut(Qt::CTRL | Qt::SHIFT | Qt::Key_Down, [this] {
+        if (Session* s = currentSession())
+            s->terminal()->scrollToPrompt(false);
+    });
+    shortcut(Qt::CTRL | Qt::SHIFT | Qt::Key_M, [this] {
+        if (Session* s = currentSession())
+            s->terminal()->setMetricsOverlay(!s->terminal()->metricsOverlay());
+    });
+    shortcut(Qt::CTRL | Qt::SHIFT | Qt::Key_PageDown,
+             [this] { m_tabs->setCurrentIndex((m_tabs->currentIndex() + 1) % std::max(1, m_tabs->count())); });
+    shortcut(Qt::CTRL | Qt::SHIFT | Qt::Key_PageUp, [this] {
+        m_tabs->setCurrentIndex((m_tabs->currentIndex() + m_tabs->count() - 1) % std::max(1, m_tabs->count()));
+    });
 
-    if (m_shellPid > 0) {
-#ifdef ENABLE_DEBUG
-        DBG() << "Waiting on shell PID:" << m_shellPid;
-#endif
-        ::waitpid(m_shellPid, nullptr, WNOHANG);
-    }
+    m_ioThread.setObjectName(QStringLiteral("1t-pty-io"));
+    m_scheduler->moveToThread(&m_ioThread);
+    connect(&m_ioThread, &QThread::finished, m_scheduler, &QObject::deleteLater);
+    m_ioThread.start();
 }
 
-void OneTerm::launchShell(const char* shellPath) {
-    int masterFD, slaveFD;
-    if (openpty(&masterFD, &slaveFD, nullptr, nullptr, nullptr) < 0) {
-        qWarning() << "openpty failed:" << strerror(errno);
-        return;
-    }
-#ifdef ENABLE_DEBUG
-    DBG() << "openpty master FD:" << masterFD << "slave FD:" << slaveFD;
-#endif
+OneTerm::~OneTerm() {
+    // Sessions stop their workers on the I/O thread, so they go first,
+    // including closed ones still waiting for deferred deletion.
+    delete m_tabs;
+    QCoreApplication::sendPostedEvents(nullptr, QEvent::DeferredDelete);
+    m_ioThread.quit();
+    m_ioThread.wait();
+}
 
-    fcntl(masterFD, F_SETFL, fcntl(masterFD, F_GETFL) | O_NONBLOCK);
+Session* OneTerm::createSession() {
+    auto* session = new Session(m_config, &m_ioThread, m_scheduler, m_reaper);
+    connect(session, &Session::finished, this, &OneTerm::closeSession);
+    connect(session, &Session::titleChanged, this, &OneTerm::updateTitle);
+    return session;
+}
 
-    pid_t pid = fork();
-    if (pid < 0) {
-        qWarning() << "fork failed:" << strerror(errno);
-        ::close(masterFD);
-        ::close(slaveFD);
-        return;
-    }
-    if (pid == 0) {
-        ::close(masterFD);
-        setsid();
-        if (ioctl(slaveFD, TIOCSCTTY, 0) < 0) {
-            qWarning() << "Failed to set controlling terminal:" << strerror(errno);
-            _exit(127);
-        }
-        dup2(slaveFD, STDIN_FILENO);
-        dup2(slaveFD, STDOUT_FILENO);
-        dup2(slaveFD, STDERR_FILENO);
-        ::close(slaveFD);
+Session* OneTerm::addTab() {
+    Session* session = createSession();
+    auto* splitter = new QSplitter(Qt::Horizontal);
+    splitter->setChildrenCollapsible(false);
+    splitter->addWidget(session);
+    m_tabs->addTab(splitter, QString());
+    return session;
+}
 
-        ::setenv("TERM", "xterm-256color", 0);
+Session* OneTerm::newTab(std::optional<ShellProcess> shell) {
+    Session* session = addTab();
+    if (shell)
+        session->attachShell(*shell, m_config.shell);
+    else
+        session->launchShell(m_config.shell);
+    updateTitle(session, session->title());
+    m_tabs->setCurrentIndex(m_tabs->count() - 1);
+    session->setFocus();
+    return session;
+}
 
-        if (execl(shellPath, shellPath, "-i", static_cast<char*>(nullptr)) == -1) {
-            qWarning() << "execl failed:" << strerror(errno);
-            _exit(127);
-        }
+Session* OneTerm::replayTab(const QString& path, double speed, double startSeconds) {
+    Session* session = addTab();
+    if (!session->replay(path, speed, startSeconds)) {
+        closeSession(session);
+        return nullptr;
     }
+    updateTitle(session, session->title());
+    m_tabs->setCurrentIndex(m_tabs->count() - 1);
+    session->setFocus();
+    return session;
+}
 
-    ::close(slaveFD);
-    m_shellPid = pid;
-    m_masterFD = masterFD;
+Session* OneTerm::splitCurrent(Qt::Orientation orientation) {
+    Session* current = currentSession();
+    if (!current)
+        return newTab();
 
-#ifdef ENABLE_DEBUG
-    DBG() << "Launched shell PID:" << m_shellPid << "masterFD:" << m_masterFD;
-#endif
+    auto* parent = qobject_cast<QSplitter*>(current->parentWidget());
+    Session* session = createSession();
+    if (parent->count() == 1 || parent->orientation() == orientation) {
+        parent->setOrientation(orientation);
+        parent->insertWidget(parent->indexOf(current) + 1, session);
+    }
+    else {
+        auto* inner = new QSplitter(orientation);
+        inner->setChildrenCollapsible(false);
+        parent->insertWidget(parent->indexOf(current), inner);
+        inner->addWidget(current);
+        inner->addWidget(session);
+        current->show();
+    }
 
-    m_notifier = std::make_unique<QSocketNotifier>(m_masterFD, QSocketNotifier::Read, this);
-    connect(m_notifier.get(), &QSocketNotifier::activated, this, [this] { readFromPty(); });
+    // Share the space evenly rather than halving only the split pane.
+    auto* splitter = qobject_cast<QSplitter*>(session->parentWidget());
+    const int extent = orientation == Qt::Horizontal ? splitter->width() : splitter->height();
+    splitter->setSizes(QList<int>(splitter->count(), extent / std::max(1, splitter->count())));
 
-    m_terminalWidget->setPtyInfo(m_masterFD, m_shellPid);
+    session->launchShell(m_config.shell);
+    session->setFocus();
+    return session;
 }
 
-void OneTerm::readFromPty() {
-    if (m_masterFD < 0)
+void OneTerm::closeSession(Session* session) {
+    // Already closed, e.g. the shell exited while its tab was being closed.
+    if (!session->parentWidget())
         return;
-
-    char buf[4096];
-    for (;;) {
-        ssize_t n = ::read(m_masterFD, buf, sizeof(buf));
-        if (n > 0) {
-#ifdef ENABLE_DEBUG
-            DBG() << "readFromPty got" << n << "bytes";
-#endif
-            m_parser->feed(QByteArray(buf, n));
-        }
-        else if (n == 0) {
 #ifdef ENABLE_DEBUG
-            DBG() << "PTY EOF, waiting on shell...";
+    DBG() << "Closing session" << session->title();
 #endif
-            ::waitpid(m_shellPid, nullptr, 0);
-            m_notifier->setEnabled(false);
+    auto* splitter = qobject_cast<QSplitter*>(session->parentWidget());
+    session->hide();
+    session->setParent(nullptr);
+    session->deleteLater();
+
+    // Collapse splitters left empty or holding a single pane.
+    while (splitter) {
+        auto* outer = qobject_cast<QSplitter*>(splitter->parentWidget());
+        if (splitter->count() > 1)
             break;
-        }
-        else if (errno != EAGAIN && errno != EINTR) {
-            qWarning() << "read() failed:" << strerror(errno);
-            m_notifier->setEnabled(false);
+        if (!outer) {
+            if (splitter->count() == 0) {
+                m_tabs->removeTab(m_tabs->indexOf(splitter));
+                splitter->deleteLater();
+            }
             break;
         }
-        else {
-            break;
+        const int index = outer->indexOf(splitter);
+        if (splitter->count() == 1) {
+            QWidget* remaining = splitter->widget(0);
+            outer->insertWidget(index, remaining);
+            remaining->show();
         }
+        splitter->hide();
+        splitter->setParent(nullptr);
+        splitter->deleteLater();
+        splitter = outer;
+    }
+
+    if (m_tabs->count() == 0) {
+        close();
+        return;
+    }
+    if (Session* s = currentSession())
+        s->setFocus();
+}
+
+Session* OneTerm::currentSession() const {
+    QWidget* page = m_tabs->currentWidget();
+    if (!page)
+        return nullptr;
+
+    for (QWidget* w = QApplication::focusWidget(); w; w = w->parentWidget()) {
+        if (auto* s = qobject_cast<Session*>(w); s && page->isAncestorOf(s))
+            return s;
+    }
+    return page->findChild<Session*>();
+}
+
+QByteArray OneTerm::metricsReport() const {
+    QJsonArray sessions;
+    for (const Session* s : m_tabs->findChildren<Session*>()) {
+        QJsonObject entry = s->metrics().toJson();
+        entry.insert(QStringLiteral("title"), s->title());
+        sessions.append(entry);
+    }
+    const QJsonObject report{{QStringLiteral("sessions"), sessions},
+                             {QStringLiteral("startup"), StartupTiming::instance().toJson()}};
+    return QJsonDocument(report).toJson(QJsonDocument::Compact) + '\n';
+}
+
+bool OneTerm::serveMetrics(const QString& socketPath) {
+    if (!m_metricsServer)
+        m_metricsServer = new MetricsServer([this] { return metricsReport(); }, this);
+    return m_metricsServer->listen(socketPath);
+}
+
+void OneTerm::updateTitle(Session* session, const QString& title) {
+    for (QWidget* w = session->parentWidget(); w; w = w->parentWidget()) {
+        const int index = m_tabs->indexOf(w);
+        if (index < 0)
+            continue;
+        m_tabs->setTabText(index, title);
+        if (index == m_tabs->currentIndex())
+            setWindowTitle(title.isEmpty() ? QStringLiteral("1t") : title + QStringLiteral(" - 1t"));
+        break;
     }
 }
 
@@ -144,7 +281,15 @@ void OneTerm::resizeEvent(QResizeEvent* e) {
 }
 
 int main(int argc, char* argv[]) {
+    // The shell forks before Qt loads its platform plugin and fonts, so its
+    // startup overlaps ours; the first tab takes it over.
+    StartupTiming& startup = StartupTiming::instance();
+    std::optional<ShellProcess> firstShell;
+    if (startsShell(argc, argv))
+        firstShell = Session::spawnShell(SessionConfig().shell, Session::kDefaultRows, Session::kDefaultCols);
+
     QApplication app(argc, argv);
+    startup.mark(StartupTiming::Milestone::AppCreated);
     app.setApplicationName("1t");
     app.setOrganizationName("MyOrg");
 
@@ -158,14 +303,87 @@ int main(int argc, char* argv[]) {
     g_debugMode = false;
 #endif
 
-    OneTerm term;
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    const QCommandLineOption scrollbackLinesOpt(QStringLiteral("scrollback-lines"),
+                                                QStringLiteral("Maximum number of history lines."),
+                                                QStringLiteral("lines"),
+                                                QString::number(Scrollback::kDefaultMaxLines));
+    const QCommandLineOption scrollbackMemoryOpt(QStringLiteral("scrollback-memory"),
+                                                 QStringLiteral("Memory budget for history, in MiB."),
+                                                 QStringLiteral("mib"),
+                                                 QString::number(Scrollback::kDefaultMemoryBudget >> 20));
+    const QCommandLineOption noCompressOpt(QStringLiteral("no-scrollback-compression"),
+                                           QStringLiteral("Keep all history pages uncompressed."));
+    const QCommandLineOption spillOpt(QStringLiteral("scrollback-spill"),
+                                      QStringLiteral("Write cold history pages to a temp file in <dir>."),
+                                      QStringLiteral("dir"));
+    const QCommandLineOption gpuOpt(QStringLiteral("gpu"),
+                                    QStringLiteral("Draw with OpenGL, falling back to QPainter if unavailable."));
+    parser.addOption(scrollbackLinesOpt);
+    parser.addOption(scrollbackMemoryOpt);
+    parser.addOption(noCompressOpt);
+    parser.addOption(spillOpt);
+    const QCommandLineOption batchedEchoOpt(QStringLiteral("batched-echo"),
+                                            QStringLiteral("Paint echoed input with the next frame, not at once."));
+    const QCommandLineOption metricsSocketOpt(QStringLiteral("metrics-socket"),
+                                              QStringLiteral("Serve parse and paint metrics as JSON on a Unix socket."),
+                                              QStringLiteral("path"));
+    const QCommandLineOption recordOpt(QStringLiteral("record"),
+                                       QStringLiteral("Record each session as an asciicast file in <dir>."),
+                                       QStringLiteral("dir"));
+    const QCommandLineOption replayOpt(QStringLiteral("replay"),
+                                       QStringLiteral("Play an asciicast recording instead of running a shell."),
+                                       QStringLiteral("file"));
+    const QCommandLineOption replaySpeedOpt(QStringLiteral("replay-speed"),
+                                            QStringLiteral("Replay speed factor; 0 plays as fast as possible."),
+                                            QStringLiteral("factor"), QStringLiteral("1"));
+    const QCommandLineOption replayFromOpt(QStringLiteral("replay-from"),
+                                           QStringLiteral("Start the replay this far in."), QStringLiteral("seconds"),
+                                           QStringLiteral("0"));
+    parser.addOption(gpuOpt);
+    parser.addOption(batchedEchoOpt);
+    parser.addOption(metricsSocketOpt);
+    parser.addOption(recordOpt);
+    parser.addOption(replayOpt);
+    parser.addOption(replaySpeedOpt);
+    const QCommandLineOption startupTimingOpt(
+        QStringLiteral("startup-timing"), QStringLiteral("Print startup milestones once the first prompt is shown."));
+    parser.addOption(replayFromOpt);
+    parser.addOption(startupTimingOpt);
+    parser.process(app);
+    startup.setReport(parser.isSet(startupTimingOpt));
+
+    SessionConfig config;
+    if (parser.isSet(scrollbackLinesOpt))
+        config.scrollbackLines = parser.value(scrollbackLinesOpt).toULongLong();
+    config.scrollbackMemory = std::size_t(parser.value(scrollbackMemoryOpt).toULongLong()) << 20;
+    config.compressScrollback = !parser.isSet(noCompressOpt);
+    if (parser.isSet(spillOpt))
+        config.spillDir = parser.value(spillOpt);
+    config.gpuRendering = parser.isSet(gpuOpt);
+    config.lowLatencyEcho = !parser.isSet(batchedEchoOpt);
+    if (parser.isSet(recordOpt))
+        config.recordDir = parser.value(recordOpt);
+
+    OneTerm term(config);
     term.resize(1200, 300);
     term.show();
+    startup.mark(StartupTiming::Milestone::WindowShown);
+    if (parser.isSet(metricsSocketOpt))
+        term.serveMetrics(parser.value(metricsSocketOpt));
+
+    if (parser.isSet(replayOpt)) {
+        if (!term.replayTab(parser.value(replayOpt), parser.value(replaySpeedOpt).toDouble(),
+                            parser.value(replayFromOpt).toDouble()))
+            return 1;
+        return app.exec();
+    }
 
 #ifdef ENABLE_DEBUG
-    DBG() << "Launching shell path:" << "/bin/bash";
+    DBG() << "Launching shell path:" << config.shell;
 #endif
-    term.launchShell("/bin/bash");
+    term.newTab(firstShell);
 
     return app.exec();
 }
@@ -2,37 +2,54 @@
 #define ONETERM_H
 
 #include <QWidget>
-#include <QSocketNotifier>
+#include <QThread>
 #include <QVBoxLayout>
-#include <QScrollArea>
-#include <memory>
-#include <sys/types.h>
 
-#include "escapeparser.h"
-#include "terminalwidget.h"
+#include "session.h"
 
+class ChildReaper;
+class MetricsServer;
+class PtyScheduler;
+class QSplitter;
+class QTabWidget;
+
+// Top-level window: tabs of split panes, one Session per pane. All sessions
+// share one PTY I/O thread and its scheduler, and terminals with the same font
+// share one glyph cache.
 class OneTerm : public QWidget {
     Q_OBJECT
 
    public:
-    explicit OneTerm(QWidget* parent = nullptr);
+    explicit OneTerm(const SessionConfig& config, QWidget* parent = nullptr);
     ~OneTerm() override;
 
-    void launchShell(const char* shellPath);
+    // Runs shell in the new tab if given, else starts one.
+    Session* newTab(std::optional<ShellProcess> shell = std::nullopt);
+    // A tab playing a recording; null if it cannot be opened.
+    Session* replayTab(const QString& path, double speed, double startSeconds);
+    Session* splitCurrent(Qt::Orientation orientation);
+    void closeSession(Session* session);
 
-   private slots:
-    void readFromPty();
+    // Every session's metrics as one JSON document.
+    QByteArray metricsReport() const;
+    bool serveMetrics(const QString& socketPath);
 
    private:
     void resizeEvent(QResizeEvent* event) override;
 
+    Session* createSession();
+    Session* addTab();
+    Session* currentSession() const;
+    void updateTitle(Session* session, const QString& title);
+
+    SessionConfig m_config;
     QVBoxLayout* m_layout;
-    TerminalWidget* m_terminalWidget;
-    EscapeSequenceParser* m_parser;
+    QTabWidget* m_tabs;
 
-    std::unique_ptr<QSocketNotifier> m_notifier;
-    int m_masterFD;
-    pid_t m_shellPid;
+    QThread m_ioThread;
+    PtyScheduler* m_scheduler;
+    ChildReaper* m_reaper;
+    MetricsServer* m_metricsServer{nullptr};
 };
 
 #endif
@@ -0,0 +1,61 @@
+#ifndef ASCIISCAN_H
+#define ASCIISCAN_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// Length of the leading run of printable ASCII (0x20-0x7E) in p[0, n). This
+// is what plain-text output consists of almost entirely, so the parser hands
+// such runs to the model in one call instead of classifying byte by byte.
+inline std::size_t printableAsciiRun(const unsigned char* p, std::size_t n) noexcept {
+    std::size_t i = 0;
+
+#if defined(__SSE2__)
+    const __m128i space = _mm_set1_epi8(0x20);
+    const __m128i del = _mm_set1_epi8(0x7F);
+    for (; i + 16 <= n; i += 16) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        // Signed compare: bytes >= 0x80 are negative and land below 0x20 too.
+        const __m128i bad = _mm_or_si128(_mm_cmplt_epi8(v, space), _mm_cmpeq_epi8(v, del));
+        const int mask = _mm_movemask_epi8(bad);
+        if (mask)
+            return i + std::size_t(__builtin_ctz(unsigned(mask)));
+    }
+#elif defined(__ARM_NEON)
+    const uint8x16_t space = vdupq_n_u8(0x20);
+    const uint8x16_t del = vdupq_n_u8(0x7F);
+    for (; i + 16 <= n; i += 16) {
+        const uint8x16_t v = vld1q_u8(p + i);
+        const uint8x16_t bad = vorrq_u8(vcltq_u8(v, space), vcgeq_u8(v, del));
+        // Narrow each byte of the mask to a nibble to get a 64-bit bitmap.
+        const uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(bad), 4)), 0);
+        if (mask)
+            return i + std::size_t(__builtin_ctzll(mask) >> 2);
+    }
+#else
+    for (; i + 8 <= n; i += 8) {
+        std::uint64_t w;
+        std::memcpy(&w, p + i, sizeof(w));
+        constexpr std::uint64_t kOnes = 0x0101010101010101ull;
+        constexpr std::uint64_t kHigh = 0x8080808080808080ull;
+        // A byte is bad if it has the high bit set, is below 0x20, or is 0x7F.
+        const std::uint64_t below = (w - kOnes * 0x20) & ~w;
+        const std::uint64_t isDel = ((w ^ (kOnes * 0x7F)) - kOnes) & ~(w ^ (kOnes * 0x7F));
+        if ((w | below | isDel) & kHigh)
+            break;
+    }
+#endif
+
+    while (i < n && p[i] >= 0x20 && p[i] < 0x7F)
+        ++i;
+    return i;
+}
+
+#endif
@@ -0,0 +1,50 @@
+#include "attrtable.h"
+#include "debug.h"
+
+#include <QDebug>
+
+AttrTable::AttrTable() {
+    intern(CellAttr{});
+}
+
+AttrTable::Id AttrTable::intern(const CellAttr& attr) {
+    auto it = m_index.constFind(attr);
+    if (it != m_index.constEnd())
+        return it.value();
+
+    ++m_misses;
+    Id id = kDefault;
+    if (const std::optional<Id> free = m_pool.take()) {
+        id = *free;
+    }
+    else if (m_size < kCapacity) {
+        const std::size_t chunk = m_size >> kChunkBits;
+        if (!m_chunks[chunk])
+            m_chunks[chunk] = std::make_unique<Chunk>();
+        id = Id(m_size++);
+    }
+    else {
+        if (!m_warned) {
+            qWarning() << "AttrTable full:" << kCapacity << "attributes in use, falling back to the default";
+            m_warned = true;
+        }
+        return kDefault;
+    }
+
+    (*m_chunks[id >> kChunkBits])[id & (kChunkSize - 1)] = attr;
+    m_index.insert(attr, id);
+    return id;
+}
+
+void AttrTable::reclaim(const std::vector<bool>& live) {
+    for (std::size_t i = 1; i < m_size; ++i) {
+        const Id id = Id(i);
+        if (live[i] || m_pool.vacant(id))
+            continue;
+        m_index.remove((*this)[id]);
+        m_pool.retire(id);
+    }
+#ifdef ENABLE_DEBUG
+    DBG() << "AttrTable reclaimed, now" << used() << "of" << m_size << "attributes in use";
+#endif
+}
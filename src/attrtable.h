@@ -0,0 +1,108 @@
+#ifndef ATTRTABLE_H
+#define ATTRTABLE_H
+
+#include <QHash>
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "idpool.h"
+
+enum class TextStyle : std::uint8_t { None = 0, Bold = 1 << 0, Underline = 1 << 1, Inverse = 1 << 2 };
+
+// A cell color is a 32-bit word: either a palette index (0-255) or, with
+// kTrueColorFlag set, a 24-bit RGB value. Both fit the same attribute entry.
+namespace CellColor {
+constexpr std::uint32_t kTrueColorFlag = 1u << 24;
+constexpr std::uint32_t kDefaultFg = 7;
+constexpr std::uint32_t kDefaultBg = 0;
+
+constexpr std::uint32_t indexed(int idx) noexcept {
+    return std::uint32_t(idx) & 0xFFu;
+}
+constexpr std::uint32_t rgb(int r, int g, int b) noexcept {
+    return kTrueColorFlag | ((std::uint32_t(r) & 0xFFu) << 16) | ((std::uint32_t(g) & 0xFFu) << 8) |
+           (std::uint32_t(b) & 0xFFu);
+}
+constexpr bool isTrueColor(std::uint32_t c) noexcept {
+    return (c & kTrueColorFlag) != 0;
+}
+constexpr int index(std::uint32_t c) noexcept {
+    return int(c & 0xFFu);
+}
+constexpr int red(std::uint32_t c) noexcept {
+    return int((c >> 16) & 0xFFu);
+}
+constexpr int green(std::uint32_t c) noexcept {
+    return int((c >> 8) & 0xFFu);
+}
+constexpr int blue(std::uint32_t c) noexcept {
+    return int(c & 0xFFu);
+}
+}  // namespace CellColor
+
+// OSC 133 semantic zones: what the shell says a cell belongs to.
+enum class Zone : std::uint8_t { None, Prompt, Input, Output };
+
+// The rendition set by SGR, plus the OSC 8 hyperlink (a LinkTable id, 0 for
+// none) and zone the text was written in, which SGR 0 leaves alone.
+struct CellAttr {
+    std::uint32_t fg{CellColor::kDefaultFg};
+    std::uint32_t bg{CellColor::kDefaultBg};
+    std::uint8_t style{0};
+    Zone zone{Zone::None};
+    std::uint16_t link{0};
+
+    bool operator==(const CellAttr&) const = default;
+};
+
+inline size_t qHash(const CellAttr& a, size_t seed = 0) noexcept {
+    return qHashMulti(seed, a.fg, a.bg, a.style, std::uint8_t(a.zone), a.link);
+}
+
+// Deduplicated table of cell attributes. Cells only store the 16-bit id.
+// Entries are stored in fixed chunks that never move, so the GUI thread may
+// resolve any id it received in a snapshot without locking while the parser
+// thread interns new ones. Ids no cell uses any more are reclaimed by the
+// model and reused after its next snapshot; see IdPool.
+class AttrTable {
+   public:
+    using Id = std::uint16_t;
+    static constexpr Id kDefault = 0;
+    static constexpr std::size_t kCapacity = 1u << 16;
+
+    AttrTable();
+
+    // The writer side calls these, with the model mutex held. intern()
+    // returns kDefault once the table is full.
+    Id intern(const CellAttr& attr);
+    // Retires every id but kDefault that live, indexed by id, does not mark.
+    void reclaim(const std::vector<bool>& live);
+    void release() { m_pool.release(); }
+
+    const CellAttr& operator[](Id id) const noexcept {
+        return (*m_chunks[id >> kChunkBits])[id & (kChunkSize - 1)];
+    }
+    // Slots handed out so far, and how many of them are in use.
+    std::size_t size() const noexcept { return m_size; }
+    std::size_t used() const noexcept { return m_size - m_pool.size(); }
+    bool full() const noexcept { return m_size >= kCapacity && !m_pool.available(); }
+    // Attributes added or turned away since the table was made.
+    std::size_t misses() const noexcept { return m_misses; }
+
+   private:
+    static constexpr int kChunkBits = 10;
+    static constexpr std::size_t kChunkSize = std::size_t(1) << kChunkBits;
+    using Chunk = std::array<CellAttr, kChunkSize>;
+
+    std::array<std::unique_ptr<Chunk>, kCapacity / kChunkSize> m_chunks;
+    std::size_t m_size{0};
+    std::size_t m_misses{0};
+    bool m_warned{false};
+    QHash<CellAttr, Id> m_index;
+    IdPool<Id> m_pool{kCapacity};
+};
+
+#endif
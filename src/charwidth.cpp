@@ -0,0 +1,173 @@
+#include "charwidth.h"
+
+#include <array>
+#include <cstdint>
+
+namespace {
+enum Kind : std::uint8_t { kZero = 0, kNarrow = 1, kWide = 2, kSkip = 3 };
+
+struct Range {
+    char32_t first;
+    char32_t last;
+    Kind kind;
+};
+
+// Everything below kTableEnd that is not narrow, from UnicodeData.txt and
+// EastAsianWidth.txt: Mn, Me and Cf (but U+00AD) plus Hangul medial vowels
+// and final consonants are zero width; W and F, and unassigned codepoints in
+// the CJK blocks, are wide; Cc, Cs, Zl and Zp are not printed.
+constexpr Range kRanges[] = {
+    {0x0, 0x1F, kSkip}, {0x7F, 0x9F, kSkip}, {0x300, 0x36F, kZero}, {0x483, 0x489, kZero}, {0x591, 0x5BD, kZero},
+    {0x5BF, 0x5BF, kZero}, {0x5C1, 0x5C2, kZero}, {0x5C4, 0x5C5, kZero}, {0x5C7, 0x5C7, kZero}, {0x600, 0x605, kZero},
+    {0x610, 0x61A, kZero}, {0x61C, 0x61C, kZero}, {0x64B, 0x65F, kZero}, {0x670, 0x670, kZero}, {0x6D6, 0x6DD, kZero},
+    {0x6DF, 0x6E4, kZero}, {0x6E7, 0x6E8, kZero}, {0x6EA, 0x6ED, kZero}, {0x70F, 0x70F, kZero}, {0x711, 0x711, kZero},
+    {0x730, 0x74A, kZero}, {0x7A6, 0x7B0, kZero}, {0x7EB, 0x7F3, kZero}, {0x7FD, 0x7FD, kZero}, {0x816, 0x819, kZero},
+    {0x81B, 0x823, kZero}, {0x825, 0x827, kZero}, {0x829, 0x82D, kZero}, {0x859, 0x85B, kZero}, {0x890, 0x891, kZero},
+    {0x898, 0x89F, kZero}, {0x8CA, 0x902, kZero}, {0x93A, 0x93A, kZero}, {0x93C, 0x93C, kZero}, {0x941, 0x948, kZero},
+    {0x94D, 0x94D, kZero}, {0x951, 0x957, kZero}, {0x962, 0x963, kZero}, {0x981, 0x981, kZero}, {0x9BC, 0x9BC, kZero},
+    {0x9C1, 0x9C4, kZero}, {0x9CD, 0x9CD, kZero}, {0x9E2, 0x9E3, kZero}, {0x9FE, 0x9FE, kZero}, {0xA01, 0xA02, kZero},
+    {0xA3C, 0xA3C, kZero}, {0xA41, 0xA42, kZero}, {0xA47, 0xA48, kZero}, {0xA4B, 0xA4D, kZero}, {0xA51, 0xA51, kZero},
+    {0xA70, 0xA71, kZero}, {0xA75, 0xA75, kZero}, {0xA81, 0xA82, kZero}, {0xABC, 0xABC, kZero}, {0xAC1, 0xAC5, kZero},
+    {0xAC7, 0xAC8, kZero}, {0xACD, 0xACD, kZero}, {0xAE2, 0xAE3, kZero}, {0xAFA, 0xAFF, kZero}, {0xB01, 0xB01, kZero},
+    {0xB3C, 0xB3C, kZero}, {0xB3F, 0xB3F, kZero}, {0xB41, 0xB44, kZero}, {0xB4D, 0xB4D, kZero}, {0xB55, 0xB56, kZero},
+    {0xB62, 0xB63, kZero}, {0xB82, 0xB82, kZero}, {0xBC0, 0xBC0, kZero}, {0xBCD, 0xBCD, kZero}, {0xC00, 0xC00, kZero},
+    {0xC04, 0xC04, kZero}, {0xC3C, 0xC3C, kZero}, {0xC3E, 0xC40, kZero}, {0xC46, 0xC48, kZero}, {0xC4A, 0xC4D, kZero},
+    {0xC55, 0xC56, kZero}, {0xC62, 0xC63, kZero}, {0xC81, 0xC81, kZero}, {0xCBC, 0xCBC, kZero}, {0xCBF, 0xCBF, kZero},
+    {0xCC6, 0xCC6, kZero}, {0xCCC, 0xCCD, kZero}, {0xCE2, 0xCE3, kZero}, {0xD00, 0xD01, kZero}, {0xD3B, 0xD3C, kZero},
+    {0xD41, 0xD44, kZero}, {0xD4D, 0xD4D, kZero}, {0xD62, 0xD63, kZero}, {0xD81, 0xD81, kZero}, {0xDCA, 0xDCA, kZero},
+    {0xDD2, 0xDD4, kZero}, {0xDD6, 0xDD6, kZero}, {0xE31, 0xE31, kZero}, {0xE34, 0xE3A, kZero}, {0xE47, 0xE4E, kZero},
+    {0xEB1, 0xEB1, kZero}, {0xEB4, 0xEBC, kZero}, {0xEC8, 0xECD, kZero}, {0xF18, 0xF19, kZero}, {0xF35, 0xF35, kZero},
+    {0xF37, 0xF37, kZero}, {0xF39, 0xF39, kZero}, {0xF71, 0xF7E, kZero}, {0xF80, 0xF84, kZero}, {0xF86, 0xF87, kZero},
+    {0xF8D, 0xF97, kZero}, {0xF99, 0xFBC, kZero}, {0xFC6, 0xFC6, kZero}, {0x102D, 0x1030, kZero},
+    {0x1032, 0x1037, kZero}, {0x1039, 0x103A, kZero}, {0x103D, 0x103E, kZero}, {0x1058, 0x1059, kZero},
+    {0x105E, 0x1060, kZero}, {0x1071, 0x1074, kZero}, {0x1082, 0x1082, kZero}, {0x1085, 0x1086, kZero},
+    {0x108D, 0x108D, kZero}, {0x109D, 0x109D, kZero}, {0x1100, 0x115F, kWide}, {0x1160, 0x11FF, kZero},
+    {0x135D, 0x135F, kZero}, {0x1712, 0x1714, kZero}, {0x1732, 0x1733, kZero}, {0x1752, 0x1753, kZero},
+    {0x1772, 0x1773, kZero}, {0x17B4, 0x17B5, kZero}, {0x17B7, 0x17BD, kZero}, {0x17C6, 0x17C6, kZero},
+    {0x17C9, 0x17D3, kZero}, {0x17DD, 0x17DD, kZero}, {0x180B, 0x180F, kZero}, {0x1885, 0x1886, kZero},
+    {0x18A9, 0x18A9, kZero}, {0x1920, 0x1922, kZero}, {0x1927, 0x1928, kZero}, {0x1932, 0x1932, kZero},
+    {0x1939, 0x193B, kZero}, {0x1A17, 0x1A18, kZero}, {0x1A1B, 0x1A1B, kZero}, {0x1A56, 0x1A56, kZero},
+    {0x1A58, 0x1A5E, kZero}, {0x1A60, 0x1A60, kZero}, {0x1A62, 0x1A62, kZero}, {0x1A65, 0x1A6C, kZero},
+    {0x1A73, 0x1A7C, kZero}, {0x1A7F, 0x1A7F, kZero}, {0x1AB0, 0x1ACE, kZero}, {0x1B00, 0x1B03, kZero},
+    {0x1B34, 0x1B34, kZero}, {0x1B36, 0x1B3A, kZero}, {0x1B3C, 0x1B3C, kZero}, {0x1B42, 0x1B42, kZero},
+    {0x1B6B, 0x1B73, kZero}, {0x1B80, 0x1B81, kZero}, {0x1BA2, 0x1BA5, kZero}, {0x1BA8, 0x1BA9, kZero},
+    {0x1BAB, 0x1BAD, kZero}, {0x1BE6, 0x1BE6, kZero}, {0x1BE8, 0x1BE9, kZero}, {0x1BED, 0x1BED, kZero},
+    {0x1BEF, 0x1BF1, kZero}, {0x1C2C, 0x1C33, kZero}, {0x1C36, 0x1C37, kZero}, {0x1CD0, 0x1CD2, kZero},
+    {0x1CD4, 0x1CE0, kZero}, {0x1CE2, 0x1CE8, kZero}, {0x1CED, 0x1CED, kZero}, {0x1CF4, 0x1CF4, kZero},
+    {0x1CF8, 0x1CF9, kZero}, {0x1DC0, 0x1DFF, kZero}, {0x200B, 0x200F, kZero}, {0x2028, 0x2029, kSkip},
+    {0x202A, 0x202E, kZero}, {0x2060, 0x2064, kZero}, {0x2066, 0x206F, kZero}, {0x20D0, 0x20F0, kZero},
+    {0x231A, 0x231B, kWide}, {0x2329, 0x232A, kWide}, {0x23E9, 0x23EC, kWide}, {0x23F0, 0x23F0, kWide},
+    {0x23F3, 0x23F3, kWide}, {0x25FD, 0x25FE, kWide}, {0x2614, 0x2615, kWide}, {0x2648, 0x2653, kWide},
+    {0x267F, 0x267F, kWide}, {0x2693, 0x2693, kWide}, {0x26A1, 0x26A1, kWide}, {0x26AA, 0x26AB, kWide},
+    {0x26BD, 0x26BE, kWide}, {0x26C4, 0x26C5, kWide}, {0x26CE, 0x26CE, kWide}, {0x26D4, 0x26D4, kWide},
+    {0x26EA, 0x26EA, kWide}, {0x26F2, 0x26F3, kWide}, {0x26F5, 0x26F5, kWide}, {0x26FA, 0x26FA, kWide},
+    {0x26FD, 0x26FD, kWide}, {0x2705, 0x2705, kWide}, {0x270A, 0x270B, kWide}, {0x2728, 0x2728, kWide},
+    {0x274C, 0x274C, kWide}, {0x274E, 0x274E, kWide}, {0x2753, 0x2755, kWide}, {0x2757, 0x2757, kWide},
+    {0x2795, 0x2797, kWide}, {0x27B0, 0x27B0, kWide}, {0x27BF, 0x27BF, kWide}, {0x2B1B, 0x2B1C, kWide},
+    {0x2B50, 0x2B50, kWide}, {0x2B55, 0x2B55, kWide}, {0x2CEF, 0x2CF1, kZero}, {0x2D7F, 0x2D7F, kZero},
+    {0x2DE0, 0x2DFF, kZero}, {0x2E80, 0x2E99, kWide}, {0x2E9B, 0x2EF3, kWide}, {0x2F00, 0x2FD5, kWide},
+    {0x2FF0, 0x2FFB, kWide}, {0x3000, 0x3029, kWide}, {0x302A, 0x302D, kZero}, {0x302E, 0x303E, kWide},
+    {0x3041, 0x3096, kWide}, {0x3099, 0x309A, kZero}, {0x309B, 0x30FF, kWide}, {0x3105, 0x312F, kWide},
+    {0x3131, 0x318E, kWide}, {0x3190, 0x31E3, kWide}, {0x31F0, 0x321E, kWide}, {0x3220, 0x3247, kWide},
+    {0x3250, 0x4DBF, kWide}, {0x4E00, 0xA48C, kWide}, {0xA490, 0xA4C6, kWide}, {0xA66F, 0xA672, kZero},
+    {0xA674, 0xA67D, kZero}, {0xA69E, 0xA69F, kZero}, {0xA6F0, 0xA6F1, kZero}, {0xA802, 0xA802, kZero},
+    {0xA806, 0xA806, kZero}, {0xA80B, 0xA80B, kZero}, {0xA825, 0xA826, kZero}, {0xA82C, 0xA82C, kZero},
+    {0xA8C4, 0xA8C5, kZero}, {0xA8E0, 0xA8F1, kZero}, {0xA8FF, 0xA8FF, kZero}, {0xA926, 0xA92D, kZero},
+    {0xA947, 0xA951, kZero}, {0xA960, 0xA97C, kWide}, {0xA980, 0xA982, kZero}, {0xA9B3, 0xA9B3, kZero},
+    {0xA9B6, 0xA9B9, kZero}, {0xA9BC, 0xA9BD, kZero}, {0xA9E5, 0xA9E5, kZero}, {0xAA29, 0xAA2E, kZero},
+    {0xAA31, 0xAA32, kZero}, {0xAA35, 0xAA36, kZero}, {0xAA43, 0xAA43, kZero}, {0xAA4C, 0xAA4C, kZero},
+    {0xAA7C, 0xAA7C, kZero}, {0xAAB0, 0xAAB0, kZero}, {0xAAB2, 0xAAB4, kZero}, {0xAAB7, 0xAAB8, kZero},
+    {0xAABE, 0xAABF, kZero}, {0xAAC1, 0xAAC1, kZero}, {0xAAEC, 0xAAED, kZero}, {0xAAF6, 0xAAF6, kZero},
+    {0xABE5, 0xABE5, kZero}, {0xABE8, 0xABE8, kZero}, {0xABED, 0xABED, kZero}, {0xAC00, 0xD7A3, kWide},
+    {0xD800, 0xDFFF, kSkip}, {0xF900, 0xFAFF, kWide}, {0xFB1E, 0xFB1E, kZero}, {0xFE00, 0xFE0F, kZero},
+    {0xFE10, 0xFE19, kWide}, {0xFE20, 0xFE2F, kZero}, {0xFE30, 0xFE52, kWide}, {0xFE54, 0xFE66, kWide},
+    {0xFE68, 0xFE6B, kWide}, {0xFEFF, 0xFEFF, kZero}, {0xFF01, 0xFF60, kWide}, {0xFFE0, 0xFFE6, kWide},
+    {0xFFF9, 0xFFFB, kZero}, {0x101FD, 0x101FD, kZero}, {0x102E0, 0x102E0, kZero}, {0x10376, 0x1037A, kZero},
+    {0x10A01, 0x10A03, kZero}, {0x10A05, 0x10A06, kZero}, {0x10A0C, 0x10A0F, kZero}, {0x10A38, 0x10A3A, kZero},
+    {0x10A3F, 0x10A3F, kZero}, {0x10AE5, 0x10AE6, kZero}, {0x10D24, 0x10D27, kZero}, {0x10EAB, 0x10EAC, kZero},
+    {0x10F46, 0x10F50, kZero}, {0x10F82, 0x10F85, kZero}, {0x11001, 0x11001, kZero}, {0x11038, 0x11046, kZero},
+    {0x11070, 0x11070, kZero}, {0x11073, 0x11074, kZero}, {0x1107F, 0x11081, kZero}, {0x110B3, 0x110B6, kZero},
+    {0x110B9, 0x110BA, kZero}, {0x110BD, 0x110BD, kZero}, {0x110C2, 0x110C2, kZero}, {0x110CD, 0x110CD, kZero},
+    {0x11100, 0x11102, kZero}, {0x11127, 0x1112B, kZero}, {0x1112D, 0x11134, kZero}, {0x11173, 0x11173, kZero},
+    {0x11180, 0x11181, kZero}, {0x111B6, 0x111BE, kZero}, {0x111C9, 0x111CC, kZero}, {0x111CF, 0x111CF, kZero},
+    {0x1122F, 0x11231, kZero}, {0x11234, 0x11234, kZero}, {0x11236, 0x11237, kZero}, {0x1123E, 0x1123E, kZero},
+    {0x112DF, 0x112DF, kZero}, {0x112E3, 0x112EA, kZero}, {0x11300, 0x11301, kZero}, {0x1133B, 0x1133C, kZero},
+    {0x11340, 0x11340, kZero}, {0x11366, 0x1136C, kZero}, {0x11370, 0x11374, kZero}, {0x11438, 0x1143F, kZero},
+    {0x11442, 0x11444, kZero}, {0x11446, 0x11446, kZero}, {0x1145E, 0x1145E, kZero}, {0x114B3, 0x114B8, kZero},
+    {0x114BA, 0x114BA, kZero}, {0x114BF, 0x114C0, kZero}, {0x114C2, 0x114C3, kZero}, {0x115B2, 0x115B5, kZero},
+    {0x115BC, 0x115BD, kZero}, {0x115BF, 0x115C0, kZero}, {0x115DC, 0x115DD, kZero}, {0x11633, 0x1163A, kZero},
+    {0x1163D, 0x1163D, kZero}, {0x1163F, 0x11640, kZero}, {0x116AB, 0x116AB, kZero}, {0x116AD, 0x116AD, kZero},
+    {0x116B0, 0x116B5, kZero}, {0x116B7, 0x116B7, kZero}, {0x1171D, 0x1171F, kZero}, {0x11722, 0x11725, kZero},
+    {0x11727, 0x1172B, kZero}, {0x1182F, 0x11837, kZero}, {0x11839, 0x1183A, kZero}, {0x1193B, 0x1193C, kZero},
+    {0x1193E, 0x1193E, kZero}, {0x11943, 0x11943, kZero}, {0x119D4, 0x119D7, kZero}, {0x119DA, 0x119DB, kZero},
+    {0x119E0, 0x119E0, kZero}, {0x11A01, 0x11A0A, kZero}, {0x11A33, 0x11A38, kZero}, {0x11A3B, 0x11A3E, kZero},
+    {0x11A47, 0x11A47, kZero}, {0x11A51, 0x11A56, kZero}, {0x11A59, 0x11A5B, kZero}, {0x11A8A, 0x11A96, kZero},
+    {0x11A98, 0x11A99, kZero}, {0x11C30, 0x11C36, kZero}, {0x11C38, 0x11C3D, kZero}, {0x11C3F, 0x11C3F, kZero},
+    {0x11C92, 0x11CA7, kZero}, {0x11CAA, 0x11CB0, kZero}, {0x11CB2, 0x11CB3, kZero}, {0x11CB5, 0x11CB6, kZero},
+    {0x11D31, 0x11D36, kZero}, {0x11D3A, 0x11D3A, kZero}, {0x11D3C, 0x11D3D, kZero}, {0x11D3F, 0x11D45, kZero},
+    {0x11D47, 0x11D47, kZero}, {0x11D90, 0x11D91, kZero}, {0x11D95, 0x11D95, kZero}, {0x11D97, 0x11D97, kZero},
+    {0x11EF3, 0x11EF4, kZero}, {0x13430, 0x13438, kZero}, {0x16AF0, 0x16AF4, kZero}, {0x16B30, 0x16B36, kZero},
+    {0x16F4F, 0x16F4F, kZero}, {0x16F8F, 0x16F92, kZero}, {0x16FE0, 0x16FE3, kWide}, {0x16FE4, 0x16FE4, kZero},
+    {0x16FF0, 0x16FF1, kWide}, {0x17000, 0x187F7, kWide}, {0x18800, 0x18CD5, kWide}, {0x18D00, 0x18D08, kWide},
+    {0x1AFF0, 0x1AFF3, kWide}, {0x1AFF5, 0x1AFFB, kWide}, {0x1AFFD, 0x1AFFE, kWide}, {0x1B000, 0x1B122, kWide},
+    {0x1B150, 0x1B152, kWide}, {0x1B164, 0x1B167, kWide}, {0x1B170, 0x1B2FB, kWide}, {0x1BC9D, 0x1BC9E, kZero},
+    {0x1BCA0, 0x1BCA3, kZero}, {0x1CF00, 0x1CF2D, kZero}, {0x1CF30, 0x1CF46, kZero}, {0x1D167, 0x1D169, kZero},
+    {0x1D173, 0x1D182, kZero}, {0x1D185, 0x1D18B, kZero}, {0x1D1AA, 0x1D1AD, kZero}, {0x1D242, 0x1D244, kZero},
+    {0x1DA00, 0x1DA36, kZero}, {0x1DA3B, 0x1DA6C, kZero}, {0x1DA75, 0x1DA75, kZero}, {0x1DA84, 0x1DA84, kZero},
+    {0x1DA9B, 0x1DA9F, kZero}, {0x1DAA1, 0x1DAAF, kZero}, {0x1E000, 0x1E006, kZero}, {0x1E008, 0x1E018, kZero},
+    {0x1E01B, 0x1E021, kZero}, {0x1E023, 0x1E024, kZero}, {0x1E026, 0x1E02A, kZero}, {0x1E130, 0x1E136, kZero},
+    {0x1E2AE, 0x1E2AE, kZero}, {0x1E2EC, 0x1E2EF, kZero}, {0x1E8D0, 0x1E8D6, kZero}, {0x1E944, 0x1E94A, kZero},
+    {0x1F004, 0x1F004, kWide}, {0x1F0CF, 0x1F0CF, kWide}, {0x1F18E, 0x1F18E, kWide}, {0x1F191, 0x1F19A, kWide},
+    {0x1F200, 0x1F202, kWide}, {0x1F210, 0x1F23B, kWide}, {0x1F240, 0x1F248, kWide}, {0x1F250, 0x1F251, kWide},
+    {0x1F260, 0x1F265, kWide}, {0x1F300, 0x1F320, kWide}, {0x1F32D, 0x1F335, kWide}, {0x1F337, 0x1F37C, kWide},
+    {0x1F37E, 0x1F393, kWide}, {0x1F3A0, 0x1F3CA, kWide}, {0x1F3CF, 0x1F3D3, kWide}, {0x1F3E0, 0x1F3F0, kWide},
+    {0x1F3F4, 0x1F3F4, kWide}, {0x1F3F8, 0x1F43E, kWide}, {0x1F440, 0x1F440, kWide}, {0x1F442, 0x1F4FC, kWide},
+    {0x1F4FF, 0x1F53D, kWide}, {0x1F54B, 0x1F54E, kWide}, {0x1F550, 0x1F567, kWide}, {0x1F57A, 0x1F57A, kWide},
+    {0x1F595, 0x1F596, kWide}, {0x1F5A4, 0x1F5A4, kWide}, {0x1F5FB, 0x1F64F, kWide}, {0x1F680, 0x1F6C5, kWide},
+    {0x1F6CC, 0x1F6CC, kWide}, {0x1F6D0, 0x1F6D2, kWide}, {0x1F6D5, 0x1F6D7, kWide}, {0x1F6DD, 0x1F6DF, kWide},
+    {0x1F6EB, 0x1F6EC, kWide}, {0x1F6F4, 0x1F6FC, kWide}, {0x1F7E0, 0x1F7EB, kWide}, {0x1F7F0, 0x1F7F0, kWide},
+    {0x1F90C, 0x1F93A, kWide}, {0x1F93C, 0x1F945, kWide}, {0x1F947, 0x1F9FF, kWide}, {0x1FA70, 0x1FA74, kWide},
+    {0x1FA78, 0x1FA7C, kWide}, {0x1FA80, 0x1FA86, kWide}, {0x1FA90, 0x1FAAC, kWide}, {0x1FAB0, 0x1FABA, kWide},
+    {0x1FAC0, 0x1FAC5, kWide}, {0x1FAD0, 0x1FAD9, kWide}, {0x1FAE0, 0x1FAE7, kWide}, {0x1FAF0, 0x1FAF6, kWide},
+};
+
+constexpr char32_t kTableEnd = 0x20000;
+constexpr std::uint8_t kAllNarrow = 0x55;
+
+// Two bits per codepoint.
+constexpr std::array<std::uint8_t, kTableEnd / 4> buildTable() {
+    std::array<std::uint8_t, kTableEnd / 4> table{};
+    table.fill(kAllNarrow);
+    for (const Range& r : kRanges) {
+        for (char32_t cp = r.first; cp <= r.last;) {
+            if ((cp & 3) == 0 && cp + 3 <= r.last) {
+                table[cp >> 2] = std::uint8_t(r.kind * kAllNarrow);
+                cp += 4;
+                continue;
+            }
+            const unsigned shift = (cp & 3) * 2;
+            table[cp >> 2] = std::uint8_t((table[cp >> 2] & ~(3u << shift)) | (unsigned(r.kind) << shift));
+            ++cp;
+        }
+    }
+    return table;
+}
+
+constexpr std::array<std::uint8_t, kTableEnd / 4> kTable = buildTable();
+
+static_assert(((kTable[0x4E00 >> 2] >> ((0x4E00 & 3) * 2)) & 3) == kWide);
+static_assert(((kTable[0x0301 >> 2] >> ((0x0301 & 3) * 2)) & 3) == kZero);
+}  // namespace
+
+int charWidthLookup(char32_t ch) noexcept {
+    unsigned kind = kNarrow;
+    if (ch < kTableEnd)
+        kind = (kTable[ch >> 2] >> ((ch & 3) * 2)) & 3u;
+    else if (ch <= 0x3FFFD)
+        kind = kWide;  // CJK extensions B and beyond
+    else if (ch >= 0xE0000 && ch <= 0xE0FFF)
+        kind = kZero;  // tags and variation selectors supplement
+    else if (ch > 0x10FFFF)
+        kind = kSkip;
+    return kind == kSkip ? -1 : int(kind);
+}
@@ -0,0 +1,23 @@
+#ifndef CHARWIDTH_H
+#define CHARWIDTH_H
+
+// Columns a codepoint takes on the grid: 1, or 2 for East Asian wide and
+// fullwidth characters and emoji. 0 means it joins the cell before it
+// (combining marks, joiners, variation selectors); -1 that it is not printed
+// at all (C0/C1 controls, surrogates, line and paragraph separators). A
+// table built at compile time from Unicode 14.0 answers, so the hot path
+// never asks for Unicode properties.
+int charWidthLookup(char32_t ch) noexcept;
+
+// Cell contents that are not codepoints: the right half of a wide character,
+// whose glyph the cell before holds, and kClusterBit | a ClusterTable id.
+constexpr char32_t kWideSpacer = 0x80000000u;
+constexpr char32_t kClusterBit = 0x40000000u;
+
+inline int charWidth(char32_t ch) noexcept {
+    if (ch < 0x7F)
+        return ch >= 0x20 ? 1 : -1;
+    return charWidthLookup(ch);
+}
+
+#endif
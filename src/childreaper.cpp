@@ -0,0 +1,44 @@
+#include "childreaper.h"
+#include "debug.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <sys/wait.h>
+
+namespace {
+// True once pid is gone, reaped now or by someone else before.
+bool collect(pid_t pid) {
+    pid_t r;
+    do {
+        r = ::waitpid(pid, nullptr, WNOHANG);
+    } while (r < 0 && errno == EINTR);
+    return r != 0;
+}
+}  // namespace
+
+ChildReaper::ChildReaper(QObject* parent) : QObject(parent), m_timer(this) {
+    m_timer.setSingleShot(true);
+    connect(&m_timer, &QTimer::timeout, this, &ChildReaper::poll);
+}
+
+ChildReaper::~ChildReaper() {
+    // Whatever is left is reparented to init once we exit.
+    for (pid_t pid : m_pending)
+        collect(pid);
+}
+
+void ChildReaper::reap(pid_t pid) {
+    if (pid <= 0 || collect(pid))
+        return;
+#ifdef ENABLE_DEBUG
+    DBG() << "Shell" << pid << "still running, reaping it later";
+#endif
+    m_pending.push_back(pid);
+    m_timer.start(kFirstInterval);
+}
+
+void ChildReaper::poll() {
+    m_pending.erase(std::remove_if(m_pending.begin(), m_pending.end(), collect), m_pending.end());
+    if (!m_pending.empty())
+        m_timer.start(std::min(m_timer.interval() * 2, kMaxInterval));
+}
@@ -0,0 +1,33 @@
+#ifndef CHILDREAPER_H
+#define CHILDREAPER_H
+
+#include <QObject>
+#include <QTimer>
+#include <vector>
+#include <sys/types.h>
+
+// Collects the shells of closed sessions so none is left a zombie, without
+// ever blocking a thread on one. Closing its PTY only hangs a shell up: it
+// may take a moment to exit, or keep running with its tty closed. Children
+// are polled with WNOHANG, backing off while they linger. Lives on the GUI
+// thread.
+class ChildReaper : public QObject {
+    Q_OBJECT
+
+   public:
+    static constexpr int kFirstInterval = 50;
+    static constexpr int kMaxInterval = 2000;
+
+    explicit ChildReaper(QObject* parent = nullptr);
+    ~ChildReaper() override;
+
+    void reap(pid_t pid);
+
+   private:
+    void poll();
+
+    std::vector<pid_t> m_pending;
+    QTimer m_timer;
+};
+
+#endif
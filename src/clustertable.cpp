@@ -0,0 +1,46 @@
+#include "clustertable.h"
+#include "debug.h"
+
+#include <QDebug>
+
+ClusterTable::Id ClusterTable::intern(const std::u32string& text) {
+    auto it = m_index.find(text);
+    if (it != m_index.end())
+        return it->second;
+
+    ++m_misses;
+    Id id = kNone;
+    if (const std::optional<Id> free = m_pool.take()) {
+        id = *free;
+    }
+    else if (m_size < kCapacity) {
+        const std::size_t chunk = m_size >> kChunkBits;
+        if (!m_chunks[chunk])
+            m_chunks[chunk] = std::make_unique<Chunk>();
+        id = Id(m_size++);
+    }
+    else {
+        if (!m_warned) {
+            qWarning() << "ClusterTable full:" << kCapacity << "clusters in use, dropping combining marks";
+            m_warned = true;
+        }
+        return kNone;
+    }
+
+    (*m_chunks[id >> kChunkBits])[id & (kChunkSize - 1)] = text;
+    m_index.emplace(text, id);
+    return id;
+}
+
+void ClusterTable::reclaim(const std::vector<bool>& live) {
+    for (std::size_t i = 0; i < m_size; ++i) {
+        const Id id = Id(i);
+        if (live[i] || m_pool.vacant(id))
+            continue;
+        m_index.erase((*this)[id]);
+        m_pool.retire(id);
+    }
+#ifdef ENABLE_DEBUG
+    DBG() << "ClusterTable reclaimed, now" << used() << "of" << m_size << "clusters in use";
+#endif
+}
@@ -0,0 +1,52 @@
+#ifndef CLUSTERTABLE_H
+#define CLUSTERTABLE_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "idpool.h"
+
+// Characters that do not fit one codepoint: a base with the combining marks,
+// joiners and variation selectors that followed it. A cell holding one
+// stores kClusterBit | id. Same contract as AttrTable: deduplicated and
+// chunked, so the GUI thread may read any id it received in a snapshot while
+// the parser thread interns new ones, and reclaimed the same way.
+class ClusterTable {
+   public:
+    using Id = std::uint32_t;
+    static constexpr Id kNone = ~Id(0);
+    static constexpr std::size_t kCapacity = 1u << 16;
+
+    // Requires the model mutex; only the writer side calls these. intern()
+    // returns kNone once the table is full.
+    Id intern(const std::u32string& text);
+    void reclaim(const std::vector<bool>& live);
+    void release() { m_pool.release(); }
+
+    const std::u32string& operator[](Id id) const noexcept {
+        return (*m_chunks[id >> kChunkBits])[id & (kChunkSize - 1)];
+    }
+    std::size_t size() const noexcept { return m_size; }
+    std::size_t used() const noexcept { return m_size - m_pool.size(); }
+    bool full() const noexcept { return m_size >= kCapacity && !m_pool.available(); }
+    std::size_t misses() const noexcept { return m_misses; }
+
+   private:
+    static constexpr int kChunkBits = 10;
+    static constexpr std::size_t kChunkSize = std::size_t(1) << kChunkBits;
+    using Chunk = std::array<std::u32string, kChunkSize>;
+
+    std::array<std::unique_ptr<Chunk>, kCapacity / kChunkSize> m_chunks;
+    std::size_t m_size{0};
+    std::size_t m_misses{0};
+    bool m_warned{false};
+    std::unordered_map<std::u32string, Id> m_index;
+    IdPool<Id> m_pool{kCapacity};
+};
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef CSIPARAMS_H
+#define CSIPARAMS_H
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <span>
+
+struct CsiParam {
+    int value{0};
+    // Separated from the previous parameter by ':' rather than ';', as in the
+    // ITU T.416 form of extended colors (38:2::r:g:b).
+    bool sub{false};
+};
+
+// CSI parameters, accumulated in place as bytes arrive. Fixed capacity, so
+// parsing a sequence never allocates; parameters past kMax are dropped.
+class CsiParams {
+   public:
+    static constexpr std::size_t kMax = 32;
+    static constexpr int kMaxValue = 65535;
+
+    void clear() noexcept {
+        m_size = 0;
+        m_full = false;
+    }
+
+    // b is a digit, ';' or ':'.
+    void push(unsigned char b) noexcept {
+        if (m_size == 0)
+            start(false);
+        if (b >= '0' && b <= '9') {
+            if (!m_full) {
+                int& v = m_params[m_size - 1].value;
+                v = std::min(v * 10 + (b - '0'), kMaxValue);
+            }
+        }
+        else {
+            start(b == ':');
+        }
+    }
+
+    // An empty parameter string reads as a single 0, like a lone separator.
+    std::span<const CsiParam> finish() noexcept {
+        if (m_size == 0)
+            start(false);
+        return {m_params.data(), m_size};
+    }
+
+   private:
+    void start(bool sub) noexcept {
+        if (m_size == kMax) {
+            m_full = true;
+            return;
+        }
+        m_params[m_size++] = CsiParam{0, sub};
+    }
+
+    std::array<CsiParam, kMax> m_params{};
+    std::size_t m_size{0};
+    bool m_full{false};
+};
+
+#endif
@@ -1,5 +1,6 @@
 #include "escapeparser.h"
-#include "terminalwidget.h"
+#include "terminalmodel.h"
+#include "asciiscan.h"
 #include "debug.h"
 
 #include <QDebug>
@@ -8,14 +9,22 @@
 #include <QChar>
 #include <algorithm>
 #include <array>
+#include <charconv>
+#include <chrono>
+#include <string_view>
 #include <vector>
 
 #if __cplusplus < 201402L
 #error "This file requires at least C++14 (or newer) language standard."
 #endif
 
-EscapeSequenceParser::EscapeSequenceParser(TerminalWidget* widget, QObject* parent)
-    : QObject(parent), m_widget(widget) {
+namespace {
+// OSC and DCS payloads past this are dropped rather than buffered.
+constexpr qsizetype kMaxStringBytes = 1 << 20;
+}  // namespace
+
+EscapeSequenceParser::EscapeSequenceParser(TerminalModel* model, QObject* parent)
+    : QObject(parent), m_model(model) {
 #ifdef ENABLE_DEBUG
     DBG() << "EscapeSequenceParser constructor";
 #endif
@@ -23,302 +32,329 @@ EscapeSequenceParser::EscapeSequenceParser(TerminalWidget* widget, QObject* pare
 }
 
 void EscapeSequenceParser::feed(const QByteArray& data) {
+    feed(std::as_bytes(std::span(data.constData(), std::size_t(data.size()))));
+}
+
+void EscapeSequenceParser::feed(std::span<const std::byte> data) {
 #ifdef ENABLE_DEBUG
     DBG() << "feed" << data.size() << "bytes";
 #endif
 
-    for (char c : data) {
-        unsigned char b = static_cast<unsigned char>(c);
-        processByte(b);
+    const auto start = std::chrono::steady_clock::now();
+    const auto* p = reinterpret_cast<const unsigned char*>(data.data());
+    const std::size_t n = data.size();
+    std::size_t i = 0;
+    while (i < n) {
+        if (m_state == State::Ground && p[i] >= 0x20 && p[i] < 0x7F && !m_utf8.pending() && m_model) {
+            const std::size_t run = printableAsciiRun(p + i, n - i);
+            m_model->putAsciiRun(p + i, run);
+            i += run;
+            continue;
+        }
+        processByte(p[i++]);
     }
 
-    flushTextBuffer();
-
-    if (m_widget) {
-#ifdef ENABLE_DEBUG
-        DBG() << "calling updateScreen() after feed";
-#endif
-        m_widget->updateScreen();
+    if (m_model) {
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+        m_model->metrics().recordFeed(
+            n, std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
     }
 }
 
 void EscapeSequenceParser::processByte(unsigned char b) {
-    static constexpr std::array<uint8_t, 256> g_cls = [] {
-        std::array<uint8_t, 256> arr{};
-
-        for (auto& x : arr) {
-            x = 0;
+    // (state, byte) -> action << 4 | next state, for every state and byte,
+    // built at compile time. Bytes from 0x80 up are UTF-8 here, not C1
+    // controls: they print in Ground, go into strings and are ignored inside
+    // control sequences. C1 arriving as UTF-8 is handled in printByte().
+    static constexpr auto kTransitions = [] {
+        constexpr auto kStates = std::size_t(State::Count);
+        std::array<std::array<std::uint8_t, 256>, kStates> table{};
+        auto set = [&](State s, unsigned from, unsigned to, Action a, State next) {
+            for (unsigned c = from; c <= to; ++c)
+                table[std::size_t(s)][c] = std::uint8_t((unsigned(a) << 4) | unsigned(next));
+        };
+        // Executes C0 controls, except in DCS and strings.
+        auto c0 = [&](State s, Action a) {
+            set(s, 0x00, 0x17, a, s);
+            set(s, 0x19, 0x19, a, s);
+            set(s, 0x1C, 0x1F, a, s);
+        };
+
+        for (std::size_t i = 0; i < kStates; ++i) {
+            const auto s = State(i);
+            set(s, 0x00, 0xFF, Action::None, s);
+            c0(s, Action::Execute);
         }
 
-        for (unsigned i = 0; i < 0x20; ++i) {
-            arr[i] = 1;
+        set(State::Ground, 0x20, 0xFF, Action::Print, State::Ground);
+
+        set(State::Escape, 0x20, 0x2F, Action::Collect, State::EscapeIntermediate);
+        set(State::Escape, 0x30, 0x7E, Action::EscDispatch, State::Ground);
+        set(State::Escape, 'P', 'P', Action::None, State::DcsEntry);
+        set(State::Escape, 'X', 'X', Action::None, State::SosPmApcString);
+        set(State::Escape, '[', '[', Action::None, State::CsiEntry);
+        set(State::Escape, ']', ']', Action::None, State::OscString);
+        set(State::Escape, '^', '_', Action::None, State::SosPmApcString);
+
+        set(State::EscapeIntermediate, 0x20, 0x2F, Action::Collect, State::EscapeIntermediate);
+        set(State::EscapeIntermediate, 0x30, 0x7E, Action::EscDispatch, State::Ground);
+
+        // ':' separates sub-parameters rather than making the sequence invalid.
+        set(State::CsiEntry, 0x20, 0x2F, Action::Collect, State::CsiIntermediate);
+        set(State::CsiEntry, 0x30, 0x3B, Action::Param, State::CsiParam);
+        set(State::CsiEntry, 0x3C, 0x3F, Action::Collect, State::CsiParam);
+        set(State::CsiEntry, 0x40, 0x7E, Action::CsiDispatch, State::Ground);
+
+        set(State::CsiParam, 0x20, 0x2F, Action::Collect, State::CsiIntermediate);
+        set(State::CsiParam, 0x30, 0x3B, Action::Param, State::CsiParam);
+        set(State::CsiParam, 0x3C, 0x3F, Action::None, State::CsiIgnore);
+        set(State::CsiParam, 0x40, 0x7E, Action::CsiDispatch, State::Ground);
+
+        set(State::CsiIntermediate, 0x20, 0x2F, Action::Collect, State::CsiIntermediate);
+        set(State::CsiIntermediate, 0x30, 0x3F, Action::None, State::CsiIgnore);
+        set(State::CsiIntermediate, 0x40, 0x7E, Action::CsiDispatch, State::Ground);
+
+        set(State::CsiIgnore, 0x40, 0x7E, Action::None, State::Ground);
+
+        for (State s : {State::DcsEntry, State::DcsParam, State::DcsIntermediate, State::DcsIgnore})
+            c0(s, Action::None);
+        set(State::DcsEntry, 0x20, 0x2F, Action::Collect, State::DcsIntermediate);
+        set(State::DcsEntry, 0x30, 0x3B, Action::Param, State::DcsParam);
+        set(State::DcsEntry, 0x3C, 0x3F, Action::Collect, State::DcsParam);
+        set(State::DcsEntry, 0x40, 0x7E, Action::None, State::DcsPassthrough);
+
+        set(State::DcsParam, 0x20, 0x2F, Action::Collect, State::DcsIntermediate);
+        set(State::DcsParam, 0x30, 0x3B, Action::Param, State::DcsParam);
+        set(State::DcsParam, 0x3C, 0x3F, Action::None, State::DcsIgnore);
+        set(State::DcsParam, 0x40, 0x7E, Action::None, State::DcsPassthrough);
+
+        set(State::DcsIntermediate, 0x20, 0x2F, Action::Collect, State::DcsIntermediate);
+        set(State::DcsIntermediate, 0x30, 0x3F, Action::None, State::DcsIgnore);
+        set(State::DcsIntermediate, 0x40, 0x7E, Action::None, State::DcsPassthrough);
+
+        c0(State::DcsPassthrough, Action::Put);
+        set(State::DcsPassthrough, 0x20, 0x7E, Action::Put, State::DcsPassthrough);
+        set(State::DcsPassthrough, 0x80, 0xFF, Action::Put, State::DcsPassthrough);
+
+        // xterm also ends OSC with BEL.
+        c0(State::OscString, Action::None);
+        set(State::OscString, 0x07, 0x07, Action::None, State::Ground);
+        set(State::OscString, 0x20, 0x7E, Action::OscPut, State::OscString);
+        set(State::OscString, 0x80, 0xFF, Action::OscPut, State::OscString);
+
+        c0(State::SosPmApcString, Action::None);
+
+        // From anywhere: CAN and SUB abort a sequence, ESC starts a new one.
+        for (std::size_t i = 0; i < kStates; ++i) {
+            set(State(i), 0x18, 0x18, Action::Execute, State::Ground);
+            set(State(i), 0x1A, 0x1A, Action::Execute, State::Ground);
+            set(State(i), 0x1B, 0x1B, Action::None, State::Escape);
         }
-
-        arr[0x1B] = 2;
-        return arr;
+        return table;
     }();
 
-    State oldState = m_state;
-    uint8_t cls = g_cls[b];
+    const std::uint8_t t = kTransitions[std::size_t(m_state)][b];
+    const auto action = Action(t >> 4);
+    const auto next = State(t & 0x0F);
+    const State prev = m_state;
 
-    switch (m_state) {
-        case State::Ground: {
-            if (cls == 0) {
-                m_textBuffer.push_back(static_cast<char>(b));
-            }
-            else if (cls == 1) {
-                flushTextBuffer();
-                handleControlChar(b);
-            }
-            else {
-                flushTextBuffer();
-                m_state = State::Escape;
-            }
-            break;
-        }
+    if (prev == State::Ground && action != Action::Print)
+        abortUtf8Sequence();
+    if (next != prev)
+        exitState(prev);
 
-        case State::Escape: {
-            switch (b) {
-                case '[':
-                    m_state = State::CsiEntry;
-                    m_paramBuffer.clear();
-                    m_intermediate.clear();
-                    m_escQuestionMark = false;
-                    break;
-                case ']':
-                    m_state = State::OscString;
-                    m_oscString.clear();
-                    break;
-                case '7':
-                    if (m_widget)
-                        m_widget->saveCursorPos();
-                    m_state = State::Ground;
-                    break;
-                case '8':
-                    if (m_widget)
-                        m_widget->restoreCursorPos();
-                    m_state = State::Ground;
-                    break;
-                case 'D':
-                    if (m_widget)
-                        m_widget->lineFeed();
-                    m_state = State::Ground;
-                    break;
-                case 'M':
-                    if (m_widget)
-                        m_widget->reverseLineFeed();
-                    m_state = State::Ground;
-                    break;
-                case 'E':
-                    if (m_widget) {
-                        m_widget->lineFeed();
-                        m_widget->setCursorPos(m_widget->getCursorRow(), 0, true);
-                    }
-                    m_state = State::Ground;
-                    break;
-                case 'c':
-                    if (m_widget)
-                        m_widget->fullReset();
-                    m_state = State::Ground;
-                    break;
-                default:
-#ifdef ENABLE_DEBUG
-                    DBG() << "Unrecognized ESC sequence: ESC " << char(b);
-#endif
-                    m_state = State::Ground;
-                    break;
-            }
+    switch (action) {
+        case Action::None:
             break;
-        }
-
-        case State::CsiEntry:
-        case State::CsiParam:
-        case State::CsiIntermediate:
-        case State::CsiIgnore:
-            processCsiSubState(b);
+        case Action::Print:
+            printByte(b);
             break;
-
-        case State::OscString: {
-            if (b == 0x07) {
-                oscDispatch();
-                m_state = State::Ground;
-            }
-            else if (b == 0x1B) {
-                m_oscString.push_back('\x1B');
-            }
-            else if (b == '\\') {
-                if (!m_oscString.isEmpty() && m_oscString.back() == '\x1B') {
-                    m_oscString.chop(1);
-                    oscDispatch();
-                    m_state = State::Ground;
-                }
-                else {
-                    m_oscString.push_back('\\');
-                }
-            }
-            else {
-                m_oscString.push_back(static_cast<char>(b));
-            }
+        case Action::Execute:
+            handleControlChar(b);
             break;
-        }
-
-        case State::SosPmApcString:
+        case Action::Collect:
+            collect(b);
+            break;
+        case Action::Param:
+            m_params.push(b);
+            break;
+        case Action::EscDispatch:
+            escDispatch(b);
+            break;
+        case Action::CsiDispatch:
+            csiDispatch(b);
+            break;
+        case Action::Put:
+            if (m_dcsString.size() < kMaxStringBytes)
+                m_dcsString.push_back(static_cast<char>(b));
+            break;
+        case Action::OscPut:
+            if (m_oscString.size() < kMaxStringBytes)
+                m_oscString.push_back(static_cast<char>(b));
             break;
     }
 
+    if (next != prev) {
+        m_state = next;
+        enterState(next, b);
 #ifdef ENABLE_DEBUG
-    if (oldState != m_state) {
-        DBG() << "processByte(" << int(b) << ") state transition: Ground -> " << stateName(oldState) << " -> "
-              << stateName(m_state);
-    }
+        DBG() << "processByte(" << int(b) << ") transition" << stateName(prev) << "->" << stateName(next);
 #endif
+    }
 }
 
-void EscapeSequenceParser::processCsiSubState(unsigned char b) {
-    State old = m_state;
-
-    switch (m_state) {
-        case State::CsiEntry: {
-            if (b == '?') {
-                m_escQuestionMark = true;
-                m_state = State::CsiParam;
-            }
-            else if ((b >= '0' && b <= '9') || b == ';') {
-                m_paramBuffer.push_back(static_cast<char>(b));
-                m_state = State::CsiParam;
-            }
-            else if (b >= 0x20 && b <= 0x2F) {
-                m_intermediate.push_back(static_cast<char>(b));
-                m_state = State::CsiIntermediate;
-            }
-            else if (b >= 0x40 && b <= 0x7E) {
-                csiDispatch(b);
-                m_state = State::Ground;
-            }
-            else {
-                m_state = State::Ground;
-            }
+void EscapeSequenceParser::enterState(State s, unsigned char b) {
+    switch (s) {
+        case State::Escape:
+        case State::CsiEntry:
+        case State::DcsEntry:
+            clearSequence();
             break;
-        }
-        case State::CsiParam: {
-            if ((b >= '0' && b <= '9') || b == ';') {
-                m_paramBuffer.push_back(static_cast<char>(b));
-            }
-            else if (b >= 0x20 && b <= 0x2F) {
-                m_intermediate.push_back(static_cast<char>(b));
-                m_state = State::CsiIntermediate;
-            }
-            else if (b >= 0x40 && b <= 0x7E) {
-                csiDispatch(b);
-                m_state = State::Ground;
-            }
-            else {
-                m_state = State::CsiIgnore;
-            }
+        case State::OscString:
+            m_oscString.clear();
             break;
-        }
-        case State::CsiIntermediate: {
-            if (b >= 0x20 && b <= 0x2F) {
-                m_intermediate.push_back(static_cast<char>(b));
-            }
-            else if (b >= 0x40 && b <= 0x7E) {
-                csiDispatch(b);
-                m_state = State::Ground;
-            }
-            else {
-                m_state = State::CsiIgnore;
-            }
+        case State::DcsPassthrough:
+            m_dcsFinal = b;
+            m_dcsString.clear();
             break;
-        }
-        case State::CsiIgnore: {
-            if (b >= 0x40 && b <= 0x7E) {
-                m_state = State::Ground;
-            }
+        case State::SosPmApcString:
+            if (m_model)
+                m_model->metrics().countSequence(Metrics::Sequence::String);
             break;
-        }
         default:
             break;
     }
+}
+
+void EscapeSequenceParser::exitState(State s) {
+    if (s == State::OscString)
+        oscDispatch();
+    else if (s == State::DcsPassthrough)
+        dcsDispatch();
+}
 
+void EscapeSequenceParser::clearSequence() {
+    m_params.clear();
+    m_intermediate.clear();
+    m_privateMarker = 0;
+}
+
+void EscapeSequenceParser::collect(unsigned char b) {
+    if (b >= 0x3C && b <= 0x3F)
+        m_privateMarker = char(b);
+    else
+        m_intermediate.push_back(static_cast<char>(b));
+}
+
+void EscapeSequenceParser::escDispatch(unsigned char finalByte) {
+    if (!m_model)
+        return;
+    m_model->metrics().countSequence(Metrics::Sequence::Escape);
+    // Charset designations and the like; everything is UTF-8 here.
+    if (!m_intermediate.isEmpty()) {
 #ifdef ENABLE_DEBUG
-    if (old != m_state) {
-        DBG() << "processCsiSubState(" << int(b) << ") transition " << stateName(old) << " -> " << stateName(m_state);
+        DBG() << "Ignored ESC sequence: ESC" << m_intermediate << char(finalByte);
+#endif
+        return;
     }
+
+    switch (finalByte) {
+        case '7':
+            m_model->saveCursorPos();
+            break;
+        case '8':
+            m_model->restoreCursorPos();
+            break;
+        case 'D':
+            m_model->lineFeed();
+            break;
+        case 'M':
+            m_model->reverseLineFeed();
+            break;
+        case 'E':
+            m_model->lineFeed();
+            m_model->setCursorPos(m_model->getCursorRow(), 0, true);
+            break;
+        case 'c':
+            m_model->fullReset();
+            break;
+        case '\\':
+            // ST, left over from a string that ended at its ESC.
+            break;
+        default:
+#ifdef ENABLE_DEBUG
+            DBG() << "Unrecognized ESC sequence: ESC " << char(finalByte);
 #endif
+            break;
+    }
 }
 
-void EscapeSequenceParser::flushTextBuffer() {
-    if (m_textBuffer.isEmpty()) {
+void EscapeSequenceParser::printByte(unsigned char b) {
+    if (!m_model)
         return;
-    }
 
-    if (!m_widget) {
-        m_textBuffer.clear();
+    if (b < 0x80 && !m_utf8.pending()) {
+        m_model->putChar(char32_t(b));
         return;
     }
 
-    QString chunk = QString::fromUtf8(m_textBuffer.data(), m_textBuffer.size());
-    m_textBuffer.clear();
-
-    for (int i = 0; i < chunk.size(); ++i) {
-        QChar ch = chunk.at(i);
-
-        if (ch.isHighSurrogate() && (i + 1) < chunk.size()) {
-            QChar nextCh = chunk.at(i + 1);
-            if (nextCh.isLowSurrogate()) {
-                char32_t high = static_cast<char32_t>(ch.unicode() - 0xD800) << 10;
-                char32_t low = static_cast<char32_t>(nextCh.unicode() - 0xDC00);
-                char32_t ucs4 = 0x10000 + (high | low);
-
-                QString wideChar = QString::fromUcs4(&ucs4, 1);
-
-                if (!wideChar.isEmpty()) {
-                    m_widget->putChar(wideChar.at(0));
-                }
-                ++i;
-                continue;
+    switch (m_utf8.step(b)) {
+        case Utf8Decoder::Result::Codepoint: {
+            const char32_t cp = m_utf8.codepoint();
+            // A C1 control is the same as ESC and its 7-bit Fe byte.
+            if (cp >= 0x80 && cp < 0xA0) {
+                processByte(0x1B);
+                processByte(static_cast<unsigned char>(cp - 0x40));
+                break;
             }
+            m_model->putChar(cp);
+            break;
         }
-
-        if (ch == u'\r') {
-            m_widget->setCursorPos(m_widget->getCursorRow(), 0, true);
-            continue;
-        }
-        if (ch == u'\n') {
-            m_widget->lineFeed();
-            continue;
-        }
-
-        m_widget->putChar(ch);
+        case Utf8Decoder::Result::Invalid:
+            m_model->putChar(Utf8Decoder::kReplacement);
+            if (m_utf8.restart())
+                printByte(b);
+            break;
+        case Utf8Decoder::Result::Incomplete:
+            break;
     }
 }
 
+void EscapeSequenceParser::abortUtf8Sequence() {
+    if (!m_utf8.pending())
+        return;
+    m_utf8.reset();
+    if (m_model)
+        m_model->putChar(Utf8Decoder::kReplacement);
+}
+
 void EscapeSequenceParser::handleControlChar(unsigned char c0) {
-    if (!m_widget)
+    if (!m_model)
         return;
+    m_model->metrics().countSequence(Metrics::Sequence::Control);
 
     switch (c0) {
         case 0x0D:
-            m_widget->setCursorPos(m_widget->getCursorRow(), 0, true);
+            m_model->setCursorPos(m_model->getCursorRow(), 0, true);
             break;
 
         case 0x0A:
-            m_widget->lineFeed();
+            m_model->lineFeed();
             break;
 
         case 0x08:
-            m_widget->setCursorCol(m_widget->getCursorCol() - 1);
-            m_widget->clampCursor();
+            m_model->setCursorCol(m_model->getCursorCol() - 1);
+            m_model->clampCursor();
             break;
 
         case 0x07:
-            m_widget->handleBell();
+            m_model->handleBell();
             break;
 
         case 0x09: {
-            int nextTab = ((m_widget->getCursorCol() / 8) + 1) * 8;
-            m_widget->setCursorCol(nextTab);
-            m_widget->clampCursor();
+            int nextTab = ((m_model->getCursorCol() / 8) + 1) * 8;
+            m_model->setCursorCol(nextTab);
+            m_model->clampCursor();
             break;
         }
 
@@ -335,73 +371,71 @@ void EscapeSequenceParser::csiDispatch(unsigned char finalByte) {
     DBG() << "csiDispatch finalByte=" << int(finalByte);
 #endif
 
-    if (!m_widget) {
-        m_paramBuffer.clear();
-        m_intermediate.clear();
+    if (!m_model) {
+        clearSequence();
         return;
     }
+    m_model->metrics().countSequence(Metrics::Sequence::Csi);
 
-    std::vector<int> params;
-    if (!m_paramBuffer.isEmpty()) {
-        const QList<QByteArray> parts = QByteArray{m_paramBuffer}.split(';');
-        for (const QByteArray& part : parts) {
-            bool ok = false;
-            int v = part.toInt(&ok);
+    const std::span<const CsiParam> params = m_params.finish();
 
-            if (!ok || v < 0) {
+    bool priv = m_privateMarker == '?';
+    // Secondary DA, xterm's modifyOtherKeys and friends; none are supported.
+    if (m_privateMarker && !priv) {
 #ifdef ENABLE_DEBUG
-                DBG() << "Invalid parameter in CSI sequence:" << part;
+        DBG() << "Ignored CSI" << m_privateMarker << "sequence, final" << char(finalByte);
 #endif
-                params.push_back(0);
-            }
-            else {
-                params.push_back(v);
-            }
-        }
+        clearSequence();
+        return;
     }
-    if (params.empty()) {
-        params.emplace_back(0);
+    // SL, SR, DECCARA, DECSCA and the like share a final byte with a plain
+    // sequence and must not run as it.
+    const char* expected = finalByte == 'p' ? "$" : finalByte == 'q' ? " " : "";
+    if (m_intermediate != expected) {
+#ifdef ENABLE_DEBUG
+        DBG() << "Ignored CSI sequence with intermediate" << m_intermediate << "final" << char(finalByte);
+#endif
+        clearSequence();
+        return;
     }
 
-    bool priv = m_escQuestionMark;
-
     auto P = [&](int idx, int def) -> int {
         if (idx >= 0 && idx < static_cast<int>(params.size())) {
-            return params[static_cast<size_t>(idx)];
+            return params[static_cast<size_t>(idx)].value;
         }
         return def;
     };
 
-    const int rows = m_widget->currentBuffer().rows();
-    const int cols = m_widget->currentBuffer().cols();
-    const int curR = m_widget->getCursorRow();
-    const int curC = m_widget->getCursorCol();
+    const int rows = m_model->currentBuffer().rows();
+    const int cols = m_model->currentBuffer().cols();
+    const int curR = m_model->getCursorRow();
+    const int curC = m_model->getCursorCol();
 
     switch (finalByte) {
         case 'A':
-            m_widget->setCursorRow(curR - P(0, 1));
-            m_widget->clampCursor();
+            m_model->setCursorRow(curR - P(0, 1));
+            m_model->clampCursor();
             break;
 
         case 'B':
-            m_widget->setCursorRow(curR + P(0, 1));
-            m_widget->clampCursor();
+            m_model->setCursorRow(curR + P(0, 1));
+            m_model->clampCursor();
             break;
 
         case 'C': {
             int newC = std::min(curC + P(0, 1), cols - 1);
-            m_widget->setCursorCol(newC);
+            m_model->setCursorCol(newC);
             break;
         }
         case 'D': {
             int newC = std::max(curC - P(0, 1), 0);
-            m_widget->setCursorCol(newC);
+            m_model->setCursorCol(newC);
             break;
         }
 
         case 'G': {
             int col = std::clamp(P(0, 1) - 1, 0, cols - 1);
-            m_widget->setCursorPos(curR, col, false);
+            m_model->setCursorPos(curR, col, false);
             break;
         }
 
@@ -409,7 +443,7 @@ void EscapeSequenceParser::csiDispatch(unsigned char finalByte) {
         case 'f': {
             int row = std::clamp(P(0, 1) - 1, 0, rows - 1);
             int col = std::clamp(P(1, 1) - 1, 0, cols - 1);
-            m_widget->setCursorPos(row, col, false);
+            m_model->setCursorPos(row, col, false);
             break;
         }
 
@@ -420,29 +454,58 @@ void EscapeSequenceParser::csiDispatch(unsigned char finalByte) {
             doEraseInLine(P(0, 0));
             break;
         case 'P':
-            m_widget->deleteChars(P(0, 1));
+            m_model->deleteChars(P(0, 1));
             break;
         case 'X':
-            m_widget->eraseChars(P(0, 1));
+            m_model->eraseChars(P(0, 1));
             break;
         case '@':
-            m_widget->insertChars(P(0, 1));
+            m_model->insertChars(P(0, 1));
             break;
         case 'L':
-            m_widget->insertLines(P(0, 1));
+            m_model->insertLines(P(0, 1));
             break;
         case 'M':
-            m_widget->deleteLines(P(0, 1));
+            m_model->deleteLines(P(0, 1));
             break;
         case 'S':
-            m_widget->scrollUpLines(P(0, 1));
+            m_model->scrollUpLines(P(0, 1));
             break;
         case 'T':
-            m_widget->scrollDownLines(P(0, 1));
+            m_model->scrollDownLines(P(0, 1));
             break;
 
         case 'm':
-            m_widget->setSGR(params);
+            m_model->setSGR(params);
+            break;
+
+        case 'h':
+        case 'l':
+            if (priv) {
+                for (const CsiParam& p : params) {
+                    if (finalByte == 'h')
+                        doSetMode(p.value);
+                    else
+                        doResetMode(p.value);
+                }
+            }
+            break;
+
+        case 'p':
+            // DECRQM, so applications can probe for synchronized output.
+            if (priv) {
+                const int mode = P(0, 0);
+                int state = 0;
+                if (mode == 2026)
+                    state = m_model->synchronizedUpdate() ? 1 : 2;
+                else if (mode == 2004)
+                    state = m_model->bracketedPaste() ? 1 : 2;
+                emit m_model->reply("\x1B[?" + QByteArray::number(mode) + ';' + QByteArray::number(state) + "$y");
+            }
+            break;
+
+        case 'q':
+            m_model->setCursorStyle(P(0, 0));
             break;
 
         case 'r': {
@@ -454,100 +517,196 @@ void EscapeSequenceParser::csiDispatch(unsigned char finalByte) {
 #endif
                 std::swap(top, bottom);
             }
-            m_widget->setScrollingRegion(top, bottom);
+            m_model->setScrollingRegion(top, bottom);
             break;
         }
 
         default:
 #ifdef ENABLE_DEBUG
-            DBG() << "Unsupported CSI finalByte:" << char(finalByte) << "params=" << params;
+            DBG() << "Unsupported CSI finalByte:" << char(finalByte) << "params=" << params.size();
 #endif
             break;
     }
 
-    m_paramBuffer.clear();
-    m_intermediate.clear();
+    clearSequence();
 }
 
-void EscapeSequenceParser::oscDispatch() {
+void EscapeSequenceParser::dcsDispatch() {
 #ifdef ENABLE_DEBUG
-    DBG() << "oscDispatch";
+    DBG() << "dcsDispatch final=" << char(m_dcsFinal) << "bytes=" << m_dcsString.size();
 #endif
-
-    if (!m_widget) {
-        m_oscString.clear();
-        return;
+    if (m_model) {
+        m_model->metrics().countSequence(Metrics::Sequence::Dcs);
+        // DECRQSS: nothing is reported, but answering keeps a waiting
+        // application from hanging.
+        if (m_dcsFinal == 'q' && m_intermediate == "$")
+            emit m_model->reply("\x1BP0$r\x1B\\");
     }
+    m_dcsString.clear();
+    clearSequence();
+}
 
-    QStringView osc = QString::fromLatin1(m_oscString);
-    m_oscString.clear();
-
-    qsizetype sep = osc.indexOf(u';');
-    if (sep < 0) {
+void EscapeSequenceParser::oscDispatch() {
 #ifdef ENABLE_DEBUG
-        DBG() << "Malformed OSC: missing semicolon";
+    DBG() << "oscDispatch";
 #endif
+
+    if (!m_model) {
+        m_oscString.clear();
         return;
     }
-
-    bool ok = false;
-    int ps = osc.left(sep).toInt(&ok);
-    if (!ok) {
+    m_model->metrics().countSequence(Metrics::Sequence::Osc);
+
+    // Ps is read from the bytes, and only the codes that take text convert
+    // the rest; hyperlinks and prompt marks are handled as they are.
+    const std::string_view osc(m_oscString.constData(), std::size_t(m_oscString.size()));
+    // Ps alone is allowed: OSC 104 without indices resets every color.
+    const std::size_t sep = osc.find(';');
+    const std::string_view digits = osc.substr(0, sep);
+    int ps = 0;
+    const auto [end, ec] = std::from_chars(digits.data(), digits.data() + digits.size(), ps);
+    if (ec != std::errc() || end != digits.data() + digits.size()) {
 #ifdef ENABLE_DEBUG
         DBG() << "Malformed OSC: cannot parse ps (before semicolon)";
 #endif
+        m_oscString.clear();
         return;
     }
 
-    QStringView pt = osc.mid(sep + 1);
+    const std::string_view pt = sep == std::string_view::npos ? std::string_view() : osc.substr(sep + 1);
+    auto text = [pt] { return QString::fromLatin1(pt.data(), qsizetype(pt.size())); };
 
     switch (ps) {
         case 0:
         case 2:
-            m_widget->setWindowTitle(pt.toString());
+            m_model->setWindowTitle(text());
             break;
 
         case 4:
-#ifdef ENABLE_DEBUG
-            DBG() << "OSC 4 (set color) not yet implemented. Param=" << pt;
-#endif
+            doSetPaletteColors(text());
             break;
 
         case 8:
+            doHyperlink(pt);
+            break;
+
+        case 104:
+            doResetPaletteColors(text());
+            break;
+
+        case 133:
+            doSemanticPrompt(pt);
+            break;
+
+        default:
 #ifdef ENABLE_DEBUG
-            DBG() << "OSC 8 (hyperlink) not yet implemented. Param=" << pt;
+            DBG() << "Ignoring unsupported OSC code: " << ps << ", params=" << text();
 #endif
             break;
+    }
+    m_oscString.clear();
+}
 
+void EscapeSequenceParser::doHyperlink(std::string_view pt) {
+    // params;URI, where params are key=value pairs separated by ':'.
+    const std::size_t sep = pt.find(';');
+    if (sep == std::string_view::npos) {
+#ifdef ENABLE_DEBUG
+        DBG() << "OSC 8: missing URI";
+#endif
+        return;
+    }
+
+    std::string_view id;
+    for (std::string_view params = pt.substr(0, sep); !params.empty();) {
+        const std::size_t colon = params.find(':');
+        const std::string_view param = params.substr(0, colon);
+        if (param.starts_with("id="))
+            id = param.substr(3);
+        params = colon == std::string_view::npos ? std::string_view() : params.substr(colon + 1);
+    }
+    m_model->setHyperlink(id, pt.substr(sep + 1));
+}
+
+void EscapeSequenceParser::doSemanticPrompt(std::string_view pt) {
+    // FinalTerm marks: A starts the prompt, B the command line, C its output,
+    // and D;status ends the command.
+    switch (pt.empty() ? 0 : pt.front()) {
+        case 'A':
+            m_model->setZone(Zone::Prompt);
+            break;
+        case 'B':
+            m_model->setZone(Zone::Input);
+            break;
+        case 'C':
+            m_model->setZone(Zone::Output);
+            break;
+        case 'D':
+            m_model->setZone(Zone::None);
+            break;
         default:
 #ifdef ENABLE_DEBUG
-            DBG() << "Ignoring unsupported OSC code: " << ps << ", params=" << pt;
+            DBG() << "OSC 133: ignoring mark" << QByteArray(pt.data(), qsizetype(pt.size()));
 #endif
             break;
     }
 }
 
+void EscapeSequenceParser::doSetPaletteColors(QStringView pt) {
+    // index;spec pairs; a spec of ? asks for the current color.
+    const QList<QStringView> parts = pt.split(u';');
+    for (qsizetype i = 0; i + 1 < parts.size(); i += 2) {
+        bool ok = false;
+        const int index = parts[i].toInt(&ok);
+        if (!ok || index < 0 || index >= Palette::kSize)
+            continue;
+
+        if (parts[i + 1] == u"?") {
+            emit m_model->reply("\x1B]4;" + QByteArray::number(index) + ';' +
+                                Palette::formatSpec(m_model->palette()[index]) + "\x1B\\");
+        }
+        else if (const std::optional<std::uint32_t> argb = Palette::parseSpec(parts[i + 1])) {
+            m_model->setPaletteColor(index, *argb);
+        }
+        else {
+#ifdef ENABLE_DEBUG
+            DBG() << "OSC 4: bad color spec" << parts[i + 1];
+#endif
+        }
+    }
+}
+
+void EscapeSequenceParser::doResetPaletteColors(QStringView pt) {
+    if (pt.isEmpty()) {
+        m_model->resetPaletteColor(-1);
+        return;
+    }
+    for (QStringView part : pt.split(u';')) {
+        bool ok = false;
+        const int index = part.toInt(&ok);
+        if (ok && index >= 0 && index < Palette::kSize)
+            m_model->resetPaletteColor(index);
+    }
+}
+
 void EscapeSequenceParser::resetStateMachine() {
 #ifdef ENABLE_DEBUG
     DBG() << "resetStateMachine";
 #endif
     m_state = State::Ground;
 
-    m_textBuffer.clear();
-    m_paramBuffer.clear();
-    m_intermediate.clear();
+    m_utf8.reset();
+    clearSequence();
     m_oscString.clear();
-
-    m_escIntermediate = false;
-    m_escQuestionMark = false;
+    m_dcsString.clear();
 }
 
 void EscapeSequenceParser::doEraseInDisplay(int mode) {
 #ifdef ENABLE_DEBUG
     DBG() << "doEraseInDisplay mode=" << mode;
 #endif
-    if (m_widget) {
-        m_widget->eraseInDisplay(mode);
+    if (m_model) {
+        m_model->eraseInDisplay(mode);
     }
 }
 
@@ -555,8 +714,8 @@ void EscapeSequenceParser::doEraseInLine(int mode) {
 #ifdef ENABLE_DEBUG
     DBG() << "doEraseInLine mode=" << mode;
 #endif
-    if (m_widget) {
-        m_widget->eraseInLine(mode);
+    if (m_model) {
+        m_model->eraseInLine(mode);
     }
 }
 
@@ -564,30 +723,51 @@ void EscapeSequenceParser::doSetMode(int p) {
 #ifdef ENABLE_DEBUG
     DBG() << "doSetMode p=" << p;
 #endif
-    if (!m_widget)
+    if (!m_model)
         return;
 
     switch (p) {
+        case 12:
+            m_model->setCursorBlink(true);
+            break;
+
         case 25:
-#ifdef ENABLE_DEBUG
-            DBG() << "Show cursor (not yet implemented in TerminalWidget)";
-#endif
+            m_model->setCursorVisible(true);
+            break;
+
+        case 7:
+            m_model->setAutoWrap(true);
             break;
 
+        // 47 and 1047 keep what the alternate screen last showed; 1047 clears
+        // it on the way out instead.
         case 47:
         case 1047:
+            m_model->useAlternateScreen(true);
+            break;
+
+        case 1048:
+            m_model->saveCursorPos();
+            break;
+
         case 1049:
-            m_widget->useAlternateScreen(true);
+            m_model->saveCursorPos();
+            m_model->useAlternateScreen(true);
+            m_model->clearAlternateScreen();
             break;
 
         case 1000:
-            m_widget->setMouseEnabled(true);
+#ifdef ENABLE_DEBUG
+            DBG() << "Mouse reporting requested (not yet implemented)";
+#endif
             break;
 
         case 2004:
-#ifdef ENABLE_DEBUG
-            DBG() << "Bracketed paste mode ON (not yet implemented)";
-#endif
+            m_model->setBracketedPaste(true);
+            break;
+
+        case 2026:
+            m_model->setSynchronizedUpdate(true);
             break;
 
         default:
@@ -602,30 +782,50 @@ void EscapeSequenceParser::doResetMode(int p) {
 #ifdef ENABLE_DEBUG
     DBG() << "doResetMode p=" << p;
 #endif
-    if (!m_widget)
+    if (!m_model)
         return;
 
     switch (p) {
+        case 12:
+            m_model->setCursorBlink(false);
+            break;
+
         case 25:
-#ifdef ENABLE_DEBUG
-            DBG() << "Hide cursor (not yet implemented in TerminalWidget)";
-#endif
+            m_model->setCursorVisible(false);
+            break;
+
+        case 7:
+            m_model->setAutoWrap(false);
             break;
 
         case 47:
+            m_model->useAlternateScreen(false);
+            break;
+
         case 1047:
+            if (m_model->inAlternateScreen())
+                m_model->clearAlternateScreen();
+            m_model->useAlternateScreen(false);
+            break;
+
+        case 1048:
+            m_model->restoreCursorPos();
+            break;
+
         case 1049:
-            m_widget->useAlternateScreen(false);
+            m_model->useAlternateScreen(false);
+            m_model->restoreCursorPos();
             break;
 
         case 1000:
-            m_widget->setMouseEnabled(false);
             break;
 
         case 2004:
-#ifdef ENABLE_DEBUG
-            DBG() << "Bracketed paste mode OFF (not yet implemented)";
-#endif
+            m_model->setBracketedPaste(false);
+            break;
+
+        case 2026:
+            m_model->setSynchronizedUpdate(false);
             break;
 
         default:
@@ -650,6 +850,18 @@ const char* EscapeSequenceParser::stateName(State state) {
             return "CsiIntermediate";
         case State::CsiIgnore:
             return "CsiIgnore";
+        case State::EscapeIntermediate:
+            return "EscapeIntermediate";
+        case State::DcsEntry:
+            return "DcsEntry";
+        case State::DcsParam:
+            return "DcsParam";
+        case State::DcsIntermediate:
+            return "DcsIntermediate";
+        case State::DcsPassthrough:
+            return "DcsPassthrough";
+        case State::DcsIgnore:
+            return "DcsIgnore";
         case State::OscString:
             return "OscString";
         case State::SosPmApcString:
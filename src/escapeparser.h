@@ -3,49 +3,106 @@
 
 #include <QObject>
 #include <QByteArray>
+#include <QStringView>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
 #include <vector>
 
-class TerminalWidget;
+#include "csiparams.h"
+#include "utf8decoder.h"
+
+class TerminalModel;
 
 class EscapeSequenceParser : public QObject {
     Q_OBJECT
 
    public:
-    explicit EscapeSequenceParser(TerminalWidget* widget, QObject* parent = nullptr);
+    explicit EscapeSequenceParser(TerminalModel* model, QObject* parent = nullptr);
     ~EscapeSequenceParser() override = default;
 
+    // Parses data in place; nothing is retained after the call returns.
+    void feed(std::span<const std::byte> data);
     void feed(const QByteArray& data);
 
+    // Between sequences and characters, so the next byte starts afresh.
+    bool idle() const noexcept { return m_state == State::Ground && !m_utf8.pending(); }
+    // Drops any partial sequence.
+    void resetStateMachine();
+
    private:
-    enum class State { Ground, Escape, CsiEntry, CsiParam, CsiIntermediate, CsiIgnore, OscString, SosPmApcString };
+    // The states and actions of Paul Williams' DEC-compatible parser
+    // (vt100.net/emu/dec_ansi_parser). Both fit in 4 bits, so a transition
+    // packs into one byte.
+    enum class State : std::uint8_t {
+        Ground,
+        Escape,
+        EscapeIntermediate,
+        CsiEntry,
+        CsiParam,
+        CsiIntermediate,
+        CsiIgnore,
+        DcsEntry,
+        DcsParam,
+        DcsIntermediate,
+        DcsPassthrough,
+        DcsIgnore,
+        OscString,
+        SosPmApcString,
+        Count
+    };
+    enum class Action : std::uint8_t {
+        None,
+        Print,
+        Execute,
+        Collect,
+        Param,
+        EscDispatch,
+        CsiDispatch,
+        Put,
+        OscPut,
+    };
 
     static const char* stateName(State s);
 
     void processByte(unsigned char b);
-    void processCsiSubState(unsigned char b);
+    // Entry and exit actions run only when a transition changes the state.
+    void enterState(State s, unsigned char b);
+    void exitState(State s);
 
-    void flushTextBuffer();
+    void printByte(unsigned char b);
+    void abortUtf8Sequence();
     void handleControlChar(unsigned char c0);
+    void clearSequence();
+    void collect(unsigned char b);
+    void escDispatch(unsigned char finalByte);
     void csiDispatch(unsigned char finalByte);
+    void dcsDispatch();
     void oscDispatch();
-    void resetStateMachine();
 
     void doEraseInDisplay(int mode);
     void doEraseInLine(int mode);
     void doSetMode(int p);
     void doResetMode(int p);
+    void doSetPaletteColors(QStringView pt);
+    void doResetPaletteColors(QStringView pt);
+    void doHyperlink(std::string_view pt);
+    void doSemanticPrompt(std::string_view pt);
 
    private:
-    TerminalWidget* m_widget{nullptr};
+    TerminalModel* m_model{nullptr};
     State m_state{State::Ground};
 
-    bool m_escIntermediate{false};
-    bool m_escQuestionMark{false};
+    // '?', '>', '<' or '=' right after CSI or DCS, else 0.
+    char m_privateMarker{0};
 
-    QByteArray m_textBuffer;
-    QByteArray m_paramBuffer;
+    Utf8Decoder m_utf8;
+    CsiParams m_params;
     QByteArray m_intermediate;
     QByteArray m_oscString;
+    unsigned char m_dcsFinal{0};
+    QByteArray m_dcsString;
 
     bool m_lastWasCR{false};
 };
@@ -0,0 +1,255 @@
+#include "glrenderer.h"
+#include "debug.h"
+
+#include <QByteArray>
+#include <QOpenGLContext>
+#include <QSurfaceFormat>
+#include <algorithm>
+#include <cstddef>
+
+namespace {
+// Attribute locations, as in the layout qualifiers of kVertexShader.
+constexpr GLuint kGlyphAttr = 0;
+constexpr GLuint kPageAttr = 1;
+constexpr GLuint kBgAttr = 2;
+constexpr GLuint kFgAttr = 3;
+// GlyphCache evicts once it holds this many pages.
+constexpr int kMinAtlasLayers = 8;
+
+constexpr char kVertexShader[] = R"(
+layout(location = 0) in uvec2 aGlyph;
+layout(location = 1) in uvec2 aPage;
+layout(location = 2) in vec4 aBg;
+layout(location = 3) in vec4 aFg;
+
+uniform int uCols;
+uniform vec2 uCell;
+uniform vec2 uViewport;
+
+out vec2 vLocal;
+flat out uvec2 vGlyph;
+flat out uvec2 vPage;
+flat out vec4 vBg;
+flat out vec4 vFg;
+
+void main() {
+    vec2 corner = vec2(float(gl_VertexID & 1), float(gl_VertexID >> 1));
+    vec2 cell = vec2(float(gl_InstanceID % uCols), float(gl_InstanceID / uCols));
+    vec2 pos = (cell + corner) * uCell;
+    vLocal = corner * uCell;
+    vGlyph = aGlyph;
+    vPage = aPage;
+    vBg = aBg;
+    vFg = aFg;
+    gl_Position = vec4(pos.x / uViewport.x * 2.0 - 1.0, 1.0 - pos.y / uViewport.y * 2.0, 0.0, 1.0);
+}
+)";
+
+constexpr char kFragmentShader[] = R"(
+uniform highp sampler2DArray uAtlas;
+// Top and thickness of the underline within a cell.
+uniform vec2 uUnderline;
+
+in vec2 vLocal;
+flat in uvec2 vGlyph;
+flat in uvec2 vPage;
+flat in vec4 vBg;
+flat in vec4 vFg;
+
+out vec4 fragColor;
+
+void main() {
+    vec4 color = vBg;
+    if (vPage.x != 255u) {
+        // Atlas pages hold premultiplied glyphs.
+        vec4 glyph = texelFetch(uAtlas, ivec3(ivec2(vGlyph) + ivec2(vLocal), int(vPage.x)), 0);
+        color = glyph + color * (1.0 - glyph.a);
+    }
+    if ((vPage.y & 1u) != 0u && vLocal.y >= uUnderline.x && vLocal.y < uUnderline.x + uUnderline.y)
+        color = vFg;
+    fragColor = color;
+}
+)";
+}  // namespace
+
+GlRenderer::GlRenderer(std::shared_ptr<GlyphCache> glyphs, QWidget* parent)
+    : QOpenGLWidget(parent), m_glyphs(std::move(glyphs)) {}
+
+GlRenderer::~GlRenderer() {
+    if (!isValid())
+        return;
+    makeCurrent();
+    freeAtlas();
+    m_instances.destroy();
+    m_vao.destroy();
+    doneCurrent();
+}
+
+void GlRenderer::initializeGL() {
+    QOpenGLContext* ctx = context();
+    const QSurfaceFormat fmt = ctx->format();
+    const bool es = ctx->isOpenGLES();
+    if (fmt.version() < qMakePair(3, es ? 0 : 3)) {
+#ifdef ENABLE_DEBUG
+        DBG() << "GL renderer needs GL 3.3 or ES 3.0, got" << fmt.majorVersion() << fmt.minorVersion();
+#endif
+        return;
+    }
+
+    initializeOpenGLFunctions();
+    if (!buildProgram())
+        return;
+
+    m_vao.create();
+    m_vao.bind();
+    m_instances.setUsagePattern(QOpenGLBuffer::DynamicDraw);
+    m_instances.create();
+    m_instances.bind();
+
+    const auto stride = GLsizei(sizeof(Instance));
+    auto offset = [](std::size_t bytes) { return reinterpret_cast<const void*>(bytes); };
+    glEnableVertexAttribArray(kGlyphAttr);
+    glVertexAttribIPointer(kGlyphAttr, 2, GL_UNSIGNED_SHORT, stride, offset(offsetof(Instance, glyphX)));
+    glEnableVertexAttribArray(kPageAttr);
+    glVertexAttribIPointer(kPageAttr, 2, GL_UNSIGNED_BYTE, stride, offset(offsetof(Instance, page)));
+    glEnableVertexAttribArray(kBgAttr);
+    glVertexAttribPointer(kBgAttr, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, offset(offsetof(Instance, bg)));
+    glEnableVertexAttribArray(kFgAttr);
+    glVertexAttribPointer(kFgAttr, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, offset(offsetof(Instance, fg)));
+    for (GLuint attr : {kGlyphAttr, kPageAttr, kBgAttr, kFgAttr})
+        glVertexAttribDivisor(attr, 1);
+
+    m_vao.release();
+    m_instances.release();
+    m_reallocate = true;
+    m_usable = true;
+}
+
+bool GlRenderer::buildProgram() {
+    const QByteArray header = context()->isOpenGLES()
+                                  ? QByteArrayLiteral("#version 300 es\nprecision highp float;\nprecision highp int;\n")
+                                  : QByteArrayLiteral("#version 330 core\n");
+    const bool ok = m_program.addShaderFromSourceCode(QOpenGLShader::Vertex, header + kVertexShader) &&
+                    m_program.addShaderFromSourceCode(QOpenGLShader::Fragment, header + kFragmentShader) &&
+                    m_program.link();
+    if (!ok) {
+#ifdef ENABLE_DEBUG
+        DBG() << "GL renderer shaders failed:" << m_program.log();
+#endif
+        return false;
+    }
+    m_program.bind();
+    m_program.setUniformValue("uAtlas", 0);
+    m_program.release();
+    return true;
+}
+
+void GlRenderer::resizeGrid(int rows, int cols) {
+    m_rows = std::max(rows, 0);
+    m_cols = std::max(cols, 0);
+    m_cells.assign(std::size_t(m_rows) * std::size_t(m_cols), Instance{});
+    m_reallocate = true;
+}
+
+void GlRenderer::markRowDirty(int r) noexcept {
+    if (m_dirtyFirst > m_dirtyLast) {
+        m_dirtyFirst = m_dirtyLast = r;
+        return;
+    }
+    m_dirtyFirst = std::min(m_dirtyFirst, r);
+    m_dirtyLast = std::max(m_dirtyLast, r);
+}
+
+void GlRenderer::draw(int cellWidth, int cellHeight, int underlinePos) {
+    if (!m_usable || m_cells.empty())
+        return;
+
+    syncAtlas();
+
+    m_instances.bind();
+    if (m_reallocate) {
+        m_instances.allocate(m_cells.data(), int(m_cells.size() * sizeof(Instance)));
+        m_reallocate = false;
+    }
+    else if (m_dirtyFirst <= m_dirtyLast) {
+        const std::size_t rowBytes = std::size_t(m_cols) * sizeof(Instance);
+        m_instances.write(int(std::size_t(m_dirtyFirst) * rowBytes), row(m_dirtyFirst),
+                          int(std::size_t(m_dirtyLast - m_dirtyFirst + 1) * rowBytes));
+    }
+    m_instances.release();
+    m_dirtyFirst = 0;
+    m_dirtyLast = -1;
+
+    const qreal dpr = devicePixelRatioF();
+    const auto viewportW = GLsizei(width() * dpr);
+    const auto viewportH = GLsizei(height() * dpr);
+    glViewport(0, 0, viewportW, viewportH);
+    glDisable(GL_BLEND);
+    glDisable(GL_SCISSOR_TEST);
+    glDisable(GL_DEPTH_TEST);
+
+    m_program.bind();
+    m_program.setUniformValue("uCols", m_cols);
+    m_program.setUniformValue("uCell", GLfloat(cellWidth * dpr), GLfloat(cellHeight * dpr));
+    m_program.setUniformValue("uViewport", GLfloat(viewportW), GLfloat(viewportH));
+    m_program.setUniformValue("uUnderline", GLfloat(underlinePos * dpr), GLfloat(1));
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_atlas);
+
+    m_vao.bind();
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, GLsizei(m_cells.size()));
+    m_vao.release();
+
+    // QPainter's GL engine does not expect anything of ours to stay bound.
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    m_program.release();
+}
+
+void GlRenderer::syncAtlas() {
+    const int pages = m_glyphs->pageCount();
+    if (pages == 0)
+        return;
+
+    // Pages can outnumber the layers mid-frame, before beginFrame() evicts.
+    const int size = m_glyphs->pageImage(0).width();
+    if (size != m_atlasSize || pages > m_atlasLayers) {
+        freeAtlas();
+        glGenTextures(1, &m_atlas);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, m_atlas);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        m_atlasSize = size;
+        m_atlasLayers = std::max(pages, kMinAtlasLayers);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, size, size, m_atlasLayers, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                     nullptr);
+        m_layerRevisions.assign(std::size_t(m_atlasLayers), 0);
+#ifdef ENABLE_DEBUG
+        DBG() << "GL atlas" << size << "x" << size << "x" << m_atlasLayers;
+#endif
+    }
+    else {
+        glBindTexture(GL_TEXTURE_2D_ARRAY, m_atlas);
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    for (int p = 0; p < pages; ++p) {
+        const std::uint64_t revision = m_glyphs->pageRevision(p);
+        if (m_layerRevisions[std::size_t(p)] == revision)
+            continue;
+        const QImage rgba = m_glyphs->pageImage(p).convertToFormat(QImage::Format_RGBA8888_Premultiplied);
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, p, rgba.width(), rgba.height(), 1, GL_RGBA, GL_UNSIGNED_BYTE,
+                        rgba.constBits());
+        m_layerRevisions[std::size_t(p)] = revision;
+    }
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+void GlRenderer::freeAtlas() {
+    if (m_atlas)
+        glDeleteTextures(1, &m_atlas);
+    m_atlas = 0;
+    m_atlasSize = 0;
+    m_atlasLayers = 0;
+}
@@ -0,0 +1,89 @@
+#ifndef GLRENDERER_H
+#define GLRENDERER_H
+
+#include <QOpenGLBuffer>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLVertexArrayObject>
+#include <QOpenGLWidget>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "glyphcache.h"
+
+// OpenGL backend for TerminalWidget. The grid is one instance per cell in a
+// buffer that only has its changed rows re-uploaded; glyphs come from the
+// shared GlyphCache pages, mirrored into the layers of a texture array. A
+// frame is a single instanced draw call.
+//
+// The renderer is the widget's viewport. TerminalWidget still paints it from
+// paintEvent: draw() runs between QPainter::beginNativePainting() and
+// endNativePainting(), and overlays are drawn with the same painter after.
+class GlRenderer : public QOpenGLWidget, protected QOpenGLExtraFunctions {
+    Q_OBJECT
+   public:
+    // 16 bytes per cell; the shader derives the cell position from its
+    // instance index. Colors are RGBA bytes.
+    struct Instance {
+        std::uint16_t glyphX{0};
+        std::uint16_t glyphY{0};
+        std::uint8_t page{kNoGlyph};
+        std::uint8_t flags{0};
+        std::uint8_t pad[2]{};
+        std::uint8_t bg[4]{0, 0, 0, 255};
+        std::uint8_t fg[4]{0, 0, 0, 255};
+    };
+    static_assert(sizeof(Instance) == 16);
+
+    static constexpr std::uint8_t kNoGlyph = 0xFF;
+    static constexpr std::uint8_t kUnderline = 1;
+
+    explicit GlRenderer(std::shared_ptr<GlyphCache> glyphs, QWidget* parent = nullptr);
+    ~GlRenderer() override;
+
+    // False when there is no GL 3.3 / ES 3.0 context or the shaders did not
+    // build; the owner should go back to raster painting.
+    bool usable() const { return m_usable && isValid(); }
+
+    // Resizing discards the contents; every row must be filled again.
+    void resizeGrid(int rows, int cols);
+    int gridRows() const noexcept { return m_rows; }
+    int gridCols() const noexcept { return m_cols; }
+    Instance* row(int r) noexcept { return m_cells.data() + std::size_t(r) * std::size_t(m_cols); }
+    void markRowDirty(int r) noexcept;
+
+    // Needs the context current, as it is inside native painting.
+    void draw(int cellWidth, int cellHeight, int underlinePos);
+
+   protected:
+    void initializeGL() override;
+
+   private:
+    bool buildProgram();
+    void syncAtlas();
+    void freeAtlas();
+
+    std::shared_ptr<GlyphCache> m_glyphs;
+    bool m_usable{false};
+
+    QOpenGLShaderProgram m_program;
+    QOpenGLVertexArrayObject m_vao;
+    QOpenGLBuffer m_instances{QOpenGLBuffer::VertexBuffer};
+
+    GLuint m_atlas{0};
+    int m_atlasSize{0};
+    int m_atlasLayers{0};
+    std::vector<std::uint64_t> m_layerRevisions;
+
+    int m_rows{0};
+    int m_cols{0};
+    std::vector<Instance> m_cells;
+    // Rows [m_dirtyFirst, m_dirtyLast] go out with the next draw.
+    int m_dirtyFirst{0};
+    int m_dirtyLast{-1};
+    bool m_reallocate{true};
+};
+
+#endif
@@ -0,0 +1,115 @@
+#include "glyphcache.h"
+#include "debug.h"
+
+#include <QPainter>
+#include <QString>
+#include <algorithm>
+
+namespace {
+constexpr int kPageSize = 512;
+constexpr int kMaxPages = 8;
+
+constexpr quint64 glyphKey(char32_t ch, bool bold, QRgb fg, bool wide) {
+    return (quint64(ch) << 32) | (quint64(wide) << 25) | (quint64(bold) << 24) | quint64(fg & 0xFFFFFFu);
+}
+}  // namespace
+
+GlyphCache::GlyphCache(const QFont& font, int cellWidth, int cellHeight, int ascent, qreal devicePixelRatio)
+    : m_font(font),
+      m_boldFont(font),
+      m_cellWidth(std::max(cellWidth, 1)),
+      m_cellHeight(std::max(cellHeight, 1)),
+      m_ascent(ascent),
+      m_dpr(std::max<qreal>(devicePixelRatio, 1.0)) {
+    m_boldFont.setBold(true);
+    m_slotsPerRow = std::max(1, kPageSize / m_cellWidth);
+    m_slotsPerPage = m_slotsPerRow * std::max(1, kPageSize / m_cellHeight);
+}
+
+std::shared_ptr<GlyphCache> GlyphCache::shared(const QFont& font,
+                                               int cellWidth,
+                                               int cellHeight,
+                                               int ascent,
+                                               qreal devicePixelRatio) {
+    static QHash<QString, std::weak_ptr<GlyphCache>> caches;
+    const QString key = font.key() + QLatin1Char('@') + QString::number(devicePixelRatio);
+    if (std::shared_ptr<GlyphCache> cache = caches.value(key).lock())
+        return cache;
+
+#ifdef ENABLE_DEBUG
+    DBG() << "GlyphCache created for" << key;
+#endif
+    auto cache = std::make_shared<GlyphCache>(font, cellWidth, cellHeight, ascent, devicePixelRatio);
+    caches.insert(key, cache);
+    return cache;
+}
+
+void GlyphCache::beginFrame() {
+    if (int(m_pages.size()) < kMaxPages)
+        return;
+
+#ifdef ENABLE_DEBUG
+    DBG() << "GlyphCache full, evicting" << m_glyphs.size() << "glyphs";
+#endif
+    m_glyphs.clear();
+    m_pages.clear();
+    m_nextSlot = 0;
+    ++m_epoch;
+}
+
+GlyphCache::Glyph GlyphCache::glyph(char32_t ch, bool bold, QRgb fg, bool wide, std::u32string_view text) {
+    const quint64 key = glyphKey(ch, bold, fg, wide);
+    auto it = m_glyphs.constFind(key);
+    if (it != m_glyphs.constEnd())
+        return it.value();
+
+    Glyph g = rasterize(text.empty() ? std::u32string_view(&ch, 1) : text, bold, fg, wide);
+    m_glyphs.insert(key, g);
+    return g;
+}
+
+const QPixmap& GlyphCache::page(int index) {
+    Page& pg = m_pages[std::size_t(index)];
+    if (pg.dirty) {
+        pg.pixmap = QPixmap::fromImage(pg.image);
+        pg.pixmap.setDevicePixelRatio(m_dpr);
+        pg.dirty = false;
+    }
+    return pg.pixmap;
+}
+
+GlyphCache::Glyph GlyphCache::rasterize(std::u32string_view text, bool bold, QRgb fg, bool wide) {
+    // A wide glyph takes two neighbouring cells in one atlas row.
+    const int cells = wide && m_slotsPerRow > 1 ? 2 : 1;
+    if (cells == 2 && m_nextSlot % m_slotsPerRow == m_slotsPerRow - 1)
+        ++m_nextSlot;
+    if (m_pages.empty() || m_nextSlot + cells > m_slotsPerPage) {
+        Page pg;
+        pg.image = QImage(int(kPageSize * m_dpr), int(kPageSize * m_dpr), QImage::Format_ARGB32_Premultiplied);
+        pg.image.setDevicePixelRatio(m_dpr);
+        pg.image.fill(Qt::transparent);
+        m_pages.push_back(std::move(pg));
+        m_nextSlot = 0;
+    }
+
+    const int pageIndex = int(m_pages.size()) - 1;
+    Page& pg = m_pages.back();
+    const int x = (m_nextSlot % m_slotsPerRow) * m_cellWidth;
+    const int y = (m_nextSlot / m_slotsPerRow) * m_cellHeight;
+    const int w = cells * m_cellWidth;
+    m_nextSlot += cells;
+
+    QPainter gp(&pg.image);
+    gp.setClipRect(QRect(x, y, w, m_cellHeight));
+    gp.setFont(bold ? m_boldFont : m_font);
+    gp.setPen(QColor::fromRgb(fg));
+    gp.drawText(x, y + m_ascent, QString::fromUcs4(text.data(), qsizetype(text.size())));
+    gp.end();
+    pg.dirty = true;
+    pg.revision = ++m_revision;
+
+    Glyph g;
+    g.page = pageIndex;
+    g.source = QRectF(x * m_dpr, y * m_dpr, w * m_dpr, m_cellHeight * m_dpr);
+    return g;
+}
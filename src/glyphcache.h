@@ -0,0 +1,85 @@
+#ifndef GLYPHCACHE_H
+#define GLYPHCACHE_H
+
+#include <QColor>
+#include <QFont>
+#include <QHash>
+#include <QImage>
+#include <QPixmap>
+#include <QRectF>
+
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// Pre-rasterized glyphs packed into a few atlas pages. Each glyph is drawn
+// once per (codepoint, bold, fg, wide) and afterwards only blitted, so a frame is a
+// handful of QPainter::drawPixmapFragments calls instead of one drawText per
+// cell. Terminals using the same font at the same pixel ratio share one
+// cache through shared(); it is only ever used from the GUI thread.
+class GlyphCache {
+   public:
+    struct Glyph {
+        int page{-1};
+        QRectF source;
+    };
+
+    GlyphCache(const QFont& font, int cellWidth, int cellHeight, int ascent, qreal devicePixelRatio);
+
+    static std::shared_ptr<GlyphCache> shared(const QFont& font,
+                                              int cellWidth,
+                                              int cellHeight,
+                                              int ascent,
+                                              qreal devicePixelRatio);
+
+    int cellWidth() const noexcept { return m_cellWidth; }
+    int cellHeight() const noexcept { return m_cellHeight; }
+    qreal devicePixelRatio() const noexcept { return m_dpr; }
+
+    // Call before collecting glyphs for a frame. Evicts everything once the
+    // atlas is full, which never invalidates glyphs handed out mid-frame.
+    void beginFrame();
+
+    // Wide glyphs take two cells. A grapheme cluster passes its cell code as
+    // ch, which keys the cache, and its codepoints as text.
+    Glyph glyph(char32_t ch, bool bold, QRgb fg, bool wide = false, std::u32string_view text = {});
+
+    int pageCount() const noexcept { return int(m_pages.size()); }
+    const QPixmap& page(int index);
+
+    // Raw page contents for renderers keeping their own copy of the atlas.
+    // A page's revision changes whenever a glyph is added to it, and epoch()
+    // whenever beginFrame() evicts, which moves every glyph.
+    const QImage& pageImage(int index) const { return m_pages[std::size_t(index)].image; }
+    std::uint64_t pageRevision(int index) const { return m_pages[std::size_t(index)].revision; }
+    std::uint64_t epoch() const noexcept { return m_epoch; }
+
+   private:
+    struct Page {
+        QImage image;
+        QPixmap pixmap;
+        bool dirty{true};
+        std::uint64_t revision{0};
+    };
+
+    Glyph rasterize(std::u32string_view text, bool bold, QRgb fg, bool wide);
+
+    QFont m_font;
+    QFont m_boldFont;
+    int m_cellWidth;
+    int m_cellHeight;
+    int m_ascent;
+    qreal m_dpr;
+
+    int m_slotsPerRow;
+    int m_slotsPerPage;
+    int m_nextSlot{0};
+    std::uint64_t m_revision{0};
+    std::uint64_t m_epoch{0};
+
+    std::vector<Page> m_pages;
+    QHash<quint64, Glyph> m_glyphs;
+};
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef IDPOOL_H
+#define IDPOOL_H
+
+#include <cstddef>
+#include <optional>
+#include <vector>
+
+// Ids an append-only table has taken back, for it to hand out again. The
+// GUI thread resolves ids from its last snapshot without locking, and a
+// freed id may still be in it, so a retired id is reused, and its entry
+// overwritten, only after release(): the model calls that once the next
+// snapshot has been taken, which holds only ids still in use.
+template <typename Id>
+class IdPool {
+   public:
+    explicit IdPool(std::size_t capacity) : m_vacant(capacity, false) {}
+
+    bool vacant(Id id) const noexcept { return m_vacant[std::size_t(id)]; }
+    // Ids retired or free, which the table no longer counts as used.
+    std::size_t size() const noexcept { return m_retired.size() + m_free.size(); }
+    bool available() const noexcept { return !m_free.empty(); }
+
+    void retire(Id id) {
+        m_vacant[std::size_t(id)] = true;
+        m_retired.push_back(id);
+    }
+    void release() {
+        m_free.insert(m_free.end(), m_retired.begin(), m_retired.end());
+        m_retired.clear();
+    }
+    std::optional<Id> take() {
+        if (m_free.empty())
+            return std::nullopt;
+        const Id id = m_free.back();
+        m_free.pop_back();
+        m_vacant[std::size_t(id)] = false;
+        return id;
+    }
+
+   private:
+    std::vector<bool> m_vacant;
+    std::vector<Id> m_retired;
+    std::vector<Id> m_free;
+};
+
+#endif
@@ -0,0 +1,68 @@
+#include "linktable.h"
+#include "debug.h"
+
+#include <QDebug>
+
+namespace {
+// What intern() keys the index on.
+QByteArray indexKey(const LinkTable::Link& link) {
+    QByteArray key = link.id;
+    key += '\0';
+    key += link.uri;
+    return key;
+}
+}  // namespace
+
+LinkTable::LinkTable() {
+    m_chunks[0] = std::make_unique<Chunk>();
+    m_size = 1;
+}
+
+LinkTable::Id LinkTable::intern(std::string_view id, std::string_view uri) {
+    if (uri.empty() || uri.size() > kMaxUriLength)
+        return kNone;
+
+    QByteArray key(id.data(), qsizetype(id.size()));
+    key += '\0';
+    key.append(uri.data(), qsizetype(uri.size()));
+    auto it = m_index.constFind(key);
+    if (it != m_index.constEnd())
+        return it.value();
+
+    ++m_misses;
+    Id slot = kNone;
+    if (const std::optional<Id> free = m_pool.take()) {
+        slot = *free;
+    }
+    else if (m_size < kCapacity) {
+        const std::size_t chunk = m_size >> kChunkBits;
+        if (!m_chunks[chunk])
+            m_chunks[chunk] = std::make_unique<Chunk>();
+        slot = Id(m_size++);
+    }
+    else {
+        if (!m_warned) {
+            qWarning() << "LinkTable full:" << kCapacity << "hyperlinks in use, dropping new ones";
+            m_warned = true;
+        }
+        return kNone;
+    }
+
+    (*m_chunks[slot >> kChunkBits])[slot & (kChunkSize - 1)] =
+        Link{QByteArray(uri.data(), qsizetype(uri.size())), QByteArray(id.data(), qsizetype(id.size()))};
+    m_index.insert(std::move(key), slot);
+    return slot;
+}
+
+void LinkTable::reclaim(const std::vector<bool>& live) {
+    for (std::size_t i = 1; i < m_size; ++i) {
+        const Id id = Id(i);
+        if (live[i] || m_pool.vacant(id))
+            continue;
+        m_index.remove(indexKey((*this)[id]));
+        m_pool.retire(id);
+    }
+#ifdef ENABLE_DEBUG
+    DBG() << "LinkTable reclaimed, now" << used() << "of" << m_size << "hyperlinks in use";
+#endif
+}
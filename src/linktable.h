@@ -0,0 +1,64 @@
+#ifndef LINKTABLE_H
+#define LINKTABLE_H
+
+#include <QByteArray>
+#include <QHash>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "idpool.h"
+
+// OSC 8 hyperlinks. A cell inside one has CellAttr::link set to its id, and
+// 0 means no link. Same contract as AttrTable: deduplicated and chunked, so
+// the GUI thread may read any id it received in a snapshot while the parser
+// thread interns new ones, and reclaimed the same way.
+class LinkTable {
+   public:
+    using Id = std::uint16_t;
+    static constexpr Id kNone = 0;
+    static constexpr std::size_t kCapacity = 1u << 16;
+    // Longer URIs are not links; the same limit as VTE.
+    static constexpr std::size_t kMaxUriLength = 2083;
+
+    struct Link {
+        QByteArray uri;
+        // The id= parameter, which joins cells written apart into one link.
+        QByteArray id;
+    };
+
+    LinkTable();
+
+    // Requires the model mutex; only the writer side calls these. Links with
+    // the same URI and id are one link. intern() returns kNone once the table
+    // is full or for an unusable URI.
+    Id intern(std::string_view id, std::string_view uri);
+    void reclaim(const std::vector<bool>& live);
+    void release() { m_pool.release(); }
+
+    const Link& operator[](Id id) const noexcept {
+        return (*m_chunks[id >> kChunkBits])[id & (kChunkSize - 1)];
+    }
+    std::size_t size() const noexcept { return m_size; }
+    std::size_t used() const noexcept { return m_size - m_pool.size(); }
+    bool full() const noexcept { return m_size >= kCapacity && !m_pool.available(); }
+    std::size_t misses() const noexcept { return m_misses; }
+
+   private:
+    static constexpr int kChunkBits = 8;
+    static constexpr std::size_t kChunkSize = std::size_t(1) << kChunkBits;
+    using Chunk = std::array<Link, kChunkSize>;
+
+    std::array<std::unique_ptr<Chunk>, kCapacity / kChunkSize> m_chunks;
+    std::size_t m_size{0};
+    std::size_t m_misses{0};
+    bool m_warned{false};
+    QHash<QByteArray, Id> m_index;
+    IdPool<Id> m_pool{kCapacity};
+};
+
+#endif
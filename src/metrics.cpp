@@ -0,0 +1,175 @@
+#include "metrics.h"
+
+#include <QJsonArray>
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+namespace {
+// Only ever called by the value's one writer; see the class comment.
+void bump(std::atomic<std::uint64_t>& value, std::uint64_t by = 1) noexcept {
+    value.store(value.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+}
+}  // namespace
+
+void Histogram::record(std::uint64_t value) noexcept {
+    const auto bucket = std::min(std::size_t(std::bit_width(value)), std::size_t(kBuckets - 1));
+    bump(m_buckets[bucket]);
+    bump(m_count);
+    bump(m_sum, value);
+    if (value > m_max.load(std::memory_order_relaxed))
+        m_max.store(value, std::memory_order_relaxed);
+}
+
+std::uint64_t Histogram::quantile(double q) const noexcept {
+    const std::uint64_t total = count();
+    if (total == 0)
+        return 0;
+    const auto rank = std::uint64_t(std::ceil(std::clamp(q, 0.0, 1.0) * double(total)));
+    std::uint64_t seen = 0;
+    for (int b = 0; b < kBuckets; ++b) {
+        seen += m_buckets[std::size_t(b)].load(std::memory_order_relaxed);
+        if (seen >= rank)
+            return b == 0 ? 0 : std::min((std::uint64_t(1) << b) - 1, max());
+    }
+    return max();
+}
+
+QJsonObject Histogram::toJson() const {
+    QJsonArray buckets;
+    for (const auto& b : m_buckets)
+        buckets.append(qint64(b.load(std::memory_order_relaxed)));
+    return {
+        {QStringLiteral("count"), qint64(count())},
+        {QStringLiteral("sum"), qint64(sum())},
+        {QStringLiteral("max"), qint64(max())},
+        {QStringLiteral("p50"), qint64(quantile(0.5))},
+        {QStringLiteral("p99"), qint64(quantile(0.99))},
+        {QStringLiteral("log2Buckets"), buckets},
+    };
+}
+
+void Metrics::recordFeed(std::size_t bytes, std::uint64_t nanoseconds) noexcept {
+    bump(m_bytesParsed, bytes);
+    m_feedNs.record(nanoseconds);
+}
+
+void Metrics::countSequence(Sequence s) noexcept {
+    bump(m_sequences[std::size_t(s)]);
+}
+
+void Metrics::setScrollbackBytes(std::size_t bytes) noexcept {
+    m_scrollbackBytes.store(bytes, std::memory_order_relaxed);
+}
+
+void Metrics::recordFrame(std::uint64_t paintMicroseconds) noexcept {
+    m_paintUs.record(paintMicroseconds);
+}
+
+void Metrics::recordDirtyCells(std::uint64_t cells) noexcept {
+    m_dirtyCells.record(cells);
+}
+
+void Metrics::countDroppedFrame() noexcept {
+    bump(m_droppedFrames);
+}
+
+void Metrics::recordEchoLatency(std::uint64_t microseconds) noexcept {
+    m_echoUs.record(microseconds);
+}
+
+const char* Metrics::sequenceName(Sequence s) {
+    switch (s) {
+        case Sequence::Control:
+            return "control";
+        case Sequence::Escape:
+            return "esc";
+        case Sequence::Csi:
+            return "csi";
+        case Sequence::Osc:
+            return "osc";
+        case Sequence::Dcs:
+            return "dcs";
+        case Sequence::String:
+            return "sos_pm_apc";
+        default:
+            return "unknown";
+    }
+}
+
+QJsonObject Metrics::toJson() const {
+    QJsonObject sequenceCounts;
+    for (int i = 0; i < int(Sequence::Count); ++i) {
+        const auto s = Sequence(i);
+        sequenceCounts.insert(QString::fromLatin1(sequenceName(s)), qint64(sequences(s)));
+    }
+    return {
+        {QStringLiteral("bytesParsed"), qint64(bytesParsed())},
+        {QStringLiteral("sequences"), sequenceCounts},
+        {QStringLiteral("feedNs"), m_feedNs.toJson()},
+        {QStringLiteral("paintUs"), m_paintUs.toJson()},
+        {QStringLiteral("dirtyCells"), m_dirtyCells.toJson()},
+        {QStringLiteral("echoUs"), m_echoUs.toJson()},
+        {QStringLiteral("droppedFrames"), qint64(droppedFrames())},
+        {QStringLiteral("scrollbackBytes"), qint64(scrollbackBytes())},
+    };
+}
+
+StartupTiming& StartupTiming::instance() {
+    static StartupTiming timing;
+    return timing;
+}
+
+bool StartupTiming::mark(Milestone m) noexcept {
+    std::atomic<std::uint64_t>& slot = m_us[std::size_t(m)];
+    if (slot.load(std::memory_order_relaxed) != 0)
+        return false;
+    const auto elapsed = std::chrono::steady_clock::now() - m_start;
+    // 0 means unreached, so nothing is stamped sooner than 1us.
+    const auto us = std::max<std::uint64_t>(
+        1, std::uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count()));
+    std::uint64_t expected = 0;
+    return slot.compare_exchange_strong(expected, us, std::memory_order_relaxed);
+}
+
+const char* StartupTiming::milestoneName(Milestone m) {
+    switch (m) {
+        case Milestone::ShellSpawned:
+            return "shellSpawned";
+        case Milestone::AppCreated:
+            return "appCreated";
+        case Milestone::WindowShown:
+            return "windowShown";
+        case Milestone::FirstOutput:
+            return "firstOutput";
+        case Milestone::FirstPaint:
+            return "firstPaint";
+        case Milestone::FirstPrompt:
+            return "firstPrompt";
+        default:
+            return "unknown";
+    }
+}
+
+QJsonObject StartupTiming::toJson() const {
+    QJsonObject out;
+    for (int i = 0; i < int(Milestone::Count); ++i) {
+        const auto m = Milestone(i);
+        if (reached(m))
+            out.insert(QString::fromLatin1(milestoneName(m)) + QStringLiteral("Us"), qint64(microseconds(m)));
+    }
+    return out;
+}
+
+QString StartupTiming::summary() const {
+    QString out = QStringLiteral("startup:");
+    for (int i = 0; i < int(Milestone::Count); ++i) {
+        const auto m = Milestone(i);
+        if (reached(m))
+            out += QStringLiteral(" %1 %2ms")
+                       .arg(QString::fromLatin1(milestoneName(m)))
+                       .arg(double(microseconds(m)) / 1000.0, 0, 'f', 1);
+    }
+    return out;
+}
@@ -0,0 +1,116 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QJsonObject>
+
+#include <QString>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// Counters and histograms kept in release builds, cheap enough for the parse
+// and paint paths. Every value has a single writing thread, so updates are
+// plain relaxed loads and stores rather than locked read-modify-writes; any
+// thread may read them.
+class Histogram {
+   public:
+    // Bucket b holds values in [2^(b-1), 2^b), bucket 0 only zero.
+    static constexpr int kBuckets = 40;
+
+    void record(std::uint64_t value) noexcept;
+
+    std::uint64_t count() const noexcept { return m_count.load(std::memory_order_relaxed); }
+    std::uint64_t sum() const noexcept { return m_sum.load(std::memory_order_relaxed); }
+    std::uint64_t max() const noexcept { return m_max.load(std::memory_order_relaxed); }
+    // Upper bound of the bucket holding quantile q, so within a factor of 2.
+    std::uint64_t quantile(double q) const noexcept;
+
+    QJsonObject toJson() const;
+
+   private:
+    std::array<std::atomic<std::uint64_t>, kBuckets> m_buckets{};
+    std::atomic<std::uint64_t> m_count{0};
+    std::atomic<std::uint64_t> m_sum{0};
+    std::atomic<std::uint64_t> m_max{0};
+};
+
+class Metrics {
+   public:
+    enum class Sequence { Control, Escape, Csi, Osc, Dcs, String, Count };
+
+    // Parser thread.
+    void recordFeed(std::size_t bytes, std::uint64_t nanoseconds) noexcept;
+    void countSequence(Sequence s) noexcept;
+    // Model mutex holder; sampled when the GUI takes a snapshot.
+    void setScrollbackBytes(std::size_t bytes) noexcept;
+    // GUI thread.
+    void recordFrame(std::uint64_t paintMicroseconds) noexcept;
+    void recordDirtyCells(std::uint64_t cells) noexcept;
+    void countDroppedFrame() noexcept;
+    // From writing input to the end of the first paint showing output after it.
+    void recordEchoLatency(std::uint64_t microseconds) noexcept;
+
+    std::uint64_t bytesParsed() const noexcept { return m_bytesParsed.load(std::memory_order_relaxed); }
+    std::uint64_t sequences(Sequence s) const noexcept {
+        return m_sequences[std::size_t(s)].load(std::memory_order_relaxed);
+    }
+    std::uint64_t scrollbackBytes() const noexcept { return m_scrollbackBytes.load(std::memory_order_relaxed); }
+    std::uint64_t droppedFrames() const noexcept { return m_droppedFrames.load(std::memory_order_relaxed); }
+    const Histogram& feedNanoseconds() const noexcept { return m_feedNs; }
+    const Histogram& paintMicroseconds() const noexcept { return m_paintUs; }
+    const Histogram& dirtyCells() const noexcept { return m_dirtyCells; }
+    const Histogram& echoMicroseconds() const noexcept { return m_echoUs; }
+
+    static const char* sequenceName(Sequence s);
+    QJsonObject toJson() const;
+
+   private:
+    std::atomic<std::uint64_t> m_bytesParsed{0};
+    std::array<std::atomic<std::uint64_t>, std::size_t(Sequence::Count)> m_sequences{};
+    std::atomic<std::uint64_t> m_scrollbackBytes{0};
+    std::atomic<std::uint64_t> m_droppedFrames{0};
+    Histogram m_feedNs;
+    Histogram m_paintUs;
+    Histogram m_dirtyCells;
+    Histogram m_echoUs;
+};
+
+// Milestones from the start of main() to the first shell output on screen,
+// for tracking time to first prompt. Each is stamped once, by whichever
+// thread gets there first.
+class StartupTiming {
+   public:
+    enum class Milestone { ShellSpawned, AppCreated, WindowShown, FirstOutput, FirstPaint, FirstPrompt, Count };
+
+    // Process-wide; the clock starts with the first call.
+    static StartupTiming& instance();
+
+    // Returns whether this call stamped m, i.e. it was not reached before.
+    bool mark(Milestone m) noexcept;
+    bool reached(Milestone m) const noexcept { return microseconds(m) != 0; }
+    // Since the clock started; 0 until reached.
+    std::uint64_t microseconds(Milestone m) const noexcept {
+        return m_us[std::size_t(m)].load(std::memory_order_relaxed);
+    }
+
+    // Print summary() once the first prompt is painted.
+    void setReport(bool report) noexcept { m_report.store(report, std::memory_order_relaxed); }
+    bool report() const noexcept { return m_report.load(std::memory_order_relaxed); }
+
+    static const char* milestoneName(Milestone m);
+    QJsonObject toJson() const;
+    // One line of milestones reached so far, in milliseconds.
+    QString summary() const;
+
+   private:
+    StartupTiming() = default;
+
+    const std::chrono::steady_clock::time_point m_start{std::chrono::steady_clock::now()};
+    std::array<std::atomic<std::uint64_t>, std::size_t(Milestone::Count)> m_us{};
+    std::atomic<bool> m_report{false};
+};
+
+#endif
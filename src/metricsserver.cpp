@@ -0,0 +1,85 @@
+#include "metricsserver.h"
+
+#include <QDebug>
+#include <QFile>
+#include <QSocketNotifier>
+
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+// A client that does not read its report is dropped after this long.
+constexpr int kSendTimeoutMs = 200;
+}  // namespace
+
+MetricsServer::MetricsServer(Report report, QObject* parent) : QObject(parent), m_report(std::move(report)) {}
+
+MetricsServer::~MetricsServer() {
+    if (m_fd < 0)
+        return;
+    m_notifier.reset();
+    ::close(m_fd);
+    ::unlink(QFile::encodeName(m_path).constData());
+}
+
+bool MetricsServer::listen(const QString& path) {
+    const QByteArray name = QFile::encodeName(path);
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (m_fd >= 0 || name.isEmpty() || std::size_t(name.size()) >= sizeof(addr.sun_path)) {
+        qWarning() << "Cannot serve metrics on" << path;
+        return false;
+    }
+    std::memcpy(addr.sun_path, name.constData(), std::size_t(name.size()));
+
+    // Only a socket left behind by an earlier run is replaced.
+    struct stat st;
+    if (::lstat(name.constData(), &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            qWarning() << "Cannot serve metrics on" << path << ": not a socket";
+            return false;
+        }
+        ::unlink(name.constData());
+    }
+
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0 || ::bind(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(fd, 4) != 0) {
+        qWarning() << "Cannot serve metrics on" << path << ":" << strerror(errno);
+        if (fd >= 0)
+            ::close(fd);
+        return false;
+    }
+
+    m_fd = fd;
+    m_path = path;
+    m_notifier = std::make_unique<QSocketNotifier>(m_fd, QSocketNotifier::Read, this);
+    connect(m_notifier.get(), &QSocketNotifier::activated, this, &MetricsServer::acceptClients);
+    return true;
+}
+
+void MetricsServer::acceptClients() {
+    for (;;) {
+        const int client = ::accept4(m_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client < 0)
+            return;
+
+        const timeval timeout{0, kSendTimeoutMs * 1000};
+        ::setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        const QByteArray report = m_report();
+        std::size_t sent = 0;
+        while (sent < std::size_t(report.size())) {
+            const ssize_t n = ::send(client, report.constData() + sent, std::size_t(report.size()) - sent, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                break;
+            sent += std::size_t(n);
+        }
+        ::close(client);
+    }
+}
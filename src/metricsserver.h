@@ -0,0 +1,37 @@
+#ifndef METRICSSERVER_H
+#define METRICSSERVER_H
+
+#include <QByteArray>
+#include <QObject>
+#include <QString>
+
+#include <functional>
+#include <memory>
+
+class QSocketNotifier;
+
+// Serves a metrics report on a Unix socket. Each client gets one JSON
+// document and is disconnected, so `socat - UNIX-CONNECT:<path>` dumps it.
+// Runs on the GUI thread, where the report is built.
+class MetricsServer : public QObject {
+    Q_OBJECT
+
+   public:
+    using Report = std::function<QByteArray()>;
+
+    explicit MetricsServer(Report report, QObject* parent = nullptr);
+    ~MetricsServer() override;
+
+    // Replaces whatever is at path.
+    bool listen(const QString& path);
+
+   private:
+    void acceptClients();
+
+    Report m_report;
+    QString m_path;
+    int m_fd{-1};
+    std::unique_ptr<QSocketNotifier> m_notifier;
+};
+
+#endif
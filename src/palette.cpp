@@ -0,0 +1,100 @@
+#include "palette.h"
+
+#include <QList>
+
+#include <algorithm>
+
+namespace {
+// Qt::black, red, ..., lightGray, then darkGray and the lighter(150) brights.
+constexpr std::array<std::uint32_t, 16> kAnsiColors = {
+    0xFF000000, 0xFFFF0000, 0xFF00FF00, 0xFFFFFF00, 0xFF0000FF, 0xFFFF00FF, 0xFF00FFFF, 0xFFC0C0C0,
+    0xFF808080, 0xFFFF8080, 0xFF80FF80, 0xFFFFFF80, 0xFF8080FF, 0xFFFF80FF, 0xFF80FFFF, 0xFFFFFFFF,
+};
+
+constexpr std::uint32_t opaque(int r, int g, int b) noexcept {
+    return 0xFF000000u | (std::uint32_t(r) << 16) | (std::uint32_t(g) << 8) | std::uint32_t(b);
+}
+
+// Scales a channel of 1-4 hex digits to 8 bits.
+bool parseChannel(QStringView digits, int& out) {
+    if (digits.isEmpty() || digits.size() > 4)
+        return false;
+    bool ok = false;
+    const uint value = digits.toUInt(&ok, 16);
+    if (!ok)
+        return false;
+    const uint max = (1u << (4 * digits.size())) - 1;
+    out = int((value * 255 + max / 2) / max);
+    return true;
+}
+}  // namespace
+
+Palette::Palette() {
+    resetAll();
+}
+
+void Palette::set(int index, std::uint32_t argb) noexcept {
+    if (index >= 0 && index < kSize)
+        m_colors[std::size_t(index)] = argb | 0xFF000000u;
+}
+
+void Palette::reset(int index) noexcept {
+    if (index >= 0 && index < kSize)
+        m_colors[std::size_t(index)] = defaultColor(index);
+}
+
+void Palette::resetAll() noexcept {
+    for (int i = 0; i < kSize; ++i)
+        m_colors[std::size_t(i)] = defaultColor(i);
+}
+
+std::uint32_t Palette::defaultColor(int index) noexcept {
+    if (index < 16)
+        return kAnsiColors[std::size_t(std::max(index, 0))];
+    if (index < 232) {
+        const int offset = index - 16;
+        auto level = [](int v) { return v == 0 ? 0 : 55 + v * 40; };
+        return opaque(level(offset / 36), level((offset % 36) / 6), level(offset % 6));
+    }
+    const int gray = 8 + (index - 232) * 10;
+    return opaque(gray, gray, gray);
+}
+
+std::optional<std::uint32_t> Palette::parseSpec(QStringView spec) {
+    int r = 0, g = 0, b = 0;
+    if (spec.startsWith(u"rgb:")) {
+        const QList<QStringView> parts = spec.mid(4).split(u'/');
+        if (parts.size() != 3 || !parseChannel(parts[0], r) || !parseChannel(parts[1], g) ||
+            !parseChannel(parts[2], b))
+            return std::nullopt;
+        return opaque(r, g, b);
+    }
+
+    if (spec.startsWith(u'#')) {
+        // Only the high bits count: #abc is #a0b0c0, #aaabbbccc is #aabbcc.
+        const QStringView digits = spec.mid(1);
+        const qsizetype width = digits.size() / 3;
+        if (width == 0 || width > 4 || digits.size() % 3)
+            return std::nullopt;
+        int* channels[] = {&r, &g, &b};
+        for (qsizetype i = 0; i < 3; ++i) {
+            bool ok = false;
+            const uint value = digits.mid(i * width, width).toUInt(&ok, 16);
+            if (!ok)
+                return std::nullopt;
+            *channels[i] = int(width == 1 ? value << 4 : value >> (4 * (width - 2)));
+        }
+        return opaque(r, g, b);
+    }
+    return std::nullopt;
+}
+
+QByteArray Palette::formatSpec(std::uint32_t argb) {
+    QByteArray out("rgb:");
+    for (int shift : {16, 8, 0}) {
+        if (shift != 16)
+            out += '/';
+        out += QByteArray::number(((argb >> shift) & 0xFFu) * 0x101u, 16).rightJustified(4, '0');
+    }
+    return out;
+}
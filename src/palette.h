@@ -0,0 +1,37 @@
+#ifndef PALETTE_H
+#define PALETTE_H
+
+#include <QByteArray>
+#include <QStringView>
+
+#include <array>
+#include <cstdint>
+#include <optional>
+
+// The 256 indexed colors as 0xAARRGGBB, the layout of QRgb: the 16 ANSI
+// colors, the 6x6x6 cube and the gray ramp. Each terminal keeps its own copy
+// so OSC 4 can change entries.
+class Palette {
+   public:
+    static constexpr int kSize = 256;
+
+    Palette();
+
+    std::uint32_t operator[](int index) const noexcept { return m_colors[std::size_t(index & 0xFF)]; }
+    void set(int index, std::uint32_t argb) noexcept;
+    void reset(int index) noexcept;
+    void resetAll() noexcept;
+
+    static std::uint32_t defaultColor(int index) noexcept;
+
+    // XParseColor forms: rgb:r/g/b with 1-4 hex digits per channel, and
+    // #rgb, #rrggbb, #rrrgggbbb or #rrrrggggbbbb.
+    static std::optional<std::uint32_t> parseSpec(QStringView spec);
+    // rgb:rrrr/gggg/bbbb, as xterm answers a query.
+    static QByteArray formatSpec(std::uint32_t argb);
+
+   private:
+    std::array<std::uint32_t, kSize> m_colors;
+};
+
+#endif
@@ -0,0 +1,15 @@
+#include "paste.h"
+
+QByteArray pasteBytes(QString text, bool bracketed) {
+    text.replace(QStringLiteral("\r\n"), QStringLiteral("\r"));
+    text.replace(QLatin1Char('\n'), QLatin1Char('\r'));
+    if (!bracketed)
+        return text.toUtf8();
+
+    text.remove(QChar(0x1B));
+    text.remove(QChar(0x9B));
+    QByteArray bytes = text.toUtf8();
+    bytes.prepend("\x1b[200~");
+    bytes.append("\x1b[201~");
+    return bytes;
+}
@@ -0,0 +1,14 @@
+#ifndef PASTE_H
+#define PASTE_H
+
+#include <QByteArray>
+#include <QString>
+
+// The bytes pasting text sends to the shell. Line breaks become CR, as if
+// typed. With bracketed paste (DEC mode 2004) the text goes between
+// ESC[200~ and ESC[201~, and every ESC and C1 CSI in it is dropped first:
+// otherwise pasted text could end the bracket early, however the terminator
+// is nested in it, and the rest would run as typed input.
+QByteArray pasteBytes(QString text, bool bracketed);
+
+#endif
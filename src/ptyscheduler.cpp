@@ -0,0 +1,44 @@
+#include "ptyscheduler.h"
+#include "ptyworker.h"
+#include "debug.h"
+
+#include <algorithm>
+#include <vector>
+
+PtyScheduler::PtyScheduler(QObject* parent) : QObject(parent), m_tick(this) {
+    m_tick.setSingleShot(true);
+    m_tick.setInterval(0);
+    connect(&m_tick, &QTimer::timeout, this, &PtyScheduler::tick);
+}
+
+void PtyScheduler::markReady(PtyWorker* worker) {
+    if (std::find(m_ready.begin(), m_ready.end(), worker) == m_ready.end())
+        m_ready.push_back(worker);
+    if (!m_tick.isActive())
+        m_tick.start();
+}
+
+void PtyScheduler::remove(PtyWorker* worker) {
+    m_ready.erase(std::remove(m_ready.begin(), m_ready.end(), worker), m_ready.end());
+}
+
+void PtyScheduler::tick() {
+    if (m_ready.empty())
+        return;
+
+    const std::size_t slice = std::max(kMinSlice, kTickBudget / m_ready.size());
+    std::vector<PtyWorker*> round(m_ready.begin(), m_ready.end());
+    m_ready.clear();
+
+#ifdef ENABLE_DEBUG
+    DBG() << "PtyScheduler tick:" << round.size() << "ready, slice" << slice;
+#endif
+    for (PtyWorker* worker : round) {
+        // Still behind after its slice: back of the queue for the next tick.
+        if (worker->readFromPty(slice))
+            m_ready.push_back(worker);
+    }
+
+    if (!m_ready.empty())
+        m_tick.start();
+}
@@ -0,0 +1,37 @@
+#ifndef PTYSCHEDULER_H
+#define PTYSCHEDULER_H
+
+#include <QObject>
+#include <QTimer>
+#include <cstddef>
+#include <deque>
+
+class PtyWorker;
+
+// Shares the I/O thread between sessions. A worker whose PTY turns readable is
+// queued here instead of reading on the spot; each tick then hands every
+// queued worker an equal slice of the tick's byte budget, round-robin, and
+// goes back to the event loop before the next tick. A session flooding output
+// therefore gets its turn like any other but cannot starve them.
+class PtyScheduler : public QObject {
+    Q_OBJECT
+
+   public:
+    // Bytes parsed per tick across all ready sessions, and the smallest slice
+    // a session is given however many are ready.
+    static constexpr std::size_t kTickBudget = 512 * 1024;
+    static constexpr std::size_t kMinSlice = 16 * 1024;
+
+    explicit PtyScheduler(QObject* parent = nullptr);
+
+    void markReady(PtyWorker* worker);
+    void remove(PtyWorker* worker);
+
+   private:
+    void tick();
+
+    std::deque<PtyWorker*> m_ready;
+    QTimer m_tick;
+};
+
+#endif
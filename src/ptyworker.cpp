@@ -0,0 +1,225 @@
+#include "ptyworker.h"
+#include "escapeparser.h"
+#include "metrics.h"
+#include "ptyscheduler.h"
+#include "recording.h"
+#include "terminalmodel.h"
+#include "debug.h"
+
+#include <QByteArray>
+#include <QDebug>
+#include <QMutexLocker>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+
+namespace {
+constexpr std::size_t kMinReadSize = 4 * 1024;
+constexpr std::size_t kMaxReadSize = 256 * 1024;
+// Wakeups without a single full read before the buffer is halved.
+constexpr int kShrinkAfterQuietWakeups = 64;
+
+// Largest single write() and the most written per wakeup, so draining a big
+// paste still lets the thread get back to reading the shell's echo.
+constexpr qsizetype kWriteChunk = 16 * 1024;
+constexpr qsizetype kMaxWriteBytesPerWakeup = 256 * 1024;
+}  // namespace
+
+PtyWorker::PtyWorker(TerminalModel* model, PtyScheduler* scheduler, QObject* parent)
+    : QObject(parent),
+      m_model(model),
+      m_scheduler(scheduler),
+      m_parser(new EscapeSequenceParser(model, this)),
+      m_readBuffer(kMinReadSize) {
+    // Answers are produced while parsing, so on this thread: written directly.
+    connect(m_model, &TerminalModel::reply, this, &PtyWorker::write);
+}
+
+PtyWorker::~PtyWorker() {
+#ifdef ENABLE_DEBUG
+    DBG() << "PtyWorker destroyed";
+#endif
+}
+
+void PtyWorker::setRecorder(std::unique_ptr<Recorder> recorder) {
+    m_recorder = std::move(recorder);
+}
+
+void PtyWorker::start(int masterFD, pid_t shellPid) {
+    m_masterFD = masterFD;
+    m_shellPid = shellPid;
+
+    m_notifier = std::make_unique<QSocketNotifier>(m_masterFD, QSocketNotifier::Read, this);
+    connect(m_notifier.get(), &QSocketNotifier::activated, this, [this] {
+        m_notifier->setEnabled(false);
+        m_scheduler->markReady(this);
+    });
+
+    m_writeNotifier = std::make_unique<QSocketNotifier>(m_masterFD, QSocketNotifier::Write, this);
+    m_writeNotifier->setEnabled(false);
+    connect(m_writeNotifier.get(), &QSocketNotifier::activated, this, [this] { flushWrites(); });
+
+#ifdef ENABLE_DEBUG
+    DBG() << "PtyWorker started on masterFD:" << m_masterFD;
+#endif
+}
+
+void PtyWorker::stop() {
+#ifdef ENABLE_DEBUG
+    DBG() << "PtyWorker stopping";
+#endif
+    m_scheduler->remove(this);
+    m_notifier.reset();
+    m_writeNotifier.reset();
+    m_writeQueue.clear();
+    m_writeOffset = 0;
+    m_queuedBytes = 0;
+    m_masterFD = -1;
+}
+
+void PtyWorker::write(const QByteArray& bytes) {
+    if (m_masterFD < 0 || bytes.isEmpty())
+        return;
+
+    if (m_queuedBytes + std::size_t(bytes.size()) > kMaxQueuedBytes) {
+        qWarning() << "PTY input queue full, dropping" << bytes.size() << "bytes";
+        emit writeOverflow();
+        return;
+    }
+
+    const bool wasIdle = m_writeQueue.empty();
+    m_writeQueue.push_back(bytes);
+    m_queuedBytes += std::size_t(bytes.size());
+    if (wasIdle)
+        flushWrites();
+}
+
+void PtyWorker::flushWrites() {
+    qsizetype budget = kMaxWriteBytesPerWakeup;
+    while (!m_writeQueue.empty() && budget > 0) {
+        const QByteArray& front = m_writeQueue.front();
+        const qsizetype chunk = std::min({front.size() - m_writeOffset, kWriteChunk, budget});
+        const ssize_t n = ::write(m_masterFD, front.constData() + m_writeOffset, std::size_t(chunk));
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN) {
+                qWarning() << "Failed to write to PTY:" << strerror(errno);
+                m_writeQueue.clear();
+                m_writeOffset = 0;
+                m_queuedBytes = 0;
+            }
+            break;
+        }
+
+        m_writeOffset += n;
+        m_queuedBytes -= std::size_t(n);
+        budget -= n;
+        if (m_writeOffset == front.size()) {
+            m_writeQueue.pop_front();
+            m_writeOffset = 0;
+        }
+    }
+
+#ifdef ENABLE_DEBUG
+    if (!m_writeQueue.empty()) {
+        DBG() << "PTY write backlog:" << m_queuedBytes << "bytes";
+    }
+#endif
+    if (m_writeNotifier)
+        m_writeNotifier->setEnabled(!m_writeQueue.empty());
+}
+
+bool PtyWorker::readFromPty(std::size_t budget) {
+    if (m_masterFD < 0 || !m_notifier)
+        return false;
+
+    bool sawFullRead = false;
+    bool drained = false;
+    std::size_t remaining = budget;
+    while (remaining > 0) {
+        const std::size_t want = std::min(m_readBuffer.size(), remaining);
+        ssize_t n = ::read(m_masterFD, m_readBuffer.data(), want);
+        if (n > 0) {
+#ifdef ENABLE_DEBUG
+            DBG() << "readFromPty got" << n << "bytes";
+#endif
+            const std::span<const std::byte> data(m_readBuffer.data(), std::size_t(n));
+            QByteArray checkpoint;
+            {
+                QMutexLocker lock(&m_model->mutex());
+                if (m_recorder)
+                    m_recorder->resize(m_model->rows(), m_model->cols());
+                m_parser->feed(data);
+                if (m_recorder && m_recorder->checkpointDue() && m_parser->idle())
+                    checkpoint = m_model->encodeScreen();
+            }
+            if (m_recorder) {
+                m_recorder->output(data);
+                if (!checkpoint.isEmpty())
+                    m_recorder->checkpoint(checkpoint);
+            }
+            m_model->notifyChanged(std::size_t(n));
+            StartupTiming::instance().mark(StartupTiming::Milestone::FirstOutput);
+            remaining -= std::size_t(n);
+
+            if (std::size_t(n) == m_readBuffer.size()) {
+                sawFullRead = true;
+                // Grow between reads so the next one can already use it.
+                adaptReadSize(true);
+            }
+        }
+        else if (n == 0) {
+#ifdef ENABLE_DEBUG
+            DBG() << "PTY EOF";
+#endif
+            // The session hands the shell to the ChildReaper as it closes;
+            // waiting here would stall every session on the thread.
+            m_writeNotifier->setEnabled(false);
+            emit shellExited();
+            return false;
+        }
+        else if (errno == EINTR) {
+            continue;
+        }
+        else if (errno != EAGAIN) {
+            qWarning() << "read() failed:" << strerror(errno);
+            m_writeNotifier->setEnabled(false);
+            emit shellExited();
+            return false;
+        }
+        else {
+            drained = true;
+            break;
+        }
+    }
+
+    if (!sawFullRead)
+        adaptReadSize(false);
+    if (drained)
+        m_notifier->setEnabled(true);
+    return !drained;
+}
+
+void PtyWorker::adaptReadSize(bool sawFullRead) {
+    std::size_t size = m_readBuffer.size();
+    if (sawFullRead) {
+        m_quietWakeups = 0;
+        if (size >= kMaxReadSize)
+            return;
+        size *= 2;
+    }
+    else {
+        if (size <= kMinReadSize || ++m_quietWakeups < kShrinkAfterQuietWakeups)
+            return;
+        m_quietWakeups = 0;
+        size /= 2;
+    }
+
+#ifdef ENABLE_DEBUG
+    DBG() << "PTY read buffer resized to" << size << "bytes";
+#endif
+    m_readBuffer = std::vector<std::byte>(size);
+}
@@ -0,0 +1,70 @@
+#ifndef PTYWORKER_H
+#define PTYWORKER_H
+
+#include <QByteArray>
+#include <QObject>
+#include <QSocketNotifier>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <vector>
+#include <sys/types.h>
+
+class EscapeSequenceParser;
+class PtyScheduler;
+class Recorder;
+class TerminalModel;
+
+// Owns the PTY master FD on the I/O thread: reads, parses into the model and
+// tells the GUI a new frame is available. Never touches any widget. Input for
+// the shell is queued and written as the FD becomes writable, so neither a
+// large paste nor a slow reader can block or spin either thread. Reads are
+// paced by the PtyScheduler shared by all workers on the thread.
+class PtyWorker : public QObject {
+    Q_OBJECT
+
+   public:
+    PtyWorker(TerminalModel* model, PtyScheduler* scheduler, QObject* parent = nullptr);
+    ~PtyWorker() override;
+
+    // Input beyond this much unwritten data is refused.
+    static constexpr std::size_t kMaxQueuedBytes = std::size_t(64) << 20;
+
+    void start(int masterFD, pid_t shellPid);
+    void stop();
+    void write(const QByteArray& bytes);
+    // Tees everything read from the PTY into recorder. Set before start().
+    void setRecorder(std::unique_ptr<Recorder> recorder);
+
+    // Parses up to budget bytes. Returns true if the PTY may still have data,
+    // in which case the read notifier stays off until the next call.
+    bool readFromPty(std::size_t budget);
+
+   signals:
+    void shellExited();
+    void writeOverflow();
+
+   private:
+    void adaptReadSize(bool sawFullRead);
+    void flushWrites();
+
+    TerminalModel* m_model;
+    PtyScheduler* m_scheduler;
+    EscapeSequenceParser* m_parser;
+    std::unique_ptr<Recorder> m_recorder;
+
+    // Grows while reads keep filling it and shrinks back once output calms.
+    std::vector<std::byte> m_readBuffer;
+    int m_quietWakeups{0};
+
+    std::deque<QByteArray> m_writeQueue;
+    qsizetype m_writeOffset{0};
+    std::size_t m_queuedBytes{0};
+
+    std::unique_ptr<QSocketNotifier> m_notifier;
+    std::unique_ptr<QSocketNotifier> m_writeNotifier;
+    int m_masterFD{-1};
+    pid_t m_shellPid{-1};
+};
+
+#endif
@@ -0,0 +1,388 @@
+#include "recording.h"
+#include "escapeparser.h"
+#include "terminalmodel.h"
+#include "debug.h"
+
+#include <QDateTime>
+#include <QDebug>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+
+namespace {
+// Output is written in lines of about this much, so the file stays
+// seekable at a fine grain even when one read is large.
+constexpr std::size_t kMaxEventBytes = 64 * 1024;
+
+void appendJsonChar(QByteArray& out, char32_t ch) {
+    static constexpr char kHex[] = "0123456789abcdef";
+    switch (ch) {
+        case U'"':
+            out += "\\\"";
+            break;
+        case U'\\':
+            out += "\\\\";
+            break;
+        case U'\n':
+            out += "\\n";
+            break;
+        case U'\r':
+            out += "\\r";
+            break;
+        case U'\t':
+            out += "\\t";
+            break;
+        default:
+            if (ch < 0x20 || ch == 0x7F) {
+                out += "\\u00";
+                out += kHex[ch >> 4];
+                out += kHex[ch & 0xF];
+            }
+            else {
+                appendUtf8(out, ch);
+            }
+            break;
+    }
+}
+
+const char* skipSpace(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t'))
+        ++p;
+    return p;
+}
+
+int hexValue(char c) {
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+bool parseHex4(const char* p, const char* end, char32_t& out) {
+    if (end - p < 4)
+        return false;
+    out = 0;
+    for (int i = 0; i < 4; ++i) {
+        const int v = hexValue(p[i]);
+        if (v < 0)
+            return false;
+        out = (out << 4) | char32_t(v);
+    }
+    return true;
+}
+
+// Decodes the JSON string starting after its opening quote into out as
+// UTF-8. Returns the position after the closing quote, or null.
+const char* parseJsonString(const char* p, const char* end, QByteArray* out) {
+    while (p < end) {
+        const char* run = p;
+        while (p < end && *p != '"' && *p != '\\')
+            ++p;
+        if (out)
+            out->append(run, p - run);
+        if (p == end)
+            return nullptr;
+        if (*p++ == '"')
+            return p;
+        if (p == end)
+            return nullptr;
+
+        const char esc = *p++;
+        char32_t ch = 0;
+        switch (esc) {
+            case 'n':
+                ch = U'\n';
+                break;
+            case 'r':
+                ch = U'\r';
+                break;
+            case 't':
+                ch = U'\t';
+                break;
+            case 'b':
+                ch = U'\b';
+                break;
+            case 'f':
+                ch = U'\f';
+                break;
+            case 'u':
+                if (!parseHex4(p, end, ch))
+                    return nullptr;
+                p += 4;
+                if (QChar::isHighSurrogate(ch)) {
+                    char32_t low = 0;
+                    if (end - p >= 6 && p[0] == '\\' && p[1] == 'u' && parseHex4(p + 2, end, low) &&
+                        QChar::isLowSurrogate(low)) {
+                        ch = QChar::surrogateToUcs4(char16_t(ch), char16_t(low));
+                        p += 6;
+                    }
+                    else {
+                        ch = Utf8Decoder::kReplacement;
+                    }
+                }
+                else if (QChar::isLowSurrogate(ch)) {
+                    ch = Utf8Decoder::kReplacement;
+                }
+                break;
+            default:
+                // \" \\ \/
+                ch = char32_t(static_cast<unsigned char>(esc));
+                break;
+        }
+        if (out)
+            appendUtf8(*out, ch);
+    }
+    return nullptr;
+}
+
+// Parses [time, "type", "data"]; data is only decoded if asked for.
+bool parseEvent(const char* p, const char* end, Recording::Event& e, bool withData) {
+    p = skipSpace(p, end);
+    if (p == end || *p++ != '[')
+        return false;
+    p = skipSpace(p, end);
+    const auto [next, ec] = std::from_chars(p, end, e.time);
+    if (ec != std::errc())
+        return false;
+    p = skipSpace(next, end);
+    if (p == end || *p++ != ',')
+        return false;
+    p = skipSpace(p, end);
+    if (end - p < 3 || p[0] != '"' || p[2] != '"')
+        return false;
+    e.type = p[1];
+    p = skipSpace(p + 3, end);
+    if (p == end || *p++ != ',')
+        return false;
+    p = skipSpace(p, end);
+    if (p == end || *p++ != '"')
+        return false;
+    e.data.clear();
+    return parseJsonString(p, end, withData ? &e.data : nullptr) != nullptr;
+}
+
+bool parseSize(const QByteArray& spec, int& rows, int& cols) {
+    const qsizetype x = spec.indexOf('x');
+    if (x <= 0)
+        return false;
+    bool colsOk = false, rowsOk = false;
+    const int c = spec.left(x).toInt(&colsOk);
+    const int r = spec.mid(x + 1).toInt(&rowsOk);
+    if (!colsOk || !rowsOk || c < 1 || r < 1)
+        return false;
+    rows = r;
+    cols = c;
+    return true;
+}
+}  // namespace
+
+Recorder::Recorder(int rows, int cols, std::size_t checkpointInterval)
+    : m_start(std::chrono::steady_clock::now()), m_rows(rows), m_cols(cols), m_checkpointInterval(checkpointInterval) {
+    m_line.reserve(qsizetype(kMaxEventBytes) + 64);
+}
+
+Recorder::~Recorder() {
+    if (m_file.isOpen())
+        m_file.flush();
+}
+
+std::unique_ptr<Recorder> Recorder::create(const QString& path, int rows, int cols, std::size_t checkpointInterval) {
+    std::unique_ptr<Recorder> recorder(new Recorder(rows, cols, checkpointInterval));
+    recorder->m_file.setFileName(path);
+    if (!recorder->m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "Cannot record to" << path << ":" << recorder->m_file.errorString();
+        return nullptr;
+    }
+
+    const QJsonObject header{
+        {QStringLiteral("version"), 2},
+        {QStringLiteral("width"), cols},
+        {QStringLiteral("height"), rows},
+        {QStringLiteral("timestamp"), QDateTime::currentSecsSinceEpoch()},
+        {QStringLiteral("env"), QJsonObject{{QStringLiteral("TERM"), QStringLiteral("xterm-256color")}}},
+    };
+    recorder->m_file.write(QJsonDocument(header).toJson(QJsonDocument::Compact) + '\n');
+#ifdef ENABLE_DEBUG
+    DBG() << "Recording session to" << path;
+#endif
+    return recorder;
+}
+
+void Recorder::output(std::span<const std::byte> data) {
+    for (std::size_t off = 0; off < data.size(); off += kMaxEventBytes)
+        writeEvent('o', data.subspan(off, std::min(kMaxEventBytes, data.size() - off)), m_utf8);
+    m_sinceCheckpoint += data.size();
+}
+
+void Recorder::resize(int rows, int cols) {
+    if (rows == m_rows && cols == m_cols)
+        return;
+    m_rows = rows;
+    m_cols = cols;
+    const QByteArray spec = QByteArray::number(cols) + 'x' + QByteArray::number(rows);
+    Utf8Decoder decoder;
+    writeEvent('r', std::as_bytes(std::span(spec.constData(), std::size_t(spec.size()))), decoder);
+}
+
+void Recorder::checkpoint(const QByteArray& screen) {
+    Utf8Decoder decoder;
+    writeEvent('c', std::as_bytes(std::span(screen.constData(), std::size_t(screen.size()))), decoder);
+    m_sinceCheckpoint = 0;
+    // A crash loses at most the output since the last checkpoint.
+    m_file.flush();
+}
+
+void Recorder::writeEvent(char type, std::span<const std::byte> data, Utf8Decoder& decoder) {
+    if (!m_file.isOpen())
+        return;
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+    m_line.clear();
+    m_line += '[';
+    m_line += QByteArray::number(seconds, 'f', 6);
+    m_line += ", \"";
+    m_line += type;
+    m_line += "\", \"";
+    for (std::size_t i = 0; i < data.size(); ++i) {
+        const auto b = static_cast<unsigned char>(data[i]);
+        switch (decoder.step(b)) {
+            case Utf8Decoder::Result::Codepoint:
+                appendJsonChar(m_line, decoder.codepoint());
+                break;
+            case Utf8Decoder::Result::Invalid:
+                appendUtf8(m_line, Utf8Decoder::kReplacement);
+                if (decoder.restart())
+                    --i;
+                break;
+            case Utf8Decoder::Result::Incomplete:
+                break;
+        }
+    }
+    m_line += "\"]\n";
+
+    if (m_file.write(m_line) != m_line.size()) {
+        qWarning() << "Recording to" << m_file.fileName() << "failed:" << m_file.errorString();
+        m_file.close();
+    }
+}
+
+Recording::~Recording() {
+    if (m_data)
+        m_file.unmap(reinterpret_cast<uchar*>(const_cast<char*>(m_data)));
+}
+
+std::unique_ptr<Recording> Recording::open(const QString& path) {
+    std::unique_ptr<Recording> rec(new Recording);
+    rec->m_file.setFileName(path);
+    if (!rec->m_file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Cannot open recording" << path << ":" << rec->m_file.errorString();
+        return nullptr;
+    }
+    rec->m_size = rec->m_file.size();
+    if (rec->m_size > 0)
+        rec->m_data = reinterpret_cast<const char*>(rec->m_file.map(0, rec->m_size));
+    if (!rec->m_data) {
+        qWarning() << "Cannot map recording" << path << ":" << rec->m_file.errorString();
+        return nullptr;
+    }
+
+    const char* nl = static_cast<const char*>(std::memchr(rec->m_data, '\n', std::size_t(rec->m_size)));
+    const qint64 headerEnd = nl ? nl - rec->m_data : rec->m_size;
+    const QJsonObject header =
+        QJsonDocument::fromJson(QByteArray::fromRawData(rec->m_data, qsizetype(headerEnd))).object();
+    if (header.value(QStringLiteral("version")).toInt() != 2) {
+        qWarning() << path << "is not an asciicast v2 recording";
+        return nullptr;
+    }
+    rec->m_cols = std::max(1, header.value(QStringLiteral("width")).toInt(rec->m_cols));
+    rec->m_rows = std::max(1, header.value(QStringLiteral("height")).toInt(rec->m_rows));
+    rec->m_firstEvent = rec->m_pos = std::min(headerEnd + 1, rec->m_size);
+
+    // Index the checkpoints and the size in force at each. Only size events
+    // have their text decoded.
+    int rows = rec->m_rows, cols = rec->m_cols;
+    Event e;
+    for (;;) {
+        const qint64 at = rec->m_pos;
+        const char* line = rec->m_data + at;
+        const char* lineEnd = static_cast<const char*>(std::memchr(line, '\n', std::size_t(rec->m_size - at)));
+        if (!lineEnd)
+            lineEnd = rec->m_data + rec->m_size;
+        if (line == lineEnd && lineEnd == rec->m_data + rec->m_size)
+            break;
+        rec->m_pos = std::min(qint64(lineEnd - rec->m_data) + 1, rec->m_size);
+        if (!parseEvent(line, lineEnd, e, false))
+            continue;
+        rec->m_duration = std::max(rec->m_duration, e.time);
+        if (e.type == 'r' && parseEvent(line, lineEnd, e, true))
+            parseSize(e.data, rows, cols);
+        else if (e.type == 'c')
+            rec->m_checkpoints.push_back({e.time, at, rows, cols});
+    }
+    rec->m_pos = rec->m_firstEvent;
+#ifdef ENABLE_DEBUG
+    DBG() << "Opened recording" << path << "of" << rec->m_duration << "s with" << rec->m_checkpoints.size()
+          << "checkpoints";
+#endif
+    return rec;
+}
+
+bool Recording::next(Event& e) {
+    while (m_pos < m_size) {
+        const char* line = m_data + m_pos;
+        const char* lineEnd = static_cast<const char*>(std::memchr(line, '\n', std::size_t(m_size - m_pos)));
+        if (!lineEnd)
+            lineEnd = m_data + m_size;
+        m_pos = std::min(qint64(lineEnd - m_data) + 1, m_size);
+        if (parseEvent(line, lineEnd, e, true))
+            return true;
+    }
+    return false;
+}
+
+void Recording::apply(const Event& e, TerminalModel& model, EscapeSequenceParser& parser) {
+    if (e.type == 'o') {
+        parser.feed(e.data);
+    }
+    else if (e.type == 'r') {
+        int rows = model.rows(), cols = model.cols();
+        if (parseSize(e.data, rows, cols))
+            model.setTerminalSize(rows, cols);
+    }
+}
+
+void Recording::seek(double seconds, TerminalModel& model, EscapeSequenceParser& parser) {
+    parser.resetStateMachine();
+    model.fullReset();
+    const auto it = std::upper_bound(m_checkpoints.begin(), m_checkpoints.end(), seconds,
+                                     [](double t, const Checkpoint& c) { return t < c.time; });
+    Event e;
+    if (it == m_checkpoints.begin()) {
+        model.setTerminalSize(m_rows, m_cols);
+        m_pos = m_firstEvent;
+    }
+    else {
+        const Checkpoint& c = *std::prev(it);
+        model.setTerminalSize(c.rows, c.cols);
+        m_pos = c.offset;
+        if (next(e))
+            parser.feed(e.data);
+    }
+
+    for (;;) {
+        const qint64 at = m_pos;
+        if (!next(e))
+            break;
+        if (e.time > seconds) {
+            m_pos = at;
+            break;
+        }
+        apply(e, model, parser);
+    }
+}
@@ -0,0 +1,116 @@
+#ifndef RECORDING_H
+#define RECORDING_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "utf8decoder.h"
+
+class EscapeSequenceParser;
+class TerminalModel;
+
+// Sessions are recorded as asciicast v2: a JSON header line, then one
+// [seconds, "o", text] line per PTY read and [seconds, "r", "COLSxROWS"] when
+// the size changes. Every checkpoint interval of output adds a
+// [seconds, "c", vt] line holding TerminalModel::encodeScreen(), so a player
+// can seek without parsing everything before; other players skip the
+// unknown type. Output that is not valid UTF-8 is stored as U+FFFD, which is
+// also what the parser makes of it.
+
+// Appends a session to its file from the PTY thread.
+class Recorder {
+   public:
+    static constexpr std::size_t kDefaultCheckpointInterval = std::size_t(8) << 20;
+
+    // Creates or truncates path. Returns null, with a warning, on failure.
+    static std::unique_ptr<Recorder> create(const QString& path, int rows, int cols,
+                                            std::size_t checkpointInterval = kDefaultCheckpointInterval);
+    ~Recorder();
+
+    Recorder(const Recorder&) = delete;
+    Recorder& operator=(const Recorder&) = delete;
+
+    void output(std::span<const std::byte> data);
+    void resize(int rows, int cols);
+    // True once enough output has gone by since the last checkpoint. Only
+    // take one while the parser is idle, as a player restarts it there.
+    bool checkpointDue() const noexcept { return m_sinceCheckpoint >= m_checkpointInterval; }
+    void checkpoint(const QByteArray& screen);
+
+    int rows() const noexcept { return m_rows; }
+    int cols() const noexcept { return m_cols; }
+
+   private:
+    Recorder(int rows, int cols, std::size_t checkpointInterval);
+    void writeEvent(char type, std::span<const std::byte> data, Utf8Decoder& decoder);
+
+    QFile m_file;
+    std::chrono::steady_clock::time_point m_start;
+    int m_rows;
+    int m_cols;
+    std::size_t m_checkpointInterval;
+    std::size_t m_sinceCheckpoint{0};
+    // Output may end inside a character; the rest comes with the next read.
+    Utf8Decoder m_utf8;
+    QByteArray m_line;
+};
+
+// A recording opened for playback. The file is mapped, and its checkpoints
+// are indexed when it is opened.
+class Recording {
+   public:
+    struct Event {
+        double time{0};
+        char type{0};
+        QByteArray data;
+    };
+
+    ~Recording();
+
+    // Returns null, with a warning, if path is not an asciicast v2 file.
+    static std::unique_ptr<Recording> open(const QString& path);
+
+    int rows() const noexcept { return m_rows; }
+    int cols() const noexcept { return m_cols; }
+    double duration() const noexcept { return m_duration; }
+
+    // Reads the next event; false at the end of the file.
+    bool next(Event& e);
+    // Applies an "o" or "r" event. Checkpoints only matter to seek().
+    static void apply(const Event& e, TerminalModel& model, EscapeSequenceParser& parser);
+    // Brings model to its state at seconds into the recording from the last
+    // checkpoint before then, and leaves next() at the first later event.
+    // History from before that checkpoint is not restored. The caller holds
+    // the model mutex.
+    void seek(double seconds, TerminalModel& model, EscapeSequenceParser& parser);
+
+   private:
+    struct Checkpoint {
+        double time;
+        qint64 offset;
+        int rows;
+        int cols;
+    };
+
+    Recording() = default;
+
+    QFile m_file;
+    const char* m_data{nullptr};
+    qint64 m_size{0};
+    qint64 m_pos{0};
+    qint64 m_firstEvent{0};
+    int m_rows{24};
+    int m_cols{80};
+    double m_duration{0};
+    std::vector<Checkpoint> m_checkpoints;
+};
+
+#endif
@@ -0,0 +1,73 @@
+#include "replayer.h"
+#include "terminalmodel.h"
+#include "debug.h"
+
+#include <QMutexLocker>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+Replayer::Replayer(TerminalModel* model, std::unique_ptr<Recording> recording, QObject* parent)
+    : QObject(parent), m_model(model), m_recording(std::move(recording)), m_parser(model) {
+    m_timer.setSingleShot(true);
+    connect(&m_timer, &QTimer::timeout, this, &Replayer::advance);
+}
+
+Replayer::~Replayer() = default;
+
+void Replayer::play(double speed, double start) {
+    m_speed = std::max(speed, 0.0);
+    m_start = std::clamp(start, 0.0, m_recording->duration());
+    {
+        QMutexLocker lock(&m_model->mutex());
+        m_recording->seek(m_start, *m_model, m_parser);
+    }
+    m_model->notifyChanged();
+    m_pending = false;
+#ifdef ENABLE_DEBUG
+    DBG() << "Replaying from" << m_start << "s of" << m_recording->duration() << "s at speed" << m_speed;
+#endif
+    m_clock.start();
+    advance();
+}
+
+void Replayer::advance() {
+    const double now = m_speed > 0 ? m_start + double(m_clock.nsecsElapsed()) * 1e-9 * m_speed
+                                   : std::numeric_limits<double>::infinity();
+    std::size_t fed = 0;
+    bool done = false;
+    {
+        QMutexLocker lock(&m_model->mutex());
+        while (fed < kSliceBytes) {
+            if (!m_pending) {
+                if (!m_recording->next(m_event)) {
+                    done = true;
+                    break;
+                }
+                m_pending = true;
+            }
+            if (m_event.time > now)
+                break;
+            Recording::apply(m_event, *m_model, m_parser);
+            if (m_event.type == 'o')
+                fed += std::size_t(m_event.data.size());
+            m_pending = false;
+        }
+    }
+    m_model->notifyChanged(fed);
+
+    if (done) {
+#ifdef ENABLE_DEBUG
+        DBG() << "Replay finished";
+#endif
+        emit finished();
+        return;
+    }
+    if (fed >= kSliceBytes || m_speed == 0) {
+        m_timer.start(0);
+        return;
+    }
+    const double wait = (m_event.time - now) / m_speed;
+    m_timer.start(int(std::min(std::ceil(wait * 1000), double(std::numeric_limits<int>::max()))));
+}
@@ -0,0 +1,48 @@
+#ifndef REPLAYER_H
+#define REPLAYER_H
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QTimer>
+#include <cstddef>
+#include <memory>
+
+#include "escapeparser.h"
+#include "recording.h"
+
+class TerminalModel;
+
+// Plays a recording into a model on this thread's event loop, at speed times
+// the recorded pace or, with speed 0, as fast as the parser goes. Either way
+// at most kSliceBytes are parsed per turn, so the view keeps painting.
+class Replayer : public QObject {
+    Q_OBJECT
+
+   public:
+    static constexpr std::size_t kSliceBytes = 512 * 1024;
+
+    Replayer(TerminalModel* model, std::unique_ptr<Recording> recording, QObject* parent = nullptr);
+    ~Replayer() override;
+
+    // Restores the screen at start seconds and plays on from there.
+    void play(double speed, double start = 0);
+
+   signals:
+    void finished();
+
+   private:
+    void advance();
+
+    TerminalModel* m_model;
+    std::unique_ptr<Recording> m_recording;
+    EscapeSequenceParser m_parser;
+    Recording::Event m_event;
+    // m_event has been read but is not due yet.
+    bool m_pending{false};
+    double m_speed{1};
+    double m_start{0};
+    QElapsedTimer m_clock;
+    QTimer m_timer;
+};
+
+#endif
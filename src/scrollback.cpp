@@ -0,0 +1,640 @@
+#include "scrollback.h"
+#include "debug.h"
+
+#include <QDebug>
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+// Pages this close to the live screen stay uncompressed; they are what a
+// short scroll back touches.
+constexpr std::size_t kHotPages = 4;
+
+bool isBlank(const Cell& c) noexcept {
+    return c.ch == U' ' && c.attr == AttrTable::kDefault;
+}
+
+template <typename T>
+void appendRaw(QByteArray& out, const std::vector<T>& v) {
+    out.append(reinterpret_cast<const char*>(v.data()), qsizetype(v.size() * sizeof(T)));
+}
+
+template <typename T>
+const char* readRaw(const char* in, std::vector<T>& v, std::size_t n) {
+    v.resize(n);
+    std::memcpy(v.data(), in, n * sizeof(T));
+    return in + n * sizeof(T);
+}
+
+template <typename T>
+void sortUnique(std::vector<T>& v) {
+    std::sort(v.begin(), v.end());
+    v.erase(std::unique(v.begin(), v.end()), v.end());
+    v.shrink_to_fit();
+}
+}  // namespace
+
+Scrollback::Scrollback(const AttrTable* attrs) : m_attrs(attrs) {}
+Scrollback::~Scrollback() = default;
+
+std::size_t Scrollback::Page::indexBytes() const noexcept {
+    return sizeof(Page) + textStart.capacity() * sizeof(std::uint32_t) + prompts.capacity() * sizeof(std::uint16_t) +
+           spacers.capacity() / 8 + attrIds.capacity() * sizeof(AttrTable::Id) +
+           clusterIds.capacity() * sizeof(ClusterTable::Id);
+}
+
+std::size_t Scrollback::Page::bytes() const noexcept {
+    if (spilled)
+        return 0;
+    const std::size_t index = indexBytes() + sizeof(TrigramFilter);
+    if (!packed.isEmpty())
+        return index + std::size_t(packed.size());
+    return index + runStart.size() * sizeof(std::uint32_t) + text.size() * sizeof(char32_t) +
+           runs.size() * sizeof(AttrRun);
+}
+
+std::size_t Scrollback::setLimits(std::size_t maxLines, std::size_t memoryBudget) {
+    m_maxLines = std::max<std::size_t>(maxLines, 1);
+    m_memoryBudget = memoryBudget;
+    return enforceLimits();
+}
+
+std::size_t Scrollback::setWidth(int cols) {
+    cols = std::max(cols, 1);
+    if (cols == m_width)
+        return 0;
+
+    m_width = cols;
+    std::size_t next = 0;
+    for (const auto& page : m_pages) {
+        page->firstRow = next;
+        page->rows = countRows(*page, 0);
+        next += page->rows;
+    }
+    m_frontSkipRows = m_pages.empty() ? 0 : m_pages.front()->rows - countRows(*m_pages.front(), m_frontSkip);
+    m_rows = next - m_frontSkipRows;
+    m_lookupPage = nullptr;
+    return enforceLimits();
+}
+
+bool Scrollback::enableSpill(const QString& dir) {
+    if (!m_spill)
+        m_spill = SpillFile::create(dir);
+    return m_spill != nullptr;
+}
+
+std::size_t Scrollback::clear() {
+    const std::size_t dropped = m_rows;
+    m_pagesDropped += m_pages.size();
+    m_pages.clear();
+    if (m_spill)
+        m_spill->reset();
+    m_frontSkip = 0;
+    m_frontSkipRows = 0;
+    m_rows = 0;
+    m_bytes = 0;
+    m_spilledIndexBytes = 0;
+    m_open = false;
+    m_lastZone = Zone::None;
+    m_cachedFrom = nullptr;
+    m_lookupPage = nullptr;
+    return dropped;
+}
+
+std::size_t Scrollback::rowsFor(const Page& page, int line) const {
+    const std::size_t length = page.lineLength(line);
+    if (!page.mayHaveSpacers(line))
+        return length == 0 ? 1 : (length + std::size_t(m_width) - 1) / std::size_t(m_width);
+    std::size_t rows = 1;
+    for (std::size_t start = 0; (start = rowEnd(page, line, start)) < length;)
+        ++rows;
+    return rows;
+}
+
+std::size_t Scrollback::rowEnd(const Page& page, int line, std::size_t start) const {
+    const std::size_t base = page.textStart[std::size_t(line)];
+    return wrapRow(start, page.lineLength(line), m_width, [&](std::size_t i) {
+        return base + i < page.spacers.size() && page.spacers[base + i];
+    });
+}
+
+std::size_t Scrollback::rowOf(const Page& page, int line, std::size_t offset, std::size_t& start) const {
+    if (!page.mayHaveSpacers(line)) {
+        start = offset - offset % std::size_t(m_width);
+        return offset / std::size_t(m_width);
+    }
+    std::size_t row = 0;
+    start = 0;
+    for (std::size_t end; (end = rowEnd(page, line, start)) <= offset && end < page.lineLength(line); start = end)
+        ++row;
+    return row;
+}
+
+std::size_t Scrollback::countRows(const Page& page, int first) const {
+    std::size_t rows = 0;
+    for (int l = first; l < page.lines; ++l)
+        rows += rowsFor(page, l);
+    return rows;
+}
+
+std::size_t Scrollback::lineRow(const Page& page, int line) const {
+    std::size_t row = page.firstRow;
+    for (int l = 0; l < line; ++l)
+        row += rowsFor(page, l);
+    return row;
+}
+
+void Scrollback::appendCells(Page& page, const Cell* cells, int len, bool extend) {
+    // Trigrams that straddle the wrap need the two cells before it.
+    const std::size_t lineStart = page.textStart[std::size_t(page.lines) - 1];
+    const std::size_t indexFrom = std::max(lineStart, std::max<std::size_t>(page.text.size(), 2) - 2);
+
+    int c = 0;
+    if (extend && len > 0 && page.runs.size() > page.runStart[std::size_t(page.lines) - 1]) {
+        // Continue the line's last run across the wrap where possible.
+        AttrRun& last = page.runs.back();
+        while (c < len && cells[c].attr == last.attr && last.length < 0xFFFF) {
+            page.text.push_back(cells[c++].ch);
+            ++last.length;
+        }
+    }
+    while (c < len) {
+        const AttrTable::Id attr = cells[c].attr;
+        int end = c + 1;
+        while (end < len && cells[end].attr == attr && end - c < 0xFFFF)
+            ++end;
+        page.runs.push_back(AttrRun{std::uint16_t(end - c), attr});
+        for (; c < end; ++c)
+            page.text.push_back(cells[c].ch);
+    }
+    for (std::size_t k = page.textStart.back(); k < page.text.size(); ++k) {
+        if (page.text[k] == kWideSpacer) {
+            page.spacers.resize(std::max(page.spacers.size(), k + 1));
+            page.spacers[k] = true;
+        }
+    }
+    page.textStart.back() = std::uint32_t(page.text.size());
+    page.runStart.back() = std::uint32_t(page.runs.size());
+    page.filter->addText(page.text.data(), indexFrom, page.text.size());
+}
+
+std::size_t Scrollback::push(const Cell* cells, int cols, bool wrapped) {
+    bool extend = m_open && !m_pages.empty();
+    if (extend) {
+        const Page& page = *m_pages.back();
+        extend = page.lineLength(page.lines - 1) + std::size_t(cols) <= kMaxLineCells;
+    }
+
+    if (!extend && (m_pages.empty() || m_pages.back()->lines == kLinesPerPage)) {
+        std::size_t firstRow = 0;
+        if (!m_pages.empty()) {
+            Page& sealed = *m_pages.back();
+            m_bytes -= sealed.bytes();
+            sealed.textStart.shrink_to_fit();
+            sealed.runStart.shrink_to_fit();
+            sealed.text.shrink_to_fit();
+            sealed.runs.shrink_to_fit();
+            sealed.prompts.shrink_to_fit();
+            sealed.spacers.shrink_to_fit();
+            m_bytes += sealed.bytes();
+            firstRow = sealed.firstRow + sealed.rows;
+        }
+        if (m_pages.size() > kHotPages)
+            retire(*m_pages[m_pages.size() - 1 - kHotPages]);
+        m_pages.push_back(std::make_unique<Page>());
+        m_pages.back()->firstRow = firstRow;
+        m_bytes += m_pages.back()->bytes();
+    }
+
+    Page& page = *m_pages.back();
+    m_bytes -= page.bytes();
+
+    // A wrapped row is full by definition; its trailing blanks are text.
+    int len = cols;
+    if (!wrapped) {
+        while (len > 0 && isBlank(cells[len - 1]))
+            --len;
+    }
+
+    std::size_t oldRows = 0;
+    const int used = len;
+    if (extend) {
+        oldRows = rowsFor(page, page.lines - 1);
+        // The blank a wide character wrapped past is left out; laying the
+        // line out at this width puts it back.
+        if (cols > 1 && cells[1].isWideSpacer() && page.lineLength(page.lines - 1) > 0 && page.text.back() == U' ') {
+            page.text.pop_back();
+            if (--page.runs.back().length == 0)
+                page.runs.pop_back();
+            page.textStart.back() = std::uint32_t(page.text.size());
+            page.runStart.back() = std::uint32_t(page.runs.size());
+        }
+        // Keep the row even if it is blank, so the line still spans it.
+        if (len == 0)
+            len = 1;
+    }
+    else {
+        page.textStart.push_back(page.textStart.back());
+        page.runStart.push_back(page.runStart.back());
+        ++page.lines;
+        m_lineZone = m_lastZone;
+    }
+    appendCells(page, cells, len, extend);
+    if (m_attrs && startsPrompt(cells, used, *m_attrs, m_lastZone)) {
+        const auto line = std::uint16_t(page.lines - 1);
+        if (page.prompts.empty() || page.prompts.back() != line)
+            page.prompts.push_back(line);
+    }
+
+    const std::size_t newRows = rowsFor(page, page.lines - 1);
+    page.rows += newRows - oldRows;
+    m_rows += newRows - oldRows;
+    m_open = wrapped;
+
+    m_bytes += page.bytes();
+    return enforceLimits();
+}
+
+bool Scrollback::takeOpenLine(std::vector<Cell>& out) {
+    if (!m_open || m_pages.empty())
+        return false;
+    m_open = false;
+
+    // The newest page is always hot, so it is never packed.
+    Page& page = *m_pages.back();
+    const int line = page.lines - 1;
+    out.clear();
+    out.reserve(page.lineLength(line));
+    const char32_t* text = page.text.data() + page.textStart[std::size_t(line)];
+    for (std::uint32_t r = page.runStart[std::size_t(line)]; r < page.runStart[std::size_t(line) + 1]; ++r) {
+        for (int k = 0; k < page.runs[r].length; ++k)
+            out.push_back(Cell{*text++, page.runs[r].attr});
+    }
+
+    const std::size_t rows = rowsFor(page, line);
+    m_bytes -= page.bytes();
+    page.text.resize(page.textStart[std::size_t(line)]);
+    page.spacers.resize(std::min(page.spacers.size(), page.text.size()));
+    page.runs.resize(page.runStart[std::size_t(line)]);
+    page.textStart.pop_back();
+    page.runStart.pop_back();
+    if (!page.prompts.empty() && page.prompts.back() == line)
+        page.prompts.pop_back();
+    m_lastZone = m_lineZone;
+    --page.lines;
+    page.rows -= rows;
+    m_rows -= rows;
+    m_bytes += page.bytes();
+    m_lookupPage = nullptr;
+
+    if (page.lines == 0) {
+        m_bytes -= page.bytes();
+        m_pages.pop_back();
+        if (m_pages.empty())
+            m_frontSkip = 0;
+    }
+    return true;
+}
+
+bool Scrollback::copyLine(std::size_t i, Cell* dst, int cols) const {
+    if (i >= m_rows) {
+        std::fill(dst, dst + cols, Cell{});
+        return false;
+    }
+
+    // Find the page, then the line within it, then the row within the line.
+    const std::size_t target = m_pages.front()->firstRow + m_frontSkipRows + i;
+    const auto it = std::upper_bound(m_pages.begin(), m_pages.end(), target,
+                                     [](std::size_t row, const auto& p) { return row < p->firstRow; });
+    const Page& page = **std::prev(it);
+
+    int line = &page == m_pages.front().get() ? m_frontSkip : 0;
+    std::size_t lineRow = page.firstRow + (line ? m_frontSkipRows : 0);
+    if (m_lookupPage == &page && m_lookupRow <= target && m_lookupLine >= line) {
+        line = m_lookupLine;
+        lineRow = m_lookupRow;
+    }
+    std::size_t lineRows = rowsFor(page, line);
+    while (lineRow + lineRows <= target) {
+        lineRow += lineRows;
+        lineRows = rowsFor(page, ++line);
+    }
+    m_lookupPage = &page;
+    m_lookupLine = line;
+    m_lookupRow = lineRow;
+
+    const std::size_t seg = target - lineRow;
+    const bool lastLine = &page == m_pages.back().get() && line == page.lines - 1;
+    const bool wrapped = seg + 1 < lineRows || (m_open && lastLine);
+
+    const Page* data = resident(page);
+    if (!data) {
+        std::fill(dst, dst + cols, Cell{});
+        return wrapped;
+    }
+
+    std::size_t begin = seg * std::size_t(m_width);
+    if (page.mayHaveSpacers(line)) {
+        begin = 0;
+        for (std::size_t k = 0; k < seg; ++k)
+            begin = rowEnd(page, line, begin);
+    }
+    const std::size_t end = rowEnd(page, line, begin);
+    const char32_t* text = data->text.data() + page.textStart[std::size_t(line)];
+    std::size_t pos = 0;
+    int c = 0;
+    for (std::uint32_t r = data->runStart[std::size_t(line)];
+         r < data->runStart[std::size_t(line) + 1] && pos < end && c < cols; ++r) {
+        const AttrRun& run = data->runs[r];
+        const std::size_t runEnd = pos + run.length;
+        for (std::size_t k = std::max(pos, begin); k < std::min(runEnd, end) && c < cols; ++k, ++c) {
+            dst[c].ch = text[k];
+            dst[c].attr = run.attr;
+        }
+        pos = runEnd;
+    }
+    std::fill(dst + c, dst + cols, Cell{});
+    return wrapped;
+}
+
+std::size_t Scrollback::search(const SearchQuery& query, std::size_t first, std::size_t last, std::size_t maxLines,
+                              std::uint64_t rowBase, std::vector<SearchMatch>& out) const {
+    last = std::min(last, m_rows);
+    if (first >= last)
+        return first;
+
+    const std::size_t base = m_pages.front()->firstRow + m_frontSkipRows;
+    const std::size_t lo = base + first;
+    std::size_t resume = base + last;
+    auto it = std::upper_bound(m_pages.begin(), m_pages.end(), resume - 1,
+                               [](std::size_t row, const auto& p) { return row < p->firstRow; });
+
+    std::vector<std::size_t> lineRows;
+    std::vector<SearchQuery::Hit> hits;
+    std::size_t scanned = 0;
+    while (it != m_pages.begin()) {
+        const Page& page = **--it;
+        const bool front = it == m_pages.begin();
+        const int firstLine = front ? m_frontSkip : 0;
+        const std::size_t pageRow = page.firstRow + (front ? m_frontSkipRows : 0);
+
+        if (!mayMatch(page, query)) {
+            if (pageRow <= lo)
+                return first;
+            resume = pageRow;
+            continue;
+        }
+
+        lineRows.clear();
+        for (int l = firstLine; l < page.lines; ++l)
+            lineRows.push_back(lineRows.empty() ? pageRow : lineRows.back() + rowsFor(page, l - 1));
+
+        const Page* data = resident(page);
+        for (int l = page.lines - 1; l >= firstLine; --l) {
+            const std::size_t row = lineRows[std::size_t(l - firstLine)];
+            if (row >= resume)
+                continue;
+            if (row < lo)
+                return first;
+            if (scanned == maxLines)
+                return resume - base;
+
+            if (data) {
+                hits.clear();
+                query.match(data->text.data() + page.textStart[std::size_t(l)], page.lineLength(l), hits);
+                for (const SearchQuery::Hit& hit : hits) {
+                    std::size_t start;
+                    const std::size_t seg = rowOf(page, l, hit.start, start);
+                    out.push_back(SearchMatch{rowBase + (row - base) + seg, int(hit.start - start), int(hit.length)});
+                }
+            }
+            ++scanned;
+            resume = row;
+        }
+    }
+    return first;
+}
+
+std::optional<std::size_t> Scrollback::promptBefore(std::size_t row) const {
+    if (m_pages.empty())
+        return std::nullopt;
+
+    const std::size_t base = m_pages.front()->firstRow + m_frontSkipRows;
+    const std::size_t target = base + std::min(row, m_rows);
+    auto it = std::upper_bound(m_pages.begin(), m_pages.end(), target,
+                               [](std::size_t r, const auto& p) { return r < p->firstRow; });
+    while (it != m_pages.begin()) {
+        const Page& page = **--it;
+        const int skip = &page == m_pages.front().get() ? m_frontSkip : 0;
+        for (auto l = page.prompts.rbegin(); l != page.prompts.rend() && *l >= skip; ++l) {
+            const std::size_t r = lineRow(page, *l);
+            if (r < target)
+                return r - base;
+        }
+    }
+    return std::nullopt;
+}
+
+std::optional<std::size_t> Scrollback::promptAfter(std::size_t row) const {
+    if (m_pages.empty() || row >= m_rows)
+        return std::nullopt;
+
+    const std::size_t base = m_pages.front()->firstRow + m_frontSkipRows;
+    const std::size_t target = base + row;
+    auto it = std::upper_bound(m_pages.begin(), m_pages.end(), target,
+                               [](std::size_t r, const auto& p) { return r < p->firstRow; });
+    for (it = std::prev(it); it != m_pages.end(); ++it) {
+        const Page& page = **it;
+        const int skip = &page == m_pages.front().get() ? m_frontSkip : 0;
+        for (std::uint16_t l : page.prompts) {
+            const std::size_t r = lineRow(page, l);
+            if (l >= skip && r > target)
+                return r - base;
+        }
+    }
+    return std::nullopt;
+}
+
+void Scrollback::markUsed(std::vector<bool>& attrs, std::vector<bool>& clusters) const {
+    for (const auto& page : m_pages) {
+        if (page->spilled || !page->packed.isEmpty()) {
+            for (AttrTable::Id id : page->attrIds)
+                attrs[id] = true;
+            for (ClusterTable::Id id : page->clusterIds)
+                clusters[id] = true;
+            continue;
+        }
+        for (const AttrRun& run : page->runs)
+            attrs[run.attr] = true;
+        for (char32_t ch : page->text) {
+            if (const Cell cell{ch}; cell.isCluster())
+                clusters[cell.cluster()] = true;
+        }
+    }
+}
+
+void Scrollback::retire(Page& page) {
+    if (page.spilled || (!m_compress && !m_spill))
+        return;
+
+    m_bytes -= page.bytes();
+    if (page.packed.isEmpty())
+        pack(page, m_spill != nullptr);
+    if (m_spill && !page.packed.isEmpty()) {
+        QByteArray extent(reinterpret_cast<const char*>(page.filter.get()), qsizetype(sizeof(TrigramFilter)));
+        extent += page.packed;
+        if (m_spill->write(extent, page.spill)) {
+            page.spilled = true;
+            page.packed = QByteArray();
+            page.filter.reset();
+            m_spilledIndexBytes += page.indexBytes();
+        }
+    }
+    m_bytes += page.bytes();
+}
+
+bool Scrollback::mayMatch(const Page& page, const SearchQuery& query) const {
+    if (!page.spilled)
+        return query.mayMatch(*page.filter);
+
+    const char* data = m_spill->map(page.spill);
+    if (!data)
+        return false;
+    TrigramFilter filter;
+    std::memcpy(&filter, data, sizeof(TrigramFilter));
+    m_spill->release(page.spill);
+    return query.mayMatch(filter);
+}
+
+const Scrollback::Page* Scrollback::resident(const Page& page) const {
+    if (!page.spilled && page.packed.isEmpty())
+        return &page;
+    if (m_cachedFrom == &page)
+        return &m_cache;
+
+    bool unpacked = false;
+    if (page.spilled) {
+        if (const char* data = m_spill->map(page.spill)) {
+            unpacked = unpack(page, data + sizeof(TrigramFilter), qsizetype(page.spill.size - sizeof(TrigramFilter)),
+                              m_cache);
+            m_spill->release(page.spill);
+        }
+    }
+    else {
+        unpacked = unpack(page, page.packed.constData(), page.packed.size(), m_cache);
+    }
+    if (!unpacked) {
+        m_cachedFrom = nullptr;
+        return nullptr;
+    }
+    m_cachedFrom = &page;
+    return &m_cache;
+}
+
+bool Scrollback::pack(Page& page, bool force) {
+    QByteArray raw;
+    raw.reserve(qsizetype(page.runStart.size() * sizeof(std::uint32_t) + page.text.size() * sizeof(char32_t) +
+                          page.runs.size() * sizeof(AttrRun)));
+    appendRaw(raw, page.runStart);
+    appendRaw(raw, page.text);
+    appendRaw(raw, page.runs);
+
+    QByteArray packed = qCompress(raw, 1);
+    if (packed.size() >= raw.size() && !force)
+        return false;
+
+    page.attrIds.clear();
+    for (const AttrRun& run : page.runs)
+        page.attrIds.push_back(run.attr);
+    page.clusterIds.clear();
+    for (char32_t ch : page.text) {
+        if (const Cell cell{ch}; cell.isCluster())
+            page.clusterIds.push_back(cell.cluster());
+    }
+    sortUnique(page.attrIds);
+    sortUnique(page.clusterIds);
+
+    page.packed = std::move(packed);
+    page.textCount = std::uint32_t(page.text.size());
+    page.runCount = std::uint32_t(page.runs.size());
+    page.runStart = {};
+    page.text = {};
+    page.runs = {};
+    return true;
+}
+
+bool Scrollback::unpack(const Page& page, const char* data, qsizetype size, Page& out) {
+    const QByteArray raw = qUncompress(reinterpret_cast<const uchar*>(data), size);
+    const std::size_t expected = (std::size_t(page.lines) + 1) * sizeof(std::uint32_t) +
+                                 page.textCount * sizeof(char32_t) + page.runCount * sizeof(AttrRun);
+    if (std::size_t(raw.size()) != expected) {
+        qWarning() << "Scrollback page did not unpack:" << raw.size() << "bytes instead of" << expected;
+        return false;
+    }
+    const char* in = raw.constData();
+
+    out.lines = page.lines;
+    in = readRaw(in, out.runStart, std::size_t(page.lines) + 1);
+    in = readRaw(in, out.text, page.textCount);
+    readRaw(in, out.runs, page.runCount);
+    return true;
+}
+
+std::size_t Scrollback::enforceLimits() {
+    std::size_t dropped = 0;
+
+    while (m_rows > m_maxLines)
+        dropped += dropFrontLine();
+
+    while (m_bytes > m_memoryBudget && m_pages.size() > 1) {
+        if (m_pages.front()->spilled) {
+            // Spilled pages cost the budget nothing. Dropping them only helps
+            // on the way to a cold page still on the heap, not for the hot ones.
+            const auto hot = m_pages.end() - std::ptrdiff_t(std::min(m_pages.size(), kHotPages + 1));
+            if (std::find_if(m_pages.begin(), hot, [](const auto& p) { return !p->spilled; }) == hot)
+                break;
+        }
+        const std::size_t take = m_pages.front()->rows - m_frontSkipRows;
+        m_rows -= take;
+        dropped += take;
+        dropFrontPage();
+    }
+
+#ifdef ENABLE_DEBUG
+    if (dropped) {
+        DBG() << "Scrollback dropped" << dropped << "rows, now" << m_rows << "rows in" << m_bytes << "bytes";
+    }
+#endif
+    return dropped;
+}
+
+std::size_t Scrollback::dropFrontLine() {
+    Page& front = *m_pages.front();
+    const std::size_t rows = rowsFor(front, m_frontSkip);
+    ++m_frontSkip;
+    m_frontSkipRows += rows;
+    m_rows -= rows;
+    if (m_frontSkip == front.lines) {
+        if (m_pages.size() == 1)
+            m_open = false;
+        dropFrontPage();
+    }
+    m_lookupPage = nullptr;
+    return rows;
+}
+
+void Scrollback::dropFrontPage() {
+    if (m_cachedFrom == m_pages.front().get())
+        m_cachedFrom = nullptr;
+    if (m_pages.front()->spilled) {
+        m_spill->discard(m_pages.front()->spill);
+        m_spilledIndexBytes -= m_pages.front()->indexBytes();
+    }
+    m_bytes -= m_pages.front()->bytes();
+    m_pages.pop_front();
+    ++m_pagesDropped;
+    m_frontSkip = 0;
+    m_frontSkipRows = 0;
+    m_lookupPage = nullptr;
+}
@@ -0,0 +1,200 @@
+#ifndef SCROLLBACK_H
+#define SCROLLBACK_H
+
+#include <QByteArray>
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "spillfile.h"
+#include "terminalmodel.h"
+#include "textsearch.h"
+
+// History that has scrolled off the top of the main screen. Rows that were
+// soft-wrapped are joined back into logical lines, which are packed into
+// fixed-size pages: trailing blanks are trimmed, attributes are stored as
+// runs, and pages older than the few most recent ones are zlib-compressed.
+// With a spill file, those cold pages are written to disk instead of being
+// kept on the heap. Oldest lines are dropped to stay within both a line limit
+// and a heap budget for the pages in memory. A spilled page only leaves its
+// line lengths, spacers, prompts and ids behind, which the budget does not
+// count. Not thread-safe; the model's mutex guards it.
+//
+// Rows are addressed at the current width(). Changing it only recounts rows
+// from the per-line lengths and where wide characters sit, which stay
+// uncompressed; the text itself is rewrapped as rows are read, so a resize
+// reflows all of history without touching more than what is painted.
+//
+// Each page also keeps a trigram filter of its text, built as lines arrive
+// and spilled along with the text, so a search only decompresses the pages
+// that may hold a match. Given the
+// attribute table, it likewise lists the lines where an OSC 133 prompt
+// starts, so finding the previous or next one never reads the text.
+class Scrollback {
+   public:
+    static constexpr int kLinesPerPage = 256;
+    // A soft-wrapped line growing past this is split, so a single runaway
+    // line cannot keep its page from ever being dropped.
+    static constexpr std::size_t kMaxLineCells = 64 * 1024;
+    static constexpr std::size_t kDefaultMaxLines = 100000;
+    static constexpr std::size_t kDefaultMemoryBudget = std::size_t(64) << 20;
+
+    explicit Scrollback(const AttrTable* attrs = nullptr);
+    ~Scrollback();
+
+    // These return the number of rows dropped from the front as a result.
+    std::size_t setLimits(std::size_t maxLines, std::size_t memoryBudget);
+    std::size_t setWidth(int cols);
+    // wrapped means the row continues on the next one pushed (or on the
+    // screen's first row, until it is pushed too).
+    std::size_t push(const Cell* cells, int cols, bool wrapped);
+    std::size_t clear();
+
+    // If the newest line continues onto the screen, removes it and fills out
+    // with its cells, so the screen can be reflowed together with it.
+    bool takeOpenLine(std::vector<Cell>& out);
+
+    void setCompression(bool on) noexcept { m_compress = on; }
+    // Cold pages go to a file in dir from now on. Returns false if the file
+    // could not be created.
+    bool enableSpill(const QString& dir);
+    bool spilling() const noexcept { return m_spill != nullptr; }
+
+    int width() const noexcept { return m_width; }
+    std::size_t size() const noexcept { return m_rows; }
+    std::size_t maxLines() const noexcept { return m_maxLines; }
+    std::size_t memoryBudget() const noexcept { return m_memoryBudget; }
+    // Heap in use, spilled pages' indexes included.
+    std::size_t memoryUsage() const noexcept { return m_bytes + m_spilledIndexBytes; }
+
+    // Copies row i (0 is the oldest retained row) into dst, padded with
+    // blanks or clipped to cols. Returns true if the row is soft-wrapped.
+    bool copyLine(std::size_t i, Cell* dst, int cols) const;
+
+    // Runs query over the lines starting in rows [first, last), newest first,
+    // looking at no more than maxLines of them. Matches are appended with
+    // rowBase added to their row. Returns the row the scan stopped at: every
+    // line starting at or after it has been searched, so first means done.
+    std::size_t search(const SearchQuery& query, std::size_t first, std::size_t last, std::size_t maxLines,
+                       std::uint64_t rowBase, std::vector<SearchMatch>& out) const;
+
+    // The first row of the last line starting a prompt above row, or of the
+    // first one below it.
+    std::optional<std::size_t> promptBefore(std::size_t row) const;
+    std::optional<std::size_t> promptAfter(std::size_t row) const;
+    // The zone the newest line ends in, which the screen's first row follows.
+    Zone lastZone() const noexcept { return m_lastZone; }
+
+    // Sets, by id, the attributes and clusters history refers to.
+    void markUsed(std::vector<bool>& attrs, std::vector<bool>& clusters) const;
+    // Pages dropped from the front so far, each of which may have held the
+    // last use of some ids.
+    std::size_t pagesDropped() const noexcept { return m_pagesDropped; }
+
+   private:
+    struct AttrRun {
+        std::uint16_t length;
+        AttrTable::Id attr;
+    };
+
+    struct Page {
+        int lines{0};
+        // Rows the lines take at the current width, and the absolute index of
+        // the first one.
+        std::size_t rows{0};
+        std::size_t firstRow{0};
+        // Per-line offsets into text and runs; lines + 1 entries each.
+        // textStart is never packed: it holds the lengths rows are counted by.
+        std::vector<std::uint32_t> textStart{0};
+        std::vector<std::uint32_t> runStart{0};
+        std::vector<char32_t> text;
+        std::vector<AttrRun> runs;
+        // Never packed, and only ever added to: a line taken back out leaves
+        // its trigrams behind as harmless false positives. A spilled page has
+        // it at the start of its extent instead.
+        std::unique_ptr<TrigramFilter> filter{std::make_unique<TrigramFilter>()};
+        // Lines starting a prompt, ascending; never packed either.
+        std::vector<std::uint16_t> prompts;
+        // Set at each text offset holding a kWideSpacer, up to the last one,
+        // so rows are counted without the text. Never packed.
+        std::vector<bool> spacers;
+        // Set when packing: the ids runs and text refer to, so markUsed()
+        // never unpacks.
+        std::vector<AttrTable::Id> attrIds;
+        std::vector<ClusterTable::Id> clusterIds;
+
+        // When non-empty the vectors above are released and live here instead,
+        // or in the spill file at spill when spilled is set.
+        QByteArray packed;
+        std::uint32_t textCount{0};
+        std::uint32_t runCount{0};
+        bool spilled{false};
+        SpillFile::Extent spill;
+
+        // What the page holds on the heap: the index, which a spilled page
+        // keeps, and what the memory budget counts, which it does not.
+        std::size_t indexBytes() const noexcept;
+        std::size_t bytes() const noexcept;
+        std::size_t lineLength(int line) const noexcept { return textStart[line + 1] - textStart[line]; }
+        bool mayHaveSpacers(int line) const noexcept { return spacers.size() > textStart[line]; }
+    };
+
+    // Lines are laid out at the current width with wrapRow(), so a wide
+    // character is never split; only lines that may hold one need walking.
+    std::size_t rowsFor(const Page& page, int line) const;
+    std::size_t rowEnd(const Page& page, int line, std::size_t start) const;
+    // The row of line holding offset, and where it starts.
+    std::size_t rowOf(const Page& page, int line, std::size_t offset, std::size_t& start) const;
+
+    static bool pack(Page& page, bool force);
+    // False, with a warning, if data does not hold what page says it does.
+    static bool unpack(const Page& page, const char* data, qsizetype size, Page& out);
+    const Page* resident(const Page& page) const;
+    bool mayMatch(const Page& page, const SearchQuery& query) const;
+    void retire(Page& page);
+    void appendCells(Page& page, const Cell* cells, int len, bool extend);
+    std::size_t countRows(const Page& page, int first) const;
+    std::size_t lineRow(const Page& page, int line) const;
+
+    std::size_t enforceLimits();
+    std::size_t dropFrontLine();
+    void dropFrontPage();
+
+    std::deque<std::unique_ptr<Page>> m_pages;
+    int m_width{80};
+    // Lines of the front page already dropped, and the rows they took.
+    int m_frontSkip{0};
+    std::size_t m_frontSkipRows{0};
+    std::size_t m_rows{0};
+    std::size_t m_bytes{0};
+    std::size_t m_spilledIndexBytes{0};
+    bool m_open{false};
+    std::size_t m_pagesDropped{0};
+
+    std::size_t m_maxLines{kDefaultMaxLines};
+    std::size_t m_memoryBudget{kDefaultMemoryBudget};
+    bool m_compress{true};
+    std::unique_ptr<SpillFile> m_spill;
+
+    const AttrTable* m_attrs;
+    Zone m_lastZone{Zone::None};
+    // What m_lastZone was before the newest line, for takeOpenLine().
+    Zone m_lineZone{Zone::None};
+
+    // Last compressed page that was read back, so painting or selecting
+    // consecutive lines decompresses it once.
+    mutable const Page* m_cachedFrom{nullptr};
+    mutable Page m_cache;
+
+    // Where the last row lookup landed, so consecutive rows of a page do
+    // not rescan it from the top.
+    mutable const Page* m_lookupPage{nullptr};
+    mutable int m_lookupLine{0};
+    mutable std::size_t m_lookupRow{0};
+};
+
+#endif
@@ -0,0 +1,45 @@
+#include "selection.h"
+#include "terminalmodel.h"
+#include "utf8decoder.h"
+
+#include <vector>
+
+int Selection::appendText(const TerminalModel& model, int first, int last, QByteArray& out, int dropped) const {
+    first = std::max(first, m_top);
+    last = std::min(last, m_bottom);
+    const int cols = model.cols();
+    const ClusterTable& clusters = model.clusters();
+    std::vector<Cell> cells;
+    cells.reserve(std::size_t(cols));
+
+    for (int line = first; line <= last; ++line) {
+        bool wrapped = false;
+        if (!model.copyAbsoluteLine(line - dropped, cells, &wrapped))
+            continue;
+
+        const Span s = span(line);
+        int c = std::max(s.first, 0);
+        const int end = std::min(s.last, cols - 1) + 1;
+        const bool joined = !m_block && wrapped && end == cols;
+        int stop = end;
+        if (!joined) {
+            while (stop > c && (cells[std::size_t(stop - 1)].ch == U' ' || cells[std::size_t(stop - 1)].isWideSpacer()))
+                --stop;
+        }
+        for (; c < stop; ++c) {
+            const Cell& cell = cells[std::size_t(c)];
+            if (cell.isWideSpacer())
+                continue;
+            if (cell.isCluster()) {
+                for (char32_t ch : clusters[cell.cluster()])
+                    appendUtf8(out, ch);
+            }
+            else {
+                appendUtf8(out, cell.ch);
+            }
+        }
+        if (line < m_bottom && !joined)
+            out += '\n';
+    }
+    return std::max(last - first + 1, 0);
+}
@@ -0,0 +1,86 @@
+#ifndef SELECTION_H
+#define SELECTION_H
+
+#include <QByteArray>
+
+#include <algorithm>
+#include <limits>
+
+class TerminalModel;
+
+// A selected region of the grid in absolute lines, from the anchor where the
+// drag started to the active end under the pointer. A linear selection runs
+// between the two in reading order; a block selection takes the same columns
+// on every line. The bounds are worked out whenever an end moves, so painting
+// and hit tests only compare against them.
+class Selection {
+   public:
+    // Inclusive columns of one line; last is open-ended (INT_MAX) when a
+    // linear selection runs on past the end of the line.
+    struct Span {
+        int first{0};
+        int last{-1};
+        bool empty() const noexcept { return first > last; }
+    };
+
+    Selection() = default;
+    Selection(int line, int col, bool block = false) noexcept
+        : m_anchorLine(line), m_anchorCol(col), m_activeLine(line), m_activeCol(col), m_block(block) {
+        normalize();
+    }
+
+    void extend(int line, int col) noexcept {
+        m_activeLine = line;
+        m_activeCol = col;
+        normalize();
+    }
+
+    bool block() const noexcept { return m_block; }
+    bool isEmpty() const noexcept { return m_anchorLine == m_activeLine && m_anchorCol == m_activeCol; }
+    int anchorLine() const noexcept { return m_anchorLine; }
+    int topLine() const noexcept { return m_top; }
+    int bottomLine() const noexcept { return m_bottom; }
+    int lineCount() const noexcept { return m_bottom - m_top + 1; }
+
+    Span span(int line) const noexcept {
+        if (line < m_top || line > m_bottom)
+            return {};
+        if (m_block)
+            return {m_left, m_right};
+        return {line == m_top ? m_topCol : 0, line == m_bottom ? m_bottomCol : std::numeric_limits<int>::max()};
+    }
+    bool contains(int line, int col) const noexcept {
+        const Span s = span(line);
+        return col >= s.first && col <= s.last;
+    }
+
+    // Appends the text of selected lines [first, last] as UTF-8 and returns
+    // the number of lines read. Rows are separated by '\n' and lose their
+    // trailing blanks, except that a linear selection joins a soft-wrapped
+    // row to the next one unchanged. History dropped since the selection was
+    // made moves its lines up by dropped; lines gone with it are skipped.
+    // The caller holds the model mutex.
+    int appendText(const TerminalModel& model, int first, int last, QByteArray& out, int dropped = 0) const;
+
+   private:
+    void normalize() noexcept {
+        const bool forward =
+            m_anchorLine < m_activeLine || (m_anchorLine == m_activeLine && m_anchorCol <= m_activeCol);
+        m_top = std::min(m_anchorLine, m_activeLine);
+        m_bottom = std::max(m_anchorLine, m_activeLine);
+        m_topCol = forward ? m_anchorCol : m_activeCol;
+        m_bottomCol = forward ? m_activeCol : m_anchorCol;
+        m_left = std::min(m_anchorCol, m_activeCol);
+        m_right = std::max(m_anchorCol, m_activeCol);
+    }
+
+    int m_anchorLine{0}, m_anchorCol{0};
+    int m_activeLine{0}, m_activeCol{0};
+    bool m_block{false};
+
+    int m_top{0}, m_bottom{0};
+    int m_topCol{0}, m_bottomCol{0};
+    int m_left{0}, m_right{0};
+};
+
+#endif
@@ -0,0 +1,288 @@
+#include "session.h"
+#include "childreaper.h"
+#include "metrics.h"
+#include "ptyscheduler.h"
+#include "ptyworker.h"
+#include "recording.h"
+#include "replayer.h"
+#include "terminalmodel.h"
+#include "terminalwidget.h"
+#include "debug.h"
+
+#include <QCheckBox>
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QHBoxLayout>
+#include <QKeySequence>
+#include <QLabel>
+#include <QLineEdit>
+#include <QMetaObject>
+#include <QMutexLocker>
+#include <QShortcut>
+#include <QThread>
+#include <QVBoxLayout>
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <limits>
+#include <pty.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+// The forked child reports with write(2) alone: another thread may have held
+// the allocator's or Qt's locks at fork(), so nothing that can take one runs
+// before exec.
+[[noreturn]] void childFailed(const char* message) {
+    const std::size_t len = std::strlen(message);
+    ssize_t n;
+    do {
+        n = ::write(STDERR_FILENO, message, len);
+    } while (n < 0 && errno == EINTR);
+    _exit(127);
+}
+}  // namespace
+
+Session::Session(const SessionConfig& config, QThread* ioThread, PtyScheduler* scheduler, ChildReaper* reaper,
+                 QWidget* parent)
+    : QWidget(parent),
+      m_model(new TerminalModel(kDefaultRows, kDefaultCols, this)),
+      m_terminalWidget(new TerminalWidget(m_model, this)),
+      m_worker(new PtyWorker(m_model, scheduler)),
+      m_reaper(reaper),
+      m_recordDir(config.recordDir) {
+    auto* layout = new QVBoxLayout(this);
+    layout->setContentsMargins(0, 0, 0, 0);
+    layout->addWidget(m_terminalWidget);
+    setFocusProxy(m_terminalWidget);
+    if (config.gpuRendering)
+        m_terminalWidget->useGpuRenderer();
+    m_terminalWidget->setLowLatencyEcho(config.lowLatencyEcho);
+    createFindBar();
+    layout->addWidget(m_findBar);
+
+    {
+        QMutexLocker lock(&m_model->mutex());
+        std::size_t lines = config.scrollbackLines.value_or(Scrollback::kDefaultMaxLines);
+        // History on disk is only bounded when a line limit is given explicitly.
+        if (!config.spillDir.isEmpty() && m_model->enableScrollbackSpill(config.spillDir) && !config.scrollbackLines)
+            lines = std::numeric_limits<int>::max();
+        m_model->setScrollbackLimits(lines, config.scrollbackMemory, config.compressScrollback);
+    }
+
+    m_worker->moveToThread(ioThread);
+    connect(m_terminalWidget, &TerminalWidget::ptyInput, m_worker, &PtyWorker::write);
+    connect(m_worker, &PtyWorker::writeOverflow, m_terminalWidget, &TerminalWidget::handleBell);
+    connect(m_worker, &PtyWorker::shellExited, this, [this] { emit finished(this); });
+    connect(m_model, &TerminalModel::titleChanged, this, [this](const QString& title) {
+        m_title = title;
+        emit titleChanged(this, title);
+    });
+}
+
+Session::~Session() {
+    // The worker lives on the shared I/O thread; stop and free it there.
+    QMetaObject::invokeMethod(
+        m_worker,
+        [worker = m_worker] {
+            worker->stop();
+            delete worker;
+        },
+        Qt::BlockingQueuedConnection);
+
+    if (m_masterFD >= 0) {
+#ifdef ENABLE_DEBUG
+        DBG() << "Closing master FD:" << m_masterFD;
+#endif
+        ::close(m_masterFD);
+    }
+
+    // The closed master hangs the shell up, but it has not exited yet.
+    if (m_shellPid > 0)
+        m_reaper->reap(m_shellPid);
+}
+
+const Metrics& Session::metrics() const noexcept {
+    return m_model->metrics();
+}
+
+void Session::createFindBar() {
+    m_findBar = new QWidget(this);
+    m_findEdit = new QLineEdit(m_findBar);
+    m_findCase = new QCheckBox(QStringLiteral("Match case"), m_findBar);
+    m_findRegex = new QCheckBox(QStringLiteral("Regex"), m_findBar);
+    m_findStatus = new QLabel(m_findBar);
+
+    auto* layout = new QHBoxLayout(m_findBar);
+    layout->setContentsMargins(4, 2, 4, 2);
+    layout->addWidget(m_findEdit, 1);
+    layout->addWidget(m_findCase);
+    layout->addWidget(m_findRegex);
+    layout->addWidget(m_findStatus);
+    m_findEdit->setPlaceholderText(QStringLiteral("Find in scrollback"));
+    m_findEdit->setClearButtonEnabled(true);
+    m_findBar->hide();
+
+    // Return goes to older matches, as the newest is shown first.
+    connect(m_findEdit, &QLineEdit::textChanged, this, &Session::runFind);
+    connect(m_findCase, &QCheckBox::toggled, this, &Session::runFind);
+    connect(m_findRegex, &QCheckBox::toggled, this, &Session::runFind);
+    connect(m_findEdit, &QLineEdit::returnPressed, this, [this] { m_terminalWidget->findNext(true); });
+    auto* newer = new QShortcut(QKeySequence(Qt::SHIFT | Qt::Key_Return), m_findBar);
+    newer->setContext(Qt::WidgetWithChildrenShortcut);
+    connect(newer, &QShortcut::activated, this, [this] { m_terminalWidget->findNext(false); });
+    auto* close = new QShortcut(QKeySequence(Qt::Key_Escape), m_findBar);
+    close->setContext(Qt::WidgetWithChildrenShortcut);
+    connect(close, &QShortcut::activated, this, &Session::hideFindBar);
+
+    connect(m_terminalWidget, &TerminalWidget::searchProgress, this, [this](int matches, bool complete) {
+        const QString text = QStringLiteral("%1 matches").arg(matches);
+        m_findStatus->setText(complete ? text : text + QStringLiteral("..."));
+    });
+}
+
+void Session::showFindBar() {
+    m_findBar->show();
+    m_findEdit->setFocus();
+    m_findEdit->selectAll();
+}
+
+void Session::hideFindBar() {
+    m_findBar->hide();
+    m_terminalWidget->clearSearch();
+    m_findStatus->setText(QString());
+    m_terminalWidget->setFocus();
+}
+
+void Session::runFind() {
+    const QString pattern = m_findEdit->text();
+    if (!m_terminalWidget->find(pattern, m_findRegex->isChecked(), m_findCase->isChecked()))
+        m_findStatus->setText(pattern.isEmpty() ? QString() : QStringLiteral("Invalid pattern"));
+}
+
+std::optional<ShellProcess> Session::spawnShell(const QString& shellPath, int rows, int cols) {
+    const QByteArray shell = shellPath.toLocal8Bit();
+
+    struct winsize ws;
+    std::memset(&ws, 0, sizeof(ws));
+    ws.ws_row = static_cast<unsigned short>(rows);
+    ws.ws_col = static_cast<unsigned short>(cols);
+
+    int masterFD, slaveFD;
+    if (openpty(&masterFD, &slaveFD, nullptr, nullptr, &ws) < 0) {
+        qWarning() << "openpty failed:" << strerror(errno);
+        return std::nullopt;
+    }
+#ifdef ENABLE_DEBUG
+    DBG() << "openpty master FD:" << masterFD << "slave FD:" << slaveFD;
+#endif
+
+    fcntl(masterFD, F_SETFL, fcntl(masterFD, F_GETFL) | O_NONBLOCK);
+    fcntl(masterFD, F_SETFD, FD_CLOEXEC);
+
+    // Everything the child needs is built here, it must not allocate.
+    std::vector<char*> env;
+    bool hasTerm = false;
+    for (char** e = environ; *e; ++e) {
+        hasTerm = hasTerm || std::strncmp(*e, "TERM=", 5) == 0;
+        env.push_back(*e);
+    }
+    if (!hasTerm)
+        env.push_back(const_cast<char*>("TERM=xterm-256color"));
+    env.push_back(nullptr);
+    char* const argv[] = {const_cast<char*>(shell.constData()), const_cast<char*>("-i"), nullptr};
+    const QByteArray execFailed = "1t: cannot run " + shell + '\n';
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        qWarning() << "fork failed:" << strerror(errno);
+        ::close(masterFD);
+        ::close(slaveFD);
+        return std::nullopt;
+    }
+    if (pid == 0) {
+        ::close(masterFD);
+        setsid();
+        if (ioctl(slaveFD, TIOCSCTTY, 0) < 0)
+            childFailed("1t: cannot set the controlling terminal\n");
+        dup2(slaveFD, STDIN_FILENO);
+        dup2(slaveFD, STDOUT_FILENO);
+        dup2(slaveFD, STDERR_FILENO);
+        ::close(slaveFD);
+
+        ::execve(shell.constData(), argv, env.data());
+        childFailed(execFailed.constData());
+    }
+
+    ::close(slaveFD);
+    StartupTiming::instance().mark(StartupTiming::Milestone::ShellSpawned);
+#ifdef ENABLE_DEBUG
+    DBG() << "Spawned shell PID:" << pid << "masterFD:" << masterFD;
+#endif
+    return ShellProcess{masterFD, pid};
+}
+
+bool Session::launchShell(const QString& shellPath) {
+    int rows, cols;
+    {
+        QMutexLocker lock(&m_model->mutex());
+        rows = m_model->rows();
+        cols = m_model->cols();
+    }
+    const std::optional<ShellProcess> shell = spawnShell(shellPath, rows, cols);
+    if (!shell)
+        return false;
+    attachShell(*shell, shellPath);
+    return true;
+}
+
+void Session::attachShell(const ShellProcess& shell, const QString& shellPath) {
+    m_title = QFileInfo(shellPath).fileName();
+    m_shellPid = shell.pid;
+    m_masterFD = shell.masterFD;
+    // The PTY takes the view's size first, so a recording starts out at it.
+    m_terminalWidget->setPtyInfo(m_masterFD, m_shellPid);
+
+    if (!m_recordDir.isEmpty()) {
+        static int recordings = 0;
+        const QString name = QStringLiteral("1t-%1-%2-%3.cast")
+                                 .arg(QDateTime::currentDateTime().toString(QStringLiteral("yyyyMMdd-HHmmss")))
+                                 .arg(::getpid())
+                                 .arg(++recordings);
+        int rows, cols;
+        {
+            QMutexLocker lock(&m_model->mutex());
+            rows = m_model->rows();
+            cols = m_model->cols();
+        }
+        // The worker has not started yet, so it can be handed over from here.
+        if (auto recorder = Recorder::create(QDir(m_recordDir).filePath(name), rows, cols))
+            m_worker->setRecorder(std::move(recorder));
+    }
+
+#ifdef ENABLE_DEBUG
+    DBG() << "Attached shell PID:" << m_shellPid << "masterFD:" << m_masterFD;
+#endif
+
+    QMetaObject::invokeMethod(
+        m_worker, [worker = m_worker, masterFD = m_masterFD, pid = m_shellPid] { worker->start(masterFD, pid); },
+        Qt::QueuedConnection);
+}
+
+bool Session::replay(const QString& path, double speed, double startSeconds) {
+    std::unique_ptr<Recording> recording = Recording::open(path);
+    if (!recording)
+        return false;
+
+    m_title = QFileInfo(path).fileName();
+    m_replayer = new Replayer(m_model, std::move(recording), this);
+    connect(m_replayer, &Replayer::finished, this, [this] {
+        m_title += QStringLiteral(" (ended)");
+        emit titleChanged(this, m_title);
+    });
+    m_replayer->play(speed, startSeconds);
+    return true;
+}
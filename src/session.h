@@ -0,0 +1,98 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <QString>
+#include <QWidget>
+#include <cstddef>
+#include <optional>
+#include <sys/types.h>
+
+#include "scrollback.h"
+
+class ChildReaper;
+class Metrics;
+class PtyScheduler;
+class PtyWorker;
+class QCheckBox;
+class QLabel;
+class QLineEdit;
+class QThread;
+class Replayer;
+class TerminalModel;
+class TerminalWidget;
+
+struct SessionConfig {
+    QString shell{QStringLiteral("/bin/bash")};
+    // Unset keeps the default line limit, or none at all when spilling to disk.
+    std::optional<std::size_t> scrollbackLines;
+    std::size_t scrollbackMemory{Scrollback::kDefaultMemoryBudget};
+    bool compressScrollback{true};
+    QString spillDir;
+    bool gpuRendering{false};
+    bool lowLatencyEcho{true};
+    // Each shell session is recorded to a new asciicast file in here.
+    QString recordDir;
+};
+
+// A shell running on its own PTY, not yet attached to a session.
+struct ShellProcess {
+    int masterFD{-1};
+    pid_t pid{-1};
+};
+
+// One shell: its PTY, parser, grid and view. The PtyWorker runs on the I/O
+// thread shared by every session of the window.
+class Session : public QWidget {
+    Q_OBJECT
+
+   public:
+    static constexpr int kDefaultRows = 24;
+    static constexpr int kDefaultCols = 80;
+
+    Session(const SessionConfig& config, QThread* ioThread, PtyScheduler* scheduler, ChildReaper* reaper,
+            QWidget* parent = nullptr);
+    ~Session() override;
+
+    // Forks shellPath on a new PTY of the given size. Needs no Qt
+    // application, so main() can start the first shell before creating one.
+    static std::optional<ShellProcess> spawnShell(const QString& shellPath, int rows, int cols);
+    bool launchShell(const QString& shellPath);
+    // Takes over a shell from spawnShell(); the PTY is resized to the view.
+    void attachShell(const ShellProcess& shell, const QString& shellPath);
+    // Plays a recording instead of running a shell; speed 0 plays it as fast
+    // as it parses.
+    bool replay(const QString& path, double speed, double startSeconds);
+    void showFindBar();
+    void hideFindBar();
+
+    TerminalWidget* terminal() const noexcept { return m_terminalWidget; }
+    QString title() const { return m_title; }
+    const Metrics& metrics() const noexcept;
+
+   signals:
+    void titleChanged(Session* session, const QString& title);
+    void finished(Session* session);
+
+   private:
+    void createFindBar();
+    void runFind();
+
+    TerminalModel* m_model;
+    TerminalWidget* m_terminalWidget;
+    PtyWorker* m_worker;
+    ChildReaper* m_reaper;
+    Replayer* m_replayer{nullptr};
+    QString m_recordDir;
+    QString m_title;
+
+    QWidget* m_findBar;
+    QLineEdit* m_findEdit;
+    QCheckBox* m_findCase;
+    QCheckBox* m_findRegex;
+    QLabel* m_findStatus;
+
+    int m_masterFD{-1};
+    pid_t m_shellPid{-1};
+};
+
+#endif
@@ -0,0 +1,124 @@
+#include "spillfile.h"
+#include "debug.h"
+
+#include <QDebug>
+#include <QFile>
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+constexpr std::uint64_t kSegmentSize = std::uint64_t(64) << 20;
+
+int openUnlinked(const QString& dir) {
+    const QByteArray path = QFile::encodeName(dir);
+#ifdef O_TMPFILE
+    int fd = ::open(path.constData(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    if (fd >= 0)
+        return fd;
+#endif
+    QByteArray templ = path + "/1t-scrollback-XXXXXX";
+    int tfd = ::mkostemp(templ.data(), O_CLOEXEC);
+    if (tfd >= 0)
+        ::unlink(templ.constData());
+    return tfd;
+}
+}  // namespace
+
+std::unique_ptr<SpillFile> SpillFile::create(const QString& dir) {
+    const int fd = openUnlinked(dir);
+    if (fd < 0) {
+        qWarning() << "Cannot create scrollback spill file in" << dir << ":" << strerror(errno);
+        return nullptr;
+    }
+#ifdef ENABLE_DEBUG
+    DBG() << "Scrollback spill file created in" << dir << "fd=" << fd;
+#endif
+    return std::unique_ptr<SpillFile>(new SpillFile(fd));
+}
+
+SpillFile::~SpillFile() {
+    for (char* seg : m_segments) {
+        if (seg)
+            ::munmap(seg, kSegmentSize);
+    }
+    ::close(m_fd);
+}
+
+bool SpillFile::write(const QByteArray& data, Extent& out) {
+    const std::uint64_t size = std::uint64_t(data.size());
+    if (size == 0 || size > kSegmentSize)
+        return false;
+
+    std::uint64_t offset = m_end;
+    if (offset % kSegmentSize + size > kSegmentSize)
+        offset = (offset / kSegmentSize + 1) * kSegmentSize;
+
+    const char* p = data.constData();
+    std::uint64_t done = 0;
+    while (done < size) {
+        const ssize_t n = ::pwrite(m_fd, p + done, size - done, off_t(offset + done));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            qWarning() << "Scrollback spill write failed:" << strerror(errno);
+            return false;
+        }
+        done += std::uint64_t(n);
+    }
+
+    out.offset = offset;
+    out.size = std::uint32_t(size);
+    m_end = offset + size;
+    m_liveBytes += size;
+    return true;
+}
+
+const char* SpillFile::map(const Extent& e) {
+    const std::size_t seg = std::size_t(e.offset / kSegmentSize);
+    if (seg >= m_segments.size())
+        m_segments.resize(seg + 1, nullptr);
+
+    if (!m_segments[seg]) {
+        void* addr = ::mmap(nullptr, kSegmentSize, PROT_READ, MAP_SHARED, m_fd, off_t(seg * kSegmentSize));
+        if (addr == MAP_FAILED) {
+            qWarning() << "Scrollback spill mmap failed:" << strerror(errno);
+            return nullptr;
+        }
+        m_segments[seg] = static_cast<char*>(addr);
+    }
+    return m_segments[seg] + e.offset % kSegmentSize;
+}
+
+void SpillFile::release(const Extent& e) {
+    const std::size_t seg = std::size_t(e.offset / kSegmentSize);
+    if (seg >= m_segments.size() || !m_segments[seg])
+        return;
+
+    // Drop the pages from our RSS; they stay in the page cache if there is room.
+    const long pageSize = ::sysconf(_SC_PAGESIZE);
+    const std::uint64_t begin = (e.offset % kSegmentSize) / std::uint64_t(pageSize) * std::uint64_t(pageSize);
+    ::madvise(m_segments[seg] + begin, std::size_t(e.offset % kSegmentSize + e.size - begin), MADV_DONTNEED);
+}
+
+void SpillFile::discard(const Extent& e) {
+    m_liveBytes -= std::min<std::uint64_t>(m_liveBytes, e.size);
+#ifdef FALLOC_FL_PUNCH_HOLE
+    ::fallocate(m_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, off_t(e.offset), off_t(e.size));
+#endif
+}
+
+void SpillFile::reset() {
+    for (char*& seg : m_segments) {
+        if (seg)
+            ::munmap(seg, kSegmentSize);
+        seg = nullptr;
+    }
+    if (::ftruncate(m_fd, 0) < 0)
+        qWarning() << "Scrollback spill truncate failed:" << strerror(errno);
+    m_end = 0;
+    m_liveBytes = 0;
+}
@@ -0,0 +1,48 @@
+#ifndef SPILLFILE_H
+#define SPILLFILE_H
+
+#include <QByteArray>
+#include <QString>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Unlinked temp file that cold scrollback pages are written to. Reads go
+// through read-only mappings of fixed-size segments, so a page is faulted in
+// from disk only when it is looked at and its memory is handed back right
+// after. An extent never straddles two segments.
+class SpillFile {
+   public:
+    struct Extent {
+        std::uint64_t offset{0};
+        std::uint32_t size{0};
+    };
+
+    static std::unique_ptr<SpillFile> create(const QString& dir);
+    ~SpillFile();
+
+    SpillFile(const SpillFile&) = delete;
+    SpillFile& operator=(const SpillFile&) = delete;
+
+    bool write(const QByteArray& data, Extent& out);
+    // Valid until release() or reset().
+    const char* map(const Extent& e);
+    void release(const Extent& e);
+    // Frees the disk blocks behind e.
+    void discard(const Extent& e);
+    void reset();
+
+    std::uint64_t liveBytes() const noexcept { return m_liveBytes; }
+
+   private:
+    explicit SpillFile(int fd) : m_fd(fd) {}
+
+    int m_fd;
+    std::uint64_t m_end{0};
+    std::uint64_t m_liveBytes{0};
+    std::vector<char*> m_segments;
+};
+
+#endif
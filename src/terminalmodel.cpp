@@ -0,0 +1,1382 @@
+#include "terminalmodel.h"
+#include "scrollback.h"
+#include "textsearch.h"
+#include "utf8decoder.h"
+#include "debug.h"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+
+namespace {
+bool isBlank(const Cell& c) noexcept {
+    return c.ch == U' ' && c.attr == AttrTable::kDefault;
+}
+
+// Length of row r up to its last non-blank cell; a wrapped row is full.
+int usedLength(const ScreenBuffer& buf, int r) {
+    const Cell* row = buf.row(r);
+    int len = buf.cols();
+    if (!buf.wrapped(r)) {
+        while (len > 0 && isBlank(row[len - 1]))
+            --len;
+    }
+    return len;
+}
+
+// OSC 8 and OSC 133 for where attr's link and zone differ from the last ones
+// written, link and zone.
+void appendLinkAndZone(QByteArray& out, const LinkTable& links, const CellAttr& attr, LinkTable::Id& link,
+                       Zone& zone) {
+    if (attr.link != link) {
+        link = attr.link;
+        out += "\x1b]8;";
+        if (link != LinkTable::kNone && !links[link].id.isEmpty())
+            out += "id=" + links[link].id;
+        out += ';';
+        if (link != LinkTable::kNone)
+            out += links[link].uri;
+        out += "\x1b\\";
+    }
+    if (attr.zone != zone) {
+        static constexpr char kMarks[] = {'D', 'A', 'B', 'C'};
+        zone = attr.zone;
+        out += "\x1b]133;";
+        out += kMarks[std::size_t(zone)];
+        out += "\x1b\\";
+    }
+}
+
+// A table this full is reclaimed after kReclaimMisses new entries, or after
+// history has dropped a page, whichever comes first.
+constexpr std::size_t kReclaimMisses = 4096;
+
+template <typename Table>
+bool crowded(const Table& table) noexcept {
+    return table.used() >= Table::kCapacity / 4 * 3;
+}
+
+// SGR that sets exactly attr, whatever was set before.
+void appendSgr(QByteArray& out, const CellAttr& attr) {
+    out += "\x1b[0";
+    if (attr.style & std::uint8_t(TextStyle::Bold))
+        out += ";1";
+    if (attr.style & std::uint8_t(TextStyle::Underline))
+        out += ";4";
+    if (attr.style & std::uint8_t(TextStyle::Inverse))
+        out += ";7";
+    auto color = [&out](std::uint32_t c, std::uint32_t fallback, const char* select) {
+        if (c == fallback)
+            return;
+        out += select;
+        if (CellColor::isTrueColor(c))
+            out += "2;" + QByteArray::number(CellColor::red(c)) + ';' + QByteArray::number(CellColor::green(c)) +
+                   ';' + QByteArray::number(CellColor::blue(c));
+        else
+            out += "5;" + QByteArray::number(CellColor::index(c));
+    };
+    color(attr.fg, CellColor::kDefaultFg, ";38;");
+    color(attr.bg, CellColor::kDefaultBg, ";48;");
+    out += 'm';
+}
+
+// Combining marks beyond this many are dropped.
+constexpr std::size_t kMaxClusterLength = 32;
+constexpr char32_t kZeroWidthJoiner = 0x200D;
+
+// Before cells [c0, c1) are overwritten: blanks the halves of wide characters
+// that would be left behind just outside them.
+void splitWideChars(Cell* row, int cols, int c0, int c1) noexcept {
+    if (c0 > 0 && row[c0].isWideSpacer())
+        row[c0 - 1].ch = U' ';
+    if (c1 < cols && row[c1].isWideSpacer())
+        row[c1].ch = U' ';
+}
+
+void cropInto(const ScreenBuffer& src, ScreenBuffer& dst, const Cell& blank) {
+    const int cols = std::min(src.cols(), dst.cols());
+    for (int r = 0; r < dst.rows(); ++r) {
+        Cell* row = dst.row(r);
+        const int copied = r < src.rows() ? cols : 0;
+        if (copied) {
+            std::copy_n(src.row(r), copied, row);
+            // A wide character whose right half is cut off goes with it.
+            if (copied < src.cols() && src.row(r)[copied].isWideSpacer())
+                row[copied - 1].ch = U' ';
+        }
+        std::fill(row + copied, row + dst.cols(), blank);
+    }
+}
+}  // namespace
+
+bool startsPrompt(const Cell* cells, int count, const AttrTable& attrs, Zone& zone) noexcept {
+    bool starts = false;
+    AttrTable::Id last = AttrTable::kDefault;
+    for (int c = 0; c < count; ++c) {
+        if (c > 0 && cells[c].attr == last)
+            continue;
+        last = cells[c].attr;
+        const Zone z = attrs[last].zone;
+        starts = starts || (z == Zone::Prompt && zone != Zone::Prompt);
+        zone = z;
+    }
+    return starts;
+}
+
+TerminalModel::TerminalModel(int rows, int cols, QObject* parent)
+    : QObject(parent),
+      m_mainScreen(std::make_unique<ScreenBuffer>(rows, cols)),
+      m_scrollback(std::make_unique<Scrollback>(&m_attrs)) {
+    m_scrollRegionBottom = m_mainScreen->rows() - 1;
+    m_scrollback->setWidth(m_mainScreen->cols());
+
+#ifdef ENABLE_DEBUG
+    DBG() << "TerminalModel created with rows=" << m_mainScreen->rows() << " cols=" << m_mainScreen->cols();
+#endif
+}
+
+TerminalModel::~TerminalModel() {
+#ifdef ENABLE_DEBUG
+    DBG() << "TerminalModel destroyed";
+#endif
+}
+
+void TerminalModel::notifyChanged(std::size_t parsedBytes) {
+    if (parsedBytes)
+        m_parsedBytes.fetch_add(parsedBytes, std::memory_order_relaxed);
+
+    if (!m_changePending.exchange(true, std::memory_order_acq_rel)) {
+        emit changed();
+    }
+}
+
+void TerminalModel::snapshot(int firstLine, ScreenSnapshot& out) {
+    m_changePending.store(false, std::memory_order_release);
+    // Ids retired since the last snapshot may still be in out, but not once
+    // this returns: whatever changed is copied over below.
+    m_snapshotTaken = true;
+    releaseIds();
+
+    ScreenBuffer& buf = currentBuffer();
+    const int rows = buf.rows();
+    const int cols = buf.cols();
+    const int sbLines = scrollbackSize();
+    const int first = (firstLine < 0) ? sbLines : std::clamp(firstLine, 0, sbLines);
+
+    const bool geometryChanged = out.rows != rows || out.cols != cols;
+    const bool shifted = geometryChanged || out.firstLine != first || out.scrollbackLines != sbLines ||
+                         out.droppedLines != m_droppedLines || out.alternateScreen != m_inAlternateScreen;
+
+    // Canvas row of screen row 0; screen damage is tracked in screen rows.
+    const int screenOffset = sbLines - first;
+    const bool cursorChanged =
+        out.cursorRow != m_cursorRow || out.cursorCol != m_cursorCol || out.showCursor != m_showCursor;
+
+    out.mouseEnabled = m_mouseEnabled;
+    // The cursor is drawn over the cells, so it never damages them.
+    out.cursorShape = m_cursorShape;
+    out.cursorBlink = m_cursorBlink;
+    m_metrics.setScrollbackBytes(m_scrollback->memoryUsage());
+    out.bracketedPaste = m_bracketedPaste;
+    if (out.paletteGeneration != m_paletteGeneration) {
+        out.palette = m_palette;
+        out.paletteGeneration = m_paletteGeneration;
+    }
+    if (!shifted && !cursorChanged && out.generation == buf.generation()) {
+        out.dirtyRows.clear();
+        return;
+    }
+
+    if (geometryChanged) {
+        out.cells.assign(std::size_t(rows) * std::size_t(cols), Cell{});
+        out.dirtyRows.resize(rows, cols);
+    }
+    out.dirtyRows.clear();
+    const RowDamage& damage = buf.damaged();
+    if (shifted || damage.all()) {
+        out.dirtyRows.setAll();
+    }
+    else {
+        for (int r = 0; r < rows; ++r) {
+            const RowDamage::Span span = damage.span(r);
+            if (!span.empty())
+                out.dirtyRows.set(r + screenOffset, span.first, span.last);
+        }
+    }
+    buf.clearDamage();
+
+    out.rows = rows;
+    out.cols = cols;
+    out.scrollbackLines = sbLines;
+    out.droppedLines = m_droppedLines;
+    out.alternateScreen = m_inAlternateScreen;
+    out.generation = buf.generation();
+    out.firstLine = first;
+    out.cursorRow = m_cursorRow;
+    out.cursorCol = m_cursorCol;
+    out.showCursor = m_showCursor;
+
+    for (int r = 0; r < rows; ++r) {
+        if (!out.dirtyRows.test(r))
+            continue;
+
+        Cell* dst = out.cells.data() + std::size_t(r) * std::size_t(cols);
+        const int absLine = first + r;
+        if (absLine < sbLines) {
+            m_scrollback->copyLine(std::size_t(absLine), dst, cols);
+        }
+        else {
+            const RowDamage::Span span = out.dirtyRows.span(r);
+            std::copy(buf.row(absLine - sbLines) + span.first, buf.row(absLine - sbLines) + span.last,
+                      dst + span.first);
+        }
+    }
+}
+
+void TerminalModel::setMouseEnabled(bool on) {
+#ifdef ENABLE_DEBUG
+    DBG() << "setMouseEnabled:" << (on ? "enabled" : "disabled");
+#endif
+    m_mouseEnabled = on;
+}
+
+void TerminalModel::setSynchronizedUpdate(bool on) noexcept {
+    std::int64_t deadline = 0;
+    if (on) {
+        const auto expiry = std::chrono::steady_clock::now() + std::chrono::milliseconds(kSynchronizedUpdateTimeoutMs);
+        deadline = std::chrono::duration_cast<std::chrono::nanoseconds>(expiry.time_since_epoch()).count();
+    }
+    m_syncDeadline.store(deadline, std::memory_order_release);
+}
+
+bool TerminalModel::synchronizedUpdate() const noexcept {
+    const std::int64_t deadline = m_syncDeadline.load(std::memory_order_acquire);
+    if (deadline == 0)
+        return false;
+    const auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(now).count() < deadline;
+}
+
+void TerminalModel::useAlternateScreen(bool alt) {
+#ifdef ENABLE_DEBUG
+    DBG() << "useAlternateScreen alt=" << alt;
+#endif
+    if (m_inAlternateScreen == alt)
+        return;
+
+    // Allocated the first time an application asks for it; most shells never
+    // do. From then on it is resized along with the main screen.
+    if (alt && !m_alternateScreen) {
+        m_alternateScreen = std::make_unique<ScreenBuffer>(m_mainScreen->rows(), m_mainScreen->cols());
+        fillScreen(*m_alternateScreen, makeCellForCurrentAttr());
+    }
+    m_inAlternateScreen = alt;
+    markAllDirty();
+}
+
+void TerminalModel::clearAlternateScreen() {
+    if (m_alternateScreen)
+        fillScreen(*m_alternateScreen, makeCellForCurrentAttr());
+}
+
+void TerminalModel::setScrollingRegion(int top, int bottom) {
+#ifdef ENABLE_DEBUG
+    DBG() << "setScrollingRegion top=" << top << " bottom=" << bottom;
+#endif
+
+    if (bottom < top) {
+        m_scrollRegionTop = 0;
+        m_scrollRegionBottom = currentBuffer().rows() - 1;
+    }
+    else {
+        m_scrollRegionTop = std::clamp(top, 0, currentBuffer().rows() - 1);
+        m_scrollRegionBottom = std::clamp(bottom, 0, currentBuffer().rows() - 1);
+    }
+}
+
+void TerminalModel::lineFeed() {
+#ifdef ENABLE_DEBUG
+    DBG() << "lineFeed at row=" << m_cursorRow;
+#endif
+
+    m_cursorRow++;
+
+    if (m_cursorRow > m_scrollRegionBottom) {
+        scrollUp(m_scrollRegionTop, m_scrollRegionBottom);
+
+        m_cursorRow = m_scrollRegionBottom;
+    }
+
+    clampCursor();
+
+#ifdef ENABLE_DEBUG
+    DBG() << "Updated cursor position: row=" << m_cursorRow;
+#endif
+}
+
+void TerminalModel::reverseLineFeed() {
+#ifdef ENABLE_DEBUG
+    DBG() << "reverseLineFeed at row=" << m_cursorRow;
+#endif
+
+    if (m_cursorRow == m_scrollRegionTop) {
+        scrollDown(m_scrollRegionTop, m_scrollRegionBottom);
+    }
+    else {
+        m_cursorRow = std::max(m_cursorRow - 1, 0);
+    }
+
+    clampCursor();
+
+#ifdef ENABLE_DEBUG
+    DBG() << "Updated cursor position: row=" << m_cursorRow;
+#endif
+}
+
+void TerminalModel::putChar(char32_t ch) {
+#ifdef ENABLE_DEBUG
+    DBG() << "putChar: " << uint(ch);
+#endif
+
+    if (ch == U'\r') {
+#ifdef ENABLE_DEBUG
+        DBG() << "Carriage return encountered. Resetting column to 0.";
+#endif
+        m_cursorCol = 0;
+        m_joinNext = false;
+        clampCursor();
+        return;
+    }
+
+    if (ch == U'\n') {
+#ifdef ENABLE_DEBUG
+        DBG() << "Newline encountered. Moving cursor to the next line.";
+#endif
+
+        m_cursorCol = 0;
+        m_joinNext = false;
+        clampCursor();
+        return;
+    }
+
+    const int width = charWidth(ch);
+    if (width < 0) {
+#ifdef ENABLE_DEBUG
+        DBG() << "Non-printable character skipped: " << uint(ch);
+#endif
+        return;
+    }
+    if (width == 0 || std::exchange(m_joinNext, false)) {
+        if (joinPrevious(ch) || width == 0)
+            return;
+    }
+
+    ScreenBuffer& buf = currentBuffer();
+    const int cols = buf.cols();
+    // A wide character never straddles the right margin.
+    const int cells = cols > 1 ? width : 1;
+    if (m_cursorCol >= cols || m_cursorCol + cells > cols) {
+#ifdef ENABLE_DEBUG
+        DBG() << "Column limit reached. Wrapping text to the next line.";
+#endif
+        if (m_autoWrap)
+            wrapToNextLine();
+        else
+            m_cursorCol = cols - cells;
+    }
+
+    Cell* row = buf.row(m_cursorRow);
+    splitWideChars(row, cols, m_cursorCol, m_cursorCol + cells);
+    row[m_cursorCol] = Cell{ch, m_currentAttrId};
+    if (cells == 2)
+        row[m_cursorCol + 1] = Cell{kWideSpacer, m_currentAttrId};
+
+#ifdef ENABLE_DEBUG
+    DBG() << "Cell updated at row=" << m_cursorRow << " col=" << m_cursorCol << " with char=" << uint(ch);
+#endif
+    markCellsDirty(m_cursorRow, m_cursorCol - 1, m_cursorCol + cells + 1);
+
+    m_cursorCol += cells;
+}
+
+bool TerminalModel::joinPrevious(char32_t mark) {
+    ScreenBuffer& buf = currentBuffer();
+    int col = std::min(m_cursorCol, buf.cols()) - 1;
+    Cell* row = buf.row(m_cursorRow);
+    if (col > 0 && row[col].isWideSpacer())
+        --col;
+    if (col < 0 || row[col].isWideSpacer())
+        return false;
+
+    Cell& base = row[col];
+    std::u32string text = base.isCluster() ? m_clusters[base.cluster()] : std::u32string(1, base.ch);
+    if (text.size() >= kMaxClusterLength)
+        return true;
+    text.push_back(mark);
+
+    reclaimIfDue();
+    const ClusterTable::Id id = m_clusters.intern(text);
+    if (id == ClusterTable::kNone)
+        return true;
+    base.ch = kClusterBit | id;
+    m_joinNext = mark == kZeroWidthJoiner;
+    markCellsDirty(m_cursorRow, col, col + 2);
+    return true;
+}
+
+void TerminalModel::putAsciiRun(const unsigned char* text, std::size_t n) {
+    ScreenBuffer& buf = currentBuffer();
+    const int cols = buf.cols();
+    m_joinNext = false;
+
+    while (n > 0) {
+        if (m_cursorCol >= cols) {
+            if (m_autoWrap) {
+                wrapToNextLine();
+            }
+            else {
+                // Without autowrap every further byte lands on the last column.
+                m_cursorCol = cols - 1;
+                text += n - 1;
+                n = 1;
+            }
+        }
+
+        const int take = int(std::min<std::size_t>(n, std::size_t(cols - m_cursorCol)));
+        Cell* row = buf.row(m_cursorRow);
+        splitWideChars(row, cols, m_cursorCol, m_cursorCol + take);
+        Cell* dst = row + m_cursorCol;
+        for (int i = 0; i < take; ++i) {
+            dst[i].ch = text[i];
+            dst[i].attr = m_currentAttrId;
+        }
+        markCellsDirty(m_cursorRow, m_cursorCol - 1, m_cursorCol + take + 1);
+        m_cursorCol += take;
+        text += take;
+        n -= std::size_t(take);
+    }
+}
+
+void TerminalModel::wrapToNextLine() {
+    currentBuffer().setWrapped(m_cursorRow, true);
+    m_cursorCol = 0;
+    lineFeed();
+}
+
+void TerminalModel::setCursorPos(int r, int c, bool doClamp) {
+#ifdef ENABLE_DEBUG
+    DBG() << "setCursorPos r=" << r << ", c=" << c << ", clamp=" << doClamp;
+#endif
+
+    if (doClamp) {
+        r = std::clamp(r, 0, currentBuffer().rows() - 1);
+        c = std::clamp(c, 0, currentBuffer().cols() - 1);
+    }
+
+    m_cursorRow = r;
+    m_cursorCol = c;
+}
+
+void TerminalModel::saveCursorPos() {
+#ifdef ENABLE_DEBUG
+    DBG() << "saveCursorPos row=" << m_cursorRow << ", col=" << m_cursorCol;
+#endif
+    m_savedCursors[m_inAlternateScreen] = {m_cursorRow, m_cursorCol, m_currentAttr};
+}
+
+void TerminalModel::restoreCursorPos() {
+    const SavedCursor& saved = m_savedCursors[m_inAlternateScreen];
+#ifdef ENABLE_DEBUG
+    DBG() << "restoreCursorPos to row=" << saved.row << ", col=" << saved.col;
+#endif
+    m_cursorRow = saved.row;
+    m_cursorCol = saved.col;
+    // Only the rendition is restored; a link or zone opened since stays.
+    CellAttr attr = saved.attr;
+    attr.link = m_currentAttr.link;
+    attr.zone = m_currentAttr.zone;
+    setCurrentAttr(attr);
+    clampCursor();
+}
+
+void TerminalModel::clampCursor() {
+#ifdef ENABLE_DEBUG
+    DBG() << "Clamping cursor: row=" << m_cursorRow << ", col=" << m_cursorCol;
+#endif
+
+    m_cursorRow = std::clamp(m_cursorRow, 0, currentBuffer().rows() - 1);
+    m_cursorCol = std::clamp(m_cursorCol, 0, currentBuffer().cols() - 1);
+
+#ifdef ENABLE_DEBUG
+    DBG() << "Clamped cursor: row=" << m_cursorRow << ", col=" << m_cursorCol;
+#endif
+}
+
+void TerminalModel::deleteChars(int n) {
+#ifdef ENABLE_DEBUG
+    DBG() << "deleteChars n=" << n << "row=" << m_cursorRow << "col=" << m_cursorCol;
+#endif
+
+    int row = m_cursorRow;
+    if (row < 0 || row >= currentBuffer().rows() || n < 1)
+        return;
+
+    for (int count = 0; count < n; ++count) {
+        for (int c = m_cursorCol; c < currentBuffer().cols() - 1; ++c) {
+            currentBuffer().cell(row, c) = currentBuffer().cell(row, c + 1);
+        }
+        currentBuffer().cell(row, currentBuffer().cols() - 1) = makeCellForCurrentAttr();
+    }
+    markCellsDirty(row, std::min(m_cursorCol, currentBuffer().cols() - 1), currentBuffer().cols());
+}
+
+void TerminalModel::eraseChars(int n) {
+#ifdef ENABLE_DEBUG
+    DBG() << "eraseChars n=" << n << "row=" << m_cursorRow << "col=" << m_cursorCol;
+#endif
+
+    int row = m_cursorRow;
+    if (row < 0 || row >= currentBuffer().rows() || n < 1)
+        return;
+
+    for (int i = 0; i < n; ++i) {
+        int c = m_cursorCol + i;
+        if (c >= currentBuffer().cols())
+            break;
+        currentBuffer().cell(row, c) = makeCellForCurrentAttr();
+    }
+    markCellsDirty(row, m_cursorCol, m_cursorCol + n);
+}
+
+void TerminalModel::insertChars(int n) {
+#ifdef ENABLE_DEBUG
+    DBG() << "insertChars n=" << n << "row=" << m_cursorRow << "col=" << m_cursorCol;
+#endif
+
+    int row = m_cursorRow;
+    if (row < 0 || row >= currentBuffer().rows() || n < 1)
+        return;
+
+    // The cursor may sit just past the last column, waiting to wrap.
+    const int col = std::min(m_cursorCol, currentBuffer().cols() - 1);
+    for (int count = 0; count < n; ++count) {
+        for (int c = currentBuffer().cols() - 1; c > col; --c) {
+            currentBuffer().cell(row, c) = currentBuffer().cell(row, c - 1);
+        }
+        currentBuffer().cell(row, col) = makeCellForCurrentAttr();
+    }
+    markCellsDirty(row, col, currentBuffer().cols());
+}
+
+void TerminalModel::deleteLines(int n) {
+#ifdef ENABLE_DEBUG
+    DBG() << "deleteLines n=" << n << " row=" << m_cursorRow;
+#endif
+
+    int top = m_cursorRow;
+    int bottom = m_scrollRegionBottom;
+    int regionHeight = bottom - top + 1;
+    if (regionHeight <= 0 || n < 1)
+        return;
+
+    n = std::min(n, regionHeight);
+    int cols = currentBuffer().cols();
+    currentBuffer().rotateUp(top, bottom, n);
+    for (int r = bottom - n + 1; r <= bottom; ++r) {
+        currentBuffer().fillRow(r, 0, cols, makeCellForCurrentAttr());
+    }
+}
+
+void TerminalModel::insertLines(int n) {
+#ifdef ENABLE_DEBUG
+    DBG() << "insertLines n=" << n << " row=" << m_cursorRow;
+#endif
+
+    int top = m_cursorRow;
+    int bottom = m_scrollRegionBottom;
+    int regionHeight = bottom - top + 1;
+    if (regionHeight <= 0 || n < 1)
+        return;
+
+    n = std::min(n, regionHeight);
+    int cols = currentBuffer().cols();
+    currentBuffer().rotateDown(top, bottom, n);
+    for (int r = 0; r < n; ++r) {
+        currentBuffer().fillRow(top + r, 0, cols, makeCellForCurrentAttr());
+    }
+}
+
+void TerminalModel::scrollUpLines(int n) {
+    for (int i = 0; i < n; ++i)
+        scrollUp(m_scrollRegionTop, m_scrollRegionBottom);
+}
+
+void TerminalModel::scrollDownLines(int n) {
+    for (int i = 0; i < n; ++i)
+        scrollDown(m_scrollRegionTop, m_scrollRegionBottom);
+}
+
+void TerminalModel::eraseInLine(int mode) {
+#ifdef ENABLE_DEBUG
+    DBG() << "eraseInLine mode=" << mode << "cursorRow=" << m_cursorRow;
+#endif
+
+    int row = m_cursorRow;
+    if (row < 0 || row >= currentBuffer().rows())
+        return;
+
+    int startCol, endCol;
+    switch (mode) {
+        case 0:
+            startCol = m_cursorCol;
+            endCol = currentBuffer().cols();
+            break;
+        case 1:
+            startCol = 0;
+            endCol = m_cursorCol + 1;
+            break;
+        case 2:
+            startCol = 0;
+            endCol = currentBuffer().cols();
+            break;
+        default:
+            startCol = 0;
+            endCol = currentBuffer().cols();
+            break;
+    }
+
+    currentBuffer().fillRow(row, startCol, endCol, makeCellForCurrentAttr());
+}
+
+void TerminalModel::eraseInDisplay(int mode) {
+#ifdef ENABLE_DEBUG
+    DBG() << "eraseInDisplay mode=" << mode << "cursorRow=" << m_cursorRow;
+#endif
+
+    Cell blank = makeCellForCurrentAttr();
+
+    if (mode == 2) {
+        fillScreen(currentBuffer(), blank);
+        return;
+    }
+
+    if (mode == 0) {
+        eraseInLine(0);
+        for (int r = m_cursorRow + 1; r < currentBuffer().rows(); ++r) {
+            currentBuffer().fillRow(r, 0, currentBuffer().cols(), blank);
+        }
+    }
+    else if (mode == 1) {
+        eraseInLine(1);
+        for (int r = 0; r < m_cursorRow; ++r) {
+            currentBuffer().fillRow(r, 0, currentBuffer().cols(), blank);
+        }
+    }
+}
+
+void TerminalModel::scrollUp(int top, int bottom) {
+#ifdef ENABLE_DEBUG
+    DBG() << "scrollUp top=" << top << "bottom=" << bottom;
+#endif
+
+    const int cols = currentBuffer().cols();
+    const int regionHeight = bottom - top + 1;
+    if (regionHeight <= 0)
+        return;
+
+    // Only lines leaving the top of the main screen are history; scrolling a
+    // sub-region or the alternate screen (editors, pagers) is not.
+    if (top == 0 && !m_inAlternateScreen)
+        m_droppedLines += m_scrollback->push(currentBuffer().row(top), cols, currentBuffer().wrapped(top));
+
+    currentBuffer().rotateUp(top, bottom, 1);
+    currentBuffer().fillRow(bottom, 0, cols, makeCellForCurrentAttr());
+}
+
+void TerminalModel::scrollDown(int top, int bottom) {
+#ifdef ENABLE_DEBUG
+    DBG() << "scrollDown top=" << top << "bottom=" << bottom;
+#endif
+
+    const int cols = currentBuffer().cols();
+    const int regionHeight = bottom - top + 1;
+    if (regionHeight <= 0)
+        return;
+
+    currentBuffer().rotateDown(top, bottom, 1);
+    currentBuffer().fillRow(top, 0, cols, makeCellForCurrentAttr());
+}
+
+ScreenBuffer& TerminalModel::currentBuffer() {
+    return m_inAlternateScreen ? *m_alternateScreen : *m_mainScreen;
+}
+
+const ScreenBuffer& TerminalModel::currentBuffer() const {
+    return m_inAlternateScreen ? *m_alternateScreen : *m_mainScreen;
+}
+
+void TerminalModel::fillScreen(ScreenBuffer& buf, const Cell& blank) {
+#ifdef ENABLE_DEBUG
+    DBG() << "fillScreen rows=" << buf.rows() << "cols=" << buf.cols();
+#endif
+    for (int r = 0; r < buf.rows(); ++r) {
+        buf.fillRow(r, 0, buf.cols(), blank);
+    }
+    buf.damageAll();
+}
+
+void TerminalModel::reflowMainScreen(int rows, int cols, bool moveCursor) {
+    const ScreenBuffer& old = *m_mainScreen;
+    const int oldCols = old.cols();
+
+    // A line that wrapped off the top of the screen is rewrapped whole.
+    std::vector<Cell> cells;
+    const bool haveOpen = m_scrollback->takeOpenLine(cells);
+    m_droppedLines += m_scrollback->setWidth(cols);
+
+    // Rows below both the cursor and the last non-blank row carry nothing.
+    int used = moveCursor ? m_cursorRow + 1 : 0;
+    for (int r = old.rows() - 1; r >= used; --r) {
+        if (usedLength(old, r) > 0) {
+            used = r + 1;
+            break;
+        }
+    }
+
+    // A wrapped row ending in the blank a wide character wrapped past.
+    auto padded = [&](const Cell* row, int below) {
+        return oldCols > 1 && row[oldCols - 1].ch == U' ' && old.row(below)[1].isWideSpacer();
+    };
+
+    // Join the used rows back into logical lines, one after the other in
+    // cells, and lay them out at the new width, finding where the cursor
+    // lands.
+    struct Row {
+        std::size_t begin;
+        std::size_t end;
+        bool wrapped;
+    };
+    std::vector<Row> layout;
+    std::size_t cursorRow = 0;
+    int cursorCol = 0;
+    for (int r = 0; r < used || (r == 0 && haveOpen);) {
+        const std::size_t begin = r == 0 ? 0 : cells.size();
+        // The open line above may end in one too.
+        if (begin == 0 && !cells.empty() && used > 0 && oldCols > 1 && cells.back().ch == U' ' &&
+            old.row(0)[1].isWideSpacer())
+            cells.pop_back();
+
+        int last = r;
+        while (last < used - 1 && old.wrapped(last))
+            ++last;
+        bool hasCursor = false;
+        std::size_t cursorOffset = 0;
+        for (int k = r; k <= last && k < used; ++k) {
+            if (moveCursor && k == m_cursorRow) {
+                hasCursor = true;
+                cursorOffset = cells.size() - begin + std::size_t(m_cursorCol);
+            }
+            const Cell* row = old.row(k);
+            const int n = k < last ? oldCols - (padded(row, k + 1) ? 1 : 0) : usedLength(old, k);
+            cells.insert(cells.end(), row, row + n);
+        }
+        if (hasCursor && begin + cursorOffset > cells.size())
+            cells.resize(begin + cursorOffset, Cell{});
+
+        const std::size_t length = cells.size() - begin;
+        const auto spacerAt = [&](std::size_t i) { return cells[begin + i].isWideSpacer(); };
+        std::size_t start = 0;
+        do {
+            const std::size_t end = wrapRow(start, length, cols, spacerAt);
+            if (hasCursor && cursorOffset >= start && (cursorOffset < end || end == length)) {
+                cursorRow = layout.size();
+                cursorCol = int(cursorOffset - start);
+                hasCursor = false;
+            }
+            layout.push_back(Row{begin + start, begin + end, end < length});
+            start = end;
+        } while (start < length);
+        r = last + 1;
+    }
+
+    // Keep the bottom of the content on screen, but never push the cursor
+    // off the top; what is above goes to history.
+    std::size_t top = layout.size() > std::size_t(rows) ? layout.size() - std::size_t(rows) : 0;
+    if (moveCursor)
+        top = std::min(top, cursorRow);
+
+    ScreenBuffer next(rows, cols);
+    std::vector<Cell> history(static_cast<std::size_t>(cols));
+    for (std::size_t phys = 0; phys < layout.size() && phys < top + std::size_t(rows); ++phys) {
+        const Row& row = layout[phys];
+        const Cell* src = cells.data() + row.begin;
+        const int n = int(row.end - row.begin);
+        Cell* dst = phys < top ? history.data() : next.row(int(phys - top));
+        std::copy_n(src, n, dst);
+        std::fill(dst + n, dst + cols, Cell{});
+        if (phys < top)
+            m_droppedLines += m_scrollback->push(history.data(), cols, row.wrapped);
+        else
+            next.setWrapped(int(phys - top), row.wrapped);
+    }
+
+    *m_mainScreen = std::move(next);
+    if (moveCursor) {
+        m_cursorRow = int(cursorRow - top);
+        m_cursorCol = cursorCol;
+    }
+}
+
+void TerminalModel::setTerminalSize(int rows, int cols) {
+#ifdef ENABLE_DEBUG
+    DBG() << "setTerminalSize rows=" << rows << "cols=" << cols;
+#endif
+    rows = std::max(rows, 1);
+    cols = std::max(cols, 1);
+    if (m_mainScreen->rows() == rows && m_mainScreen->cols() == cols)
+        return;
+
+    // The main screen is rewrapped; the alternate screen belongs to a
+    // full-screen application that redraws it for the new size anyway.
+    reflowMainScreen(rows, cols, !m_inAlternateScreen);
+    if (m_alternateScreen) {
+        ScreenBuffer alternate(rows, cols);
+        cropInto(*m_alternateScreen, alternate, makeCellForCurrentAttr());
+        *m_alternateScreen = std::move(alternate);
+    }
+
+    m_scrollRegionTop = 0;
+    m_scrollRegionBottom = rows - 1;
+
+    markAllDirty();
+
+    // A cursor left just past the last column still wraps on the next print.
+    m_cursorRow = std::clamp(m_cursorRow, 0, rows - 1);
+    m_cursorCol = std::clamp(m_cursorCol, 0, cols);
+    for (SavedCursor& saved : m_savedCursors) {
+        saved.row = std::clamp(saved.row, 0, rows - 1);
+        saved.col = std::clamp(saved.col, 0, cols - 1);
+    }
+}
+
+void TerminalModel::fullReset() {
+#ifdef ENABLE_DEBUG
+    DBG() << "fullReset";
+#endif
+    m_droppedLines += m_scrollback->clear();
+    m_currentAttr = CellAttr{};
+    m_currentAttrId = AttrTable::kDefault;
+    m_blankAttrId = AttrTable::kDefault;
+    fillScreen(*m_mainScreen, Cell{});
+    m_alternateScreen.reset();
+    m_inAlternateScreen = false;
+    m_cursorRow = 0;
+    m_cursorCol = 0;
+    m_savedCursors = {};
+    // Nothing is left that uses any id but the defaults.
+    reclaimIds();
+    m_scrollRegionTop = 0;
+    m_scrollRegionBottom = m_mainScreen->rows() - 1;
+    m_bracketedPaste = false;
+    m_autoWrap = true;
+    m_showCursor = true;
+    setCursorStyle(0);
+    setSynchronizedUpdate(false);
+    resetPaletteColor(-1);
+}
+
+void TerminalModel::setCursorStyle(int ps) noexcept {
+    static constexpr CursorShape kShapes[] = {CursorShape::Block, CursorShape::Underline, CursorShape::Bar};
+    ps = std::clamp(ps, 0, 6);
+    m_cursorShape = kShapes[ps == 0 ? 0 : (ps - 1) / 2];
+    m_cursorBlink = ps == 0 || ps % 2 == 1;
+}
+
+QByteArray TerminalModel::encodeScreen() const {
+    const ScreenBuffer& buf = currentBuffer();
+    QByteArray out;
+    out.reserve(qsizetype(buf.rows()) * buf.cols() * (m_inAlternateScreen ? 4 : 2));
+    out += "\x1b" "c";
+    for (int i = 0; i < Palette::kSize; ++i) {
+        if (m_palette[i] != Palette::defaultColor(i))
+            out += "\x1b]4;" + QByteArray::number(i) + ';' + Palette::formatSpec(m_palette[i]) + "\x1b\\";
+    }
+
+    auto moveTo = [&out](int row, int col) {
+        out += "\x1b[" + QByteArray::number(row + 1) + ';' + QByteArray::number(col + 1) + 'H';
+    };
+    auto saveCursor = [&](const SavedCursor& saved) {
+        moveTo(saved.row, saved.col);
+        appendSgr(out, saved.attr);
+        out += "\x1b" "7";
+    };
+    encodeRows(*m_mainScreen, out);
+    saveCursor(m_savedCursors[0]);
+    if (m_inAlternateScreen) {
+        out += "\x1b[0m\x1b[?47h";
+        encodeRows(*m_alternateScreen, out);
+        saveCursor(m_savedCursors[1]);
+    }
+
+    if (m_scrollRegionTop != 0 || m_scrollRegionBottom != buf.rows() - 1)
+        out += "\x1b[" + QByteArray::number(m_scrollRegionTop + 1) + ';' +
+               QByteArray::number(m_scrollRegionBottom + 1) + 'r';
+    // A wrap still pending at the end of the line is lost.
+    moveTo(m_cursorRow, std::min(m_cursorCol, buf.cols() - 1));
+    appendSgr(out, m_currentAttr);
+    LinkTable::Id link = LinkTable::kNone;
+    Zone zone = Zone::None;
+    appendLinkAndZone(out, m_links, m_currentAttr, link, zone);
+
+    if (!m_autoWrap)
+        out += "\x1b[?7l";
+    if (m_bracketedPaste)
+        out += "\x1b[?2004h";
+    if (!m_showCursor)
+        out += "\x1b[?25l";
+    if (m_cursorShape != CursorShape::Block || !m_cursorBlink)
+        out += "\x1b[" + QByteArray::number(int(m_cursorShape) * 2 + (m_cursorBlink ? 1 : 2)) + " q";
+    return out;
+}
+
+void TerminalModel::encodeRows(const ScreenBuffer& buf, QByteArray& out) const {
+    AttrTable::Id attr = AttrTable::kDefault;
+    LinkTable::Id link = LinkTable::kNone;
+    Zone zone = Zone::None;
+    bool continued = false;
+    for (int r = 0; r < buf.rows(); ++r) {
+        const Cell* cells = buf.row(r);
+        // A soft-wrapped row is written out to its last column, so the next
+        // row's first character wraps onto it and sets the flag again.
+        const bool wraps = buf.wrapped(r) && r + 1 < buf.rows();
+        const int end = usedLength(buf, r);
+        if (end == 0) {
+            continued = false;
+            continue;
+        }
+
+        if (!continued)
+            out += "\x1b[" + QByteArray::number(r + 1) + "H";
+        for (int c = 0; c < end; ++c) {
+            const Cell& cell = cells[c];
+            if (cell.isWideSpacer())
+                continue;
+            if (cell.attr != attr) {
+                attr = cell.attr;
+                appendSgr(out, m_attrs[attr]);
+                appendLinkAndZone(out, m_links, m_attrs[attr], link, zone);
+            }
+            if (cell.isCluster()) {
+                for (char32_t ch : m_clusters[cell.cluster()])
+                    appendUtf8(out, ch);
+            }
+            else {
+                appendUtf8(out, cell.ch);
+            }
+        }
+        continued = wraps;
+    }
+    appendLinkAndZone(out, m_links, CellAttr{}, link, zone);
+}
+
+void TerminalModel::handleBell() {
+#ifdef ENABLE_DEBUG
+    DBG() << "handleBell";
+#endif
+    emit bell();
+}
+
+void TerminalModel::setWindowTitle(const QString& title) {
+#ifdef ENABLE_DEBUG
+    DBG() << "setWindowTitle" << title;
+#endif
+    emit titleChanged(title);
+}
+
+void TerminalModel::setPaletteColor(int index, std::uint32_t argb) {
+#ifdef ENABLE_DEBUG
+    DBG() << "setPaletteColor" << index << QString::number(argb, 16);
+#endif
+    m_palette.set(index, argb);
+    ++m_paletteGeneration;
+    markAllDirty();
+}
+
+void TerminalModel::resetPaletteColor(int index) {
+    if (index < 0)
+        m_palette.resetAll();
+    else
+        m_palette.reset(index);
+    ++m_paletteGeneration;
+    markAllDirty();
+}
+
+int TerminalModel::scrollbackSize() const noexcept {
+    return int(m_scrollback->size());
+}
+
+void TerminalModel::setScrollbackLimits(std::size_t maxLines, std::size_t memoryBudget, bool compress) {
+#ifdef ENABLE_DEBUG
+    DBG() << "setScrollbackLimits lines=" << maxLines << "budget=" << memoryBudget << "compress=" << compress;
+#endif
+    // Line numbers are ints throughout the view.
+    maxLines = std::min<std::size_t>(maxLines, std::numeric_limits<int>::max());
+
+    m_scrollback->setCompression(compress);
+    const std::size_t dropped = m_scrollback->setLimits(maxLines, memoryBudget);
+    if (dropped) {
+        m_droppedLines += dropped;
+        markAllDirty();
+    }
+}
+
+bool TerminalModel::enableScrollbackSpill(const QString& dir) {
+#ifdef ENABLE_DEBUG
+    DBG() << "enableScrollbackSpill dir=" << dir;
+#endif
+    return m_scrollback->enableSpill(dir);
+}
+
+bool TerminalModel::copyAbsoluteLine(int absLine, std::vector<Cell>& out, bool* wrapped) const {
+#ifdef ENABLE_DEBUG
+    DBG() << "copyAbsoluteLine called for line=" << absLine;
+#endif
+
+    if (absLine < 0)
+        return false;
+
+    const int cols = currentBuffer().cols();
+    const int sbLines = scrollbackSize();
+    out.resize(std::size_t(cols));
+    if (absLine < sbLines) {
+        const bool w = m_scrollback->copyLine(std::size_t(absLine), out.data(), cols);
+        if (wrapped)
+            *wrapped = w;
+        return true;
+    }
+    int offset = absLine - sbLines;
+    if (offset < currentBuffer().rows()) {
+        std::copy_n(currentBuffer().row(offset), cols, out.data());
+        if (wrapped)
+            *wrapped = currentBuffer().wrapped(offset);
+        return true;
+    }
+#ifdef ENABLE_DEBUG
+    DBG() << "Line " << absLine << " is out of bounds.";
+#endif
+    return false;
+}
+
+std::uint64_t TerminalModel::search(const SearchQuery& query, std::uint64_t first, std::uint64_t last,
+                                    std::size_t maxLines, std::vector<SearchMatch>& out) const {
+    const std::uint64_t sbTop = m_droppedLines;
+    const std::uint64_t screenTop = sbTop + m_scrollback->size();
+    first = std::max(first, sbTop);
+    if (first >= last)
+        return first;
+
+    // The screen first, one logical line at a time from the bottom up.
+    const ScreenBuffer& buf = currentBuffer();
+    std::uint64_t resume = std::min<std::uint64_t>(last, screenTop + std::uint64_t(buf.rows()));
+    std::vector<char32_t> text;
+    std::vector<SearchQuery::Hit> hits;
+    while (resume > screenTop) {
+        const int end = int(resume - screenTop) - 1;
+        int start = end;
+        while (start > 0 && buf.wrapped(start - 1))
+            --start;
+        if (screenTop + std::uint64_t(start) < first)
+            return first;
+        if (maxLines == 0)
+            return resume;
+
+        text.clear();
+        for (int r = start; r <= end; ++r) {
+            const Cell* row = buf.row(r);
+            const int len = r == end ? usedLength(buf, r) : buf.cols();
+            for (int c = 0; c < len; ++c)
+                text.push_back(row[c].ch);
+        }
+        hits.clear();
+        query.match(text.data(), text.size(), hits);
+        for (const SearchQuery::Hit& hit : hits) {
+            out.push_back(SearchMatch{screenTop + std::uint64_t(start) + hit.start / std::size_t(buf.cols()),
+                                      int(hit.start % std::size_t(buf.cols())), int(hit.length)});
+        }
+        --maxLines;
+        resume = screenTop + std::uint64_t(start);
+    }
+
+    const std::size_t stop = m_scrollback->search(query, std::size_t(first - sbTop), std::size_t(resume - sbTop),
+                                                  maxLines, sbTop, out);
+    return sbTop + stop;
+}
+
+Cell TerminalModel::makeCellForCurrentAttr() const {
+    Cell blank;
+    blank.attr = m_blankAttrId;
+    return blank;
+}
+
+void TerminalModel::setSGR(std::span<const CsiParam> params) {
+#ifdef ENABLE_DEBUG
+    DBG() << "setSGR params size=" << params.size();
+#endif
+    // SGR 0 resets the rendition only, not the hyperlink or zone.
+    const CellAttr reset{.zone = m_currentAttr.zone, .link = m_currentAttr.link};
+    if (params.empty()) {
+        setCurrentAttr(reset);
+        return;
+    }
+    size_t i = 0;
+    while (i < params.size()) {
+        int p = params[i++].value;
+        switch (p) {
+            case 0:
+                m_currentAttr = reset;
+                break;
+            case 1:
+                m_currentAttr.style |= (unsigned char)TextStyle::Bold;
+                break;
+            case 4:
+                // 4:0 is "no underline"; other underline styles draw as single.
+                if (i < params.size() && params[i].sub && params[i].value == 0)
+                    m_currentAttr.style &= ~(unsigned char)TextStyle::Underline;
+                else
+                    m_currentAttr.style |= (unsigned char)TextStyle::Underline;
+                break;
+            case 7:
+                m_currentAttr.style |= (unsigned char)TextStyle::Inverse;
+                break;
+            case 22:
+                m_currentAttr.style &= ~(unsigned char)TextStyle::Bold;
+                break;
+            case 24:
+                m_currentAttr.style &= ~(unsigned char)TextStyle::Underline;
+                break;
+            case 27:
+                m_currentAttr.style &= ~(unsigned char)TextStyle::Inverse;
+                break;
+            case 39:
+                m_currentAttr.fg = CellColor::kDefaultFg;
+                break;
+            case 49:
+                m_currentAttr.bg = CellColor::kDefaultBg;
+                break;
+            case 30:
+            case 31:
+            case 32:
+            case 33:
+            case 34:
+            case 35:
+            case 36:
+            case 37:
+                m_currentAttr.fg = CellColor::indexed(p - 30);
+                break;
+            case 40:
+            case 41:
+            case 42:
+            case 43:
+            case 44:
+            case 45:
+            case 46:
+            case 47:
+                m_currentAttr.bg = CellColor::indexed(p - 40);
+                break;
+            case 90:
+            case 91:
+            case 92:
+            case 93:
+            case 94:
+            case 95:
+            case 96:
+            case 97:
+                m_currentAttr.fg = CellColor::indexed((p - 90) + 8);
+                break;
+            case 100:
+            case 101:
+            case 102:
+            case 103:
+            case 104:
+            case 105:
+            case 106:
+            case 107:
+                m_currentAttr.bg = CellColor::indexed((p - 100) + 8);
+                break;
+            case 38:
+                parseExtendedColor(params, i, m_currentAttr.fg);
+                break;
+            case 48:
+                parseExtendedColor(params, i, m_currentAttr.bg);
+                break;
+            default:
+#ifdef ENABLE_DEBUG
+                DBG() << "Unknown SGR code" << p;
+#endif
+                break;
+        }
+        while (i < params.size() && params[i].sub)
+            ++i;
+    }
+    setCurrentAttr(m_currentAttr);
+}
+
+void TerminalModel::parseExtendedColor(std::span<const CsiParam> params, std::size_t& i, std::uint32_t& color) {
+    if (i >= params.size())
+        return;
+
+    // 38:5:n and 38:2:[colorspace]:r:g:b; the caller skips the sub-parameters.
+    if (params[i].sub) {
+        std::size_t n = 0;
+        while (i + n < params.size() && params[i + n].sub)
+            ++n;
+        const std::span<const CsiParam> sub = params.subspan(i, n);
+        if (sub[0].value == 5 && n >= 2)
+            color = CellColor::indexed(sub[1].value);
+        else if (sub[0].value == 2 && n >= 5)
+            color = CellColor::rgb(sub[2].value, sub[3].value, sub[4].value);
+        else if (sub[0].value == 2 && n == 4)
+            color = CellColor::rgb(sub[1].value, sub[2].value, sub[3].value);
+        return;
+    }
+
+    // Legacy 38;5;n and 38;2;r;g;b.
+    if (params[i].value == 5) {
+        if (i + 1 < params.size()) {
+            color = CellColor::indexed(params[i + 1].value);
+            i += 2;
+        }
+        else {
+            i = params.size();
+        }
+    }
+    else if (params[i].value == 2) {
+        if (i + 3 < params.size()) {
+            color = CellColor::rgb(params[i + 1].value, params[i + 2].value, params[i + 3].value);
+            i += 4;
+        }
+        else {
+            i = params.size();
+        }
+    }
+}
+
+void TerminalModel::setCurrentAttr(const CellAttr& attr) {
+    // After the assignment, so a link just interned for attr is kept.
+    m_currentAttr = attr;
+    reclaimIfDue();
+    m_currentAttrId = m_attrs.intern(attr);
+    if (attr.link == LinkTable::kNone && attr.zone == Zone::None) {
+        m_blankAttrId = m_currentAttrId;
+        return;
+    }
+    CellAttr blank = attr;
+    blank.link = LinkTable::kNone;
+    blank.zone = Zone::None;
+    m_blankAttrId = m_attrs.intern(blank);
+}
+
+void TerminalModel::setHyperlink(std::string_view id, std::string_view uri) {
+#ifdef ENABLE_DEBUG
+    DBG() << "setHyperlink id=" << QByteArray(id.data(), qsizetype(id.size()))
+          << "uri=" << QByteArray(uri.data(), qsizetype(uri.size()));
+#endif
+    reclaimIfDue();
+    CellAttr attr = m_currentAttr;
+    attr.link = uri.empty() ? LinkTable::kNone : m_links.intern(id, uri);
+    setCurrentAttr(attr);
+}
+
+void TerminalModel::reclaimIfDue() {
+    if (!crowded(m_attrs) && !crowded(m_clusters) && !crowded(m_links))
+        return;
+    const std::size_t misses = m_attrs.misses() + m_clusters.misses() + m_links.misses();
+    if (misses - m_reclaimMisses >= kReclaimMisses || m_scrollback->pagesDropped() != m_reclaimPages)
+        reclaimIds();
+}
+
+void TerminalModel::reclaimIds() {
+    std::vector<bool> attrs(AttrTable::kCapacity);
+    std::vector<bool> clusters(ClusterTable::kCapacity);
+    std::vector<bool> links(LinkTable::kCapacity);
+
+    for (const ScreenBuffer* buf : {m_mainScreen.get(), m_alternateScreen.get()}) {
+        if (!buf)
+            continue;
+        for (int r = 0; r < buf->rows(); ++r) {
+            const Cell* row = buf->row(r);
+            for (int c = 0; c < buf->cols(); ++c) {
+                attrs[row[c].attr] = true;
+                if (row[c].isCluster())
+                    clusters[row[c].cluster()] = true;
+            }
+        }
+    }
+    m_scrollback->markUsed(attrs, clusters);
+    attrs[m_currentAttrId] = true;
+    attrs[m_blankAttrId] = true;
+
+    // Links are only referred to by attributes, and by the cursor's while
+    // it could not be interned.
+    for (std::size_t id = 0; id < m_attrs.size(); ++id) {
+        if (attrs[id])
+            links[m_attrs[AttrTable::Id(id)].link] = true;
+    }
+    links[m_currentAttr.link] = true;
+    for (const SavedCursor& saved : m_savedCursors)
+        links[saved.attr.link] = true;
+
+    m_attrs.reclaim(attrs);
+    m_clusters.reclaim(clusters);
+    m_links.reclaim(links);
+    if (!m_snapshotTaken)
+        releaseIds();
+    m_reclaimMisses = m_attrs.misses() + m_clusters.misses() + m_links.misses();
+    m_reclaimPages = m_scrollback->pagesDropped();
+}
+
+void TerminalModel::releaseIds() {
+    m_attrs.release();
+    m_clusters.release();
+    m_links.release();
+}
+
+void TerminalModel::setZone(Zone zone) {
+    CellAttr attr = m_currentAttr;
+    attr.zone = zone;
+    setCurrentAttr(attr);
+}
+
+int TerminalModel::promptLine(int line, bool above) const {
+    // History has its index per page; the screen is short enough to scan.
+    const int history = scrollbackSize();
+    int before = -1;
+    int after = -1;
+    if (!m_inAlternateScreen) {
+        Zone zone = m_scrollback->lastZone();
+        for (int r = 0; r < m_mainScreen->rows() && after < 0; ++r) {
+            if (!startsPrompt(m_mainScreen->row(r), usedLength(*m_mainScreen, r), m_attrs, zone))
+                continue;
+            if (history + r < line)
+                before = history + r;
+            else if (history + r > line)
+                after = history + r;
+        }
+    }
+
+    if (above) {
+        if (before >= 0 || line <= 0)
+            return before;
+        const std::optional<std::size_t> row = m_scrollback->promptBefore(std::size_t(std::min(line, history)));
+        return row ? int(*row) : -1;
+    }
+    if (line < history) {
+        if (const std::optional<std::size_t> row = m_scrollback->promptAfter(std::size_t(std::max(line, 0))))
+            return int(*row);
+    }
+    return after;
+}
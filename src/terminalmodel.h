@@ -0,0 +1,536 @@
+#ifndef TERMINALMODEL_H
+#define TERMINALMODEL_H
+
+#include <QByteArray>
+#include <QObject>
+#include <QChar>
+#include <QMutex>
+#include <QString>
+
+#include "attrtable.h"
+#include "charwidth.h"
+#include "clustertable.h"
+#include "csiparams.h"
+#include "linktable.h"
+#include "metrics.h"
+#include "palette.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <vector>
+
+// DECSCUSR shapes.
+enum class CursorShape : std::uint8_t { Block, Underline, Bar };
+
+// Colors and style live in the model's AttrTable; a cell only carries the id.
+// A wide character takes its cell and a kWideSpacer after it; one with
+// combining marks is a ClusterTable entry.
+struct Cell {
+    char32_t ch{U' '};
+    AttrTable::Id attr{AttrTable::kDefault};
+
+    bool isWideSpacer() const noexcept { return ch == kWideSpacer; }
+    bool isCluster() const noexcept { return (ch & kClusterBit) != 0; }
+    ClusterTable::Id cluster() const noexcept { return ch & ~kClusterBit; }
+};
+static_assert(sizeof(Cell) == 8, "Cell should stay packed");
+
+// OSC 133: whether count cells hold the start of a prompt, a cell in the
+// prompt zone after one that is not. zone is what they follow on from, and is
+// left at the last cell's.
+bool startsPrompt(const Cell* cells, int count, const AttrTable& attrs, Zone& zone) noexcept;
+
+// Where the row starting at offset start of a line length cells long ends,
+// laid out cols wide. As in putChar(), a wide character never straddles the
+// margin: where cell end would be its spacer, which spacerAt(i) tells, the
+// row ends one cell early and is padded with a blank.
+template <typename SpacerAt>
+std::size_t wrapRow(std::size_t start, std::size_t length, int cols, SpacerAt spacerAt) {
+    const std::size_t end = start + std::size_t(cols);
+    if (end >= length)
+        return length;
+    return cols > 1 && spacerAt(end) ? end - 1 : end;
+}
+
+class Scrollback;
+class SearchQuery;
+struct SearchMatch;
+
+// Damaged columns of each row, as one half-open span per row. Carries damage
+// from the grid to the renderer so a frame only repaints the cells that
+// changed since the previous one.
+class RowDamage {
+   public:
+    struct Span {
+        int first{0};
+        int last{0};
+        bool empty() const noexcept { return first >= last; }
+    };
+
+    void resize(int rows, int cols) {
+        m_cols = std::max(cols, 0);
+        m_spans.assign(std::size_t(std::max(rows, 0)), Span{});
+        m_all = false;
+    }
+    int size() const noexcept { return int(m_spans.size()); }
+
+    void set(int r) noexcept { set(r, 0, m_cols); }
+    void set(int r, int c0, int c1) noexcept {
+        c0 = std::max(c0, 0);
+        c1 = std::min(c1, m_cols);
+        if (r < 0 || r >= size() || c0 >= c1)
+            return;
+        Span& span = m_spans[std::size_t(r)];
+        span = span.empty() ? Span{c0, c1} : Span{std::min(span.first, c0), std::max(span.last, c1)};
+    }
+    void setRange(int r0, int r1) noexcept {
+        for (int r = std::max(r0, 0); r <= std::min(r1, size() - 1); ++r)
+            set(r);
+    }
+    void setAll() noexcept { m_all = true; }
+    void clear() noexcept {
+        std::fill(m_spans.begin(), m_spans.end(), Span{});
+        m_all = false;
+    }
+
+    bool all() const noexcept { return m_all; }
+    bool test(int r) const noexcept { return m_all || !m_spans[std::size_t(r)].empty(); }
+    Span span(int r) const noexcept { return m_all ? Span{0, m_cols} : m_spans[std::size_t(r)]; }
+    bool any() const noexcept {
+        return m_all || std::any_of(m_spans.begin(), m_spans.end(), [](const Span& sp) { return !sp.empty(); });
+    }
+
+   private:
+    int m_cols{0};
+    bool m_all{false};
+    std::vector<Span> m_spans;
+};
+
+// Rows are stored out of order: m_rowIndex maps a screen row (offset by the
+// rotating m_head) to its storage slot. Scrolling permutes that map instead of
+// moving cells; a full-screen scroll is just a head bump. Each row is still
+// contiguous, so row(r) can be copied or memmoved as one block. A row's
+// soft-wrap flag belongs to its slot and so travels with it.
+//
+// Damage, on the other hand, is kept per screen row: fillRow, the rotations
+// and resize record it themselves, and whoever writes through row() or cell()
+// reports it with damage(). Every report bumps generation().
+class ScreenBuffer {
+   public:
+    ScreenBuffer(int rows, int cols);
+
+    void resize(int rows, int cols);
+    int rows() const noexcept { return m_rows; }
+    int cols() const noexcept { return m_cols; }
+
+    Cell* row(int r) noexcept;
+    const Cell* row(int r) const noexcept;
+    Cell& cell(int r, int c);
+    const Cell& cell(int r, int c) const;
+
+    // Set when output ran past the row's last column and continued on the
+    // next row, which makes the two one line for reflow.
+    bool wrapped(int r) const noexcept { return m_wrapped[slot(r)] != 0; }
+    void setWrapped(int r, bool on) noexcept { m_wrapped[slot(r)] = on; }
+
+    // Clearing through the last column also ends the row's wrap.
+    void fillRow(int r, int c0, int c1, const Cell&);
+
+    void damage(int r, int c0, int c1) noexcept {
+        m_damage.set(r, c0, c1);
+        ++m_generation;
+    }
+    void damageRows(int top, int bottom) noexcept {
+        m_damage.setRange(top, bottom);
+        ++m_generation;
+    }
+    void damageAll() noexcept {
+        m_damage.setAll();
+        ++m_generation;
+    }
+    const RowDamage& damaged() const noexcept { return m_damage; }
+    void clearDamage() noexcept { m_damage.clear(); }
+    std::uint64_t generation() const noexcept { return m_generation; }
+
+    // Rows [top, bottom] move up (or down) by n; the n rows pushed out of the
+    // region wrap around to the vacated end with their old contents.
+    void rotateUp(int top, int bottom, int n);
+    void rotateDown(int top, int bottom, int n);
+
+   private:
+    std::uint32_t& slot(int r) noexcept;
+    std::uint32_t slot(int r) const noexcept;
+    void reverseRows(int first, int last) noexcept;
+
+    int m_rows;
+    int m_cols;
+    int m_head{0};
+    std::vector<std::uint32_t> m_rowIndex;
+    std::vector<std::uint8_t> m_wrapped;
+    std::vector<Cell> m_data;
+    RowDamage m_damage;
+    std::uint64_t m_generation{0};
+};
+
+// Copy of everything the GUI thread needs to paint one frame. The widget keeps
+// one of these as its front buffer; the model is the back buffer.
+struct ScreenSnapshot {
+    int rows{0};
+    int cols{0};
+    int firstLine{0};
+    int scrollbackLines{0};
+    std::uint64_t droppedLines{0};
+    // Which screen, and its generation(), the cells were last brought up to.
+    bool alternateScreen{false};
+    std::uint64_t generation{0};
+
+    int cursorRow{0};
+    int cursorCol{0};
+    bool showCursor{true};
+    CursorShape cursorShape{CursorShape::Block};
+    bool cursorBlink{true};
+    bool mouseEnabled{true};
+    bool bracketedPaste{false};
+    // Copied only when paletteGeneration falls behind the model's.
+    Palette palette;
+    std::uint64_t paletteGeneration{0};
+
+    std::vector<Cell> cells;
+    RowDamage dirtyRows;
+
+    const Cell* line(int row) const { return cells.data() + std::size_t(row) * std::size_t(cols); }
+};
+
+// Terminal state mutated by the parser. It is owned by the GUI side but written
+// from the PTY I/O thread, so every call below must be made with mutex() held.
+class TerminalModel : public QObject {
+    Q_OBJECT
+   public:
+    explicit TerminalModel(int rows, int cols, QObject* parent = nullptr);
+    ~TerminalModel() override;
+
+    QMutex& mutex() const noexcept { return m_mutex; }
+
+    int rows() const noexcept { return currentBuffer().rows(); }
+    int cols() const noexcept { return currentBuffer().cols(); }
+
+    void setMouseEnabled(bool on);
+    bool mouseEnabled() const noexcept { return m_mouseEnabled; }
+    void setAutoWrap(bool on) noexcept { m_autoWrap = on; }
+    void setBracketedPaste(bool on) noexcept { m_bracketedPaste = on; }
+    void setCursorVisible(bool on) noexcept { m_showCursor = on; }
+    // DECSCUSR: 0 or 1 blinking block, 2 steady block, 3 and 4 underline,
+    // 5 and 6 bar.
+    void setCursorStyle(int ps) noexcept;
+    void setCursorBlink(bool on) noexcept { m_cursorBlink = on; }
+    bool bracketedPaste() const noexcept { return m_bracketedPaste; }
+
+    // DEC mode 2026. While it is set the view holds frames back, so a redraw
+    // the application sends in several writes is painted once. An update that
+    // is never ended lapses after kSynchronizedUpdateTimeoutMs. The getter is
+    // lock-free and false once the update has lapsed.
+    static constexpr int kSynchronizedUpdateTimeoutMs = 150;
+    void setSynchronizedUpdate(bool on) noexcept;
+    bool synchronizedUpdate() const noexcept;
+    // DEC modes 47, 1047 and 1049. Both screens keep their buffers, so a
+    // switch only changes which one is drawn; clearAlternateScreen() blanks
+    // it where 1049 and 1047 ask for that.
+    void useAlternateScreen(bool alt);
+    void clearAlternateScreen();
+    void setScrollingRegion(int top, int bottom);
+    void setTerminalSize(int rows, int cols);
+
+    void lineFeed();
+    void reverseLineFeed();
+    void putChar(char32_t ch);
+    // Same as putChar for each byte; text must be printable ASCII only.
+    void putAsciiRun(const unsigned char* text, std::size_t n);
+    void setCursorPos(int row, int col, bool clamp = true);
+    // DECSC and DECRC: position and attributes, saved separately per screen.
+    void saveCursorPos();
+    void restoreCursorPos();
+    void eraseInLine(int mode);
+    void eraseInDisplay(int mode);
+    void setSGR(std::span<const CsiParam> params);
+
+    void scrollUp(int top, int bottom);
+    void scrollDown(int top, int bottom);
+
+    void deleteChars(int n);
+    void eraseChars(int n);
+    void insertChars(int n);
+    void deleteLines(int n);
+    void insertLines(int n);
+    void scrollUpLines(int n);
+    void scrollDownLines(int n);
+
+    int getCursorRow() const noexcept { return m_cursorRow; }
+    int getCursorCol() const noexcept { return m_cursorCol; }
+    void setCursorRow(int r) {
+        m_cursorRow = r;
+        clampCursor();
+    }
+    void setCursorCol(int c) {
+        m_cursorCol = c;
+        clampCursor();
+    }
+    void clampCursor();
+
+    const CellAttr& currentAttr() const noexcept { return m_currentAttr; }
+    void setCurrentAttr(const CellAttr& attr);
+
+    // Ids handed out in a snapshot stay valid until the next one is taken, so
+    // the renderer may resolve them without holding mutex().
+    const AttrTable& attrs() const noexcept { return m_attrs; }
+    const ClusterTable& clusters() const noexcept { return m_clusters; }
+    const LinkTable& links() const noexcept { return m_links; }
+
+    // OSC 8 and OSC 133. Both carry over to the text written after them as
+    // part of its attributes; an empty uri ends the link.
+    void setHyperlink(std::string_view id, std::string_view uri);
+    void setZone(Zone zone);
+    // The line, numbered as for copyAbsoluteLine(), of the nearest prompt
+    // start above or below line on the main screen or in history; -1 if none.
+    int promptLine(int line, bool above) const;
+
+    void fullReset();
+    // VT sequences that rebuild the screens, cursor, modes and palette on a
+    // terminal of the same size, whatever state it was in. History is left
+    // out.
+    QByteArray encodeScreen() const;
+    void handleBell();
+    void setWindowTitle(const QString& title);
+
+    // Indexed colors as set by OSC 4 and reset by OSC 104. A change repaints
+    // everything; resetPaletteColor(-1) restores the whole palette.
+    const Palette& palette() const noexcept { return m_palette; }
+    void setPaletteColor(int index, std::uint32_t argb);
+    void resetPaletteColor(int index);
+
+    ScreenBuffer& currentBuffer();
+    const ScreenBuffer& currentBuffer() const;
+    ScreenBuffer* getMainScreen() { return m_mainScreen.get(); }
+    // Null until the alternate screen is first used.
+    ScreenBuffer* getAlternateScreen() { return m_alternateScreen.get(); }
+    bool inAlternateScreen() const noexcept { return m_inAlternateScreen; }
+    void fillScreen(ScreenBuffer& buf, const Cell& blank);
+
+    int scrollbackSize() const noexcept;
+    std::uint64_t droppedLines() const noexcept { return m_droppedLines; }
+    void setScrollbackLimits(std::size_t maxLines, std::size_t memoryBudget, bool compress);
+    bool enableScrollbackSpill(const QString& dir);
+
+    // Fills out with the cols() cells of absolute line absLine (scrollback
+    // first, then the screen). Returns false if the line does not exist;
+    // wrapped, if given, says whether it continues on the next line.
+    bool copyAbsoluteLine(int absLine, std::vector<Cell>& out, bool* wrapped = nullptr) const;
+
+    // Searches the logical lines of the screen and history that start in
+    // rows [first, last), newest first, for at most maxLines lines. Rows count
+    // like SearchMatch::row. Returns the row the scan stopped at; lines at or
+    // after it were covered, and nothing is left once it reaches droppedLines().
+    std::uint64_t search(const SearchQuery& query, std::uint64_t first, std::uint64_t last, std::size_t maxLines,
+                         std::vector<SearchMatch>& out) const;
+
+    void markCellsDirty(int row, int c0, int c1) noexcept { currentBuffer().damage(row, c0, c1); }
+    void markRowDirty(int row) noexcept { currentBuffer().damage(row, 0, cols()); }
+    void markRowsDirty(int top, int bottom) noexcept { currentBuffer().damageRows(top, bottom); }
+    void markAllDirty() noexcept { currentBuffer().damageAll(); }
+
+    // Brings out up to date with the visible rows starting at absolute line
+    // firstLine (negative means "pinned to the bottom"). out is expected to be
+    // the previous frame: only damaged cells are copied, and out.dirtyRows says
+    // which canvas rows changed.
+    void snapshot(int firstLine, ScreenSnapshot& out);
+
+    // Thread-safe, lock-free. Emits changed() once per consumed snapshot so a
+    // flooding producer cannot pile up queued events in the GUI thread.
+    void notifyChanged(std::size_t parsedBytes = 0);
+    std::size_t takeParsedBytes() noexcept { return m_parsedBytes.exchange(0, std::memory_order_relaxed); }
+    std::size_t parsedBytes() const noexcept { return m_parsedBytes.load(std::memory_order_relaxed); }
+
+    // Written by the parser and the view, readable from any thread.
+    Metrics& metrics() noexcept { return m_metrics; }
+    const Metrics& metrics() const noexcept { return m_metrics; }
+
+   signals:
+    void changed();
+    void titleChanged(const QString& title);
+    void bell();
+    // An answer to a query, for the shell. Emitted on the parser's thread.
+    void reply(const QByteArray& bytes);
+
+   private:
+    Cell makeCellForCurrentAttr() const;
+    static void parseExtendedColor(std::span<const CsiParam> params, std::size_t& i, std::uint32_t& color);
+    void wrapToNextLine();
+    // Adds a zero-width character to the one left of the cursor.
+    bool joinPrevious(char32_t mark);
+    void reflowMainScreen(int rows, int cols, bool moveCursor);
+    // Takes back the attribute, cluster and link ids that neither the screens,
+    // history nor the cursor use. reclaimIfDue() does so once a table is
+    // filling up and enough has changed since the last time.
+    void reclaimIds();
+    void reclaimIfDue();
+    void releaseIds();
+    void encodeRows(const ScreenBuffer& buf, QByteArray& out) const;
+
+    mutable QMutex m_mutex;
+    std::atomic<bool> m_changePending{false};
+    std::atomic<std::size_t> m_parsedBytes{0};
+    Metrics m_metrics;
+    // steady_clock nanoseconds; 0 while no synchronized update is open.
+    std::atomic<std::int64_t> m_syncDeadline{0};
+
+    std::unique_ptr<ScreenBuffer> m_mainScreen;
+    std::unique_ptr<ScreenBuffer> m_alternateScreen;
+    bool m_inAlternateScreen{false};
+
+    std::unique_ptr<Scrollback> m_scrollback;
+    std::uint64_t m_droppedLines{0};
+
+    bool m_showCursor{true};
+    CursorShape m_cursorShape{CursorShape::Block};
+    bool m_cursorBlink{true};
+    int m_cursorRow{0};
+    int m_cursorCol{0};
+    struct SavedCursor {
+        int row{0};
+        int col{0};
+        CellAttr attr;
+    };
+    // Indexed by m_inAlternateScreen.
+    std::array<SavedCursor, 2> m_savedCursors{};
+    AttrTable m_attrs;
+    CellAttr m_currentAttr;
+    AttrTable::Id m_currentAttrId{AttrTable::kDefault};
+    ClusterTable m_clusters;
+    LinkTable m_links;
+    // m_currentAttr without its link and zone, for erased cells.
+    AttrTable::Id m_blankAttrId{AttrTable::kDefault};
+    // Reclaimed ids are free at once until a snapshot has been handed out.
+    bool m_snapshotTaken{false};
+    // Table misses and dropped history pages as of the last reclaimIds().
+    std::size_t m_reclaimMisses{0};
+    std::size_t m_reclaimPages{0};
+    // The last character joined was a ZWJ, so the next one belongs to it too.
+    bool m_joinNext{false};
+
+    int m_scrollRegionTop{0};
+    int m_scrollRegionBottom{0};
+
+    bool m_mouseEnabled{true};
+    bool m_bracketedPaste{false};
+    bool m_autoWrap{true};
+
+    Palette m_palette;
+    std::uint64_t m_paletteGeneration{1};
+};
+
+inline ScreenBuffer::ScreenBuffer(int rows, int cols) {
+    resize(rows, cols);
+}
+
+inline void ScreenBuffer::resize(int rows, int cols) {
+    m_rows = std::max(rows, 1);
+    m_cols = std::max(cols, 1);
+    m_head = 0;
+
+    m_rowIndex.resize(std::size_t(m_rows));
+    for (int r = 0; r < m_rows; ++r)
+        m_rowIndex[std::size_t(r)] = std::uint32_t(r);
+    m_wrapped.assign(std::size_t(m_rows), 0);
+    m_data.assign(static_cast<std::size_t>(m_rows) * static_cast<std::size_t>(m_cols), Cell{});
+    m_damage.resize(m_rows, m_cols);
+    damageAll();
+}
+
+inline std::uint32_t& ScreenBuffer::slot(int r) noexcept {
+    int pos = m_head + r;
+    if (pos >= m_rows)
+        pos -= m_rows;
+    return m_rowIndex[std::size_t(pos)];
+}
+
+inline std::uint32_t ScreenBuffer::slot(int r) const noexcept {
+    int pos = m_head + r;
+    if (pos >= m_rows)
+        pos -= m_rows;
+    return m_rowIndex[std::size_t(pos)];
+}
+
+inline Cell* ScreenBuffer::row(int r) noexcept {
+    assert(r >= 0 && r < m_rows && "Row access out of bounds");
+    return m_data.data() + std::size_t(slot(r)) * std::size_t(m_cols);
+}
+
+inline const Cell* ScreenBuffer::row(int r) const noexcept {
+    assert(r >= 0 && r < m_rows && "Row access out of bounds");
+    return m_data.data() + std::size_t(slot(r)) * std::size_t(m_cols);
+}
+
+inline Cell& ScreenBuffer::cell(int r, int c) {
+    assert(c >= 0 && c < m_cols && "Cell access out of bounds");
+    return row(r)[c];
+}
+
+inline const Cell& ScreenBuffer::cell(int r, int c) const {
+    assert(c >= 0 && c < m_cols && "Cell access out of bounds");
+    return row(r)[c];
+}
+
+inline void ScreenBuffer::fillRow(int r, int c0, int c1, const Cell& cell) {
+    if (r < 0 || r >= m_rows)
+        return;
+
+    c0 = std::clamp(c0, 0, m_cols);
+    c1 = std::clamp(c1, 0, m_cols);
+
+    std::fill(row(r) + c0, row(r) + c1, cell);
+    if (c1 == m_cols)
+        setWrapped(r, false);
+    damage(r, c0, c1);
+}
+
+inline void ScreenBuffer::reverseRows(int first, int last) noexcept {
+    while (first < last)
+        std::swap(slot(first++), slot(last--));
+}
+
+inline void ScreenBuffer::rotateUp(int top, int bottom, int n) {
+    top = std::max(top, 0);
+    bottom = std::min(bottom, m_rows - 1);
+    const int height = bottom - top + 1;
+    if (height <= 0 || n <= 0)
+        return;
+    n %= height;
+    if (n == 0)
+        return;
+
+    damageRows(top, bottom);
+    if (height == m_rows) {
+        m_head = (m_head + n) % m_rows;
+        return;
+    }
+    reverseRows(top, top + n - 1);
+    reverseRows(top + n, bottom);
+    reverseRows(top, bottom);
+}
+
+inline void ScreenBuffer::rotateDown(int top, int bottom, int n) {
+    top = std::max(top, 0);
+    bottom = std::min(bottom, m_rows - 1);
+    const int height = bottom - top + 1;
+    if (height <= 0 || n <= 0)
+        return;
+    rotateUp(top, bottom, height - n % height);
+}
+
+#endif
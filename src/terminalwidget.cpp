@@ -1,73 +1,149 @@
 #include "terminalwidget.h"
+#include "metrics.h"
+#include "paste.h"
 #include "debug.h"
 
+#ifdef ENABLE_GL_RENDERER
+#include "glrenderer.h"
+#endif
+
 #include <QPainter>
 #include <QKeyEvent>
 #include <QMouseEvent>
 #include <QScrollBar>
 #include <QResizeEvent>
 #include <QClipboard>
+#include <QMimeData>
+#include <QDesktopServices>
+#include <QUrl>
 #include <QGuiApplication>
 #include <QFont>
 #include <QFontDatabase>
+#include <QFontMetrics>
 #include <QDebug>
 #include <QApplication>
-#include <cerrno>
+#include <QMutexLocker>
+#include <QScreen>
 #include <cstring>
 #include <algorithm>
+#include <chrono>
+#include <limits>
 #include <memory>
 #include <pty.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
 
-#include "terminalwidget.h"
-#include "debug.h"
+namespace {
+// More than this many bytes parsed within one frame interval counts as a bulk
+// stream (cat, build logs) rather than interactive output.
+constexpr std::size_t kStreamingBytesPerFrame = 64 * 1024;
+// The shell hears about a new size only once resizing pauses for this long,
+// so dragging a window edge doesn't make it redraw its prompt on every step.
+constexpr int kWinsizeDebounceMs = 80;
+// While streaming with the view pinned to the bottom, frames are skipped so
+// parsing is not throttled by painting, but never more than this many in a row.
+constexpr int kMaxSkippedFrames = 8;
+// History is searched this many lines per event loop turn, so neither the
+// GUI nor the PTY thread waiting on the model lock stalls on a long scan.
+constexpr std::size_t kSearchSliceLines = 50000;
+// Likewise for copying a selection; one slice is copied without deferring.
+constexpr int kCopySliceLines = 20000;
+constexpr QRgb kBlack = 0xFF000000;
+constexpr int kMetricsRefreshMs = 1000;
+// Output this soon after input, and no larger, is taken for an echo and
+// painted without waiting for the frame timer.
+constexpr auto kEchoWindow = std::chrono::milliseconds(50);
+constexpr std::size_t kEchoMaxBytes = 4096;
+
+// The terminal font and its cell geometry, shared by every terminal and
+// resolved only when the first one is created.
+struct FontSetup {
+    QFont font;
+    int charWidth;
+    int charHeight;
+    int ascent;
+    int underlinePos;
+};
+
+const FontSetup& fontSetup() {
+    static const FontSetup setup = [] {
+        QFont font = QApplication::font();
+        if (font.family().isEmpty()) {
+            font.setFamily("Source Code Pro");
+        }
+        font.setPointSize(10);
+
+        font.setStyleHint(QFont::Monospace, QFont::PreferDefault);
+        QFont::insertSubstitution("Source Code Pro", "Noto Color Emoji");
+        const QFontMetrics fm(font);
+        return FontSetup{font, fm.horizontalAdvance(QChar('M')), fm.height(), fm.ascent(),
+                         fm.ascent() + fm.underlinePos()};
+    }();
+    return setup;
+}
 
-#include <QFont>
-#include <QFontDatabase>
-#include <QApplication>
+bool hasGlyph(char32_t ch) {
+    if (ch == U' ' || ch == kWideSpacer)
+        return false;
+    return (ch & kClusterBit) || QChar::isPrint(ch);
+}
+}  // namespace
 
-TerminalWidget::TerminalWidget(QWidget* parent)
-    : QAbstractScrollArea(parent),
-      m_inAlternateScreen(false),
-      m_scrollbackMax(1000),
-      m_showCursor(true),
-      m_cursorRow(0),
-      m_cursorCol(0),
-      m_savedCursorRow(0),
-      m_savedCursorCol(0),
-      m_currentFg(7),
-      m_currentBg(0),
-      m_currentStyle(0),
-      m_scrollRegionTop(0),
-      m_scrollRegionBottom(23),
-      m_mouseEnabled(true),
-      m_selecting(false),
-      m_hasSelection(false),
-      m_ptyMaster(-1),
-      m_shellPid(-1) {
-    QFont mainFont = QApplication::font();
-    if (mainFont.family().isEmpty()) {
-        mainFont.setFamily("Source Code Pro");
-    }
-    mainFont.setPointSize(10);
-
-    mainFont.setStyleHint(QFont::Monospace, QFont::PreferDefault);
-    QFont::insertSubstitution("Source Code Pro", "Noto Color Emoji");
-    setFont(mainFont);
-
-    m_charWidth = fontMetrics().horizontalAdvance(QChar('M'));
-    m_charHeight = fontMetrics().height();
+TerminalWidget::TerminalWidget(TerminalModel* model, QWidget* parent) : QAbstractScrollArea(parent), m_model(model) {
+    const FontSetup& fonts = fontSetup();
+    setFont(fonts.font);
+    m_charWidth = fonts.charWidth;
+    m_charHeight = fonts.charHeight;
+    m_underlinePos = fonts.underlinePos;
 
     int defaultRows = height() / m_charHeight;
     int defaultCols = width() / m_charWidth;
 
-    m_mainScreen = std::make_unique<ScreenBuffer>(defaultRows, defaultCols);
-    m_alternateScreen = std::make_unique<ScreenBuffer>(defaultRows, defaultCols);
+    {
+        QMutexLocker lock(&m_model->mutex());
+        m_model->setTerminalSize(std::max(defaultRows, 1), std::max(defaultCols, 1));
+        m_model->snapshot(-1, m_snapshot);
+    }
+    syncPalette();
 
     setFocusPolicy(Qt::StrongFocus);
     setMouseTracking(true);
 
+    const QScreen* scr = QGuiApplication::primaryScreen();
+    const qreal hz = (scr && scr->refreshRate() > 1.0) ? scr->refreshRate() : 60.0;
+    m_frameTimer.setSingleShot(true);
+    m_frameTimer.setTimerType(Qt::PreciseTimer);
+    m_frameTimer.setInterval(std::max(1, int(1000.0 / hz)));
+    connect(&m_frameTimer, &QTimer::timeout, this, &TerminalWidget::renderFrame);
+
+    m_winsizeTimer.setSingleShot(true);
+    m_winsizeTimer.setInterval(kWinsizeDebounceMs);
+    connect(&m_winsizeTimer, &QTimer::timeout, this, &TerminalWidget::applyPtySize);
+
+    m_searchTimer.setSingleShot(true);
+    m_searchTimer.setInterval(0);
+    connect(&m_searchTimer, &QTimer::timeout, this, &TerminalWidget::continueSearch);
+    m_copyTimer.setInterval(0);
+    connect(&m_copyTimer, &QTimer::timeout, this, &TerminalWidget::continueCopy);
+
+    // Half the platform's flash period; 0 there means no blinking.
+    m_blinkTimer.setInterval(QApplication::cursorFlashTime() / 2);
+    connect(&m_blinkTimer, &QTimer::timeout, this, [this] {
+        m_cursorBlinkOn = !m_cursorBlinkOn;
+        viewport()->update(m_cursorRect);
+    });
+
+    m_metricsTimer.setInterval(kMetricsRefreshMs);
+    connect(&m_metricsTimer, &QTimer::timeout, this, &TerminalWidget::refreshMetricsOverlay);
+
+    connect(m_model, &TerminalModel::changed, this, &TerminalWidget::scheduleFrame);
+    connect(m_model, &TerminalModel::bell, this, &TerminalWidget::handleBell);
+    connect(m_model, &TerminalModel::titleChanged, this, &TerminalWidget::setWindowTitle);
+    connect(verticalScrollBar(), &QScrollBar::valueChanged, this, [this] {
+        if (!m_syncingScrollBar)
+            updateScreen();
+    });
+
 #ifdef ENABLE_DEBUG
     DBG() << "TerminalWidget created with rows=" << defaultRows << " cols=" << defaultCols
           << " charWidth=" << m_charWidth << " charHeight=" << m_charHeight;
@@ -81,8 +157,8 @@ TerminalWidget::~TerminalWidget() {
 }
 
 QSize TerminalWidget::sizeHint() const {
-    int w = currentBuffer().cols() * m_charWidth + verticalScrollBar()->sizeHint().width();
-    int h = currentBuffer().rows() * m_charHeight;
+    int w = m_snapshot.cols * m_charWidth + verticalScrollBar()->sizeHint().width();
+    int h = m_snapshot.rows * m_charHeight;
 
 #ifdef ENABLE_DEBUG
     DBG() << "sizeHint w=" << w << "h=" << h;
@@ -94,7 +170,7 @@ void TerminalWidget::resizeEvent(QResizeEvent* event) {
     int newCols = std::max(1, width() / m_charWidth);
     int newRows = std::max(1, height() / m_charHeight);
 
-    if (newCols != currentBuffer().cols() || newRows != currentBuffer().rows()) {
+    if (newCols != m_snapshot.cols || newRows != m_snapshot.rows) {
 #ifdef ENABLE_DEBUG
         DBG() << "resizeEvent newRows=" << newRows << " newCols=" << newCols;
 #endif
@@ -105,57 +181,314 @@ void TerminalWidget::resizeEvent(QResizeEvent* event) {
 }
 
 void TerminalWidget::paintEvent(QPaintEvent* ev) {
+    const auto paintStart = std::chrono::steady_clock::now();
     QPainter p(viewport());
-    const QRegion clip = ev->region();
+    // The GL viewport does not keep its framebuffer between frames.
+    const QRegion clip = m_gl ? QRegion(viewport()->rect()) : ev->region();
     p.setClipRegion(clip);
     p.fillRect(clip.boundingRect(), Qt::black);
 
-    const int firstVisible = verticalScrollBar()->value();
-    const int rowsOnScreen = height() / m_charHeight;
-    const int cols = currentBuffer().cols();
-    const int totalLines = int(m_scrollbackBuffer.size()) + currentBuffer().rows();
+    const int firstVisible = m_snapshot.firstLine;
+    const int rowsOnScreen = std::min(height() / m_charHeight, m_snapshot.rows);
+    const int cols = m_snapshot.cols;
+    const int totalLines = m_snapshot.scrollbackLines + m_snapshot.rows;
 
     if (totalLines == 0 || rowsOnScreen == 0 || cols == 0)
         return;
 
     const int lastVisible = std::min(firstVisible + rowsOnScreen, totalLines);
 
+    if (!m_gl || !paintGpu(p, firstVisible, lastVisible, cols)) {
+        renderCanvas(firstVisible, lastVisible, cols);
+        p.drawPixmap(0, 0, m_canvas);
+    }
+
+    // Overlays, drawn over either renderer.
+    if (m_search)
+        drawMatches(p, firstVisible, lastVisible, cols);
+    if (m_hoveredLink != LinkTable::kNone)
+        drawHoveredLink(p, rowsOnScreen, cols);
+
+    if (m_hasSelection) {
+        const int selTop = std::max(m_selection.topLine(), firstVisible);
+        const int selBottom = std::min(m_selection.bottomLine(), lastVisible - 1);
+        for (int absLine = selTop; absLine <= selBottom; ++absLine) {
+            const Selection::Span span = m_selection.span(absLine);
+            const int selStart = std::max(span.first, 0);
+            const int selEnd = std::min(span.last, cols - 1);
+            if (selStart <= selEnd)
+                p.fillRect(selStart * m_charWidth, (absLine - firstVisible) * m_charHeight,
+                           (selEnd - selStart + 1) * m_charWidth, m_charHeight, QColor(128, 128, 255, 128));
+        }
+    }
+
+    drawCursor(p);
+
+    if (metricsOverlay())
+        drawMetricsOverlay(p);
+
+    const auto paintEnd = std::chrono::steady_clock::now();
+    auto micros = [](auto d) {
+        return std::uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(d).count());
+    };
+    m_model->metrics().recordFrame(micros(paintEnd - paintStart));
+    if (m_timeNextPaint) {
+        m_timeNextPaint = false;
+        m_model->metrics().recordEchoLatency(micros(paintEnd - m_inputAt));
+    }
+
+    StartupTiming& startup = StartupTiming::instance();
+    startup.mark(StartupTiming::Milestone::FirstPaint);
+    if (m_showsOutput && startup.mark(StartupTiming::Milestone::FirstPrompt)) {
+#ifdef ENABLE_DEBUG
+        DBG() << startup.summary();
+#endif
+        if (startup.report())
+            qInfo().noquote() << startup.summary();
+    }
+}
+
+void TerminalWidget::renderCanvas(int firstVisible, int lastVisible, int cols) {
+    const qreal dpr = devicePixelRatioF();
+    const QSize size = viewport()->size() * dpr;
+    if (m_canvas.size() != size) {
+        m_canvas = QPixmap(size);
+        m_canvas.setDevicePixelRatio(dpr);
+        m_canvasDamage = viewport()->rect();
+    }
+    if (m_canvasDamage.isEmpty())
+        return;
+
+    QPainter cp(&m_canvas);
+    cp.setClipRegion(m_canvasDamage);
+    cp.fillRect(m_canvasDamage.boundingRect(), Qt::black);
+    paintCells(cp, m_canvasDamage, firstVisible, lastVisible, cols);
+    m_canvasDamage = QRegion();
+}
+
+void TerminalWidget::createGlyphCache() {
+    const FontSetup& fonts = fontSetup();
+    m_glyphCache =
+        GlyphCache::shared(fonts.font, fonts.charWidth, fonts.charHeight, fonts.ascent, devicePixelRatioF());
+}
+
+void TerminalWidget::paintCells(QPainter& p, const QRegion& clip, int firstVisible, int lastVisible, int cols) {
+    // Pass 1: one fill per background run, glyphs collected per atlas page.
+    glyphCache()->beginFrame();
+    for (auto& frags : m_glyphFragments)
+        frags.clear();
+
     for (int absLine = firstVisible; absLine < lastVisible; ++absLine) {
         const int canvasRow = absLine - firstVisible;
         const int y = canvasRow * m_charHeight;
 
-        if (!clip.intersects(QRect(0, y, viewport()->width(), m_charHeight)))
+        const QRect band(0, y, viewport()->width(), m_charHeight);
+        if (!clip.intersects(band))
             continue;
 
-        const Cell* cells = getCellsAtAbsoluteLine(absLine);
-        if (!cells)
+        // Only the damaged columns, and one either side for glyph overhang.
+        const QRect damaged = clip.intersected(band).boundingRect();
+        const int c0 = std::max(0, damaged.left() / m_charWidth - 1);
+        const int c1 = std::min(cols, damaged.right() / m_charWidth + 2);
+        drawRow(p, y, m_snapshot.line(canvasRow), c0, c1);
+    }
+
+    // Pass 2: every glyph on screen in one call per atlas page.
+    for (int page = 0; page < int(m_glyphFragments.size()); ++page) {
+        const auto& frags = m_glyphFragments[std::size_t(page)];
+        if (!frags.empty())
+            p.drawPixmapFragments(frags.data(), int(frags.size()), glyphCache()->page(page));
+    }
+}
+
+#ifdef ENABLE_GL_RENDERER
+bool TerminalWidget::paintGpu(QPainter& p, int firstVisible, int lastVisible, int cols) {
+    if (!m_gl->usable()) {
+        QMetaObject::invokeMethod(this, &TerminalWidget::dropGpuRenderer, Qt::QueuedConnection);
+        return false;
+    }
+
+    const int visibleRows = lastVisible - firstVisible;
+    glyphCache()->beginFrame();
+    if (m_gpuDamage.size() < visibleRows) {
+        m_gpuDamage.resize(m_snapshot.rows, cols);
+        m_gpuDamage.setAll();
+    }
+    if (m_gl->gridRows() != visibleRows || m_gl->gridCols() != cols || m_gpuGlyphEpoch != glyphCache()->epoch()) {
+        m_gl->resizeGrid(visibleRows, cols);
+        m_gpuGlyphEpoch = glyphCache()->epoch();
+        m_gpuDamage.setAll();
+    }
+
+    auto toRgba = [](QRgb c, std::uint8_t* out) {
+        out[0] = std::uint8_t(qRed(c));
+        out[1] = std::uint8_t(qGreen(c));
+        out[2] = std::uint8_t(qBlue(c));
+        out[3] = 255;
+    };
+
+    const AttrTable& attrs = m_model->attrs();
+    for (int r = 0; r < visibleRows; ++r) {
+        if (!m_gpuDamage.test(r))
             continue;
 
-        for (int col = 0, x = 0; col < cols; ++col, x += m_charWidth) {
-            drawCell(p, canvasRow, col, cells[col]);
+        const Cell* cells = m_snapshot.line(r);
+        GlRenderer::Instance* out = m_gl->row(r);
+        for (int col = 0; col < cols;) {
+            const AttrTable::Id runAttr = cells[col].attr;
+            int end = col + 1;
+            while (end < cols && cells[end].attr == runAttr)
+                ++end;
+
+            const CellAttr& head = attrs[runAttr];
+            const bool isBold = (head.style & (unsigned char)TextStyle::Bold);
+            QRgb fg = cellColor(head.fg, isBold);
+            QRgb bg = cellColor(head.bg, false);
+            if (head.style & (unsigned char)TextStyle::Inverse)
+                std::swap(fg, bg);
+
+            GlRenderer::Instance proto;
+            toRgba(bg, proto.bg);
+            toRgba(fg, proto.fg);
+            if (head.style & (unsigned char)TextStyle::Underline)
+                proto.flags |= GlRenderer::kUnderline;
+
+            for (int c = col; c < end; ++c) {
+                GlRenderer::Instance& in = out[c];
+                in = proto;
+                if (cells[c].isWideSpacer() && c > 0) {
+                    // The right half of the glyph to the left.
+                    const GlRenderer::Instance& lead = out[c - 1];
+                    in.page = lead.page;
+                    in.glyphX = std::uint16_t(lead.glyphX + m_charWidth * glyphCache()->devicePixelRatio());
+                    in.glyphY = lead.glyphY;
+                    continue;
+                }
+                if (!hasGlyph(cells[c].ch))
+                    continue;
+                const GlyphCache::Glyph g = cellGlyph(cells, c, isBold, fg);
+                if (g.page < 0 || g.page >= GlRenderer::kNoGlyph)
+                    continue;
+                in.page = std::uint8_t(g.page);
+                in.glyphX = std::uint16_t(g.source.x());
+                in.glyphY = std::uint16_t(g.source.y());
+            }
+            col = end;
         }
+        m_gl->markRowDirty(r);
+    }
+    m_gpuDamage.clear();
 
-        if (m_hasSelection && absLine >= std::min(m_selAnchorAbsLine, m_selActiveAbsLine) &&
-            absLine <= std::max(m_selAnchorAbsLine, m_selActiveAbsLine)) {
-            int selStart = 0, selEnd = cols - 1;
+    p.beginNativePainting();
+    m_gl->draw(m_charWidth, m_charHeight, m_underlinePos);
+    p.endNativePainting();
+    return true;
+}
+#else
+bool TerminalWidget::paintGpu(QPainter&, int, int, int) {
+    return false;
+}
+#endif
 
-            if (absLine == m_selAnchorAbsLine) {
-                selStart = (m_selAnchorAbsLine < m_selActiveAbsLine) ? m_selAnchorCol : m_selActiveCol;
-            }
-            if (absLine == m_selActiveAbsLine) {
-                selEnd = (m_selAnchorAbsLine > m_selActiveAbsLine) ? m_selAnchorCol : m_selActiveCol;
-            }
+bool TerminalWidget::useGpuRenderer() {
+#ifdef ENABLE_GL_RENDERER
+    if (m_gl)
+        return true;
+    auto* gl = new GlRenderer(glyphCache());
+    gl->setMouseTracking(viewport()->hasMouseTracking());
+    setViewport(gl);
+    m_gl = gl;
+    m_gpuDamage.resize(0, 0);
+    m_canvas = QPixmap();
+    viewport()->update();
+    return true;
+#else
+    return false;
+#endif
+}
 
-            if (selStart > selEnd)
-                std::swap(selStart, selEnd);
+void TerminalWidget::dropGpuRenderer() {
+    if (!m_gl)
+        return;
+#ifdef ENABLE_DEBUG
+    DBG() << "GL renderer unavailable, painting with QPainter";
+#endif
+    auto* raster = new QWidget;
+    raster->setMouseTracking(viewport()->hasMouseTracking());
+    m_gl = nullptr;
+    // Deletes the GL viewport.
+    setViewport(raster);
+    m_canvasDamage = raster->rect();
+    viewport()->update();
+}
 
-            p.fillRect(selStart * m_charWidth, y, (selEnd - selStart + 1) * m_charWidth, m_charHeight,
-                       QColor(128, 128, 255, 128));
-        }
+void TerminalWidget::setMetricsOverlay(bool on) {
+    if (on == metricsOverlay())
+        return;
+    if (on) {
+        m_metricsLastBytes = m_model->metrics().bytesParsed();
+        m_metricsTimer.start();
+        refreshMetricsOverlay();
+    }
+    else {
+        m_metricsTimer.stop();
+        viewport()->update(m_metricsRect);
     }
+}
 
-    if (m_showCursor)
-        drawCursor(p, firstVisible, rowsOnScreen);
+void TerminalWidget::refreshMetricsOverlay() {
+    const Metrics& m = m_model->metrics();
+    const std::uint64_t bytes = m.bytesParsed();
+    const double mibPerSecond = double(bytes - m_metricsLastBytes) * 1000.0 / kMetricsRefreshMs / (1 << 20);
+    m_metricsLastBytes = bytes;
+
+    const Histogram& feed = m.feedNanoseconds();
+    const Histogram& paint = m.paintMicroseconds();
+    const Histogram& dirty = m.dirtyCells();
+    const Histogram& echo = m.echoMicroseconds();
+    QString seq;
+    for (int i = 0; i < int(Metrics::Sequence::Count); ++i) {
+        const auto s = Metrics::Sequence(i);
+        seq += QStringLiteral(" %1 %2").arg(QString::fromLatin1(Metrics::sequenceName(s))).arg(m.sequences(s));
+    }
+
+    m_metricsText = {
+        QStringLiteral("parse %1 MiB/s  feed p50 %2us p99 %3us")
+            .arg(mibPerSecond, 0, 'f', 1)
+            .arg(feed.quantile(0.5) / 1000)
+            .arg(feed.quantile(0.99) / 1000),
+        QStringLiteral("paint p50 %1us p99 %2us  frames %3 dropped %4")
+            .arg(paint.quantile(0.5))
+            .arg(paint.quantile(0.99))
+            .arg(paint.count())
+            .arg(m.droppedFrames()),
+        QStringLiteral("dirty p50 %1 p99 %2 cells").arg(dirty.quantile(0.5)).arg(dirty.quantile(0.99)),
+        QStringLiteral("echo p50 %1us p99 %2us").arg(echo.quantile(0.5)).arg(echo.quantile(0.99)),
+        QStringLiteral("seq%1").arg(seq),
+        QStringLiteral("history %1 MiB").arg(double(m.scrollbackBytes()) / (1 << 20), 0, 'f', 1),
+    };
+
+    const QFontMetrics fm = fontMetrics();
+    int width = 0;
+    for (const QString& line : m_metricsText)
+        width = std::max(width, fm.horizontalAdvance(line));
+    const int pad = m_charWidth / 2;
+    const QRect rect(viewport()->width() - width - 3 * pad, pad, width + 2 * pad,
+                     int(m_metricsText.size()) * fm.height() + 2 * pad);
+    viewport()->update(m_metricsRect.united(rect));
+    m_metricsRect = rect;
+}
+
+void TerminalWidget::drawMetricsOverlay(QPainter& p) {
+    const QFontMetrics fm = fontMetrics();
+    const int pad = m_charWidth / 2;
+    p.fillRect(m_metricsRect, QColor(0, 0, 0, 200));
+    p.setPen(QColor(0x80, 0xFF, 0x80));
+    int y = m_metricsRect.top() + pad + fm.ascent();
+    for (const QString& line : m_metricsText) {
+        p.drawText(m_metricsRect.left() + pad, y, line);
+        y += fm.height();
+    }
 }
 
 void TerminalWidget::keyPressEvent(QKeyEvent* event) {
@@ -232,13 +565,8 @@ void TerminalWidget::setPtyInfo(int ptyMaster, pid_t shellPid) {
 #endif
     m_ptyMaster = ptyMaster;
     m_shellPid = shellPid;
-}
-
-void TerminalWidget::setMouseEnabled(bool on) {
-#ifdef ENABLE_DEBUG
-    DBG() << "setMouseEnabled:" << (on ? "enabled" : "disabled");
-#endif
-    m_mouseEnabled = on;
+    // A shell started ahead of the window still has the default size.
+    applyPtySize();
 }
 
 void TerminalWidget::updateScreen() {
@@ -246,646 +574,569 @@ void TerminalWidget::updateScreen() {
     DBG() << "updateScreen triggered";
 #endif
 
-    viewport()->update();
-}
-
-void TerminalWidget::useAlternateScreen(bool alt) {
-#ifdef ENABLE_DEBUG
-    DBG() << "useAlternateScreen alt=" << alt;
-#endif
-    if (m_inAlternateScreen == alt)
-        return;
-
-    m_inAlternateScreen = alt;
-
-    if (alt) {
-        m_alternateScreen->resize(m_mainScreen->rows(), m_mainScreen->cols());
-        fillScreen(*m_alternateScreen, makeCellForCurrentAttr());
-    }
-    else {
+    const bool pinned = isViewPinnedBottom();
+    {
+        QMutexLocker lock(&m_model->mutex());
+        int first = -1;
+        if (!pinned) {
+            // Keep the same content in view when old scrollback lines were dropped.
+            const auto dropped = int(m_model->droppedLines() - m_snapshot.droppedLines);
+            first = std::max(0, verticalScrollBar()->value() - dropped);
+        }
+        m_model->snapshot(first, m_snapshot);
+        if (!m_showsOutput)
+            m_showsOutput = m_model->metrics().bytesParsed() > 0;
+        if (m_search)
+            refreshLiveMatches();
     }
+    syncPalette();
 
-    viewport()->update();
+    syncScrollBar();
+    invalidateDirtyRows();
+    updateCursor();
 }
 
-void TerminalWidget::setScrollingRegion(int top, int bottom) {
-#ifdef ENABLE_DEBUG
-    DBG() << "setScrollingRegion top=" << top << " bottom=" << bottom;
-#endif
-
-    if (bottom < top) {
-        m_scrollRegionTop = 0;
-        m_scrollRegionBottom = currentBuffer().rows() - 1;
-    }
-    else {
-        m_scrollRegionTop = std::clamp(top, 0, currentBuffer().rows() - 1);
-        m_scrollRegionBottom = std::clamp(bottom, 0, currentBuffer().rows() - 1);
+void TerminalWidget::scheduleFrame() {
+    if (m_awaitingEcho) {
+        m_awaitingEcho = false;
+        m_timeNextPaint = true;
     }
-}
 
-void TerminalWidget::lineFeed() {
-#ifdef ENABLE_DEBUG
-    DBG() << "lineFeed at row=" << m_cursorRow;
-#endif
-
-    m_cursorRow++;
-
-    if (m_cursorRow > m_scrollRegionBottom) {
-        scrollUp(m_scrollRegionTop, m_scrollRegionBottom);
-
-        m_cursorRow = m_scrollRegionBottom;
+    // Typing: repaint now rather than up to a frame later.
+    if (m_lowLatencyEcho && std::chrono::steady_clock::now() - m_inputAt < kEchoWindow &&
+        m_model->parsedBytes() <= kEchoMaxBytes && !m_model->synchronizedUpdate()) {
+        m_frameTimer.stop();
+        renderFrame();
+        return;
     }
 
-    clampCursor();
-
-#ifdef ENABLE_DEBUG
-    DBG() << "Updated cursor position: row=" << m_cursorRow;
-#endif
+    if (!m_frameTimer.isActive())
+        m_frameTimer.start();
 }
 
-void TerminalWidget::reverseLineFeed() {
-#ifdef ENABLE_DEBUG
-    DBG() << "reverseLineFeed at row=" << m_cursorRow;
-#endif
-
-    if (m_cursorRow == m_scrollRegionTop) {
-        scrollDown(m_scrollRegionTop, m_scrollRegionBottom);
-    }
-    else {
-        m_cursorRow = std::max(m_cursorRow - 1, 0);
+void TerminalWidget::renderFrame() {
+    // Mid synchronized update: keep polling at the frame rate until the
+    // application ends it or it lapses, then paint the finished frame.
+    if (m_model->synchronizedUpdate()) {
+        m_frameTimer.start();
+        return;
     }
 
-    clampCursor();
+    const std::size_t parsed = m_model->takeParsedBytes();
+    if (parsed >= kStreamingBytesPerFrame && isViewPinnedBottom() && m_skippedFrames < kMaxSkippedFrames) {
+        ++m_skippedFrames;
+        m_model->metrics().countDroppedFrame();
+        m_frameTimer.start();
+        return;
+    }
 
-#ifdef ENABLE_DEBUG
-    DBG() << "Updated cursor position: row=" << m_cursorRow;
-#endif
+    m_skippedFrames = 0;
+    updateScreen();
 }
 
-void TerminalWidget::putChar(QChar ch) {
-#ifdef ENABLE_DEBUG
-    DBG() << "putChar: " << ch;
-#endif
-
-    if (ch == u'\r') {
-#ifdef ENABLE_DEBUG
-        DBG() << "Carriage return encountered. Resetting column to 0.";
-#endif
-        m_cursorCol = 0;
-        clampCursor();
-        return;
+void TerminalWidget::invalidateDirtyRows() {
+    const RowDamage& dirty = m_snapshot.dirtyRows;
+    std::uint64_t dirtyCells = 0;
+    if (dirty.all()) {
+        dirtyCells = std::uint64_t(m_snapshot.rows) * std::uint64_t(m_snapshot.cols);
     }
+    else {
+        for (int r = 0; r < m_snapshot.rows; ++r) {
+            const RowDamage::Span span = dirty.span(r);
+            if (!span.empty())
+                dirtyCells += std::uint64_t(span.last - span.first);
+        }
+    }
+    m_model->metrics().recordDirtyCells(dirtyCells);
 
-    if (ch == u'\n') {
-#ifdef ENABLE_DEBUG
-        DBG() << "Newline encountered. Moving cursor to the next line.";
-#endif
-
-        m_cursorCol = 0;
-        clampCursor();
+    if (m_gl) {
+        // GL frames are drawn whole; only the rows to rebuild are kept.
+        if (dirty.all() || m_gpuDamage.size() != m_snapshot.rows) {
+            m_gpuDamage.resize(m_snapshot.rows, m_snapshot.cols);
+            m_gpuDamage.setAll();
+        }
+        else {
+            for (int r = 0; r < m_snapshot.rows; ++r) {
+                if (dirty.test(r))
+                    m_gpuDamage.set(r);
+            }
+        }
+        viewport()->update();
         return;
     }
 
-    if (!ch.isPrint() || ch == u'\x7F' || ch.isHighSurrogate() || ch.isLowSurrogate()) {
-#ifdef ENABLE_DEBUG
-        DBG() << "Non-printable character skipped: " << ch;
-#endif
+    if (dirty.all()) {
+        m_canvasDamage = viewport()->rect();
+        viewport()->update();
         return;
     }
 
-    if (m_cursorCol >= currentBuffer().cols()) {
-#ifdef ENABLE_DEBUG
-        DBG() << "Column limit reached. Wrapping text to the next line.";
-#endif
-
-        m_cursorCol = 0;
+    for (int r = 0; r < m_snapshot.rows;) {
+        const RowDamage::Span span = dirty.span(r);
+        if (span.empty()) {
+            ++r;
+            continue;
+        }
+        // Rows damaged in the same columns go out as one rect.
+        int end = r + 1;
+        while (end < m_snapshot.rows && dirty.span(end).first == span.first && dirty.span(end).last == span.last)
+            ++end;
+        const QRect rect(span.first * m_charWidth, r * m_charHeight, (span.last - span.first) * m_charWidth,
+                         (end - r) * m_charHeight);
+        m_canvasDamage += rect;
+        viewport()->update(rect);
+        r = end;
     }
+}
 
-    Cell& cell = currentBuffer().cell(m_cursorRow, m_cursorCol);
-    cell.ch = ch;
+void TerminalWidget::syncScrollBar() {
+    QScrollBar* sb = verticalScrollBar();
+    m_syncingScrollBar = true;
+    sb->setRange(0, m_snapshot.scrollbackLines);
+    sb->setPageStep(m_snapshot.rows);
+    sb->setValue(m_snapshot.firstLine);
+    m_syncingScrollBar = false;
+}
 
-#ifdef ENABLE_DEBUG
-    DBG() << "Cell updated at row=" << m_cursorRow << " col=" << m_cursorCol << " with char=" << ch;
-#endif
-    cell.fg = m_currentFg;
-    cell.bg = m_currentBg;
-    cell.style = m_currentStyle;
+void TerminalWidget::clampLineCol(int& line, int& col) {
+    int maxAbsLine = m_snapshot.scrollbackLines + m_snapshot.rows - 1;
+    line = std::clamp(line, 0, maxAbsLine);
+    col = std::clamp(col, 0, m_snapshot.cols - 1);
+}
 
-    invalidateCell(m_cursorRow, m_cursorCol);
+QRect TerminalWidget::cursorRect() const {
+    const int visibleRows = std::min(height() / m_charHeight, m_snapshot.rows);
+    const int row = m_snapshot.scrollbackLines + m_snapshot.cursorRow - m_snapshot.firstLine;
+    if (!m_snapshot.showCursor || m_snapshot.cols == 0 || row < 0 || row >= visibleRows)
+        return {};
+
+    // A cursor waiting to wrap sits on the last column. Over a wide
+    // character it covers both of its cells.
+    int col = std::min(m_snapshot.cursorCol, m_snapshot.cols - 1);
+    const Cell* cells = m_snapshot.line(row);
+    if (col > 0 && cells[col].isWideSpacer())
+        --col;
+    const bool wide = col + 1 < m_snapshot.cols && cells[col + 1].isWideSpacer();
+    return QRect(col * m_charWidth, row * m_charHeight, wide ? 2 * m_charWidth : m_charWidth, m_charHeight);
+}
 
-    ++m_cursorCol;
+void TerminalWidget::updateCursor() {
+    const QRect rect = cursorRect();
+    if (rect != m_cursorRect || m_snapshot.cursorShape != m_cursorShape) {
+        viewport()->update(m_cursorRect);
+        viewport()->update(rect);
+        m_cursorRect = rect;
+        m_cursorShape = m_snapshot.cursorShape;
+        // Solid while it moves, as when typing.
+        m_cursorBlinkOn = true;
+        m_blinkTimer.stop();
+    }
+
+    const bool blink = m_snapshot.cursorBlink && hasFocus() && !rect.isEmpty() && m_blinkTimer.interval() > 0;
+    if (!blink) {
+        if (!m_cursorBlinkOn) {
+            m_cursorBlinkOn = true;
+            viewport()->update(rect);
+        }
+        m_blinkTimer.stop();
+    }
+    else if (!m_blinkTimer.isActive()) {
+        m_blinkTimer.start();
+    }
 }
 
-inline void TerminalWidget::invalidateCell(int row, int col) {
-    if (row < 0 || col < 0)
+void TerminalWidget::drawCursor(QPainter& p) {
+    if (m_cursorRect.isEmpty() || !m_cursorBlinkOn)
         return;
 
-    int absLine = int(m_scrollbackBuffer.size()) + row;
-    int firstVisibleLine = verticalScrollBar()->value();
-    int canvasRow = absLine - firstVisibleLine;
+    const int col = m_cursorRect.x() / m_charWidth;
+    const Cell* cells = m_snapshot.line(m_cursorRect.y() / m_charHeight);
+    const Cell& cell = cells[col];
+    const CellAttr& attr = m_model->attrs()[cell.attr];
+    const QColor color = QColor::fromRgb(cellColor(attr.fg, false));
 
-    if (canvasRow < 0)
+    if (!hasFocus()) {
+        p.setPen(color);
+        p.setBrush(Qt::NoBrush);
+        p.drawRect(m_cursorRect.adjusted(0, 0, -1, -1));
         return;
-
-    int y = canvasRow * m_charHeight;
-    int x = col * m_charWidth;
-    viewport()->update(x, y, m_charWidth, m_charHeight);
-}
-
-void TerminalWidget::setCursorPos(int r, int c, bool doClamp) {
-#ifdef ENABLE_DEBUG
-    DBG() << "setCursorPos r=" << r << ", c=" << c << ", clamp=" << doClamp;
-#endif
-
-    if (doClamp) {
-        r = std::clamp(r, 0, currentBuffer().rows() - 1);
-        c = std::clamp(c, 0, currentBuffer().cols() - 1);
     }
 
-    if (r == m_cursorRow && c == m_cursorCol)
-        return;
-
-    invalidateCell(m_cursorRow, m_cursorCol);
-    m_prevCursorRow = m_cursorRow;
-    m_prevCursorCol = m_cursorCol;
-    m_cursorRow = r;
-    m_cursorCol = c;
-    invalidateCell(m_cursorRow, m_cursorCol);
-}
-
-void TerminalWidget::saveCursorPos() {
-#ifdef ENABLE_DEBUG
-    DBG() << "saveCursorPos row=" << m_cursorRow << ", col=" << m_cursorCol;
-#endif
-    m_savedCursorRow = m_cursorRow;
-    m_savedCursorCol = m_cursorCol;
+    const int thickness = std::max(2, m_charHeight / 10);
+    switch (m_cursorShape) {
+        case CursorShape::Block: {
+            p.fillRect(m_cursorRect, color);
+            if (hasGlyph(cell.ch)) {
+                const bool bold = (attr.style & (unsigned char)TextStyle::Bold);
+                const GlyphCache::Glyph g = cellGlyph(cells, col, bold, cellColor(attr.bg, false));
+                p.drawPixmap(QRectF(m_cursorRect), glyphCache()->page(g.page), g.source);
+            }
+            break;
+        }
+        case CursorShape::Underline:
+            p.fillRect(m_cursorRect.x(), m_cursorRect.bottom() + 1 - thickness, m_cursorRect.width(), thickness, color);
+            break;
+        case CursorShape::Bar:
+            p.fillRect(m_cursorRect.x(), m_cursorRect.y(), thickness, m_cursorRect.height(), color);
+            break;
+    }
 }
 
-void TerminalWidget::restoreCursorPos() {
-#ifdef ENABLE_DEBUG
-    DBG() << "restoreCursorPos to row=" << m_savedCursorRow << ", col=" << m_savedCursorCol;
-#endif
-    m_cursorRow = m_savedCursorRow;
-    m_cursorCol = m_savedCursorCol;
-    clampCursor();
+void TerminalWidget::focusInEvent(QFocusEvent* event) {
+    QAbstractScrollArea::focusInEvent(event);
+    viewport()->update(m_cursorRect);
+    updateCursor();
 }
 
-void TerminalWidget::clampCursor() {
-#ifdef ENABLE_DEBUG
-    DBG() << "Clamping cursor: row=" << m_cursorRow << ", col=" << m_cursorCol;
-#endif
-
-    m_cursorRow = std::clamp(m_cursorRow, 0, currentBuffer().rows() - 1);
-    m_cursorCol = std::clamp(m_cursorCol, 0, currentBuffer().cols() - 1);
-
-#ifdef ENABLE_DEBUG
-    DBG() << "Clamped cursor: row=" << m_cursorRow << ", col=" << m_cursorCol;
-#endif
+void TerminalWidget::focusOutEvent(QFocusEvent* event) {
+    QAbstractScrollArea::focusOutEvent(event);
+    m_cursorBlinkOn = true;
+    viewport()->update(m_cursorRect);
+    updateCursor();
 }
 
-void TerminalWidget::clampLineCol(int& line, int& col) {
-    int maxAbsLine = int(m_scrollbackBuffer.size()) + currentBuffer().rows() - 1;
-    line = std::clamp(line, 0, maxAbsLine);
-    col = std::clamp(col, 0, currentBuffer().cols() - 1);
+inline bool TerminalWidget::isViewPinnedBottom() const noexcept {
+    const QScrollBar* sb = verticalScrollBar();
+    return sb->value() >= sb->maximum();
 }
 
-void TerminalWidget::deleteChars(int n) {
+void TerminalWidget::setTerminalSize(int rows, int cols) {
 #ifdef ENABLE_DEBUG
-    DBG() << "deleteChars n=" << n << "row=" << m_cursorRow << "col=" << m_cursorCol;
+    DBG() << "setTerminalSize rows=" << rows << "cols=" << cols;
 #endif
-
-    int row = m_cursorRow;
-    if (row < 0 || row >= currentBuffer().rows() || n < 1)
-        return;
-
-    for (int count = 0; count < n; ++count) {
-        for (int c = m_cursorCol; c < currentBuffer().cols() - 1; ++c) {
-            currentBuffer().cell(row, c) = currentBuffer().cell(row, c + 1);
-        }
-        currentBuffer().cell(row, currentBuffer().cols() - 1) = makeCellForCurrentAttr();
+    // Reflow renumbers history lines, so a selection would point elsewhere.
+    if (cols != m_snapshot.cols) {
+        m_hasSelection = false;
+        m_copy.reset();
+        m_copyTimer.stop();
     }
 
-    viewport()->update();
-}
-
-void TerminalWidget::eraseChars(int n) {
-#ifdef ENABLE_DEBUG
-    DBG() << "eraseChars n=" << n << "row=" << m_cursorRow << "col=" << m_cursorCol;
-#endif
-
-    int row = m_cursorRow;
-    if (row < 0 || row >= currentBuffer().rows() || n < 1)
-        return;
-
-    for (int i = 0; i < n; ++i) {
-        int c = m_cursorCol + i;
-        if (c >= currentBuffer().cols())
-            break;
-        currentBuffer().cell(row, c) = makeCellForCurrentAttr();
+    {
+        QMutexLocker lock(&m_model->mutex());
+        m_model->setTerminalSize(rows, cols);
     }
+    m_winsizeTimer.start();
+    if (m_search)
+        startSearch(std::make_unique<SearchQuery>(m_search->pattern(), m_search->isRegex(), m_search->caseSensitive()),
+                    false);
 
-    viewport()->update();
+    updateScreen();
 }
 
-void TerminalWidget::insertChars(int n) {
-#ifdef ENABLE_DEBUG
-    DBG() << "insertChars n=" << n << "row=" << m_cursorRow << "col=" << m_cursorCol;
-#endif
-
-    int row = m_cursorRow;
-    if (row < 0 || row >= currentBuffer().rows() || n < 1)
+void TerminalWidget::applyPtySize() {
+    if (m_ptyMaster < 0)
         return;
 
-    for (int count = 0; count < n; ++count) {
-        for (int c = currentBuffer().cols() - 1; c > m_cursorCol; --c) {
-            currentBuffer().cell(row, c) = currentBuffer().cell(row, c - 1);
-        }
-        currentBuffer().cell(row, m_cursorCol) = makeCellForCurrentAttr();
+    struct winsize ws;
+    memset(&ws, 0, sizeof(ws));
+    {
+        QMutexLocker lock(&m_model->mutex());
+        ws.ws_row = static_cast<unsigned short>(m_model->rows());
+        ws.ws_col = static_cast<unsigned short>(m_model->cols());
     }
-
-    viewport()->update();
-}
-
-void TerminalWidget::deleteLines(int n) {
 #ifdef ENABLE_DEBUG
-    DBG() << "deleteLines n=" << n << " row=" << m_cursorRow;
+    DBG() << "TIOCSWINSZ rows=" << ws.ws_row << "cols=" << ws.ws_col;
 #endif
-
-    int top = m_cursorRow;
-    int bottom = m_scrollRegionBottom;
-    int regionHeight = bottom - top + 1;
-    if (regionHeight <= 0 || n < 1)
-        return;
-
-    n = std::min(n, regionHeight);
-    int cols = currentBuffer().cols();
-    Cell* base = &currentBuffer().cell(top, 0);
-    if (regionHeight > n) {
-        std::memmove(base, base + n * cols, size_t(regionHeight - n) * size_t(cols) * sizeof(Cell));
-    }
-    for (int r = bottom - n + 1; r <= bottom; ++r) {
-        currentBuffer().fillRow(r, 0, cols, makeCellForCurrentAttr());
-    }
-
-    const int yTop = top * m_charHeight;
-    viewport()->scroll(0, -n * m_charHeight, QRect(0, yTop, viewport()->width(), regionHeight * m_charHeight));
-    viewport()->update(0, (bottom - n + 1) * m_charHeight, viewport()->width(), n * m_charHeight);
+    ioctl(m_ptyMaster, TIOCSWINSZ, &ws);
 }
 
-void TerminalWidget::insertLines(int n) {
+bool TerminalWidget::find(const QString& pattern, bool regex, bool caseSensitive) {
 #ifdef ENABLE_DEBUG
-    DBG() << "insertLines n=" << n << " row=" << m_cursorRow;
+    DBG() << "find pattern=" << pattern << "regex=" << regex << "caseSensitive=" << caseSensitive;
 #endif
-
-    int top = m_cursorRow;
-    int bottom = m_scrollRegionBottom;
-    int regionHeight = bottom - top + 1;
-    if (regionHeight <= 0 || n < 1)
-        return;
-
-    n = std::min(n, regionHeight);
-    int cols = currentBuffer().cols();
-    Cell* base = &currentBuffer().cell(top, 0);
-    if (regionHeight > n) {
-        std::memmove(base + n * cols, base, size_t(regionHeight - n) * size_t(cols) * sizeof(Cell));
-    }
-    for (int r = 0; r < n; ++r) {
-        currentBuffer().fillRow(top + r, 0, cols, makeCellForCurrentAttr());
+    auto query = std::make_unique<SearchQuery>(pattern, regex, caseSensitive);
+    if (!query->isValid()) {
+        clearSearch();
+        return false;
     }
-
-    const int yTop = top * m_charHeight;
-    viewport()->scroll(0, +n * m_charHeight, QRect(0, yTop, viewport()->width(), regionHeight * m_charHeight));
-    viewport()->update(0, yTop, viewport()->width(), n * m_charHeight);
-}
-
-void TerminalWidget::scrollUpLines(int n) {
-    for (int i = 0; i < n; ++i)
-        scrollUp(m_scrollRegionTop, m_scrollRegionBottom);
+    startSearch(std::move(query), true);
+    return true;
 }
 
-void TerminalWidget::scrollDownLines(int n) {
-    for (int i = 0; i < n; ++i)
-        scrollDown(m_scrollRegionTop, m_scrollRegionBottom);
+void TerminalWidget::startSearch(std::unique_ptr<SearchQuery> query, bool reveal) {
+    m_search = std::move(query);
+    m_historyMatches.clear();
+    m_screenMatches.clear();
+    m_currentMatch.reset();
+    m_longestMatch = 0;
+    m_revealPending = reveal;
+    {
+        QMutexLocker lock(&m_model->mutex());
+        m_searchResume = m_model->droppedLines() + std::uint64_t(m_model->scrollbackSize());
+        m_searchLive = m_searchResume;
+        refreshLiveMatches();
+    }
+    continueSearch();
 }
 
-void TerminalWidget::drawCursor(QPainter& p, int firstVisibleLine, int visibleRows) {
-    int cursorAbs = int(m_scrollbackBuffer.size()) + m_cursorRow;
-    if (cursorAbs < firstVisibleLine || cursorAbs >= firstVisibleLine + visibleRows)
+void TerminalWidget::continueSearch() {
+    if (!m_search)
         return;
 
-    int canvasRow = cursorAbs - firstVisibleLine;
-    int y = canvasRow * m_charHeight;
-    int x = m_cursorCol * m_charWidth;
-    QRect cellRect(x, y, m_charWidth, m_charHeight);
-
-    const Cell& cell = currentBuffer().cell(m_cursorRow, m_cursorCol);
-    QColor fg = ansiIndexToColor(cell.bg, false);
-    QColor bg = ansiIndexToColor(cell.fg, false);
-
-    p.fillRect(cellRect, bg);
-    if (cell.ch.isPrint()) {
-        p.setPen(fg);
-        int baseline = y + fontMetrics().ascent();
-        p.drawText(x, baseline, QString(cell.ch));
+    std::vector<SearchMatch> found;
+    bool complete = false;
+    {
+        QMutexLocker lock(&m_model->mutex());
+        const std::uint64_t dropped = m_model->droppedLines();
+        m_searchResume = m_model->search(*m_search, dropped, m_searchResume, kSearchSliceLines, found);
+        complete = m_searchResume <= dropped;
     }
-}
 
-void TerminalWidget::eraseInLine(int mode) {
+    // Everything found here is older than what is already listed.
+    std::sort(found.begin(), found.end());
+    for (const SearchMatch& m : found)
+        m_longestMatch = std::max(m_longestMatch, m.length);
+    m_historyMatches.insert(m_historyMatches.begin(), found.begin(), found.end());
+
+    if (!complete)
+        m_searchTimer.start();
 #ifdef ENABLE_DEBUG
-    DBG() << "eraseInLine mode=" << mode << "cursorRow=" << m_cursorRow;
+    DBG() << "Search slice found" << found.size() << "matches, complete=" << complete;
 #endif
+    emit searchProgress(int(m_historyMatches.size() + m_screenMatches.size()), complete);
 
-    int row = m_cursorRow;
-    if (row < 0 || row >= currentBuffer().rows())
-        return;
-
-    int startCol, endCol;
-    switch (mode) {
-        case 0:
-            startCol = m_cursorCol;
-            endCol = currentBuffer().cols();
-            break;
-        case 1:
-            startCol = 0;
-            endCol = m_cursorCol + 1;
-            break;
-        case 2:
-            startCol = 0;
-            endCol = currentBuffer().cols();
-            break;
-        default:
-            startCol = 0;
-            endCol = currentBuffer().cols();
-            break;
-    }
-
-    Cell blank = makeCellForCurrentAttr();
-    for (int c = startCol; c < endCol; ++c) {
-        Cell& cell = currentBuffer().cell(row, c);
-        cell.ch = QChar(' ');
-        cell.fg = blank.fg;
-        cell.bg = blank.bg;
-        cell.style = blank.style;
-    }
-
+    if (m_revealPending)
+        findNext(true);
     viewport()->update();
 }
 
-void TerminalWidget::eraseInDisplay(int mode) {
-#ifdef ENABLE_DEBUG
-    DBG() << "eraseInDisplay mode=" << mode << "cursorRow=" << m_cursorRow;
-#endif
+void TerminalWidget::refreshLiveMatches() {
+    const std::uint64_t dropped = m_model->droppedLines();
+    const std::uint64_t screenTop = dropped + std::uint64_t(m_model->scrollbackSize());
+    while (!m_historyMatches.empty() && m_historyMatches.front().row < dropped)
+        m_historyMatches.pop_front();
+
+    constexpr std::size_t kAll = std::numeric_limits<std::size_t>::max();
+    std::vector<SearchMatch> found;
+    if (screenTop > m_searchLive) {
+        m_model->search(*m_search, m_searchLive, screenTop, kAll, found);
+        std::sort(found.begin(), found.end());
+        m_historyMatches.insert(m_historyMatches.end(), found.begin(), found.end());
+        m_searchLive = screenTop;
+        found.clear();
+    }
+    m_model->search(*m_search, screenTop, screenTop + std::uint64_t(m_model->rows()), kAll, found);
+    std::sort(found.begin(), found.end());
+    m_screenMatches = std::move(found);
+
+    for (const SearchMatch& m : m_screenMatches)
+        m_longestMatch = std::max(m_longestMatch, m.length);
+}
 
-    Cell blank = makeCellForCurrentAttr();
+void TerminalWidget::findNext(bool older) {
+    if (!m_search)
+        return;
 
-    if (mode == 2) {
-        fillScreen(currentBuffer(), blank);
-        viewport()->update();
+    const std::size_t history = m_historyMatches.size();
+    const std::size_t total = history + m_screenMatches.size();
+    if (total == 0) {
+        m_revealPending = true;
         return;
     }
-
-    if (mode == 0) {
-        eraseInLine(0);
-        for (int r = m_cursorRow + 1; r < currentBuffer().rows(); ++r) {
-            currentBuffer().fillRow(r, 0, currentBuffer().cols(), blank);
+    auto at = [&](std::size_t i) -> const SearchMatch& {
+        return i < history ? m_historyMatches[i] : m_screenMatches[i - history];
+    };
+
+    // Without a current match, start from the bottom; either way, wrap around.
+    std::size_t next = total - 1;
+    if (m_currentMatch) {
+        std::size_t lo = 0, hi = total;
+        while (lo < hi) {
+            const std::size_t mid = lo + (hi - lo) / 2;
+            if (at(mid) < *m_currentMatch)
+                lo = mid + 1;
+            else
+                hi = mid;
         }
-        viewport()->update();
-    }
-    else if (mode == 1) {
-        eraseInLine(1);
-        for (int r = 0; r < m_cursorRow; ++r) {
-            currentBuffer().fillRow(r, 0, currentBuffer().cols(), blank);
+        if (older) {
+            next = lo == 0 ? total - 1 : lo - 1;
+        }
+        else {
+            if (lo < total && !(*m_currentMatch < at(lo)))
+                ++lo;
+            next = lo == total ? 0 : lo;
         }
-        viewport()->update();
     }
-}
 
-inline bool TerminalWidget::isViewPinnedBottom() const noexcept {
-    const QScrollBar* sb = verticalScrollBar();
-    return sb->value() >= sb->maximum();
+    m_revealPending = false;
+    m_currentMatch = at(next);
+    revealMatch(*m_currentMatch);
+    viewport()->update();
 }
 
-inline void TerminalWidget::maybeAdjustScrollBar(int deltaLines) {
-    QScrollBar* sb = verticalScrollBar();
-    const bool pinned = isViewPinnedBottom();
-    sb->setRange(0, int(m_scrollbackBuffer.size()));
-    sb->setPageStep(currentBuffer().rows());
-
-    if (pinned) {
-        sb->setValue(sb->maximum());
-    }
-    else {
-        sb->setValue(sb->value() + deltaLines);
-    }
+void TerminalWidget::clearSearch() {
+    m_searchTimer.stop();
+    m_search.reset();
+    m_historyMatches.clear();
+    m_screenMatches.clear();
+    m_currentMatch.reset();
+    m_longestMatch = 0;
+    m_revealPending = false;
+    viewport()->update();
 }
 
-void TerminalWidget::scrollUp(int top, int bottom) {
-#ifdef ENABLE_DEBUG
-    DBG() << "scrollUp top=" << top << "bottom=" << bottom;
-#endif
-
-    const int cols = currentBuffer().cols();
-    const int regionHeight = bottom - top + 1;
-    if (regionHeight <= 0)
+void TerminalWidget::revealMatch(const SearchMatch& match) {
+    if (match.row < m_snapshot.droppedLines)
         return;
 
-    std::vector<Cell> firstRow(cols);
-    std::copy_n(&currentBuffer().cell(top, 0), cols, firstRow.begin());
-
-    if (regionHeight > 1) {
-        Cell* base = &currentBuffer().cell(top, 0);
-        std::memmove(base, base + cols, size_t(regionHeight - 1) * size_t(cols) * sizeof(Cell));
-    }
-
-    currentBuffer().fillRow(bottom, 0, cols, makeCellForCurrentAttr());
-
-    if (int(m_scrollbackBuffer.size()) == m_scrollbackMax)
-        m_scrollbackBuffer.pop_front();
-    m_scrollbackBuffer.push_back(std::move(firstRow));
-
-    maybeAdjustScrollBar(+1);
-
-    const int yTop = top * m_charHeight;
-    const int yExposed = bottom * m_charHeight;
-    viewport()->scroll(0, -m_charHeight, QRect(0, yTop, viewport()->width(), regionHeight * m_charHeight));
-    viewport()->update(0, yExposed, viewport()->width(), m_charHeight);
-}
-
-void TerminalWidget::scrollDown(int top, int bottom) {
-#ifdef ENABLE_DEBUG
-    DBG() << "scrollDown top=" << top << "bottom=" << bottom;
-#endif
-
-    const int cols = currentBuffer().cols();
-    const int regionHeight = bottom - top + 1;
-    if (regionHeight <= 0)
+    const int line = int(match.row - m_snapshot.droppedLines);
+    if (line >= m_snapshot.firstLine && line < m_snapshot.firstLine + m_snapshot.rows)
         return;
-
-    if (regionHeight > 1) {
-        Cell* base = &currentBuffer().cell(top, 0);
-        std::memmove(base + cols, base, size_t(regionHeight - 1) * size_t(cols) * sizeof(Cell));
-    }
-
-    currentBuffer().fillRow(top, 0, cols, makeCellForCurrentAttr());
-
-    maybeAdjustScrollBar(-1);
-
-    const int yTop = top * m_charHeight;
-    viewport()->scroll(0, +m_charHeight, QRect(0, yTop, viewport()->width(), regionHeight * m_charHeight));
-    viewport()->update(0, yTop, viewport()->width(), m_charHeight);
+    verticalScrollBar()->setValue(std::clamp(line - m_snapshot.rows / 2, 0, m_snapshot.scrollbackLines));
 }
 
-ScreenBuffer& TerminalWidget::currentBuffer() {
-    return m_inAlternateScreen ? *m_alternateScreen : *m_mainScreen;
+LinkTable::Id TerminalWidget::linkAt(const QPoint& pos) const {
+    const int row = pos.y() / m_charHeight;
+    const int col = pos.x() / m_charWidth;
+    if (pos.x() < 0 || pos.y() < 0 || row >= m_snapshot.rows || col >= m_snapshot.cols)
+        return LinkTable::kNone;
+    return m_model->attrs()[m_snapshot.line(row)[col].attr].link;
 }
 
-const ScreenBuffer& TerminalWidget::currentBuffer() const {
-    return m_inAlternateScreen ? *m_alternateScreen : *m_mainScreen;
+void TerminalWidget::drawHoveredLink(QPainter& p, int rowsOnScreen, int cols) {
+    const AttrTable& attrs = m_model->attrs();
+    for (int r = 0; r < rowsOnScreen; ++r) {
+        const Cell* cells = m_snapshot.line(r);
+        for (int c = 0; c < cols;) {
+            if (attrs[cells[c].attr].link != m_hoveredLink) {
+                ++c;
+                continue;
+            }
+            const int first = c;
+            while (c < cols && attrs[cells[c].attr].link == m_hoveredLink)
+                ++c;
+            p.fillRect(first * m_charWidth, r * m_charHeight + m_underlinePos, (c - first) * m_charWidth, 1,
+                       QColor::fromRgb(cellColor(attrs[cells[first].attr].fg, false)));
+        }
+    }
 }
 
-void TerminalWidget::fillScreen(ScreenBuffer& buf, const Cell& blank) {
-#ifdef ENABLE_DEBUG
-    DBG() << "fillScreen rows=" << buf.rows() << "cols=" << buf.cols();
-#endif
-    for (int r = 0; r < buf.rows(); ++r) {
-        buf.fillRow(r, 0, buf.cols(), blank);
-    }
+bool TerminalWidget::scrollToPrompt(bool above) {
+    int line;
+    {
+        QMutexLocker lock(&m_model->mutex());
+        // The snapshot's lines are numbered as the model's, moved by history
+        // dropped since it was taken.
+        const auto dropped = int(m_model->droppedLines() - m_snapshot.droppedLines);
+        line = m_model->promptLine(m_snapshot.firstLine - dropped, above);
+        if (line >= 0)
+            line += dropped;
+    }
+    if (line < 0)
+        return false;
+    verticalScrollBar()->setValue(std::min(line, m_snapshot.scrollbackLines));
+    return true;
 }
 
-void TerminalWidget::copyBuffer(const ScreenBuffer& src, ScreenBuffer& dst, int rows, int cols, const Cell& blank) {
-    int copyRows = std::min(rows, src.rows());
-    int copyCols = std::min(cols, src.cols());
-    for (int r = 0; r < copyRows; ++r) {
-        for (int c = 0; c < copyCols; ++c) {
-            dst.cell(r, c) = src.cell(r, c);
-        }
-    }
-    for (int r = copyRows; r < rows; ++r) {
-        for (int c = 0; c < cols; ++c) {
-            dst.cell(r, c) = blank;
+void TerminalWidget::drawMatches(QPainter& p, int firstVisible, int lastVisible, int cols) {
+    const std::uint64_t top = m_snapshot.droppedLines + std::uint64_t(firstVisible);
+    const std::uint64_t bottom = m_snapshot.droppedLines + std::uint64_t(lastVisible);
+    // A match starting this many rows above the view may still reach into it.
+    const std::uint64_t reach = std::uint64_t(m_longestMatch / cols + 1);
+    const SearchMatch from{top > reach ? top - reach : 0, 0, 0};
+
+    auto paint = [&](const SearchMatch& m) {
+        const bool current = m_currentMatch && m.row == m_currentMatch->row && m.col == m_currentMatch->col;
+        const QColor color = current ? QColor(255, 140, 0, 170) : QColor(255, 220, 0, 90);
+        std::uint64_t row = m.row;
+        int col = m.col;
+        int left = m.length;
+        while (left > 0 && row < bottom && col < cols) {
+            const int n = std::min(left, cols - col);
+            if (row >= top)
+                p.fillRect(col * m_charWidth, int(row - top) * m_charHeight, n * m_charWidth, m_charHeight, color);
+            left -= n;
+            col = 0;
+            ++row;
         }
-    }
+    };
+
+    for (auto it = std::lower_bound(m_historyMatches.begin(), m_historyMatches.end(), from);
+         it != m_historyMatches.end() && it->row < bottom; ++it)
+        paint(*it);
+    for (auto it = std::lower_bound(m_screenMatches.begin(), m_screenMatches.end(), from);
+         it != m_screenMatches.end() && it->row < bottom; ++it)
+        paint(*it);
 }
 
-void TerminalWidget::setTerminalSize(int rows, int cols) {
-#ifdef ENABLE_DEBUG
-    DBG() << "setTerminalSize rows=" << rows << "cols=" << cols;
-#endif
-    if (m_mainScreen->rows() == rows && m_mainScreen->cols() == cols)
+void TerminalWidget::syncPalette() {
+    if (m_colorsGeneration == m_snapshot.paletteGeneration)
         return;
-
-    ScreenBuffer oldMain = *m_mainScreen;
-    ScreenBuffer oldAlternate = *m_alternateScreen;
-
-    m_mainScreen->resize(rows, cols);
-    m_alternateScreen->resize(rows, cols);
-
-    Cell blankCell = makeCellForCurrentAttr();
-    copyBuffer(oldMain, *m_mainScreen, rows, cols, blankCell);
-    copyBuffer(oldAlternate, *m_alternateScreen, rows, cols, blankCell);
-
-    m_scrollRegionTop = 0;
-    m_scrollRegionBottom = rows - 1;
-
-    int maxScroll = int(m_scrollbackBuffer.size());
-    verticalScrollBar()->setRange(0, maxScroll);
-    verticalScrollBar()->setPageStep(rows);
-
-    if (m_ptyMaster >= 0) {
-        struct winsize ws;
-        memset(&ws, 0, sizeof(ws));
-        ws.ws_row = rows;
-        ws.ws_col = cols;
-        ioctl(m_ptyMaster, TIOCSWINSZ, &ws);
+    m_colorsGeneration = m_snapshot.paletteGeneration;
+    for (int i = 0; i < Palette::kSize; ++i) {
+        const QRgb color = m_snapshot.palette[i];
+        m_colors[std::size_t(i)] = color;
+        // Bold also brightens the eight base colors.
+        m_boldColors[std::size_t(i)] = i < 8 ? QColor::fromRgb(color).lighter(130).rgb() : color;
     }
-
-    clampCursor();
-    viewport()->update();
 }
 
-QColor TerminalWidget::ansiIndexToColor(int idx, bool bold) {
-    if (idx < 16) {
-        static const QColor basicTable[16] = {QColor(Qt::black),
-                                              QColor(Qt::red),
-                                              QColor(Qt::green),
-                                              QColor(Qt::yellow),
-                                              QColor(Qt::blue),
-                                              QColor(Qt::magenta),
-                                              QColor(Qt::cyan),
-                                              QColor(Qt::lightGray),
-                                              QColor(Qt::darkGray),
-                                              QColor(Qt::red).lighter(150),
-                                              QColor(Qt::green).lighter(150),
-                                              QColor(Qt::yellow).lighter(150),
-                                              QColor(Qt::blue).lighter(150),
-                                              QColor(Qt::magenta).lighter(150),
-                                              QColor(Qt::cyan).lighter(150),
-                                              QColor(Qt::white)};
-        int safe = std::clamp(idx, 0, 15);
-        QColor c = basicTable[safe];
-        if (bold && idx < 8) {
-            c = c.lighter(130);
-        }
-        return c;
-    }
-    else if (idx < 256) {
-        int offset = idx - 16;
-        if (offset < 216) {
-            int r = offset / 36;
-            int g = (offset % 36) / 6;
-            int b = (offset % 6);
-            auto rgb = [&](int v) { return (v == 0) ? 0 : 55 + v * 40; };
-            return QColor(rgb(r), rgb(g), rgb(b));
+void TerminalWidget::drawRow(QPainter& p, int y, const Cell* cells, int firstCol, int endCol) {
+    const qreal scale = 1.0 / glyphCache()->devicePixelRatio();
+    const qreal halfH = m_charHeight / 2.0;
+
+    const AttrTable& attrs = m_model->attrs();
+
+    int col = firstCol;
+    while (col < endCol) {
+        const AttrTable::Id runAttr = cells[col].attr;
+        int end = col + 1;
+        while (end < endCol && cells[end].attr == runAttr)
+            ++end;
+
+        const CellAttr& head = attrs[runAttr];
+        const bool isBold = (head.style & (unsigned char)TextStyle::Bold);
+        const bool isUnderline = (head.style & (unsigned char)TextStyle::Underline);
+        const bool isInverse = (head.style & (unsigned char)TextStyle::Inverse);
+
+        QRgb fg = cellColor(head.fg, isBold);
+        QRgb bg = cellColor(head.bg, false);
+        if (isInverse)
+            std::swap(fg, bg);
+
+        const int x0 = col * m_charWidth;
+        const int runWidth = (end - col) * m_charWidth;
+        if (bg != kBlack)
+            p.fillRect(x0, y, runWidth, m_charHeight, QColor::fromRgb(bg));
+
+        if (isUnderline) {
+            const int underlineY = y + m_underlinePos;
+            p.setPen(QColor::fromRgb(fg));
+            p.drawLine(x0, underlineY, x0 + runWidth, underlineY);
         }
-        else {
-            int level = idx - 232;
-            int gray = 8 + level * 10;
-            return QColor(gray, gray, gray);
-        }
-    }
-    return (idx < 0) ? QColor(Qt::black) : QColor(Qt::white);
-}
-
-inline void TerminalWidget::drawCell(QPainter& p, int canvasRow, int col, const Cell& cell) {
-    if (cell.ch.isNull())
-        return;
-
-#ifdef ENABLE_DEBUG
-    DBG() << "Rendering character: " << cell.ch;
-#endif
 
-    int x = col * m_charWidth;
-    int y = canvasRow * m_charHeight;
-
-    bool isBold = (cell.style & (unsigned char)TextStyle::Bold);
-    bool isUnderline = (cell.style & (unsigned char)TextStyle::Underline);
-    bool isInverse = (cell.style & (unsigned char)TextStyle::Inverse);
-
-    QColor fg = ansiIndexToColor(cell.fg, isBold);
-    QColor bg = ansiIndexToColor(cell.bg, false);
+        for (int c = col; c < end; ++c) {
+            if (!hasGlyph(cells[c].ch))
+                continue;
 
-    if (isInverse)
-        std::swap(fg, bg);
+            const GlyphCache::Glyph g = cellGlyph(cells, c, isBold, fg);
+            // Fragments are placed by their centre, a cell further for wide ones.
+            const qreal centreX = c * m_charWidth + g.source.width() * scale / 2.0;
+            if (g.page >= int(m_glyphFragments.size()))
+                m_glyphFragments.resize(std::size_t(g.page) + 1);
+            m_glyphFragments[std::size_t(g.page)].push_back(
+                QPainter::PixmapFragment::create(QPointF(centreX, y + halfH), g.source, scale, scale));
+        }
 
-    p.fillRect(x, y, m_charWidth, m_charHeight, bg);
-    if (cell.ch.isPrint() && cell.ch != ' ') {
-        p.setPen(fg);
-        int baseline = y + fontMetrics().ascent();
-        p.drawText(x, baseline, QString(cell.ch));
+        col = end;
     }
+}
 
-    if (isUnderline) {
-        int underlineY = y + fontMetrics().underlinePos();
-        p.drawLine(x, underlineY, x + m_charWidth, underlineY);
-    }
+GlyphCache::Glyph TerminalWidget::cellGlyph(const Cell* cells, int c, bool bold, QRgb fg) {
+    const Cell& cell = cells[c];
+    const bool wide = c + 1 < m_snapshot.cols && cells[c + 1].isWideSpacer();
+    if (cell.isCluster())
+        return glyphCache()->glyph(cell.ch, bold, fg, wide, m_model->clusters()[cell.cluster()]);
+    return glyphCache()->glyph(cell.ch, bold, fg, wide);
 }
 
 void TerminalWidget::selectWordAtPosition(int row, int col) {
 #ifdef ENABLE_DEBUG
     DBG() << "selectWordAtPosition row=" << row << " col=" << col;
 #endif
-    const Cell* cells = getCellsAtAbsoluteLine(row);
-    if (!cells) {
+    QMutexLocker lock(&m_model->mutex());
+    std::vector<Cell> cells;
+    if (!m_model->copyAbsoluteLine(row, cells)) {
 #ifdef ENABLE_DEBUG
         DBG() << "No cells found at row=" << row;
 #endif
@@ -893,24 +1144,23 @@ void TerminalWidget::selectWordAtPosition(int row, int col) {
     }
 
     int startCol = col;
-    while (startCol > 0 && !cells[startCol - 1].ch.isSpace())
+    while (startCol > 0 && !QChar::isSpace(cells[startCol - 1].ch))
         startCol--;
     int endCol = col;
-    while (endCol < currentBuffer().cols() - 1 && !cells[endCol + 1].ch.isSpace())
+    while (endCol < m_model->cols() - 1 && !QChar::isSpace(cells[endCol + 1].ch))
         endCol++;
 
 #ifdef ENABLE_DEBUG
     DBG() << "Word selection from col=" << startCol << " to col=" << endCol;
 #endif
 
-    m_selAnchorAbsLine = row;
-    m_selAnchorCol = startCol;
-    m_selActiveAbsLine = row;
-    m_selActiveCol = endCol;
+    m_selection = Selection(row, startCol);
+    m_selection.extend(row, endCol);
     m_hasSelection = true;
+    lock.unlock();
 
 #ifdef ENABLE_DEBUG
-    DBG() << "Selection anchor set to row=" << m_selAnchorAbsLine << " col=" << m_selAnchorCol;
+    DBG() << "Selection anchor set to row=" << m_selection.anchorLine() << " col=" << startCol;
 #endif
     viewport()->update();
 }
@@ -930,7 +1180,7 @@ bool TerminalWidget::hasSelection() const {
     if (!m_hasSelection)
         return false;
 
-    if (m_selAnchorAbsLine == m_selActiveAbsLine && m_selAnchorCol == m_selActiveCol) {
+    if (m_selection.isEmpty()) {
 #ifdef ENABLE_DEBUG
         DBG() << "Selection is degenerate (same anchor and active points), returning false.";
 #endif
@@ -951,104 +1201,15 @@ QString TerminalWidget::selectedText() const {
         return QString();
     }
 
-    int startLine = std::min(m_selAnchorAbsLine, m_selActiveAbsLine);
-    int endLine = std::max(m_selAnchorAbsLine, m_selActiveAbsLine);
-
-    QStringList lines;
-    lines.reserve(endLine - startLine + 1);
-
-#ifdef ENABLE_DEBUG
-    DBG() << "Extracting selected text from lines " << startLine << " to " << endLine;
-#endif
-
-    for (int absLine = startLine; absLine <= endLine; ++absLine) {
-        const Cell* rowCells = getCellsAtAbsoluteLine(absLine);
-        if (!rowCells) {
 #ifdef ENABLE_DEBUG
-            DBG() << "No cells found for line " << absLine;
+    DBG() << "Extracting selected text from lines " << m_selection.topLine() << " to " << m_selection.bottomLine();
 #endif
-            continue;
-        }
-
-        int sc =
-            (absLine == startLine) ? ((m_selAnchorAbsLine < m_selActiveAbsLine) ? m_selAnchorCol : m_selActiveCol) : 0;
-        int ec = (absLine == endLine) ? ((m_selAnchorAbsLine > m_selActiveAbsLine) ? m_selAnchorCol : m_selActiveCol)
-                                      : currentBuffer().cols() - 1;
-        if (sc > ec)
-            std::swap(sc, ec);
 
-        sc = std::clamp(sc, 0, currentBuffer().cols() - 1);
-        ec = std::clamp(ec, 0, currentBuffer().cols() - 1);
-
-        QString lineText;
-        lineText.reserve(ec - sc + 1);
-        for (int c = sc; c <= ec; c++) {
-            lineText.append(rowCells[c].ch);
-        }
-        lines << lineText;
-    }
-    return lines.join(u"\n"_qs);
-}
-
-bool TerminalWidget::isWithinLineSelection(int lineIndex, int col) const {
-#ifdef ENABLE_DEBUG
-    DBG() << "isWithinLineSelection called for line=" << lineIndex << " col=" << col;
-#endif
-
-    if (!m_hasSelection) {
-#ifdef ENABLE_DEBUG
-        DBG() << "No selection active.";
-#endif
-        return false;
-    }
-
-    int startLine = std::min(m_selAnchorAbsLine, m_selActiveAbsLine);
-    int endLine = std::max(m_selAnchorAbsLine, m_selActiveAbsLine);
-    if (lineIndex < startLine || lineIndex > endLine) {
-#ifdef ENABLE_DEBUG
-        DBG() << "Line " << lineIndex << " is outside selection range.";
-#endif
-        return false;
-    }
-
-    int lineStartCol =
-        (lineIndex == startLine) ? ((m_selAnchorAbsLine < m_selActiveAbsLine) ? m_selAnchorCol : m_selActiveCol) : 0;
-    int lineEndCol = (lineIndex == endLine)
-                         ? ((m_selAnchorAbsLine > m_selActiveAbsLine) ? m_selAnchorCol : m_selActiveCol)
-                         : currentBuffer().cols() - 1;
-
-    if (lineStartCol > lineEndCol)
-        std::swap(lineStartCol, lineEndCol);
-
-#ifdef ENABLE_DEBUG
-    DBG() << "Line selection range: startCol=" << lineStartCol << " endCol=" << lineEndCol;
-#endif
-
-    return (col >= lineStartCol && col <= lineEndCol);
-}
-
-const Cell* TerminalWidget::getCellsAtAbsoluteLine(int absLine) const {
-#ifdef ENABLE_DEBUG
-    DBG() << "getCellsAtAbsoluteLine called for line=" << absLine;
-#endif
-
-    if (absLine < int(m_scrollbackBuffer.size())) {
-#ifdef ENABLE_DEBUG
-        DBG() << "Fetching cells from scrollback buffer for line " << absLine;
-#endif
-        return m_scrollbackBuffer[size_t(absLine)].data();
-    }
-    int offset = absLine - int(m_scrollbackBuffer.size());
-    if (offset >= 0 && offset < currentBuffer().rows()) {
-#ifdef ENABLE_DEBUG
-        DBG() << "Fetching cells from current screen buffer for line " << absLine;
-#endif
-        return &currentBuffer().cell(offset, 0);
-    }
-#ifdef ENABLE_DEBUG
-    DBG() << "Line " << absLine << " is out of bounds.";
-#endif
-    return nullptr;
+    QByteArray text;
+    QMutexLocker lock(&m_model->mutex());
+    text.reserve(qsizetype(m_selection.lineCount()) * (m_model->cols() + 1));
+    m_selection.appendText(*m_model, m_selection.topLine(), m_selection.bottomLine(), text);
+    return QString::fromUtf8(text);
 }
 
 void TerminalWidget::handleSpecialKey(int key) {
@@ -1096,12 +1257,43 @@ void TerminalWidget::copyToClipboard() {
 #endif
         return;
     }
-    QString sel = selectedText();
-    QClipboard* cb = QGuiApplication::clipboard();
-    cb->setText(sel, QClipboard::Clipboard);
+    m_copy.emplace();
+    m_copy->selection = m_selection;
+    m_copy->next = m_selection.topLine();
+    {
+        QMutexLocker lock(&m_model->mutex());
+        m_copy->dropped = m_model->droppedLines();
+        // Most text is narrow and nowhere near every row is full, so this
+        // seldom grows.
+        m_copy->text.reserve(qsizetype(m_selection.lineCount()) * (m_model->cols() + 1));
+    }
+    continueCopy();
+}
+
+void TerminalWidget::continueCopy() {
+    if (!m_copy)
+        return;
+
+    const Selection& sel = m_copy->selection;
+    {
+        QMutexLocker lock(&m_model->mutex());
+        const int dropped = int(m_model->droppedLines() - m_copy->dropped);
+        const int last = std::min(m_copy->next + kCopySliceLines - 1, sel.bottomLine());
+        m_copy->next += sel.appendText(*m_model, m_copy->next, last, m_copy->text, dropped);
+    }
+    if (m_copy->next <= sel.bottomLine()) {
+        m_copyTimer.start();
+        return;
+    }
+
+    m_copyTimer.stop();
+    auto* mime = new QMimeData;
+    mime->setData(QStringLiteral("text/plain"), m_copy->text);
+    QGuiApplication::clipboard()->setMimeData(mime, QClipboard::Clipboard);
 #ifdef ENABLE_DEBUG
-    DBG() << "Copied selected text to clipboard.";
+    DBG() << "Copied" << m_copy->text.size() << "bytes of selected text to clipboard.";
 #endif
+    m_copy.reset();
 }
 
 void TerminalWidget::pasteFromClipboard() {
@@ -1111,12 +1303,12 @@ void TerminalWidget::pasteFromClipboard() {
     if (m_ptyMaster < 0)
         return;
     QClipboard* cb = QGuiApplication::clipboard();
-    QString text = cb->text(QClipboard::Clipboard);
+    const QString text = cb->text(QClipboard::Clipboard);
     if (!text.isEmpty()) {
 #ifdef ENABLE_DEBUG
         DBG() << "Pasting text from clipboard: " << text;
 #endif
-        safeWriteToPty(text.toUtf8());
+        safeWriteToPty(pasteBytes(text, m_snapshot.bracketedPaste));
     }
     else {
 #ifdef ENABLE_DEBUG
@@ -1125,18 +1317,6 @@ void TerminalWidget::pasteFromClipboard() {
     }
 }
 
-Cell TerminalWidget::makeCellForCurrentAttr() const {
-#ifdef ENABLE_DEBUG
-    DBG() << "Creating cell with current attributes.";
-#endif
-    Cell blank;
-    blank.ch = QChar(' ');
-    blank.fg = m_currentFg;
-    blank.bg = m_currentBg;
-    blank.style = m_currentStyle;
-    return blank;
-}
-
 QByteArray TerminalWidget::keyEventToAnsiSequence(QKeyEvent* event) {
 #ifdef ENABLE_DEBUG
     DBG() << "keyEventToAnsiSequence called for key: " << event->key();
@@ -1169,7 +1349,7 @@ QByteArray TerminalWidget::keyEventToAnsiSequence(QKeyEvent* event) {
 }
 
 void TerminalWidget::handleIfMouseEnabled(QMouseEvent* event, std::function<void()> fn) {
-    if (!m_mouseEnabled) {
+    if (!m_snapshot.mouseEnabled) {
         switch (event->type()) {
             case QEvent::MouseButtonPress:
                 QAbstractScrollArea::mousePressEvent(event);
@@ -1192,38 +1372,9 @@ void TerminalWidget::safeWriteToPty(const QByteArray& data) {
     if (m_ptyMaster < 0 || data.isEmpty())
         return;
 
-    const char* buf = data.constData();
-    ssize_t remain = data.size();
-    while (remain > 0) {
-        ssize_t n = ::write(m_ptyMaster, buf, size_t(remain));
-        if (n < 0) {
-            if (errno == EAGAIN || errno == EINTR)
-                continue;
-            qWarning() << "Failed to write to PTY:" << strerror(errno);
-            break;
-        }
-        buf += n;
-        remain -= n;
-    }
-}
-
-void TerminalWidget::fullReset() {
-#ifdef ENABLE_DEBUG
-    DBG() << "fullReset";
-#endif
-    m_scrollbackBuffer.clear();
-    Cell blank = makeCellForCurrentAttr();
-    fillScreen(*m_mainScreen, blank);
-    fillScreen(*m_alternateScreen, blank);
-    m_inAlternateScreen = false;
-    m_cursorRow = 0;
-    m_cursorCol = 0;
-    m_currentFg = 7;
-    m_currentBg = 0;
-    m_currentStyle = 0;
-    m_scrollRegionTop = 0;
-    m_scrollRegionBottom = m_mainScreen->rows() - 1;
-    update();
+    m_inputAt = std::chrono::steady_clock::now();
+    m_awaitingEcho = true;
+    emit ptyInput(data);
 }
 
 void TerminalWidget::handleBell() {
@@ -1233,118 +1384,18 @@ void TerminalWidget::handleBell() {
     QApplication::beep();
 }
 
-void TerminalWidget::setSGR(const std::vector<int>& params) {
-#ifdef ENABLE_DEBUG
-    DBG() << "setSGR params size=" << params.size();
-#endif
-    if (params.empty()) {
-        m_currentFg = 7;
-        m_currentBg = 0;
-        m_currentStyle = 0;
-        return;
-    }
-    size_t i = 0;
-    while (i < params.size()) {
-        int p = params[i++];
-        switch (p) {
-            case 0:
-                m_currentFg = 7;
-                m_currentBg = 0;
-                m_currentStyle = 0;
-                break;
-            case 1:
-                m_currentStyle |= (unsigned char)TextStyle::Bold;
-                break;
-            case 4:
-                m_currentStyle |= (unsigned char)TextStyle::Underline;
-                break;
-            case 7:
-                m_currentStyle |= (unsigned char)TextStyle::Inverse;
-                break;
-            case 22:
-                m_currentStyle &= ~(unsigned char)TextStyle::Bold;
-                break;
-            case 24:
-                m_currentStyle &= ~(unsigned char)TextStyle::Underline;
-                break;
-            case 27:
-                m_currentStyle &= ~(unsigned char)TextStyle::Inverse;
-                break;
-            case 39:
-                m_currentFg = 7;
-                break;
-            case 49:
-                m_currentBg = 0;
-                break;
-            case 30:
-            case 31:
-            case 32:
-            case 33:
-            case 34:
-            case 35:
-            case 36:
-            case 37:
-                m_currentFg = p - 30;
-                break;
-            case 40:
-            case 41:
-            case 42:
-            case 43:
-            case 44:
-            case 45:
-            case 46:
-            case 47:
-                m_currentBg = p - 40;
-                break;
-            case 90:
-            case 91:
-            case 92:
-            case 93:
-            case 94:
-            case 95:
-            case 96:
-            case 97:
-                m_currentFg = (p - 90) + 8;
-                break;
-            case 100:
-            case 101:
-            case 102:
-            case 103:
-            case 104:
-            case 105:
-            case 106:
-            case 107:
-                m_currentBg = (p - 100) + 8;
-                break;
-            case 38:
-                if (i + 1 < params.size() && params[i] == 5) {
-                    i++;
-                    if (i < params.size()) {
-                        m_currentFg = params[i++];
-                    }
-                }
-                break;
-            case 48:
-                if (i + 1 < params.size() && params[i] == 5) {
-                    i++;
-                    if (i < params.size()) {
-                        m_currentBg = params[i++];
-                    }
-                }
-                break;
-            default:
-#ifdef ENABLE_DEBUG
-                DBG() << "Unknown SGR code" << p;
-#endif
-                break;
-        }
-    }
-}
-
 void TerminalWidget::mousePressEvent(QMouseEvent* event) {
 #ifdef ENABLE_DEBUG
     DBG() << "mousePressEvent pos=" << event->pos();
 #endif
+    if (event->button() == Qt::LeftButton && (event->modifiers() & Qt::ControlModifier)) {
+        if (const LinkTable::Id link = linkAt(event->pos()); link != LinkTable::kNone) {
+            const QUrl url = QUrl::fromEncoded(m_model->links()[link].uri);
+            if (url.isValid())
+                QDesktopServices::openUrl(url);
+            return;
+        }
+    }
     handleIfMouseEnabled(event, [=]() {
         if (event->button() == Qt::LeftButton) {
             if (event->type() == QEvent::MouseButtonDblClick) {
@@ -1359,10 +1410,8 @@ void TerminalWidget::mousePressEvent(QMouseEvent* event) {
                 int row = (event->pos().y() / m_charHeight) + verticalScrollBar()->value();
                 int col = (event->pos().x() / m_charWidth);
                 clampLineCol(row, col);
-                m_selAnchorAbsLine = row;
-                m_selAnchorCol = col;
-                m_selActiveAbsLine = row;
-                m_selActiveCol = col;
+                // Alt-drag selects a rectangle.
+                m_selection = Selection(row, col, event->modifiers() & Qt::AltModifier);
                 viewport()->update();
             }
         }
@@ -1370,13 +1419,20 @@ void TerminalWidget::mousePressEvent(QMouseEvent* event) {
 }
 
 void TerminalWidget::mouseMoveEvent(QMouseEvent* event) {
+    if (const LinkTable::Id link = linkAt(event->pos()); link != m_hoveredLink) {
+        m_hoveredLink = link;
+        if (link != LinkTable::kNone)
+            viewport()->setCursor(Qt::PointingHandCursor);
+        else
+            viewport()->unsetCursor();
+        viewport()->update();
+    }
     handleIfMouseEnabled(event, [=]() {
         if (m_selecting && (event->buttons() & Qt::LeftButton)) {
             int row = (event->pos().y() / m_charHeight) + verticalScrollBar()->value();
             int col = (event->pos().x() / m_charWidth);
             clampLineCol(row, col);
-            m_selActiveAbsLine = row;
-            m_selActiveCol = col;
+            m_selection.extend(row, col);
             viewport()->update();
         }
     });
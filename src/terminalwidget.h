@@ -5,55 +5,41 @@
 #include <QByteArray>
 #include <QColor>
 #include <QChar>
+#include <QFocusEvent>
 #include <QKeyEvent>
 #include <QMouseEvent>
 #include <QPaintEvent>
 #include <QPainter>
+#include <QPixmap>
+#include <QRect>
+#include <QRegion>
 #include <QResizeEvent>
 #include <QString>
+#include <QStringList>
+#include <QTimer>
 
+#include <array>
+#include <chrono>
 #include <cstdint>
 #include <cstddef>
 #include <deque>
 #include <functional>
 #include <memory>
+#include <optional>
 #include <vector>
 #include <sys/types.h>
 
-enum class TextStyle : std::uint8_t { None = 0, Bold = 1 << 0, Underline = 1 << 1, Inverse = 1 << 2 };
+#include "glyphcache.h"
+#include "selection.h"
+#include "terminalmodel.h"
+#include "textsearch.h"
 
-class EscapeSequenceParser;
-
-struct Cell {
-    QChar ch{' '};
-    int fg{7};
-    int bg{0};
-    std::uint8_t style{0};
-};
-
-class ScreenBuffer {
-   public:
-    ScreenBuffer(int rows, int cols);
-
-    void resize(int rows, int cols);
-    int rows() const noexcept { return m_rows; }
-    int cols() const noexcept { return m_cols; }
-
-    Cell& cell(int r, int c);
-    const Cell& cell(int r, int c) const;
-
-    void fillRow(int r, int c0, int c1, const Cell&);
-
-   private:
-    int m_rows;
-    int m_cols;
-    std::vector<Cell> m_data;
-};
+class GlRenderer;
 
 class TerminalWidget : public QAbstractScrollArea {
     Q_OBJECT
    public:
-    explicit TerminalWidget(QWidget* parent = nullptr);
+    explicit TerminalWidget(TerminalModel* model, QWidget* parent = nullptr);
     ~TerminalWidget() override;
 
     QSize sizeHint() const override;
@@ -63,166 +49,196 @@ class TerminalWidget : public QAbstractScrollArea {
     void mousePressEvent(QMouseEvent*) override;
     void mouseMoveEvent(QMouseEvent*) override;
     void mouseReleaseEvent(QMouseEvent*) override;
+    void focusInEvent(QFocusEvent*) override;
+    void focusOutEvent(QFocusEvent*) override;
 
     int getPtyMaster() const noexcept { return m_ptyMaster; }
-    int rows() const noexcept { return currentBuffer().rows(); }
+    int rows() const noexcept { return m_snapshot.rows; }
 
-    void setMouseEnabled(bool on);
     void updateScreen();
-    void useAlternateScreen(bool alt);
-    void setScrollingRegion(int top, int bottom);
     void setTerminalSize(int rows, int cols);
 
-    void lineFeed();
-    void reverseLineFeed();
-    void putChar(QChar ch);
-    void setCursorPos(int row, int col, bool clamp = true);
-    void saveCursorPos();
-    void restoreCursorPos();
-    void eraseInLine(int mode);
-    void eraseInDisplay(int mode);
-    void setSGR(const std::vector<int>& params);
-
-    void scrollUp(int top, int bottom);
-    void scrollDown(int top, int bottom);
-
     void selectWordAtPosition(int row, int col);
     void clearSelection();
     bool hasSelection() const;
     QString selectedText() const;
 
-    void deleteChars(int n);
-    void eraseChars(int n);
-    void insertChars(int n);
-    void deleteLines(int n);
-    void insertLines(int n);
-    void scrollUpLines(int n);
-    void scrollDownLines(int n);
-
-    int getCursorRow() const noexcept { return m_cursorRow; }
-    int getCursorCol() const noexcept { return m_cursorCol; }
-    void setCursorRow(int r) {
-        m_cursorRow = r;
-        clampCursor();
-    }
-    void setCursorCol(int c) {
-        m_cursorCol = c;
-        clampCursor();
-    }
+    void handleBell();
+    void setPtyInfo(int ptyMaster, pid_t shellPid);
 
-    void setCurrentFg(int fg) noexcept { m_currentFg = fg; }
-    void setCurrentBg(int bg) noexcept { m_currentBg = bg; }
-    void setCurrentStyle(std::uint8_t st) noexcept { m_currentStyle = st; }
+    bool isViewPinnedBottom() const noexcept;
 
-    void fullReset();
-    void handleBell();
+    // Paints through the OpenGL renderer from now on. Returns false if the
+    // build has none; if the context turns out unusable the widget quietly
+    // goes back to QPainter.
+    bool useGpuRenderer();
 
-    ScreenBuffer* getMainScreen() { return m_mainScreen.get(); }
-    ScreenBuffer* getAlternateScreen() { return m_alternateScreen.get(); }
+    // Output arriving shortly after input, if small, is painted at once
+    // instead of with the next frame. On by default.
+    void setLowLatencyEcho(bool on) noexcept { m_lowLatencyEcho = on; }
 
-    void fillScreen(ScreenBuffer& buf, const Cell& blank);
-    void setPtyInfo(int ptyMaster, pid_t shellPid);
+    // Live parse and paint statistics in the top right corner.
+    void setMetricsOverlay(bool on);
+    bool metricsOverlay() const noexcept { return m_metricsTimer.isActive(); }
 
-    bool isViewPinnedBottom() const noexcept;
-    void maybeAdjustScrollBar(int deltaLines);
+    // Highlights every match in the screen and history and shows the newest
+    // one. Older history is searched in slices from the event loop. Returns
+    // false if the pattern is empty or not a valid expression.
+    bool find(const QString& pattern, bool regex, bool caseSensitive);
+    // Moves to the next match above (older) or below the current one.
+    void findNext(bool older);
+    void clearSearch();
+
+    // Scrolls the nearest OSC 133 prompt above or below the top of the view
+    // to the top. Returns false if there is none.
+    bool scrollToPrompt(bool above);
+
+   signals:
+    // Bytes for the shell; written by the I/O thread as the PTY drains.
+    void ptyInput(const QByteArray& bytes);
+    void searchProgress(int matches, bool complete);
 
    private:
-    void clampCursor();
-    const Cell* getCellsAtAbsoluteLine(int absLine) const;
-    bool isWithinLineSelection(int line, int col) const;
-    void drawCursor(QPainter& p, int firstVisibleLine, int visibleRows);
+    // The cursor is a layer over the cells: moving or blinking it repaints
+    // its rectangle from m_canvas without drawing any cells.
+    QRect cursorRect() const;
+    void updateCursor();
+    void drawCursor(QPainter& p);
     void handleSpecialKey(int key);
     void copyToClipboard();
+    void continueCopy();
     void pasteFromClipboard();
-    Cell makeCellForCurrentAttr() const;
     void handleIfMouseEnabled(QMouseEvent*, std::function<void()> fn);
     void clampLineCol(int& line, int& col);
-    ScreenBuffer& currentBuffer();
-    const ScreenBuffer& currentBuffer() const;
+    void syncScrollBar();
+    void scheduleFrame();
+    void renderFrame();
+    void invalidateDirtyRows();
+    void applyPtySize();
+    void startSearch(std::unique_ptr<SearchQuery> query, bool reveal);
+    void continueSearch();
+    void refreshLiveMatches();
+    void revealMatch(const SearchMatch& match);
+    void drawMatches(QPainter& p, int firstVisible, int lastVisible, int cols);
+    // The OSC 8 link of the cell under pos, if any.
+    LinkTable::Id linkAt(const QPoint& pos) const;
+    void drawHoveredLink(QPainter& p, int rowsOnScreen, int cols);
+    void paintCells(QPainter& p, const QRegion& clip, int firstVisible, int lastVisible, int cols);
+    // Taken on first use rather than at construction, when the widget is
+    // not yet on the screen it will be drawn for.
+    const std::shared_ptr<GlyphCache>& glyphCache() {
+        if (!m_glyphCache)
+            createGlyphCache();
+        return m_glyphCache;
+    }
+    void createGlyphCache();
+    // Brings m_canvas up to date with the damaged cells.
+    void renderCanvas(int firstVisible, int lastVisible, int cols);
+    // False, having painted nothing, if the GL renderer cannot be used.
+    bool paintGpu(QPainter& p, int firstVisible, int lastVisible, int cols);
+    void dropGpuRenderer();
+    void refreshMetricsOverlay();
+    void drawMetricsOverlay(QPainter& p);
 
     void safeWriteToPty(const QByteArray& bytes);
     QByteArray keyEventToAnsiSequence(QKeyEvent*);
-    void invalidateCell(int row, int col);
-    void copyBuffer(const ScreenBuffer& src, ScreenBuffer& dst, int rows, int cols, const Cell& blank);
 
-    std::unique_ptr<ScreenBuffer> m_mainScreen;
-    std::unique_ptr<ScreenBuffer> m_alternateScreen;
-    bool m_inAlternateScreen{false};
+    TerminalModel* m_model;
+    ScreenSnapshot m_snapshot;
+    bool m_syncingScrollBar{false};
 
-    std::deque<std::vector<Cell>> m_scrollbackBuffer;
-    int m_scrollbackMax{1000};
+    QTimer m_frameTimer;
+    int m_skippedFrames{0};
 
-    bool m_showCursor{true};
-    int m_cursorRow{0};
-    int m_cursorCol{0};
-    int m_savedCursorRow{0};
-    int m_savedCursorCol{0};
-    int m_currentFg{7};
-    int m_currentBg{0};
-    std::uint8_t m_currentStyle{0};
+    // Input went out at m_inputAt with no output seen since while
+    // m_awaitingEcho; m_timeNextPaint times the paint that shows the reply.
+    bool m_lowLatencyEcho{true};
+    std::chrono::steady_clock::time_point m_inputAt{};
+    bool m_awaitingEcho{false};
+    bool m_timeNextPaint{false};
+    // The snapshot holds PTY output, so painting it stamps the first prompt.
+    bool m_showsOutput{false};
 
-    int m_scrollRegionTop{0};
-    int m_scrollRegionBottom{0};
+    QTimer m_metricsTimer;
+    QStringList m_metricsText;
+    QRect m_metricsRect;
+    std::uint64_t m_metricsLastBytes{0};
+    QTimer m_winsizeTimer;
 
     int m_ptyMaster{-1};
     pid_t m_shellPid{-1};
 
-    bool m_mouseEnabled{true};
     bool m_selecting{false};
     bool m_hasSelection{false};
-
-    int m_selAnchorAbsLine{0}, m_selAnchorCol{0};
-    int m_selActiveAbsLine{0}, m_selActiveCol{0};
+    Selection m_selection;
+    // Underlined while the pointer is over it; Ctrl+click opens it.
+    LinkTable::Id m_hoveredLink{LinkTable::kNone};
+
+    // A copy too large for one event loop turn. Its text is gathered a slice
+    // at a time; dropped is droppedLines() when it started, so history that
+    // scrolls away in between is accounted for.
+    struct CopyJob {
+        Selection selection;
+        std::uint64_t dropped{0};
+        int next{0};
+        QByteArray text;
+    };
+    std::optional<CopyJob> m_copy;
+    QTimer m_copyTimer;
 
     int m_charWidth{0}, m_charHeight{0};
-    int m_prevCursorRow{-1}, m_prevCursorCol{-1};
-
-    QColor ansiIndexToColor(int idx, bool bold);
-    void drawCell(QPainter&, int canvasRow, int col, const Cell&);
-    friend class EscapeSequenceParser;
-};
-
-inline ScreenBuffer::ScreenBuffer(int rows, int cols) {
-    rows = std::max(rows, 1);
-    cols = std::max(cols, 1);
-    m_rows = rows;
-    m_cols = cols;
-    m_data.resize(std::size_t(rows) * std::size_t(cols));
-}
-
-inline void ScreenBuffer::resize(int rows, int cols) {
-    m_rows = std::max(rows, 1);
-    m_cols = std::max(cols, 1);
-
-    m_data.assign(static_cast<std::size_t>(m_rows) * static_cast<std::size_t>(m_cols), Cell{});
-}
-
-inline Cell& ScreenBuffer::cell(int r, int c) {
-    assert(r >= 0 && r < m_rows && c >= 0 && c < m_cols && "Cell access out of bounds");
-
-    std::size_t idx = static_cast<std::size_t>(r) * static_cast<std::size_t>(m_cols) + static_cast<std::size_t>(c);
-
-    return m_data[idx];
-}
-
-inline const Cell& ScreenBuffer::cell(int r, int c) const {
-    assert(r >= 0 && r < m_rows && c >= 0 && c < m_cols && "Cell access out of bounds");
-
-    std::size_t idx = static_cast<std::size_t>(r) * static_cast<std::size_t>(m_cols) + static_cast<std::size_t>(c);
-
-    return m_data[idx];
-}
-
-inline void ScreenBuffer::fillRow(int r, int c0, int c1, const Cell& cell) {
-    if (r < 0 || r >= m_rows)
-        return;
-
-    c0 = std::clamp(c0, 0, m_cols);
-    c1 = std::clamp(c1, 0, m_cols);
-
-    for (int col = c0; col < c1; ++col) {
-        this->cell(r, col) = cell;
+    int m_underlinePos{0};
+
+    // History matches, oldest first, then those on the screen, which are
+    // found again whenever it changes. History above m_searchResume is still
+    // to be scanned; m_searchLive is where the screen ended when it was last
+    // scanned, so lines scrolled off since then are searched once on the way.
+    std::unique_ptr<SearchQuery> m_search;
+    std::deque<SearchMatch> m_historyMatches;
+    std::vector<SearchMatch> m_screenMatches;
+    std::uint64_t m_searchResume{0};
+    std::uint64_t m_searchLive{0};
+    int m_longestMatch{0};
+    std::optional<SearchMatch> m_currentMatch;
+    bool m_revealPending{false};
+    QTimer m_searchTimer;
+
+    std::shared_ptr<GlyphCache> m_glyphCache;
+    std::vector<std::vector<QPainter::PixmapFragment>> m_glyphFragments;
+
+    // The cells as last rendered by QPainter; paints blit from here and draw
+    // the overlays on top. Unused while the GL renderer is active.
+    QPixmap m_canvas;
+    QRegion m_canvasDamage;
+
+    QTimer m_blinkTimer;
+    bool m_cursorBlinkOn{true};
+    QRect m_cursorRect;
+    CursorShape m_cursorShape{CursorShape::Block};
+
+    // Set while the viewport is a GlRenderer. Its instance rows are rebuilt
+    // only for m_gpuDamage, or all of them once the glyph atlas was evicted.
+    GlRenderer* m_gl{nullptr};
+    RowDamage m_gpuDamage;
+    std::uint64_t m_gpuGlyphEpoch{0};
+
+    // The snapshot's palette as painted, with bold variants; a color lookup
+    // is a table load.
+    std::array<QRgb, Palette::kSize> m_colors{};
+    std::array<QRgb, Palette::kSize> m_boldColors{};
+    std::uint64_t m_colorsGeneration{0};
+
+    void syncPalette();
+    QRgb cellColor(std::uint32_t color, bool bold) const noexcept {
+        if (CellColor::isTrueColor(color))
+            return 0xFF000000u | (color & 0xFFFFFFu);
+        return (bold ? m_boldColors : m_colors)[std::size_t(CellColor::index(color))];
     }
-}
+    // Paints cells [firstCol, endCol) of one row.
+    void drawRow(QPainter&, int y, const Cell* cells, int firstCol, int endCol);
+    // The glyph for cells[c] of a snapshot row, two cells wide if a spacer
+    // follows it.
+    GlyphCache::Glyph cellGlyph(const Cell* cells, int c, bool bold, QRgb fg);
+};
 
 #endif
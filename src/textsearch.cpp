@@ -0,0 +1,199 @@
+#include "textsearch.h"
+#include "charwidth.h"
+
+#include <algorithm>
+
+namespace {
+// The longest run of characters every match of a regular expression must
+// contain literally, or an empty string when that is not plain to see.
+// Alternation, inline options and escapes with arguments give up outright.
+QString requiredLiteral(const QString& pattern) {
+    if (pattern.contains(u'|') || pattern.contains(QStringLiteral("(?")))
+        return {};
+
+    QString best, run;
+    auto endRun = [&] {
+        if (run.size() > best.size())
+            best = run;
+        run.clear();
+    };
+
+    int depth = 0;
+    const qsizetype n = pattern.size();
+    for (qsizetype i = 0; i < n; ++i) {
+        const QChar c = pattern[i];
+        QChar literal = c;
+        if (c == u'\\') {
+            if (i + 1 == n)
+                return {};
+            const QChar e = pattern[++i];
+            if (e.isLetterOrNumber()) {
+                if (!QStringView(u"dDsSwWbBntrfvAzZ").contains(e))
+                    return {};
+                endRun();
+                continue;
+            }
+            literal = e;
+        }
+        else if (c == u'[') {
+            // Skip the class; a leading ] or ^] belongs to it.
+            qsizetype j = i + 1;
+            if (j < n && pattern[j] == u'^')
+                ++j;
+            if (j < n && pattern[j] == u']')
+                ++j;
+            while (j < n && pattern[j] != u']')
+                j += pattern[j] == u'\\' ? 2 : 1;
+            i = j;
+            endRun();
+            continue;
+        }
+        else if (c == u'(' || c == u')') {
+            depth += c == u'(' ? 1 : -1;
+            endRun();
+            continue;
+        }
+        else if (QStringView(u".^$*+?{}").contains(c)) {
+            endRun();
+            continue;
+        }
+
+        if (depth > 0)
+            continue;
+        const QChar next = i + 1 < n ? pattern[i + 1] : QChar();
+        if (next == u'?' || next == u'*' || next == u'{') {
+            endRun();
+            continue;
+        }
+        run += literal;
+        if (next == u'+')
+            endRun();
+    }
+    endRun();
+    return best;
+}
+
+// Text as the grid stores it, where a wide character is followed by a spacer.
+std::vector<char32_t> gridText(const QString& text) {
+    std::vector<char32_t> out;
+    for (char32_t ch : text.toUcs4()) {
+        out.push_back(ch);
+        if (charWidth(ch) == 2)
+            out.push_back(kWideSpacer);
+    }
+    return out;
+}
+}  // namespace
+
+SearchQuery::SearchQuery(const QString& pattern, bool regex, bool caseSensitive)
+    : m_pattern(pattern), m_regex(regex), m_caseSensitive(caseSensitive) {
+    if (pattern.isEmpty())
+        return;
+
+    QString literal = pattern;
+    if (regex) {
+        m_expression.setPattern(pattern);
+        if (!caseSensitive)
+            m_expression.setPatternOptions(QRegularExpression::CaseInsensitiveOption);
+        if (!m_expression.isValid())
+            return;
+        m_expression.optimize();
+        literal = requiredLiteral(pattern);
+    }
+    else {
+        for (char32_t ch : gridText(pattern))
+            m_needle.push_back(caseSensitive ? ch : foldCase(ch));
+    }
+
+    const std::vector<char32_t> chars = gridText(literal);
+    for (std::size_t i = 0; i + 2 < chars.size(); ++i)
+        m_trigrams.push_back(TrigramFilter::key(chars[i], chars[i + 1], chars[i + 2]));
+    std::sort(m_trigrams.begin(), m_trigrams.end());
+    m_trigrams.erase(std::unique(m_trigrams.begin(), m_trigrams.end()), m_trigrams.end());
+    m_valid = true;
+}
+
+bool SearchQuery::mayMatch(const TrigramFilter& filter) const noexcept {
+    return std::all_of(m_trigrams.begin(), m_trigrams.end(), [&](std::uint32_t k) { return filter.test(k); });
+}
+
+void SearchQuery::match(const char32_t* text, std::size_t length, std::vector<Hit>& out) const {
+    if (!m_valid)
+        return;
+    if (m_regex)
+        matchRegex(text, length, out);
+    else
+        matchLiteral(text, length, out);
+}
+
+void SearchQuery::matchLiteral(const char32_t* text, std::size_t length, std::vector<Hit>& out) const {
+    if (length < m_needle.size())
+        return;
+
+    const char32_t* hay = text;
+    if (!m_caseSensitive) {
+        m_folded.resize(length);
+        std::transform(text, text + length, m_folded.begin(), foldCase);
+        hay = m_folded.data();
+    }
+
+    const char32_t* end = hay + length;
+    for (const char32_t* at = hay;;) {
+        at = std::search(at, end, m_needle.begin(), m_needle.end());
+        if (at == end)
+            break;
+        out.push_back(Hit{std::size_t(at - hay), m_needle.size()});
+        at += m_needle.size();
+    }
+}
+
+void SearchQuery::matchRegex(const char32_t* text, std::size_t length, std::vector<Hit>& out) const {
+    // QRegularExpression works on UTF-16; remember which cell each code unit
+    // came from only if the line has anything outside the BMP, wide
+    // characters, whose spacers are left out, or clusters, which stand in as
+    // U+FFFC.
+    m_utf16.clear();
+    m_utf16.reserve(qsizetype(length));
+    m_cellAt.clear();
+    auto startMap = [&] {
+        if (m_cellAt.empty()) {
+            for (qsizetype u = 0; u < m_utf16.size(); ++u)
+                m_cellAt.push_back(std::size_t(u));
+        }
+    };
+    for (std::size_t c = 0; c < length; ++c) {
+        const char32_t ch = text[c];
+        if (ch == kWideSpacer) {
+            startMap();
+        }
+        else if (ch & kClusterBit) {
+            startMap();
+            m_utf16.append(QChar(char16_t(0xFFFC)));
+            m_cellAt.push_back(c);
+        }
+        else if (QChar::requiresSurrogates(ch)) {
+            startMap();
+            m_utf16.append(QChar(QChar::highSurrogate(ch)));
+            m_utf16.append(QChar(QChar::lowSurrogate(ch)));
+            m_cellAt.push_back(c);
+            m_cellAt.push_back(c);
+        }
+        else {
+            m_utf16.append(QChar(char16_t(ch)));
+            if (!m_cellAt.empty())
+                m_cellAt.push_back(c);
+        }
+    }
+    if (!m_cellAt.empty())
+        m_cellAt.push_back(length);
+
+    auto cell = [&](qsizetype unit) { return m_cellAt.empty() ? std::size_t(unit) : m_cellAt[std::size_t(unit)]; };
+    QRegularExpressionMatchIterator it = m_expression.globalMatch(m_utf16);
+    while (it.hasNext()) {
+        const QRegularExpressionMatch m = it.next();
+        if (m.capturedLength() == 0)
+            continue;
+        const std::size_t start = cell(m.capturedStart());
+        out.push_back(Hit{start, cell(m.capturedEnd()) - start});
+    }
+}
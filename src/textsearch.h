@@ -0,0 +1,100 @@
+#ifndef TEXTSEARCH_H
+#define TEXTSEARCH_H
+
+#include <QRegularExpression>
+#include <QString>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Case-folds one character the way the trigram index and case-insensitive
+// literal search compare text.
+inline char32_t foldCase(char32_t ch) noexcept {
+    if (ch < 0x80)
+        return (ch >= U'A' && ch <= U'Z') ? ch + (U'a' - U'A') : ch;
+    return QChar::toCaseFolded(ch);
+}
+
+// Bloom summary of the case-folded trigrams in a block of text. A query is
+// only run against a block if every trigram it requires may be present, so
+// most of a large history is skipped without being decompressed.
+class TrigramFilter {
+   public:
+    static constexpr std::size_t kBits = 8192;
+
+    static std::uint32_t key(char32_t a, char32_t b, char32_t c) noexcept {
+        std::uint32_t h = foldCase(a) * 0x9E3779B1u;
+        h = (h ^ foldCase(b)) * 0x85EBCA6Bu;
+        h = (h ^ foldCase(c)) * 0xC2B2AE35u;
+        return h >> 19;
+    }
+
+    void add(std::uint32_t k) noexcept { m_bits[k >> 6] |= std::uint64_t(1) << (k & 63); }
+    bool test(std::uint32_t k) const noexcept { return (m_bits[k >> 6] >> (k & 63)) & 1; }
+
+    // Adds every trigram starting in text[begin, end - 2).
+    void addText(const char32_t* text, std::size_t begin, std::size_t end) noexcept {
+        for (std::size_t i = begin; i + 2 < end; ++i)
+            add(key(text[i], text[i + 1], text[i + 2]));
+    }
+
+   private:
+    std::array<std::uint64_t, kBits / 64> m_bits{};
+};
+
+// A match of a query in the grid. row counts from the first line the
+// terminal ever wrote (absolute line + droppedLines()), so it stays put while
+// history grows; length is in cells and may run onto following rows.
+struct SearchMatch {
+    std::uint64_t row;
+    int col;
+    int length;
+
+    friend bool operator<(const SearchMatch& a, const SearchMatch& b) noexcept {
+        return a.row != b.row ? a.row < b.row : a.col < b.col;
+    }
+};
+
+// One find-in-scrollback query, either a literal or a regular expression,
+// matched against whole logical lines so hits may span soft wraps. Keeps
+// scratch buffers, so an instance must not be used from two threads at once.
+class SearchQuery {
+   public:
+    struct Hit {
+        std::size_t start;
+        std::size_t length;
+    };
+
+    SearchQuery(const QString& pattern, bool regex, bool caseSensitive);
+
+    bool isValid() const noexcept { return m_valid; }
+    QString pattern() const { return m_pattern; }
+    bool isRegex() const noexcept { return m_regex; }
+    bool caseSensitive() const noexcept { return m_caseSensitive; }
+
+    // False if text summarised by filter cannot contain a match.
+    bool mayMatch(const TrigramFilter& filter) const noexcept;
+    // Appends the matches in text[0, length), in cells, left to right.
+    void match(const char32_t* text, std::size_t length, std::vector<Hit>& out) const;
+
+   private:
+    void matchLiteral(const char32_t* text, std::size_t length, std::vector<Hit>& out) const;
+    void matchRegex(const char32_t* text, std::size_t length, std::vector<Hit>& out) const;
+
+    QString m_pattern;
+    bool m_valid{false};
+    bool m_regex{false};
+    bool m_caseSensitive{true};
+    std::vector<char32_t> m_needle;
+    QRegularExpression m_expression;
+    // Keys every matching line contains; empty when nothing can be ruled out.
+    std::vector<std::uint32_t> m_trigrams;
+
+    mutable std::vector<char32_t> m_folded;
+    mutable QString m_utf16;
+    mutable std::vector<std::size_t> m_cellAt;
+};
+
+#endif
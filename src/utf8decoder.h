@@ -0,0 +1,103 @@
+#ifndef UTF8DECODER_H
+#define UTF8DECODER_H
+
+#include <array>
+#include <cstdint>
+
+// Incremental UTF-8 decoder after Bjoern Hoehrmann's DFA. It keeps a partial
+// sequence across calls, so input can be split at any byte boundary.
+class Utf8Decoder {
+   public:
+    enum class Result { Incomplete, Codepoint, Invalid };
+
+    static constexpr char32_t kReplacement = U'\uFFFD';
+
+    // On Codepoint, codepoint() holds the decoded value. On Invalid, the
+    // caller should emit kReplacement and, if restart() is true, feed the same
+    // byte again: it was not part of the broken sequence.
+    Result step(unsigned char b) noexcept {
+        const std::uint8_t type = kClass[b];
+        const bool wasPending = m_state != kAccept;
+        m_codepoint = wasPending ? (b & 0x3Fu) | (m_codepoint << 6) : (0xFFu >> type) & b;
+        m_state = kTransition[m_state + type];
+
+        if (m_state == kAccept)
+            return Result::Codepoint;
+        if (m_state == kReject) {
+            m_state = kAccept;
+            m_restart = wasPending;
+            return Result::Invalid;
+        }
+        return Result::Incomplete;
+    }
+
+    char32_t codepoint() const noexcept { return m_codepoint; }
+    bool restart() const noexcept { return m_restart; }
+    bool pending() const noexcept { return m_state != kAccept; }
+    void reset() noexcept { m_state = kAccept; }
+
+   private:
+    static constexpr std::uint8_t kAccept = 0;
+    static constexpr std::uint8_t kReject = 12;
+
+    static constexpr std::array<std::uint8_t, 256> kClass = [] {
+        std::array<std::uint8_t, 256> t{};
+        auto fill = [&t](int lo, int hi, std::uint8_t cls) {
+            for (int i = lo; i <= hi; ++i)
+                t[std::size_t(i)] = cls;
+        };
+        fill(0x00, 0x7F, 0);
+        fill(0x80, 0x8F, 1);
+        fill(0x90, 0x9F, 9);
+        fill(0xA0, 0xBF, 7);
+        fill(0xC0, 0xC1, 8);
+        fill(0xC2, 0xDF, 2);
+        fill(0xE0, 0xE0, 10);
+        fill(0xE1, 0xEC, 3);
+        fill(0xED, 0xED, 4);
+        fill(0xEE, 0xEF, 3);
+        fill(0xF0, 0xF0, 11);
+        fill(0xF1, 0xF3, 6);
+        fill(0xF4, 0xF4, 5);
+        fill(0xF5, 0xFF, 8);
+        return t;
+    }();
+
+    // Indexed by state + class; states are multiples of 12.
+    static constexpr std::array<std::uint8_t, 108> kTransition = {
+        0,  12, 24, 36, 60, 96, 84, 12, 12, 12, 48, 72, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12,
+        12, 0,  12, 12, 12, 12, 12, 0,  12, 0,  12, 12, 12, 24, 12, 12, 12, 12, 12, 24, 12, 24, 12, 12,
+        12, 12, 12, 12, 12, 12, 12, 24, 12, 12, 12, 12, 12, 24, 12, 12, 12, 12, 12, 12, 12, 24, 12, 12,
+        12, 12, 12, 12, 12, 12, 12, 36, 12, 36, 12, 12, 12, 36, 12, 12, 12, 12, 12, 36, 12, 36, 12, 12,
+        12, 36, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12,
+    };
+
+    std::uint8_t m_state{kAccept};
+    bool m_restart{false};
+    char32_t m_codepoint{0};
+};
+
+// Appends ch as UTF-8 to any byte container that takes += char.
+template <typename Out>
+void appendUtf8(Out& out, char32_t ch) {
+    if (ch < 0x80) {
+        out += char(ch);
+    }
+    else if (ch < 0x800) {
+        out += char(0xC0 | (ch >> 6));
+        out += char(0x80 | (ch & 0x3F));
+    }
+    else if (ch < 0x10000) {
+        out += char(0xE0 | (ch >> 12));
+        out += char(0x80 | ((ch >> 6) & 0x3F));
+        out += char(0x80 | (ch & 0x3F));
+    }
+    else {
+        out += char(0xF0 | (ch >> 18));
+        out += char(0x80 | ((ch >> 12) & 0x3F));
+        out += char(0x80 | ((ch >> 6) & 0x3F));
+        out += char(0x80 | (ch & 0x3F));
+    }
+}
+
+#endif
@@ -0,0 +1,46 @@
+// What pasting sends to the shell, above all that nothing pasted can end a
+// bracketed paste early.
+
+#include "paste.h"
+
+#include <QByteArray>
+#include <QString>
+
+#include <cstdio>
+
+namespace {
+int g_failures = 0;
+
+void expect(const char* name, const QByteArray& got, const QByteArray& want) {
+    if (got == want)
+        return;
+    std::fprintf(stderr, "FAIL %s\n  got:  %s\n  want: %s\n", name, got.toPercentEncoding().constData(),
+                 want.toPercentEncoding().constData());
+    ++g_failures;
+}
+}  // namespace
+
+int main() {
+    expect("line breaks", pasteBytes(QStringLiteral("a\r\nb\nc\rd"), false), "a\rb\rc\rd");
+    expect("unbracketed keeps escapes", pasteBytes(QStringLiteral("a\x1b[201~b"), false), "a\x1b[201~b");
+
+    expect("bracketed", pasteBytes(QStringLiteral("ls\n"), true), "\x1b[200~ls\r\x1b[201~");
+    expect("terminator", pasteBytes(QStringLiteral("a\x1b[201~b"), true), "\x1b[200~a[201~b\x1b[201~");
+    // Stripping the terminator once would leave another one behind.
+    expect("nested terminator", pasteBytes(QStringLiteral("\x1b[20\x1b[201~1~echo owned\n"), true),
+           "\x1b[200~[20[201~1~echo owned\r\x1b[201~");
+    expect("C1 CSI terminator", pasteBytes(QString(QChar(0x9B)) + QStringLiteral("201~x"), true),
+           "\x1b[200~201~x\x1b[201~");
+    // U+00DB encodes as C3 9B; only the codepoint U+009B is a CSI.
+    expect("UTF-8 0x9B byte", pasteBytes(QString(QChar(0xDB)), true), "\x1b[200~\xc3\x9b\x1b[201~");
+
+    const QByteArray nested = pasteBytes(QStringLiteral("x\x1b[20\x1b[201~1~\x1b[201\x1b[201~~y"), true);
+    if (nested.indexOf("\x1b[201~") != nested.size() - 6) {
+        std::fprintf(stderr, "FAIL paste ends before its last byte\n");
+        ++g_failures;
+    }
+
+    if (g_failures == 0)
+        std::printf("paste: all passed\n");
+    return g_failures == 0 ? 0 : 1;
+}